@@ -78,10 +78,7 @@ STATIC_INLINE bool usehacks(void)
 #define SINC_QUEUE_LENGTH 256
 
 #include "sinctable.c"
-
-typedef struct {
-	int time, output;
-} sinc_queue_t;
+#include "sincmix.h"
 
 struct audio_channel_data {
 	unsigned int adk_mask;
@@ -102,9 +99,12 @@ struct audio_channel_data {
 	uae_u16 dat, dat2;
 	int sample_accum, sample_accum_time;
 	int sinc_output_state;
-	sinc_queue_t sinc_queue[SINC_QUEUE_LENGTH];
-    int sinc_queue_time;
-    int sinc_queue_head;
+	/* mirrored: entry n is also stored at n + SINC_QUEUE_LENGTH */
+	int sinc_queue_evtime[SINC_QUEUE_LENGTH * 2];
+	int sinc_queue_output[SINC_QUEUE_LENGTH * 2];
+	int sinc_queue_time;
+	int sinc_queue_head;
+	int sinc_queue_count;
 #if TEST_AUDIO > 0
 	bool hisample, losample;
 	bool have_dat;
@@ -304,7 +304,7 @@ void (*sample_handler) (void);
 static void (*sample_prehandler) (unsigned long best_evtime);
 
 float sample_evtime;
-float scaled_sample_evtime;
+float scaled_sample_evtime, scaled_sample_evtime_orig;
 
 static unsigned long last_cycles;
 static float next_sample_evtime;
@@ -531,9 +531,12 @@ static void sinc_prehandler (unsigned long best_evtime)
 		/* if output state changes, record the state change and also
 		 * write data into sinc queue for mixing in the BLEP */
 		if (acd->sinc_output_state != output) {
-			acd->sinc_queue_head = (acd->sinc_queue_head - 1) & (SINC_QUEUE_LENGTH - 1);
-			acd->sinc_queue[acd->sinc_queue_head].time = acd->sinc_queue_time;
-			acd->sinc_queue[acd->sinc_queue_head].output = output - acd->sinc_output_state;
+			int head = (acd->sinc_queue_head - 1) & (SINC_QUEUE_LENGTH - 1);
+			acd->sinc_queue_head = head;
+			acd->sinc_queue_evtime[head] = acd->sinc_queue_evtime[head + SINC_QUEUE_LENGTH] = acd->sinc_queue_time;
+			acd->sinc_queue_output[head] = acd->sinc_queue_output[head + SINC_QUEUE_LENGTH] = output - acd->sinc_output_state;
+			if (acd->sinc_queue_count < SINC_QUEUE_LENGTH)
+				acd->sinc_queue_count++;
 			acd->sinc_output_state = output;
 		}
 
@@ -558,27 +561,31 @@ STATIC_INLINE void samplexx_sinc_handler (int *datasp)
 	winsinc = winsinc_integral[n];
 
 
-    for (i = 0; i < 4; i += 1) {
-		int j, v;
+	for (i = 0; i < 4; i += 1) {
+		int v, head, count;
 		struct audio_channel_data *acd = &audio_channel[i];
 		/* The sum rings with harmonic components up to infinity... */
 		int sum = acd->sinc_output_state << 17;
-		/* ...but we cancel them through mixing in BLEPs instead */
-		int offsetpos = acd->sinc_queue_head & (SINC_QUEUE_LENGTH - 1);
-		for (j = 0; j < SINC_QUEUE_LENGTH; j += 1) {
-			int age = acd->sinc_queue_time - acd->sinc_queue[offsetpos].time;
-			if (age >= SINC_QUEUE_MAX_AGE || age < 0)
+		/* ...but we cancel them through mixing in BLEPs instead.
+		 * Queue is ordered newest first and sinc_queue_time only grows,
+		 * so expired entries are always at the tail. */
+		head = acd->sinc_queue_head;
+		count = acd->sinc_queue_count;
+		while (count > 0) {
+			int age = acd->sinc_queue_time - acd->sinc_queue_evtime[head + count - 1];
+			if (age < SINC_QUEUE_MAX_AGE && age >= 0)
 				break;
-			sum -= winsinc[age] * acd->sinc_queue[offsetpos].output;
-			offsetpos = (offsetpos + 1) & (SINC_QUEUE_LENGTH - 1);
+			count--;
 		}
+		acd->sinc_queue_count = count;
+		sum = (int)((uae_u32)sum - sinc_mix (winsinc, acd->sinc_queue_evtime + head, acd->sinc_queue_output + head, count, acd->sinc_queue_time));
 		v = sum >> 15;
 		if (v > 32767)
 			v = 32767;
 		else if (v < -32768)
 			v = -32768;
 		datasp[i] = v;
-    }
+	}
 }
 
 static void sample16i_sinc_handler (void)
@@ -1156,7 +1163,8 @@ void update_sound (double clk)
 	if (!have_sound)
 		return;
 
-	scaled_sample_evtime = clk * CYCLE_UNIT * sound_sync_multiplier / (double)obtainedfreq;
+	scaled_sample_evtime_orig = clk * CYCLE_UNIT * sound_sync_multiplier / (double)obtainedfreq;
+	scaled_sample_evtime = scaled_sample_evtime_orig;
 #ifdef SAMPLER
 	sampler_evtime = clk * CYCLE_UNIT * sound_sync_multiplier;
 #endif
@@ -0,0 +1,176 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Headless benchmark mode
+  *
+  * -benchmark=<frames> runs the configuration without display, sound
+  * output or frame rate limiting and quits after <frames> emulated
+  * frames, writing a JSON report to -benchmark_report=<file> (default
+  * stdout). Frames are drawn into a memory buffer through the null
+  * display hooks in drawing.c, Paula is emulated but nothing is mixed.
+  *
+  * Host time is read with read_processor_time (), which counts host
+  * clock cycles on x86 machines (rdtsc) and nanoseconds elsewhere.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "uae.h"
+#include "xwin.h"
+#include "custom.h"
+#include "drawing.h"
+#include "events.h"
+#include "benchmark.h"
+
+int benchmark_frames;
+bool bench_active;
+int bench_subsys;
+frame_time_t bench_mark;
+uae_u64 bench_time[BENCH_MAX];
+
+static TCHAR benchmark_report[MAX_DPATH];
+static const TCHAR *bench_names[BENCH_MAX] = {
+	_T("cpu"), _T("custom"), _T("blitter"), _T("audio"), _T("drawing"), _T("disk")
+};
+
+static int bench_frame;
+static frame_time_t bench_last;
+static uae_u64 bench_total;
+static unsigned long bench_lastcycles;
+static uae_u64 bench_cycles;
+static uae_u8 *bench_bufmem;
+
+bool benchmark_cmdline (const TCHAR *arg)
+{
+	if (!_tcsncmp (arg, _T("-benchmark="), 11)) {
+		benchmark_frames = _tstol (arg + 11);
+		if (benchmark_frames < 0)
+			benchmark_frames = 0;
+		return true;
+	}
+	if (!_tcsncmp (arg, _T("-benchmark_report="), 18)) {
+		_tcsncpy (benchmark_report, arg + 18, MAX_DPATH - 1);
+		return true;
+	}
+	return false;
+}
+
+/* Stand-in for graphics_init (): a 32 bit memory frame buffer */
+int benchmark_graphics_init (void)
+{
+	int w, h;
+
+	fixup_prefs_dimensions (&currprefs);
+	w = currprefs.gfx_size_win.width;
+	h = currprefs.gfx_size_win.height;
+
+	xfree (bench_bufmem);
+	bench_bufmem = xcalloc (uae_u8, w * 4 * (h + 1));
+	if (!bench_bufmem)
+		return 0;
+	gfxvidinfo.width_allocated = w;
+	gfxvidinfo.height_allocated = h;
+	gfxvidinfo.bufmem = bench_bufmem;
+	gfxvidinfo.emergmem = 0;
+	gfxvidinfo.linemem = 0;
+	gfxvidinfo.pixbytes = 4;
+	gfxvidinfo.rowbytes = w * 4;
+	gfxvidinfo.maxblocklines = MAXBLOCKLINES_MAX;
+	gfxbuffer_reset ();
+	reset_drawing ();
+	alloc_colors64k (8, 8, 8, 16, 8, 0, 0, 0, 0, 0);
+	write_log (_T("Benchmark: %d frames, headless %dx%d\n"), benchmark_frames, w, h);
+	return 1;
+}
+
+/* Called once the machine is set up, just before emulation starts */
+void benchmark_start (void)
+{
+	/* emulate Paula, without mixing and output. No sound driver is
+	 * set up, so this is never changed back. */
+	currprefs.produce_sound = changed_prefs.produce_sound = changed_prefs.produce_sound ? 1 : 0;
+	bench_frame = -1;
+}
+
+static void benchmark_report_write (void)
+{
+	double secs = (double)bench_total / syncbase;
+	uae_u64 sum = 0;
+	FILE *f = stdout;
+	int i;
+
+	if (benchmark_report[0]) {
+		f = _tfopen (benchmark_report, _T("w"));
+		if (!f) {
+			write_log (_T("Benchmark: can't write '%s'\n"), benchmark_report);
+			f = stdout;
+		}
+	}
+	for (i = 0; i < BENCH_MAX; i++)
+		sum += bench_time[i];
+	if (secs <= 0)
+		secs = 1e-9;
+	if (!sum)
+		sum = 1;
+
+	fprintf (f, "{\n");
+	fprintf (f, "\t\"frames\": %d,\n", bench_frame);
+	fprintf (f, "\t\"seconds\": %.6f,\n", secs);
+	fprintf (f, "\t\"fps\": %.3f,\n", bench_frame / secs);
+	fprintf (f, "\t\"realtime_fps\": %.3f,\n", (double)vblank_hz);
+	/* CPU clock cycles, two per colour clock */
+	fprintf (f, "\t\"emulated_cycles\": %llu,\n", (unsigned long long)bench_cycles);
+	fprintf (f, "\t\"host_ticks_per_second\": %d,\n", syncbase);
+	fprintf (f, "\t\"host_cycles_per_emulated_cycle\": %.4f,\n",
+		bench_cycles ? (double)bench_total / bench_cycles : 0.0);
+	fprintf (f, "\t\"cpu_model\": %d,\n", currprefs.cpu_model);
+	fprintf (f, "\t\"cycle_exact\": %s,\n", currprefs.cpu_cycle_exact ? "true" : "false");
+	fprintf (f, "\t\"subsystems\": {\n");
+	for (i = 0; i < BENCH_MAX; i++) {
+		fprintf (f, "\t\t\"%s\": { \"seconds\": %.6f, \"percent\": %.2f }%s\n",
+			bench_names[i], (double)bench_time[i] / syncbase,
+			bench_time[i] * 100.0 / sum, i < BENCH_MAX - 1 ? "," : "");
+	}
+	fprintf (f, "\t}\n");
+	fprintf (f, "}\n");
+	if (f != stdout)
+		fclose (f);
+	else
+		fflush (f);
+}
+
+/* Called at every emulated vsync */
+void benchmark_vsync (void)
+{
+	frame_time_t t;
+	unsigned long c;
+
+	if (!benchmark_frames || bench_frame >= benchmark_frames)
+		return;
+	t = read_processor_time ();
+	c = get_cycles ();
+	if (bench_frame < 0) {
+		/* measure from the first vsync on */
+		memset (bench_time, 0, sizeof bench_time);
+		bench_total = 0;
+		bench_cycles = 0;
+		bench_mark = t;
+		bench_active = true;
+	} else {
+		bench_total += (frame_time_t)(t - bench_last);
+		bench_cycles += (c - bench_lastcycles) / CYCLE_UNIT * 2;
+	}
+	bench_last = t;
+	bench_lastcycles = c;
+	bench_frame++;
+	if (bench_frame < benchmark_frames)
+		return;
+
+	/* charge the running subsystem up to now */
+	bench_enter (bench_subsys);
+	bench_active = false;
+	benchmark_report_write ();
+	uae_quit ();
+}
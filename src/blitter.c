@@ -23,6 +23,7 @@
 #include "blit.h"
 #include "savestate.h"
 #include "debug.h"
+#include "benchmark.h"
 
 // 1 = logging
 // 2 = no wait detection
@@ -446,6 +447,69 @@ STATIC_INLINE void chipmem_agnus_wput2 (uaecptr addr, uae_u32 w)
 #endif
 }
 
+#if SPEEDUP
+/* bytes [lo, hi) a channel reads or writes during the whole blit */
+static void blit_channel_range (uaecptr pt, int mod, int desc, uae_s64 *lo, uae_s64 *hi)
+{
+	uae_s64 w = blt_info.hblitsize * 2;
+	uae_s64 first = pt, last = (uae_s64)(blt_info.vblitsize - 1) * (w + mod);
+
+	if (desc) {
+		first = (uae_s64)pt + 2 - w;
+		last = -last;
+	}
+	*lo = first + (last < 0 ? last : 0);
+	*hi = first + (last > 0 ? last : 0) + w;
+}
+
+/* The wide functions read four words ahead and write D without the one
+ * word delay, which gives the same result as long as no source reads a
+ * word D has written earlier in the blit. Sources overlapping D are only
+ * accepted with the same non-negative modulo and not trailing D. */
+static int blitter_dofast_wide (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, int desc)
+{
+	uae_u8 mt = bltcon0 & 0xFF;
+	blitter_wide_func *func = desc ? blitfunc_dofast_wide_desc[mt] : blitfunc_dofast_wide[mt];
+	uaecptr pt[4] = { pta, ptb, ptc, ptd };
+	int mod[4] = { blt_info.bltamod, blt_info.bltbmod, blt_info.bltcmod, blt_info.bltdmod };
+	uae_s64 lo[4], hi[4];
+	uae_u8 *p[4];
+	int fill = 0;
+	int i;
+
+	if (!func)
+		return 0;
+#ifdef DEBUGGER
+	if (memwatch_enabled)
+		return 0;
+#endif
+	for (i = 0; i < 4; i++) {
+		p[i] = NULL;
+		if (!pt[i])
+			continue;
+		blit_channel_range (pt[i], mod[i], desc, &lo[i], &hi[i]);
+		if (lo[i] < 0 || hi[i] > 0x7fffffff || !chipmem_xlate_dma ((uaecptr)lo[i], (uae_u32)(hi[i] - lo[i])))
+			return 0;
+		p[i] = chipmem_bank.baseaddr + pt[i];
+	}
+	if (ptd) {
+		for (i = 0; i < 3; i++) {
+			if (!pt[i] || hi[i] <= lo[3] || lo[i] >= hi[3])
+				continue;
+			if (mod[i] != mod[3] || mod[3] < 0 || (desc ? pt[i] > ptd : pt[i] < ptd))
+				return 0;
+		}
+	}
+	if (blitfill) {
+		fill = blitife ? BLITFILL_INCLUSIVE : BLITFILL_EXCLUSIVE;
+		if (bltcon1 & 0x4)
+			fill |= BLITFILL_CARRYIN;
+	}
+	func (p[0], p[1], p[2], p[3], &blt_info, fill);
+	return 1;
+}
+#endif
+
 static void blitter_dofast (void)
 {
 	int i,j;
@@ -473,7 +537,9 @@ static void blitter_dofast (void)
 	}
 
 #if SPEEDUP
-	if (blitfunc_dofast[mt] && !blitfill) {
+	if (blitter_dofast_wide (bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, 0))
+		;
+	else if (blitfunc_dofast[mt] && !blitfill) {
 		(*blitfunc_dofast[mt])(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, &blt_info);
 	} else
 #endif
@@ -572,7 +638,9 @@ static void blitter_dofast_desc (void)
 		bltdpt -= (blt_info.hblitsize * 2 + blt_info.bltdmod) * blt_info.vblitsize;
 	}
 #if SPEEDUP
-	if (blitfunc_dofast_desc[mt] && !blitfill) {
+	if (blitter_dofast_wide (bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, 1))
+		;
+	else if (blitfunc_dofast_desc[mt] && !blitfill) {
 		(*blitfunc_dofast_desc[mt])(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, &blt_info);
 	} else
 #endif
@@ -857,6 +925,8 @@ static void decide_blitter_line (int hsync, int hpos)
 
 static void actually_do_blit (void)
 {
+	int bs = bench_enter (BENCH_BLITTER);
+
 	if (blitline) {
 		do {
 			blitter_read ();
@@ -881,6 +951,7 @@ static void actually_do_blit (void)
 			blitter_dofast ();
 		bltstate = BLT_done;
 	}
+	bench_leave (bs);
 }
 
 static void blitter_doit (void)
@@ -35,6 +35,7 @@
 #include "threaddep/thread.h"
 #include "native2amiga.h"
 #include "bsdsocket.h"
+#include "writewatch.h"
 
 #ifdef BSDSOCKET
 #include <unistd.h>
@@ -747,22 +748,24 @@ uae_u32 bsdthr_Recv_2 (SB)
 {
     int foo;
     int i;
+    uae_u8 *buf = writewatch_io_begin ((uae_u8*)sb->buf, sb->len);
 
     if (sb->from == 0) {
-		foo = recv (sb->s, sb->buf, sb->len, sb->flags /*| MSG_NOSIGNAL*/);
+		foo = recv (sb->s, buf, sb->len, sb->flags /*| MSG_NOSIGNAL*/);
 		DEBUG_LOG ("recv2, recv returns %d, errno is %d\n", foo, errno);
     } else {
 		struct sockaddr_in addr;
 		socklen_t l = sizeof (struct sockaddr_in);
 		i = get_long (sb->fromlen);
 		copysockaddr_a2n (&addr, sb->from, i);
-		foo = recvfrom (sb->s, sb->buf, sb->len, sb->flags | MSG_NOSIGNAL, (struct sockaddr *)&addr, &l);
+		foo = recvfrom (sb->s, buf, sb->len, sb->flags | MSG_NOSIGNAL, (struct sockaddr *)&addr, &l);
 		DEBUG_LOG ("recv2, recvfrom returns %d, errno is %d\n", foo, errno);
 		if (foo >= 0) {
 		    copysockaddr_n2a (sb->from, &addr, l);
 		    put_long (sb->fromlen, l);
 		}
     }
+    writewatch_io_end ((uae_u8*)sb->buf, buf, foo > 0 ? foo : 0);
     return foo;
 }
 
@@ -1670,6 +1673,7 @@ void host_closesocketquick (int s)
 
 uae_u32 host_gethostname (uae_u32 name, uae_u32 namelen)
 {
+    writewatch_touch (get_real_address (name), namelen);
     return gethostname ((char *)get_real_address (name), namelen);
 }
 
@@ -1067,6 +1067,7 @@ void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type)
 	cfgfile_write_bool (f, _T("comp_nf"), p->compnf);
 	cfgfile_write_bool (f, _T("comp_constjump"), p->comp_constjump);
 	cfgfile_write_bool (f, _T("comp_oldsegv"), p->comp_oldsegv);
+	cfgfile_write_bool (f, _T("comp_superblocks"), p->comp_superblocks);
 
 	cfgfile_write_str (f, _T("comp_flushmode"), flushmode[p->comp_hardflush]);
 	cfgfile_write_bool (f, _T("compfpu"), p->compfpu);
@@ -1213,6 +1214,7 @@ void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type)
 	cfgfile_write_str (f, _T("gfx_colour_mode"), colormode1[p->color_mode]);
 	cfgfile_write_bool (f, _T("gfx_blacker_than_black"), p->gfx_blackerthanblack);
 	cfgfile_dwrite_bool (f, _T("gfx_black_frame_insertion"), p->lightboost_strobo);
+	cfgfile_dwrite_bool (f, _T("gfx_render_thread"), p->gfx_render_thread);
 	cfgfile_write_str (f, _T("gfx_api"), filterapi[p->gfx_api]);
 	cfgfile_dwrite (f, _T("gfx_horizontal_tweak"), _T("%d"), p->gfx_extrawidth);
 
@@ -1497,6 +1499,8 @@ void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type)
 
 	cfgfile_dwrite (f, _T("state_replay_rate"), _T("%d"), p->statecapturerate);
 	cfgfile_dwrite (f, _T("state_replay_buffers"), _T("%d"), p->statecapturebuffersize);
+	cfgfile_dwrite_bool (f, _T("state_replay_delta"), p->statecapturedelta);
+	cfgfile_dwrite (f, _T("state_replay_budget"), _T("%d"), p->statecapturebudget);
 	cfgfile_dwrite_bool (f, _T("state_replay_autoplay"), p->inprec_autoplay);
 	cfgfile_dwrite_bool (f, _T("warp"), p->turbo_emulation);
 
@@ -1994,6 +1998,8 @@ static int cfgfile_parse_host (struct uae_prefs *p, TCHAR *option, TCHAR *value)
 		|| cfgfile_intval (option, value, _T("sound_max_buff"), &p->sound_maxbsiz, 1)
 		|| cfgfile_intval (option, value, _T("state_replay_rate"), &p->statecapturerate, 1)
 		|| cfgfile_intval (option, value, _T("state_replay_buffers"), &p->statecapturebuffersize, 1)
+		|| cfgfile_yesno (option, value, _T("state_replay_delta"), &p->statecapturedelta)
+		|| cfgfile_intval (option, value, _T("state_replay_budget"), &p->statecapturebudget, 1)
 		|| cfgfile_yesno (option, value, _T("state_replay_autoplay"), &p->inprec_autoplay)
 		|| cfgfile_intval (option, value, _T("sound_frequency"), &p->sound_freq, 1)
 		|| cfgfile_intval (option, value, _T("sound_volume"), &p->sound_volume, 1)
@@ -2061,6 +2067,7 @@ static int cfgfile_parse_host (struct uae_prefs *p, TCHAR *option, TCHAR *value)
 		|| cfgfile_yesno (option, value, _T("filesys_no_fsdb"), &p->filesys_no_uaefsdb)
 		|| cfgfile_yesno (option, value, _T("gfx_blacker_than_black"), &p->gfx_blackerthanblack)
 		|| cfgfile_yesno (option, value, _T("gfx_black_frame_insertion"), &p->lightboost_strobo)
+		|| cfgfile_yesno (option, value, _T("gfx_render_thread"), &p->gfx_render_thread)
 		|| cfgfile_yesno (option, value, _T("gfx_flickerfixer"), &p->gfx_scandoubler)
 		|| cfgfile_yesno (option, value, _T("gfx_autoresolution_vga"), &p->gfx_autoresolution_vga)
 		|| cfgfile_yesno (option, value, _T("magic_mouse"), &p->input_magic_mouse)
@@ -3544,6 +3551,7 @@ static int cfgfile_parse_hardware (struct uae_prefs *p, const TCHAR *option, TCH
 		|| cfgfile_yesno (option, value, _T("comp_nf"), &p->compnf)
 		|| cfgfile_yesno (option, value, _T("comp_constjump"), &p->comp_constjump)
 		|| cfgfile_yesno (option, value, _T("comp_oldsegv"), &p->comp_oldsegv)
+		|| cfgfile_yesno (option, value, _T("comp_superblocks"), &p->comp_superblocks)
 		|| cfgfile_yesno (option, value, _T("compforcesettings"), &dummybool)
 		|| cfgfile_yesno (option, value, _T("compfpu"), &p->compfpu)
 		|| cfgfile_yesno (option, value, _T("fpu_strict"), &p->fpu_strict)
@@ -5229,6 +5237,7 @@ void default_prefs (struct uae_prefs *p, int type)
 	p->comp_hardflush = 0;
 	p->comp_constjump = 1;
 	p->comp_oldsegv = 0;
+	p->comp_superblocks = 0;
 	p->compfpu = 1;
 	p->fpu_strict = 0;
 	p->cachesize = 0;
@@ -5272,6 +5281,7 @@ void default_prefs (struct uae_prefs *p, int type)
 	p->gfx_autoresolution_minh = 0;
 	p->color_mode = 2;
 	p->gfx_blackerthanblack = 0;
+	p->gfx_render_thread = 0;
 	p->gfx_autoresolution_vga = true;
 	p->gfx_apmode[0].gfx_backbuffers = 2;
 	p->gfx_apmode[1].gfx_backbuffers = 1;
@@ -5435,6 +5445,8 @@ void default_prefs (struct uae_prefs *p, int type)
 
 	p->statecapturebuffersize = 100;
 	p->statecapturerate = 5 * 50;
+	p->statecapturedelta = false;
+	p->statecapturebudget = 64;
 	p->inprec_autoplay = true;
 
 #ifdef UAE_MINI
@@ -1777,6 +1777,9 @@ static void vec(int x, siginfo_t *info, ucontext_t *uap)
 	_STRUCT_X86_THREAD_STATE32 sc = uap->uc_mcontext->CONTEXT_MEMBER(ss);
 	uae_u32 addr = 0;
 	uae_u8* i=(uae_u8*)sc.CONTEXT_MEMBER(eip);
+
+	if (writewatch_fault (info->si_addr))
+		return;
 	if (i >= compiled_code) {
 		unsigned int j;
 		write_log ("JIT_APPLE: can't handle access!\n");
@@ -1808,6 +1811,10 @@ static void vec(int sig, siginfo_t* info, void* _ct)
 	uae_u8* src_addr = (uae_u8*)ctx->uc_mcontext.gregs[REG_EIP];
 	uaecptr tgt_addr = (uaecptr)info->si_addr;
 
+	/* a write to a page watched by writewatch, see flush_icache () */
+	if (writewatch_fault (info->si_addr))
+		return;
+
 	// Write some general information first
 	write_log(_T("[JIT] Got signal %d (signo %d, errno %d, code %d\n"),
 			sig, info->si_signo, info->si_errno, info->si_code);
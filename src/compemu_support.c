@@ -17,6 +17,7 @@
 #include "compemu.h"
 #include "uae_endian.h"
 #include "misc.h"
+#include "writewatch.h"
 
 #define NATMEM_OFFSETX (uae_u32)NATMEM_OFFSET
 
@@ -45,6 +46,12 @@ int soft_flush_count=0;
 int hard_flush_count=0;
 int compile_count=0;
 int checksum_count=0;
+int range_flush_count=0;
+int kept_count=0;
+int superblock_count=0;
+int flag_invalidate_count=0;
+static int tracing; /* Recording a superblock, see trace_through () */
+static int trace_exits;
 static uae_u8* current_compile_p=NULL;
 static uae_u8* max_compile_start;
 uae_u8* compiled_code=NULL;
@@ -267,8 +274,12 @@ STATIC_INLINE void remove_dep(dependency* d)
    depends on anything else */
 STATIC_INLINE void remove_deps(blockinfo* bi)
 {
+	int i;
+
 	remove_dep(&(bi->dep[0]));
 	remove_dep(&(bi->dep[1]));
+	for (i=0;i<SUPERBLOCK_EXITS+2;i++)
+		remove_dep(&(bi->fdep[i]));
 }
 
 STATIC_INLINE void adjust_jmpdep(dependency* d, cpuop_func* a)
@@ -300,12 +311,15 @@ STATIC_INLINE void set_dhtu(blockinfo* bi, cpuop_func* dh)
 	}
 }
 
+static void invalidate_flag_users(blockinfo* bi);
+
 STATIC_INLINE void invalidate_block(blockinfo* bi)
 {
 	int i;
 
 	bi->optlevel=0;
 	bi->count=currprefs.optcount[0]-1;
+	bi->hot=0;
 	bi->handler=NULL;
 	bi->handler_to_use=(cpuop_func*)popall_execute_normal;
 	bi->direct_handler=NULL;
@@ -317,6 +331,8 @@ STATIC_INLINE void invalidate_block(blockinfo* bi)
 		bi->dep[i].target=NULL;
 	}
 	remove_deps(bi);
+	/* The code may change, so may the flags it needs */
+	invalidate_flag_users(bi);
 }
 
 STATIC_INLINE void create_jmpdep(blockinfo* bi, int i, uae_u32* jmpaddr, uae_u32 target)
@@ -335,6 +351,72 @@ STATIC_INLINE void create_jmpdep(blockinfo* bi, int i, uae_u32* jmpaddr, uae_u32
 	tbi->deplist=&(bi->dep[i]);
 }
 
+/* <bi> was compiled assuming that the block at <target> only needs
+   target->needed_flags */
+STATIC_INLINE void create_flagdep(blockinfo* bi, int i, uae_u32 target)
+{
+	blockinfo* tbi = get_blockinfo_addr((void*)target);
+
+	Dif(!tbi) {
+		jit_abort (_T("JIT: Could not create flagdep!\n"));
+	}
+	bi->fdep[i].jmp_off=NULL;
+	bi->fdep[i].target=tbi;
+	bi->fdep[i].source=bi;
+	bi->fdep[i].next=tbi->deplist;
+	if (bi->fdep[i].next)
+		bi->fdep[i].next->prev_p=&(bi->fdep[i].next);
+	bi->fdep[i].prev_p=&(tbi->deplist);
+	tbi->deplist=&(bi->fdep[i]);
+}
+
+/* The blocks that rely on the flags <bi> needs have to be compiled again
+   when those change. Invalidating one removes its dependencies from our
+   list, so start over each time. */
+static void invalidate_flag_users(blockinfo* bi)
+{
+	dependency* d=bi->deplist;
+
+	while (d) {
+		blockinfo* p=d->source;
+		if (p && p->handler) {
+			flag_invalidate_count++;
+			invalidate_block(p);
+			raise_in_cl_list(p);
+			d=bi->deplist;
+			continue;
+		}
+		d=d->next;
+	}
+}
+
+static void calc_checksum(blockinfo* bi, uae_u32* c1, uae_u32* c2);
+
+/* A dormant block is only checked when it runs, but the successors whose
+   flags it relies on may have changed as well. Nonzero if one did. */
+static int flag_targets_changed(blockinfo* bi)
+{
+	int i;
+
+	for (i=0;i<SUPERBLOCK_EXITS+2;i++) {
+		blockinfo* tbi=bi->fdep[i].target;
+		uae_u32 c1,c2;
+
+		if (!bi->fdep[i].prev_p || !tbi)
+			continue;
+		if (!tbi->handler)
+			return 1;
+		if (tbi->handler_to_use==tbi->handler)
+			continue; /* active, so unchanged */
+		if (!tbi->c1 && !tbi->c2)
+			return 1;
+		calc_checksum(tbi,&c1,&c2);
+		if (c1!=tbi->c1 || c2!=tbi->c2)
+			return 1;
+	}
+	return 0;
+}
+
 STATIC_INLINE void big_to_small_state(bigstate* b, smallstate* s)
 {
 	int i;
@@ -441,6 +523,7 @@ bool check_prefs_changed_comp (void)
 		currprefs.comp_hardflush != changed_prefs.comp_hardflush ||
 		currprefs.comp_constjump != changed_prefs.comp_constjump ||
 		currprefs.comp_oldsegv != changed_prefs.comp_oldsegv ||
+		currprefs.comp_superblocks != changed_prefs.comp_superblocks ||
 		currprefs.compfpu != changed_prefs.compfpu ||
 		currprefs.fpu_strict != changed_prefs.fpu_strict)
 		changed = 1;
@@ -453,6 +536,7 @@ bool check_prefs_changed_comp (void)
 	currprefs.comp_hardflush = changed_prefs.comp_hardflush;
 	currprefs.comp_constjump = changed_prefs.comp_constjump;
 	currprefs.comp_oldsegv = changed_prefs.comp_oldsegv;
+	currprefs.comp_superblocks = changed_prefs.comp_superblocks;
 	currprefs.compfpu = changed_prefs.compfpu;
 	currprefs.fpu_strict = changed_prefs.fpu_strict;
 
@@ -471,8 +555,10 @@ bool check_prefs_changed_comp (void)
 		alloc_cache();
 		changed = 1;
 	}
-	if (!candirect)
+	if (!candirect) {
 		canbang = 0;
+		natmem_direct_update ();
+	}
 
 	// Turn off illegal-mem logging when using JIT...
 	if(currprefs.cachesize)
@@ -5372,6 +5458,7 @@ void alloc_cache(void)
 			veccode = cache_alloc (256);
 		if (!veccode) {
 			canbang = 0;
+			natmem_direct_update ();
 			sigaction (SIGSEGV, saved_handler, 0);
 		} else
 			write_log ("JIT: Enabled direct memory access.\n");
@@ -5475,7 +5562,10 @@ static void recompile_block(void)
 	Dif (!bi)
 		jit_abort (_T("recompile_block"));
 	raise_in_cl_list(bi);
+	tracing=bi->hot==1 && currprefs.comp_superblocks;
+	trace_exits=0;
 	execute_normal();
+	tracing=0;
 	return;
 }
 
@@ -5524,7 +5614,7 @@ static void check_checksum(void)
 	else {
 		c1=c2=1;  /* Make sure it doesn't match */
 	}
-	if (c1==bi->c1 && c2==bi->c2) {
+	if (c1==bi->c1 && c2==bi->c2 && !flag_targets_changed(bi)) {
 		/* This block is still OK. So we reactivate. Of course, that
 		means we have to move it into the needs-to-be-flushed list */
 		bi->handler_to_use=bi->handler;
@@ -5670,7 +5760,14 @@ static void prepare_block(blockinfo* bi)
 	for (i=0;i<2;i++) {
 		bi->dep[i].prev_p=NULL;
 		bi->dep[i].next=NULL;
+		bi->dep[i].source=NULL;
 	}
+	for (i=0;i<SUPERBLOCK_EXITS+2;i++) {
+		bi->fdep[i].prev_p=NULL;
+		bi->fdep[i].next=NULL;
+		bi->fdep[i].target=NULL;
+	}
+	bi->hot=0;
 	bi->env=default_ss;
 	bi->status=BI_NEW;
 	bi->havestate=0;
@@ -5854,10 +5951,211 @@ static void flush_icache_hard(uae_u32 ptr, int n)
 }
 
 
+/********************************************************************
+ * Write tracking of code pages                                     *
+ ********************************************************************/
+
+/* Most soft flushes come from CACR writes and CINVA/CPUSHA, which say
+   nothing about what was changed. The plain RAM banks are watched with
+   writewatch so that those only have to checksum the blocks whose pages
+   were written since the previous flush. A block stays active if all of
+   its pages are armed and clean: it was compiled or checksummed after
+   they were armed, or it was left active the same way back then. Pages
+   are armed when a block on them was sent to be checksummed, only after
+   all blocks have been looked at. Every host mapping of the RAM is
+   watched, compiled code writes through the natmem area and the rest of
+   the emulator through baseaddr. */
+
+#define MAX_CODEWATCH 8
+#define MAX_CODEWATCH_VIEWS 8
+
+struct codewatch {
+	addrbank* bank;
+	uae_u32 base;	/* host address of the view blocks are compiled from */
+	uae_u32 size;
+	int views;
+	int handle[MAX_CODEWATCH_VIEWS];
+};
+
+static struct codewatch codewatch[MAX_CODEWATCH];
+static int codewatch_count;
+static bool codewatch_ok;
+static uae_u32 codewatch_generation;
+
+static void codewatch_free(void)
+{
+	int i,j;
+
+	for (i=0;i<codewatch_count;i++) {
+		for (j=0;j<codewatch[i].views;j++)
+			writewatch_remove(codewatch[i].handle[j]);
+	}
+	codewatch_count=0;
+	codewatch_ok=false;
+}
+
+/* Watch every plain RAM bank, all pages start out dirty */
+static void codewatch_init(void)
+{
+	uae_u8* views[MAX_CODEWATCH_VIEWS];
+	int i,j;
+
+	codewatch_free();
+	codewatch_ok=true;
+	codewatch_generation=mem_banks_generation;
+	for (i=0;i<MEMORY_BANKS && codewatch_count<MAX_CODEWATCH;i++) {
+		addrbank* ab=mem_banks[i];
+		struct codewatch* cw=&codewatch[codewatch_count];
+
+		for (j=0;j<codewatch_count;j++) {
+			if (codewatch[j].bank==ab)
+				break;
+		}
+		if (j<codewatch_count)
+			continue;
+		cw->views=get_ram_views(ab,views,MAX_CODEWATCH_VIEWS);
+		if (cw->views<=0)
+			continue;
+		cw->bank=ab;
+		cw->base=(uae_u32)ab->baseaddr;
+		cw->size=ab->allocated;
+		for (j=0;j<cw->views;j++) {
+			cw->handle[j]=writewatch_add_dirty(views[j],cw->size);
+			if (cw->handle[j]<0)
+				break;
+		}
+		if (j<cw->views) {
+			while (j-->0)
+				writewatch_remove(cw->handle[j]);
+			continue;
+		}
+		codewatch_count++;
+	}
+}
+
+/* The watched bank holding all of <bi>, NULL if there is none */
+static struct codewatch* codewatch_find(blockinfo* bi, uae_u32* offset)
+{
+	int i;
+
+	for (i=0;i<codewatch_count;i++) {
+		struct codewatch* cw=&codewatch[i];
+		if (bi->min_pcp>=cw->base && bi->min_pcp+bi->len<=cw->base+cw->size) {
+			*offset=bi->min_pcp-cw->base;
+			return cw;
+		}
+	}
+	return NULL;
+}
+
+static bool codewatch_clean(struct codewatch* cw, uae_u32 offset, uae_u32 len)
+{
+	uae_u32 ps=writewatch_pagesize();
+	uae_u32 end=offset+(len?len:1);
+	int j;
+
+	while (offset<end) {
+		for (j=0;j<cw->views;j++) {
+			if (writewatch_isdirty(cw->handle[j],offset))
+				return false;
+		}
+		offset=((cw->base+offset)|(ps-1))+1-cw->base;
+	}
+	return true;
+}
+
+static void codewatch_arm(struct codewatch* cw, uae_u32 offset, uae_u32 len)
+{
+	int j;
+
+	for (j=0;j<cw->views;j++)
+		writewatch_arm(cw->handle[j],offset,len?len:1);
+}
+
+/********************************************************************
+ * Soft flushing                                                    *
+ ********************************************************************/
+
 /* "Soft flushing" --- instead of actually throwing everything away,
 we simply mark everything as "needs to be checked".
 */
 
+STATIC_INLINE void flush_block(blockinfo* bi)
+{
+	uae_u32 cl=cacheline(bi->pc_p);
+
+	if (!bi->handler) {
+		/* invalidated block */
+		if (bi==cache_tags[cl+1].bi)
+			cache_tags[cl].handler=(cpuop_func*)popall_execute_normal;
+		bi->handler_to_use=(cpuop_func*)popall_execute_normal;
+		set_dhtu(bi,bi->direct_pen);
+	} else {
+		if (bi==cache_tags[cl+1].bi)
+			cache_tags[cl].handler=(cpuop_func*)popall_check_checksum;
+		bi->handler_to_use=(cpuop_func*)popall_check_checksum;
+		set_dhtu(bi,bi->direct_pcc);
+	}
+}
+
+/* Flush the active blocks overlapping host memory start..start+size */
+static void flush_icache_range(uae_u32 start, uae_u32 size)
+{
+	blockinfo* bi=active;
+	blockinfo* next;
+
+	range_flush_count++;
+	while (bi) {
+		next=bi->next;
+		if (bi->min_pcp<start+size && bi->min_pcp+bi->len>start) {
+			flush_block(bi);
+			remove_from_list(bi);
+			add_to_dormant(bi);
+		}
+		bi=next;
+	}
+}
+
+/* Flush the active blocks on pages written since the last flush. Returns
+   false if nothing is watched. */
+static bool flush_icache_written(void)
+{
+	blockinfo* bi;
+	blockinfo* next;
+	struct codewatch* cw;
+	uae_u32 offset;
+	int flushed=0;
+
+	if (!codewatch_ok || codewatch_generation!=mem_banks_generation)
+		codewatch_init();
+	if (!codewatch_count)
+		return false;
+
+	bi=active;
+	while (bi) {
+		next=bi->next;
+		cw=codewatch_find(bi,&offset);
+		if (cw && codewatch_clean(cw,offset,bi->len)) {
+			kept_count++;
+		} else {
+			flush_block(bi);
+			remove_from_list(bi);
+			add_to_dormant(bi);
+			flushed++;
+		}
+		bi=next;
+	}
+	/* The flushed blocks are now at the head of the dormant list. Had
+	   their pages been armed right away, later blocks on the same pages
+	   would have been taken for clean. */
+	for (bi=dormant;flushed>0;bi=bi->next,flushed--) {
+		cw=codewatch_find(bi,&offset);
+		if (cw)
+			codewatch_arm(cw,offset,bi->len);
+	}
+	return true;
+}
+
 void flush_icache(uaecptr ptr, int n)
 {
 	blockinfo* bi;
@@ -5871,21 +6169,21 @@ void flush_icache(uaecptr ptr, int n)
 	if (!active)
 		return;
 
+	/* CINVL/CPUSHL and CINVP/CPUSHP only cover a line or a page */
+	if (n==1 || n==2) {
+		uae_u32 size=n==1?16:4096;
+		uae_u8* start=get_ram_address(ptr&~(size-1),size);
+		if (start) {
+			flush_icache_range((uae_u32)start,size);
+			return;
+		}
+	} else if (flush_icache_written()) {
+		return;
+	}
+
 	bi=active;
 	while (bi) {
-		uae_u32 cl=cacheline(bi->pc_p);
-		if (!bi->handler) {
-			/* invalidated block */
-			if (bi==cache_tags[cl+1].bi)
-				cache_tags[cl].handler=(cpuop_func*)popall_execute_normal;
-			bi->handler_to_use=(cpuop_func*)popall_execute_normal;
-			set_dhtu(bi,bi->direct_pen);
-		} else {
-			if (bi==cache_tags[cl+1].bi)
-				cache_tags[cl].handler=(cpuop_func*)popall_check_checksum;
-			bi->handler_to_use=(cpuop_func*)popall_check_checksum;
-			set_dhtu(bi,bi->direct_pcc);
-		}
+		flush_block(bi);
 		bi2=bi;
 		bi=bi->next;
 	}
@@ -5900,6 +6198,31 @@ void flush_icache(uaecptr ptr, int n)
 }
 
 
+/* Flush and compile counters, the rates cover the time since the last
+   call. */
+void compemu_stats(void)
+{
+	static frame_time_t last_time;
+	static int last_compile, last_checksum, last_soft;
+	frame_time_t now=read_processor_time();
+	double t=last_time && syncbase>0?(double)(now-last_time)/syncbase:0;
+
+	console_out_f(_T("JIT: %d soft flushes (%d by range, %d blocks left active), %d hard flushes\n"),
+		soft_flush_count,range_flush_count,kept_count,hard_flush_count);
+	console_out_f(_T("JIT: %d blocks compiled, %d checksummed, %d KB of %d KB cache used\n"),
+		compile_count,checksum_count,get_jitted_size()/1024,currprefs.cachesize);
+	console_out_f(_T("JIT: %d hot blocks recompiled as superblocks, %d invalidated for the flags they left out\n"),
+		superblock_count,flag_invalidate_count);
+	if (t>0) {
+		console_out_f(_T("JIT: %.1f s: %.1f blocks recompiled/s, %.1f checksummed/s, %.1f soft flushes/s\n"),
+			t,(compile_count-last_compile)/t,(checksum_count-last_checksum)/t,(soft_flush_count-last_soft)/t);
+	}
+	last_time=now;
+	last_compile=compile_count;
+	last_checksum=checksum_count;
+	last_soft=soft_flush_count;
+}
+
 static void catastrophe(void)
 {
 	jit_abort (_T("catastprophe"));
@@ -5908,6 +6231,234 @@ static void catastrophe(void)
 int failure;
 
 
+/* Superblocks (comp_superblocks): a block ending in a conditional branch
+   that has run HOT_RECOMPILE_COUNT times at the final optimization level
+   is recorded once more, this time going on through up to
+   SUPERBLOCK_EXITS forward conditional branches the way they went. Each
+   of them becomes a side exit. Along the recorded path the registers
+   stay allocated and the flags only have to be computed where they are
+   used. */
+
+/* Bcc other than BRA and BSR, and DBRA */
+STATIC_INLINE int is_trace_branch(uae_u16 op)
+{
+	return ((op&0xf000)==0x6000 && (op&0x0f00)>=0x0200) ||
+		(op&0xfff8)==0x51c8;
+}
+
+/* Called by execute_normal () for the block ending <opcode> at <pcp>.
+   Nonzero to go on recording at <next> */
+int trace_through(uae_u16 opcode, uae_u16* pcp, uae_u8* next)
+{
+	if (!tracing || trace_exits>=SUPERBLOCK_EXITS || !is_trace_branch(opcode))
+		return 0;
+	if (next<=(uae_u8*)pcp)
+		return 0; /* Loops are left to the jumps between blocks */
+	trace_exits++;
+	return 1;
+}
+
+/* Where the 68k branch at <pcp> can go, as host addresses. Returns the
+   number of targets, 0 if they are not known. */
+static int block_successors(uae_u16* pcp, uae_u32* succ)
+{
+	uae_u16 op=do_get_mem_word(pcp);
+	uae_u32 pc=(uae_u32)pcp+2;
+	uae_s32 disp;
+
+	if ((op&0xf000)==0x6000 && (op&0x0f00)!=0x0100) {
+		/* Bcc and BRA */
+		disp=(uae_s8)op;
+		if (disp==0) {
+			disp=(uae_s16)do_get_mem_word(pcp+1);
+			succ[0]=pc+2;
+		}
+		else if (disp==-1) {
+			disp=(uae_s32)do_get_mem_long((uae_u32*)(pcp+1));
+			succ[0]=pc+4;
+		}
+		else
+			succ[0]=pc;
+		succ[1]=pc+disp;
+		if ((op&0x0f00)==0) {
+			succ[0]=succ[1];
+			return 1;
+		}
+		return 2;
+	}
+	if ((op&0xf0f8)==0x50c8) {
+		/* DBcc */
+		succ[0]=pc+2;
+		succ[1]=pc+(uae_s16)do_get_mem_word(pcp+1);
+		return 2;
+	}
+	return 0;
+}
+
+/* The flags the <n> successors in <succ> read before setting them, all
+   of them unless those are compiled. Sets *self if one of them is the
+   start of <bi> itself. */
+static uae_u8 successor_flags(blockinfo* bi, uae_u32* succ, int n, uae_u8* self)
+{
+	uae_u8 flags=0;
+	int i;
+
+	if (!n)
+		return 0x1f;
+	for (i=0;i<n;i++) {
+		blockinfo* tbi;
+		if (succ[i]==(uae_u32)bi->pc_p) {
+			*self=1;
+			continue;
+		}
+		tbi=get_blockinfo_addr((void*)succ[i]);
+		if (!tbi || !tbi->handler || tbi->needed_flags==0xff)
+			return 0x1f;
+		flags|=tbi->needed_flags;
+	}
+	return flags;
+}
+
+/* The flags that are live after each of the <blocklen> instructions of
+   <bi>. Where the block is left through a branch to compiled blocks only
+   those they read are, and flag dependencies on them are created; a
+   branch back to its own start needs what the block needs. Everywhere
+   else all flags are live. An interrupt taken on the way pushes a CCR
+   that may be stale in the flags nobody reads, as it always could at the
+   spcflags checks inside a block. */
+static void compute_liveflags(blockinfo* bi, cpu_history* pc_hist, int blocklen, uae_u8* liveflags)
+{
+	uae_u8 exitflags[MAXRUN+1];
+	uae_u8 self[MAXRUN+1];
+	uae_u32 deps[SUPERBLOCK_EXITS+2];
+	int ndeps=0;
+	uae_u8 start=0;
+	int i,j;
+
+	for (i=0;i<blocklen;i++) {
+		int op=cft_map(*pc_hist[i].location);
+		uae_u32 succ[2];
+		int n;
+
+		exitflags[i+1]=0;
+		self[i+1]=0;
+		if (i<blocklen-1 && !prop[op].is_jump)
+			continue;
+		if (!currprefs.compnf || optlev<=1) {
+			exitflags[i+1]=0x1f;
+			continue;
+		}
+		n=block_successors(pc_hist[i].location,succ);
+		if (i<blocklen-1) {
+			/* Side exit, the way the superblock does not go on */
+			if (n==2 && succ[1]==(uae_u32)pc_hist[i+1].location)
+				n=1;
+			else if (n==2 && succ[0]==(uae_u32)pc_hist[i+1].location) {
+				succ[0]=succ[1];
+				n=1;
+			}
+			else
+				n=0;
+		}
+		exitflags[i+1]=successor_flags(bi,succ,n,&self[i+1]);
+		if (exitflags[i+1]==0x1f)
+			continue;
+		if (ndeps+n>SUPERBLOCK_EXITS+2) {
+			exitflags[i+1]=0x1f; /* No room to note what we rely on */
+			continue;
+		}
+		for (j=0;j<n;j++) {
+			if (succ[j]!=(uae_u32)bi->pc_p)
+				deps[ndeps++]=succ[j];
+		}
+	}
+
+	/* A loop needs what its own start needs, go round until that is
+	   known */
+	for (;;) {
+		liveflags[blocklen]=exitflags[blocklen]|(self[blocklen]?start:0);
+		i=blocklen;
+		while (i--) {
+			int op=cft_map(*pc_hist[i].location);
+
+			if (currprefs.compnf) {
+				if (i<blocklen-1)
+					liveflags[i+1]|=exitflags[i+1]|(self[i+1]?start:0);
+				liveflags[i]=((liveflags[i+1]&
+					(~prop[op].set_flags))|
+					prop[op].use_flags);
+				if (prop[op].is_addx && (liveflags[i+1]&FLAG_Z)==0)
+					liveflags[i]&= ~FLAG_Z;
+			}
+			else {
+				liveflags[i]=0x1f;
+			}
+		}
+		if (liveflags[0]==start)
+			break;
+		start=liveflags[0];
+	}
+
+	for (i=0;i<ndeps;i++)
+		create_flagdep(bi,i,deps[i]);
+}
+
+/* Leave the block for wherever regs.pc_p points, through the cache tags.
+   The registers have to be written back already. */
+static void exit_to_pc_p(int cycles)
+{
+	int r=REG_PC_TMP;
+	int r2;
+
+	if (r==0)
+		r2=1;
+	else
+		r2=0;
+	raw_mov_l_rm(r,(uae_u32)&regs.pc_p);
+	raw_and_l_ri(r,TAGMASK);
+	raw_mov_l_ri(r2,(uae_u32)popall_do_nothing);
+	raw_sub_l_mi((uae_u32)&countdown,scaled_cycles(cycles));
+	raw_cmov_l_rm_indexed(r2,(uae_u32)cache_tags,r,9);
+	raw_jmp_r(r2);
+}
+
+/* The conditional branch just compiled goes on at <trace_pc> in the
+   superblock. Only the other way out writes the registers back, and
+   charges the <cycles> run up to the branch. */
+static void compile_side_exit(uae_u32 trace_pc, int cycles)
+{
+	uae_u32 exit_pc;
+	int cc;
+	uae_u32* branchadd;
+	bigstate tmp;
+
+	Dif (!next_pc_p) {
+		jit_abort (_T("JIT: side exit without a branch"));
+	}
+	if (trace_pc==taken_pc_p) {
+		exit_pc=next_pc_p;
+		cc=branch_cc^1;
+	}
+	else {
+		exit_pc=taken_pc_p;
+		cc=branch_cc;
+	}
+	tmp=live; /* ouch! This is big... */
+	raw_jcc_l_oponly(cc^1);
+	branchadd=(uae_u32*)get_target();
+	emit_long(0);
+	flush(1);
+	raw_mov_l_mi((uae_u32)&regs.pc_p,exit_pc);
+	exit_to_pc_p(cycles);
+	*branchadd=(uae_u32)get_target()-((uae_u32)branchadd+4);
+	live=tmp; /* Ouch again */
+
+	next_pc_p=0;
+	taken_pc_p=0;
+	comp_pc_p=(uae_u8*)trace_pc;
+	mov_l_ri(PC_P,trace_pc);
+}
+
 void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
 {
 	if (letit && compiled_code && currprefs.cpu_model>=68020) {
@@ -5924,6 +6475,7 @@ void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
 		blockinfo* bi=NULL;
 		blockinfo* bi2;
 		int extra_len=0;
+		uae_u8 old_flags;
 
 		compile_count++;
 		if (current_compile_p>=max_compile_start)
@@ -5935,6 +6487,7 @@ void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
 		bi2=get_blockinfo(cl);
 
 		optlev=bi->optlevel;
+		old_flags=bi->needed_flags;
 		if (bi->handler) {
 			Dif (bi!=bi2) {
 				/* I don't think it can happen anymore. Shouldn't, in
@@ -5950,9 +6503,16 @@ void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
 			}
 		}
 		if (bi->count==-1) {
-			optlev++;
-			while (!currprefs.optcount[optlev])
+			if (bi->hot==1) {
+				/* Hot block, recorded as a superblock this time */
+				bi->hot=2;
+				superblock_count++;
+			}
+			else {
 				optlev++;
+				while (!currprefs.optcount[optlev])
+					optlev++;
+			}
 			bi->count=currprefs.optcount[optlev]-1;
 		}
 		current_block_pc_p=(uae_u32)pc_hist[0].location;
@@ -5961,30 +6521,25 @@ void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
 		bi->optlevel=optlev;
 		bi->pc_p=(uae_u8*)pc_hist[0].location;
 
-		liveflags[blocklen]=0x1f; /* All flags needed afterwards */
-		i=blocklen;
-		while (i--) {
+		for (i=0;i<blocklen;i++) {
 			uae_u16* currpcp=pc_hist[i].location;
-			int op=cft_map(*currpcp);
 
 			if ((uae_u32)currpcp<min_pcp)
 				min_pcp=(uae_u32)currpcp;
 			if ((uae_u32)currpcp>max_pcp)
 				max_pcp=(uae_u32)currpcp;
-
-			if (currprefs.compnf) {
-				liveflags[i]=((liveflags[i+1]&
-					(~prop[op].set_flags))|
-					prop[op].use_flags);
-				if (prop[op].is_addx && (liveflags[i+1]&FLAG_Z)==0)
-					liveflags[i]&= ~FLAG_Z;
-			}
-			else {
-				liveflags[i]=0x1f;
-			}
 		}
-
+		compute_liveflags(bi,pc_hist,blocklen,liveflags);
 		bi->needed_flags=liveflags[0];
+		if (old_flags!=0xff && (liveflags[0]&~old_flags))
+			invalidate_flag_users(bi);
+
+		/* Compiled for good, record it again as a superblock once hot */
+		if (currprefs.comp_superblocks && bi->count<0 && !bi->hot && optlev>1 &&
+			is_trace_branch(cft_map(*pc_hist[blocklen-1].location))) {
+				bi->hot=1;
+				bi->count=HOT_RECOMPILE_COUNT-1;
+		}
 
 		/* This is the non-direct handler */
 		align_target(32);
@@ -6059,6 +6614,8 @@ void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
 
 						comptbl[opcode](opcode);
 						freescratch();
+						if (!failure && i<blocklen-1 && prop[opcode].is_jump)
+							compile_side_exit((uae_u32)pc_hist[i+1].location,pc_hist[i].cycles);
 						if (!(liveflags[i+1] & FLAG_CZNV)) {
 							/* We can forget about flags */
 							dont_care_flags();
@@ -6104,10 +6661,22 @@ void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
 							raw_jz_b_oponly();
 							branchadd=(uae_s8*)get_target();
 							emit_byte(0);
-							raw_sub_l_mi((uae_u32)&countdown,scaled_cycles(totcycles));
+							raw_sub_l_mi((uae_u32)&countdown,scaled_cycles(pc_hist[i].cycles));
 							raw_jmp((uae_u32)popall_do_nothing);
 							*branchadd=(uae_u32)get_target()-(uae_u32)branchadd-1;
 						}
+						if (i<blocklen-1 && prop[opcode].is_jump) {
+							/* Interpreted side exit, leave unless the
+							branch went the recorded way */
+							uae_s8* branchadd;
+
+							raw_cmp_l_mi((uae_u32)&regs.pc_p,(uae_u32)pc_hist[i+1].location);
+							raw_jz_b_oponly();
+							branchadd=(uae_s8*)get_target();
+							emit_byte(0);
+							exit_to_pc_p(pc_hist[i].cycles);
+							*branchadd=(uae_u32)get_target()-(uae_u32)branchadd-1;
+						}
 					}
 			}
 #if 0 /* This isn't completely kosher yet; It really needs to be
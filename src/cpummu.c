@@ -50,6 +50,7 @@ static bool locked_rmw_cycle;
 static bool ismoves;
 bool mmu_ttr_enabled;
 int mmu_atc_ways;
+struct mmu_tlb_entry mmu_tlb[ATC_TYPE][2][MMU_TLB_SIZE];
 
 int mmu040_movem;
 uaecptr mmu040_movem_ea;
@@ -101,6 +102,51 @@ void mmu_make_transparent_region(uaecptr baseaddr, uae_u32 size, int datamode)
 void mmu_tt_modified (void)
 {
 	mmu_ttr_enabled = ((regs.dtt0 | regs.dtt1 | regs.itt0 | regs.itt1) & MMU_TTR_BIT_ENABLED) != 0;
+	mmu_tlb_flush_all ();
+}
+
+/* <cl> hit for <addr>, enter the page if it is plain RAM */
+void mmu_tlb_fill(uaecptr addr, bool super, bool data, struct mmu_atc_line *cl)
+{
+	struct mmu_tlb_entry *e = &mmu_tlb[data][super][(addr >> 12) & (MMU_TLB_SIZE - 1)];
+	uae_u8 *host = get_ram_address(cl->phys, regs.mmu_page_size);
+
+	if (!host)
+		return;
+	e->tag = (addr & mmu_pagemaski) | 1;
+	e->host = host;
+	// the first write to a page must set M in its descriptor
+	e->writable = cl->modified && !cl->write_protect;
+}
+
+void mmu_tlb_flush_page(uaecptr addr, bool super)
+{
+	int index = (addr >> 12) & (MMU_TLB_SIZE - 1);
+	int type;
+
+	for (type = 0; type < ATC_TYPE; type++) {
+		mmu_tlb[type][super][index].tag = 0;
+		// both halves of an 8k page
+		if (mmu_pagesize_8k)
+			mmu_tlb[type][super][index ^ 1].tag = 0;
+	}
+}
+
+/* ATC line <cl> in slot <index> is about to be replaced */
+void mmu_tlb_evict(struct mmu_atc_line *cl, int index)
+{
+	uaecptr addr;
+
+	if (mmu_pagesize_8k)
+		addr = ((cl->tag << 1) & 0xfffe0000) | (index << 13);
+	else
+		addr = ((cl->tag << 1) & 0xffff0000) | (index << 12);
+	mmu_tlb_flush_page(addr, (cl->tag & 0x80000000) != 0);
+}
+
+void mmu_tlb_flush_all(void)
+{
+	memset(mmu_tlb, 0, sizeof mmu_tlb);
 }
 
 
@@ -402,6 +448,7 @@ static uaecptr mmu_fill_atc(uaecptr addr, bool super, bool data, bool write, str
 {
 	uae_u32 desc;
 
+	mmu_tlb_flush_page(addr, super);
 	*status = 0;
 	SAVE_EXCEPTION;
 	TRY(prb) {
@@ -1093,6 +1140,7 @@ void REGPARAM2 mmu_flush_atc(uaecptr addr, bool super, bool global)
 {
 	int way,type,index;
 
+	mmu_tlb_flush_page(addr, super);
 	uaecptr tag = ((super ? 0x80000000 : 0) | (addr >> 1)) & mmu_tagmask;
 	if (mmu_pagesize_8k)
 		index=(addr & 0x0001E000)>>13;
@@ -1113,6 +1161,8 @@ void REGPARAM2 mmu_flush_atc(uaecptr addr, bool super, bool global)
 void REGPARAM2 mmu_flush_atc_all(bool global)
 {
 	unsigned int way,slot,type;
+
+	mmu_tlb_flush_all();
 	for (type=0;type<ATC_TYPE;type++) {
 		for (way=0;way<ATC_WAYS;way++) {
 			for (slot=0;slot<ATC_SLOTS;slot++) {
@@ -129,6 +129,69 @@ struct {
     uae_u16 status;
 } mmu030;
 
+/*
+ * Host side TLB in front of the ATC, as for the 68040/060 in cpummu.c.
+ * Pages of plain RAM that hit in the ATC are entered with the host
+ * address of their data, later accesses skip the TT check, the ATC
+ * search and the memory bank call. Direct mapped on the page number,
+ * one table per function code and per read and write, a write entry is
+ * only made for pages whose descriptor already has M set and which are
+ * not write protected, and only on the write path, so a TT register
+ * matching writes only is never bypassed. Entries are dropped with their
+ * ATC entry, when the ATC entry is replaced or flushed, and all of them
+ * on TC, root pointer and TT writes and on map_banks (). Hits don't
+ * maintain the ATC history bits, which only choose the entry replaced.
+ */
+#define MMU030_TLB_SIZE 256
+
+struct mmu030_tlb_entry {
+	uaecptr tag; // logical page | 1, 0 if unused
+	uae_u8 *host; // host address of the page
+};
+
+static struct mmu030_tlb_entry mmu030_tlb[2][8][MMU030_TLB_SIZE];
+
+static ALWAYS_INLINE uae_u8 *mmu030_tlb_lookup(uaecptr addr, uae_u32 fc, bool write)
+{
+	struct mmu030_tlb_entry *e = &mmu030_tlb[write][fc][(addr >> mmu030.translation.page.size) & (MMU030_TLB_SIZE - 1)];
+
+	if (e->tag != ((addr & mmu030.translation.page.imask) | 1))
+		return NULL;
+	return e->host + (addr & mmu030.translation.page.mask);
+}
+
+/* ATC entry <l> hit for <addr>, enter the page if it is plain RAM */
+static void mmu030_tlb_fill(uaecptr addr, uae_u32 fc, bool write, int l)
+{
+	struct mmu030_tlb_entry *e;
+	uae_u8 *host;
+
+	if (l < 0 || mmu030.atc[l].physical.bus_error || (write && mmu030.atc[l].physical.write_protect))
+		return;
+	host = get_ram_address(mmu030.atc[l].physical.addr & mmu030.translation.page.imask, regs.mmu_page_size);
+	if (!host)
+		return;
+	e = &mmu030_tlb[write][fc][(addr >> mmu030.translation.page.size) & (MMU030_TLB_SIZE - 1)];
+	e->tag = (addr & mmu030.translation.page.imask) | 1;
+	e->host = host;
+}
+
+static void mmu030_tlb_flush_page(uaecptr addr)
+{
+	int index = (addr >> mmu030.translation.page.size) & (MMU030_TLB_SIZE - 1);
+	int fc;
+
+	for (fc = 0; fc < 8; fc++) {
+		mmu030_tlb[0][fc][index].tag = 0;
+		mmu030_tlb[1][fc][index].tag = 0;
+	}
+}
+
+void mmu030_tlb_flush_all(void)
+{
+	memset(mmu030_tlb, 0, sizeof mmu030_tlb);
+}
+
 
 
 /* MMU Status Register
@@ -417,6 +480,7 @@ uae_u32 mmu_op30_helper_get_fc(uae_u16 next) {
 /* This function flushes ATC entries depending on their function code */
 void mmu030_flush_atc_fc(uae_u32 fc_base, uae_u32 fc_mask) {
     int i;
+    mmu030_tlb_flush_all();
     for (i=0; i<ATC030_NUM_ENTRIES; i++) {
         if (((fc_base&fc_mask)==(mmu030.atc[i].logical.fc&fc_mask)) &&
             mmu030.atc[i].logical.valid) {
@@ -433,6 +497,7 @@ void mmu030_flush_atc_fc(uae_u32 fc_base, uae_u32 fc_mask) {
 void mmu030_flush_atc_page_fc(uaecptr logical_addr, uae_u32 fc_base, uae_u32 fc_mask) {
     int i;
 	logical_addr &= mmu030.translation.page.imask;
+	mmu030_tlb_flush_page(logical_addr);
     for (i=0; i<ATC030_NUM_ENTRIES; i++) {
         if (((fc_base&fc_mask)==(mmu030.atc[i].logical.fc&fc_mask)) &&
             (mmu030.atc[i].logical.addr == logical_addr) &&
@@ -449,6 +514,7 @@ void mmu030_flush_atc_page_fc(uaecptr logical_addr, uae_u32 fc_base, uae_u32 fc_
 void mmu030_flush_atc_page(uaecptr logical_addr) {
     int i;
 	logical_addr &= mmu030.translation.page.imask;
+	mmu030_tlb_flush_page(logical_addr);
     for (i=0; i<ATC030_NUM_ENTRIES; i++) {
         if ((mmu030.atc[i].logical.addr == logical_addr) &&
             mmu030.atc[i].logical.valid) {
@@ -466,6 +532,7 @@ void mmu030_flush_atc_all(void) {
 	write_log(_T("ATC: Flushing all entries\n"));
 #endif
 	int i;
+    mmu030_tlb_flush_all();
     for (i=0; i<ATC030_NUM_ENTRIES; i++) {
         mmu030.atc[i].logical.valid = false;
     }
@@ -513,6 +580,8 @@ TT_info mmu030_decode_tt(uae_u32 TT) {
     
     TT_info ret;
 
+    mmu030_tlb_flush_all();
+
     ret.fc_mask = ~((TT&TT_FC_MASK)|0xFFFFFFF8);
     ret.fc_base = (TT&TT_FC_BASE)>>4;
     ret.addr_base = TT & TT_ADDR_BASE;
@@ -705,6 +774,9 @@ int mmu030_do_match_lrmw_ttr(uae_u32 tt, TT_info comp, uaecptr addr, uae_u32 fc)
 
 void mmu030_decode_tc(uae_u32 TC) {
         
+    /* the page size may change */
+    mmu030_tlb_flush_all();
+
     /* Set MMU condition */    
     if (TC & TC_ENABLE_TRANSLATION) {
         mmu030.enabled = true;
@@ -846,6 +918,8 @@ void mmu030_decode_tc(uae_u32 TC) {
 
 void mmu030_decode_rp(uae_u64 RP) {
     
+    mmu030_tlb_flush_all();
+
     uae_u8 descriptor_type = (RP & RP_DESCR_MASK) >> 32;
     if (!descriptor_type) { /* If descriptor type is invalid */
         write_log(_T("MMU Configuration Exception: Root Pointer is invalid!\n"));
@@ -1447,6 +1521,10 @@ uae_u32 mmu030_table_search(uaecptr addr, uae_u32 fc, bool write, int level) {
 
     mmu030_atc_handle_history_bit(i);
     
+    if (mmu030.atc[i].logical.valid)
+        mmu030_tlb_flush_page(mmu030.atc[i].logical.addr);
+    mmu030_tlb_flush_page(addr);
+
     /* Create ATC entry */
     mmu030.atc[i].logical.addr = addr & mmu030.translation.page.imask; /* delete page index bits */
     mmu030.atc[i].logical.fc = fc;
@@ -1775,6 +1853,7 @@ int mmu030_logical_is_in_atc(uaecptr addr, uae_u32 fc, bool write) {
 					return index;
 				} else {
 					mmu030.atc[index].logical.valid = false;
+					mmu030_tlb_flush_page(maddr);
 				}
 		}
 		index++;
@@ -1812,108 +1891,156 @@ void mmu030_atc_handle_history_bit(int entry_num) {
  */
 
 void mmu030_put_long(uaecptr addr, uae_u32 val, uae_u32 fc) {
-    
-	//                                        addr,super,write
-	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr,fc,true)) || (fc==7)) {
+    uae_u8 *p;
+
+	if (!mmu030.enabled) {
+		phys_put_long(addr,val);
+		return;
+	}
+	p = mmu030_tlb_lookup(addr, fc, true);
+	if (likely(p != NULL)) {
+		do_put_mem_long((uae_u32 *)p, val);
+		return;
+	}
+	//                                 addr,super,write
+	if ((mmu030_match_ttr_access(addr,fc,true)) || (fc==7)) {
 		phys_put_long(addr,val);
 		return;
     }
 
     int atc_line_num = mmu030_logical_is_in_atc(addr, fc, true);
 
-    if (atc_line_num>=0) {
-        mmu030_put_long_atc(addr, val, atc_line_num, fc);
-    } else {
+    if (atc_line_num<0) {
         mmu030_table_search(addr,fc,true,0);
-        mmu030_put_long_atc(addr, val, mmu030_logical_is_in_atc(addr,fc,true), fc);
+        atc_line_num = mmu030_logical_is_in_atc(addr,fc,true);
     }
+    mmu030_tlb_fill(addr, fc, true, atc_line_num);
+    mmu030_put_long_atc(addr, val, atc_line_num, fc);
 }
 
 void mmu030_put_word(uaecptr addr, uae_u16 val, uae_u32 fc) {
-    
-	//                                        addr,super,write
-	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr,fc,true)) || (fc==7)) {
+    uae_u8 *p;
+
+	if (!mmu030.enabled) {
+		phys_put_word(addr,val);
+		return;
+	}
+	p = mmu030_tlb_lookup(addr, fc, true);
+	if (likely(p != NULL)) {
+		do_put_mem_word((uae_u16 *)p, val);
+		return;
+	}
+	//                                 addr,super,write
+	if ((mmu030_match_ttr_access(addr,fc,true)) || (fc==7)) {
 		phys_put_word(addr,val);
 		return;
     }
-    
+
     int atc_line_num = mmu030_logical_is_in_atc(addr, fc, true);
-    
-    if (atc_line_num>=0) {
-        mmu030_put_word_atc(addr, val, atc_line_num, fc);
-    } else {
-        mmu030_table_search(addr, fc, true, 0);
-        mmu030_put_word_atc(addr, val, mmu030_logical_is_in_atc(addr,fc,true), fc);
+
+    if (atc_line_num<0) {
+        mmu030_table_search(addr,fc,true,0);
+        atc_line_num = mmu030_logical_is_in_atc(addr,fc,true);
     }
+    mmu030_tlb_fill(addr, fc, true, atc_line_num);
+    mmu030_put_word_atc(addr, val, atc_line_num, fc);
 }
 
 void mmu030_put_byte(uaecptr addr, uae_u8 val, uae_u32 fc) {
-    
-	//                                        addr,super,write
-	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr, fc, true)) || (fc==7)) {
+    uae_u8 *p;
+
+	if (!mmu030.enabled) {
+		phys_put_byte(addr,val);
+		return;
+	}
+	p = mmu030_tlb_lookup(addr, fc, true);
+	if (likely(p != NULL)) {
+		do_put_mem_byte(p, val);
+		return;
+	}
+	//                                 addr,super,write
+	if ((mmu030_match_ttr_access(addr,fc,true)) || (fc==7)) {
 		phys_put_byte(addr,val);
 		return;
     }
-    
+
     int atc_line_num = mmu030_logical_is_in_atc(addr, fc, true);
 
-    if (atc_line_num>=0) {
-        mmu030_put_byte_atc(addr, val, atc_line_num, fc);
-    } else {
-        mmu030_table_search(addr, fc, true, 0);
-        mmu030_put_byte_atc(addr, val, mmu030_logical_is_in_atc(addr,fc,true), fc);
+    if (atc_line_num<0) {
+        mmu030_table_search(addr,fc,true,0);
+        atc_line_num = mmu030_logical_is_in_atc(addr,fc,true);
     }
+    mmu030_tlb_fill(addr, fc, true, atc_line_num);
+    mmu030_put_byte_atc(addr, val, atc_line_num, fc);
 }
 
 uae_u32 mmu030_get_long(uaecptr addr, uae_u32 fc) {
-    
-	//                                        addr,super,write
-	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr,fc,false)) || (fc==7)) {
+    uae_u8 *p;
+
+	if (!mmu030.enabled)
+		return phys_get_long(addr);
+	p = mmu030_tlb_lookup(addr, fc, false);
+	if (likely(p != NULL))
+		return do_get_mem_long((uae_u32 *)p);
+	//                                 addr,super,write
+	if ((mmu030_match_ttr_access(addr,fc,false)) || (fc==7)) {
 		return phys_get_long(addr);
     }
     
     int atc_line_num = mmu030_logical_is_in_atc(addr, fc, false);
 
-    if (atc_line_num>=0) {
-        return mmu030_get_long_atc(addr, atc_line_num, fc);
-    } else {
+    if (atc_line_num<0) {
         mmu030_table_search(addr, fc, false, 0);
-        return mmu030_get_long_atc(addr, mmu030_logical_is_in_atc(addr,fc,false), fc);
+        atc_line_num = mmu030_logical_is_in_atc(addr,fc,false);
     }
+    mmu030_tlb_fill(addr, fc, false, atc_line_num);
+    return mmu030_get_long_atc(addr, atc_line_num, fc);
 }
 
 uae_u16 mmu030_get_word(uaecptr addr, uae_u32 fc) {
-    
-	//                                        addr,super,write
-	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr,fc,false)) || (fc==7)) {
+    uae_u8 *p;
+
+	if (!mmu030.enabled)
+		return phys_get_word(addr);
+	p = mmu030_tlb_lookup(addr, fc, false);
+	if (likely(p != NULL))
+		return do_get_mem_word((uae_u16 *)p);
+	//                                 addr,super,write
+	if ((mmu030_match_ttr_access(addr,fc,false)) || (fc==7)) {
 		return phys_get_word(addr);
     }
     
     int atc_line_num = mmu030_logical_is_in_atc(addr, fc, false);
 
-    if (atc_line_num>=0) {
-        return mmu030_get_word_atc(addr, atc_line_num, fc);
-    } else {
+    if (atc_line_num<0) {
         mmu030_table_search(addr, fc, false, 0);
-        return mmu030_get_word_atc(addr, mmu030_logical_is_in_atc(addr,fc,false), fc);
+        atc_line_num = mmu030_logical_is_in_atc(addr,fc,false);
     }
+    mmu030_tlb_fill(addr, fc, false, atc_line_num);
+    return mmu030_get_word_atc(addr, atc_line_num, fc);
 }
 
 uae_u8 mmu030_get_byte(uaecptr addr, uae_u32 fc) {
-    
-	//                                        addr,super,write
-	if ((!mmu030.enabled) || (mmu030_match_ttr_access(addr,fc,false)) || (fc==7)) {
+    uae_u8 *p;
+
+	if (!mmu030.enabled)
+		return phys_get_byte(addr);
+	p = mmu030_tlb_lookup(addr, fc, false);
+	if (likely(p != NULL))
+		return do_get_mem_byte(p);
+	//                                 addr,super,write
+	if ((mmu030_match_ttr_access(addr,fc,false)) || (fc==7)) {
 		return phys_get_byte(addr);
     }
     
     int atc_line_num = mmu030_logical_is_in_atc(addr, fc, false);
 
-    if (atc_line_num>=0) {
-        return mmu030_get_byte_atc(addr, atc_line_num, fc);
-    } else {
+    if (atc_line_num<0) {
         mmu030_table_search(addr, fc, false, 0);
-        return mmu030_get_byte_atc(addr, mmu030_logical_is_in_atc(addr,fc,false), fc);
+        atc_line_num = mmu030_logical_is_in_atc(addr,fc,false);
     }
+    mmu030_tlb_fill(addr, fc, false, atc_line_num);
+    return mmu030_get_byte_atc(addr, atc_line_num, fc);
 }
 
 
@@ -59,6 +59,7 @@
 #include "sampler.h"
 #include "hrtimer.h"
 #include "misc.h"
+#include "benchmark.h"
 
 #define CUSTOM_DEBUG 0
 #define SPRITE_DEBUG 0
@@ -373,7 +374,6 @@ static struct color_change color_changes[2][MAX_REG_CHANGE];
 
 struct decision line_decisions[2 * (MAXVPOS + 2) + 1];
 static struct draw_info line_drawinfo[2][2 * (MAXVPOS + 2) + 1];
-#define COLOR_TABLE_SIZE (MAXVPOS + 2) * 2
 static struct color_entry color_tables[2][COLOR_TABLE_SIZE];
 
 static int next_sprite_entry = 0;
@@ -568,6 +568,7 @@ void notice_new_xcolors (void)
 {
 	int i;
 
+	drawing_thread_wait (false);
 	update_mirrors ();
 	docols (&current_colors);
 	docols (&colors_for_drawing);
@@ -6659,6 +6660,12 @@ static bool framewait (void)
 
 	is_syncline = 0;
 
+	/* benchmark runs unthrottled */
+	if (benchmark_frames) {
+		frameskiptime = 0;
+		return true;
+	}
+
 	static struct mavg_data ma_frameskipt;
 	int frameskipt_avg = mavg (&ma_frameskipt, frameskiptime, MAVG_VSYNC_SIZE);
 
@@ -6997,7 +7004,11 @@ static void vsync_handler_pre (void)
 	if (bogusframe > 0)
 		bogusframe--;
 
-	while (handle_events ()) {
+	/* collect the frame the render thread drew during this one */
+	drawing_thread_wait (false);
+
+	/* headless benchmark: no display, no host events */
+	while (!benchmark_frames && handle_events ()) {
 		// we are paused, do all config checks but don't do any emulation
 		if (vsync_handle_check ()) {
 			redraw_frame ();
@@ -7039,8 +7050,10 @@ static void vsync_handler_pre (void)
 
 	if (!vsync_rendered) {
 		frame_time_t start, end;
+		int bs = bench_enter (BENCH_DRAWING);
 		start = read_processor_time ();
 		vsync_handle_redraw (lof_store, lof_changed, bplcon0, bplcon3);
+		bench_leave (bs);
 		vsync_rendered = true;
 		end = read_processor_time ();
 		frameskiptime += end - start;
@@ -7058,6 +7071,7 @@ static void vsync_handler_pre (void)
 	}
 
 	fpscounter (frameok);
+	benchmark_vsync ();
 
 	vsync_rendered = false;
 	frame_shown = false;
@@ -7069,6 +7083,7 @@ static void vsync_handler_pre (void)
 		vblank_hz_state = 1;
 
 	vsync_handle_check ();
+	drawing_thread_kick ();
 	//checklacecount (bplcon0_interlace_seen || lof_lace);
 }
 
@@ -7430,6 +7445,7 @@ static void set_hpos (void)
 static void hsync_handler_pre (bool onvsync)
 {
 	int hpos = current_hpos ();
+	int bs;
 
 	if (!nocustom ()) {
 		sync_copper_with_cpu (maxhpos, 0);
@@ -7478,9 +7494,13 @@ static void hsync_handler_pre (bool onvsync)
 #endif
 	}
 
+	bs = bench_enter (BENCH_DISK);
 	DISK_hsync ();
-	if (currprefs.produce_sound)
+	if (currprefs.produce_sound) {
+		bench_enter (BENCH_AUDIO);
 		audio_hsync ();
+	}
+	bench_leave (bs);
 	CIA_hsync_prehandler ();
 
 	hsync_counter++;
@@ -7835,12 +7855,14 @@ static void hsync_handler_post (bool onvsync)
 	/* fastest possible + last line and no vflip wait: render the frame as early as possible */
 	if (is_last_line () && isvsync_chipset () <= -2 && !vsync_rendered && currprefs.gfx_apmode[0].gfx_vflip == 0) {
 		frame_time_t start, end;
+		int bs = bench_enter (BENCH_DRAWING);
 		start = read_processor_time ();
 		vsync_rendered = true;
 		vsync_handle_redraw (lof_store, lof_changed, bplcon0, bplcon3);
 		if (vblank_hz_state) {
 			frame_rendered = render_screen (true);
 		}
+		bench_leave (bs);
 		end = read_processor_time ();
 		frameskiptime += end - start;
 	}
@@ -7887,6 +7909,7 @@ void init_eventtab (void)
 	for (i = 0; i < ev2_max; i++) {
 		eventtab2[i].active = 0;
 	}
+	event2_misc_reset ();
 
 	eventtab[ev_cia].handler = CIA_handler;
 	eventtab[ev_hsync].handler = hsync_handler;
@@ -8703,7 +8726,7 @@ static void REGPARAM2 custom_lput (uaecptr addr, uae_u32 value)
 
 void custom_prepare_savestate (void)
 {
-	int i;
+	int i, cnt;
 
 	for (i = 0; i < ev2_max; i++) {
 		if (eventtab2[i].active) {
@@ -8711,6 +8734,25 @@ void custom_prepare_savestate (void)
 			eventtab2[i].handler (eventtab2[i].data);
 		}
 	}
+	/* Only events pending now, not the ones their handlers queue */
+	cnt = event2_misc_count ();
+	if (cnt > 0) {
+		struct ev2 *pending = xmalloc (struct ev2, cnt);
+		if (!pending) {
+			/* fire them in place, the earliest first */
+			write_log (_T("custom_prepare_savestate: out of memory for %d events\n"), cnt);
+			for (i = 0; i < cnt && event2_misc_count () > 0; i++) {
+				struct ev2 e = event2_misc_pop ();
+				e.handler (e.data);
+			}
+			return;
+		}
+		for (i = 0; i < cnt; i++)
+			pending[i] = event2_misc_pop ();
+		for (i = 0; i < cnt; i++)
+			pending[i].handler (pending[i].data);
+		xfree (pending);
+	}
 }
 
 #define RB restore_u8 ()
@@ -9224,9 +9266,11 @@ uae_u8 *save_custom_extra (int *len, uae_u8 *dstptr)
 
 uae_u8 *restore_custom_event_delay (uae_u8 *src)
 {
-	if (restore_u32 () != 1)
+	uae_u32 v = restore_u32 ();
+	if (v != 1 && v != 2)
 		return src;
-	int cnt = restore_u8 ();
+	// version 2 has a long count
+	int cnt = v == 1 ? restore_u8 () : restore_u32 ();
 	for (int i = 0; i < cnt; i++) {
 		uae_u8 type = restore_u8 ();
 		evt e = restore_u64 ();
@@ -9241,8 +9285,8 @@ uae_u8 *save_custom_event_delay (int *len, uae_u8 *dstptr)
 	uae_u8 *dstbak, *dst;
 	int cnt = 0;
 
-	for (int i = ev2_misc; i < ev2_max; i++) {
-		struct ev2 *e = &eventtab2[i];
+	for (int i = 0; i < event2_misc_count (); i++) {
+		struct ev2 *e = event2_misc_get (i);
 		if (e->active && e->handler == send_interrupt_do) {
 			cnt++;
 		}
@@ -9253,13 +9297,20 @@ uae_u8 *save_custom_event_delay (int *len, uae_u8 *dstptr)
 	if (dstptr)
 		dstbak = dst = dstptr;
 	else
-		dstbak = dst = xmalloc (uae_u8, 1000);
+		dstbak = dst = xmalloc (uae_u8, 4 + 4 + cnt * (1 + 8 + 4));
 
-	save_u32 (1);
-	save_u8 (cnt);
-	for (int i = ev2_misc; i < ev2_max; i++) {
-		struct ev2 *e = &eventtab2[i];
+	// the event2 queue is unbounded, more than 255 need version 2
+	if (cnt < 256) {
+		save_u32 (1);
+		save_u8 (cnt);
+	} else {
+		save_u32 (2);
+		save_u32 (cnt);
+	}
+	for (int i = 0, j = 0; i < event2_misc_count () && j < cnt; i++) {
+		struct ev2 *e = event2_misc_get (i);
 		if (e->active && e->handler == send_interrupt_do) {
+			j++;
 			save_u8 (1);
 			save_u64 (e->evtime - get_cycles ());
 			save_u32 (e->data);
@@ -40,6 +40,7 @@
 #include "cpummu030.h"
 #include "misc.h"
 #include "ar.h"
+#include "dmatrace.h"
 
 /* external prototypes */
 void my_trim (TCHAR *s);
@@ -154,6 +155,7 @@ static TCHAR help[] = {
 	"                        residents, interrupts, doslist and memorylist.\n"
 #ifdef SAVESTATE
 	"  b                     Step to previous state capture position.\n"
+	"  bm [<rounds>]         Benchmark in-memory savestate save and restore, OCS/ECS/AGA.\n"
 #endif
 	"  M<a/b/s> <val>        Enable or disable audio channels, bitplanes or sprites.\n"
 	"  sp <addr> [<addr2][<size>] Dump sprite information.\n"
@@ -163,8 +165,13 @@ static TCHAR help[] = {
 	"  dj [<level bitmask>]  Enable joystick/mouse input debugging.\n"
 	"  smc [<0-1>]           Enable self-modifying code detector. 1 = enable break.\n"
 	"  dm                    Dump current address space map.\n"
+#ifdef JIT
+	"  dJ                    Show JIT cache flush and compile statistics.\n"
+#endif
 	"  v <vpos> [<hpos>]     Show DMA data (accurate only in cycle-exact mode).\n"
 	"                        v [-1 to -4] = enable visual DMA debugger.\n"
+	"  vt [<file>]           Start/stop streaming DMA slots of every frame to a\n"
+	"                        compressed binary trace (see tools/dmatracestat).\n"
 	"  ?<value>              Hex ($ and 0x)/Bin (%)/Dec (!) converter.\n"
 	"  q                     Quit the emulator. You don't want to use this command.\n\n"
 };
@@ -986,6 +993,10 @@ static int nr_cop_records[2], curr_cop_set;
 #define NR_DMA_REC_VPOS 1000
 static struct dma_rec *dma_record[2];
 static int dma_record_toggle;
+/* anything recorded since the last reset */
+static bool dma_record_used;
+/* debug_dma was only turned on for the trace */
+static bool dmatrace_debug_dma;
 
 void record_dma_reset (void)
 {
@@ -994,6 +1005,12 @@ void record_dma_reset (void)
 
 	if (!dma_record[0])
 		return;
+	if (dmatrace_active) {
+		dmatrace_frame (dma_record_used ? dma_record[dma_record_toggle] : NULL, NR_DMA_REC_HPOS,
+			maxhpos < NR_DMA_REC_HPOS ? maxhpos : NR_DMA_REC_HPOS,
+			maxvpos < NR_DMA_REC_VPOS ? maxvpos : NR_DMA_REC_VPOS);
+	}
+	dma_record_used = false;
 	dma_record_toggle ^= 1;
 	dr = dma_record[dma_record_toggle];
 	for (v = 0; v < NR_DMA_REC_VPOS; v++) {
@@ -1143,6 +1160,7 @@ void record_dma_event (int evt, int hpos, int vpos)
 		return;
 	dr = &dma_record[dma_record_toggle][vpos * NR_DMA_REC_HPOS + hpos];
 	dr->evt |= evt;
+	dma_record_used = true;
 }
 
 struct dma_rec *record_dma (uae_u16 reg, uae_u16 dat, uae_u32 addr, int hpos, int vpos, int type)
@@ -1161,6 +1179,7 @@ struct dma_rec *record_dma (uae_u16 reg, uae_u16 dat, uae_u32 addr, int hpos, in
 		return NULL;
 
 	record_dma_heatmap (addr, type);
+	dma_record_used = true;
 
 	dr = &dma_record[dma_record_toggle][vpos * NR_DMA_REC_HPOS + hpos];
 	if (dr->reg != 0xffff) {
@@ -1296,6 +1315,33 @@ static void decode_dma_record (int hpos, int vpos, int toggle, bool logfile)
 		}
 	}
 }
+static void dma_trace (TCHAR **c)
+{
+	TCHAR name[MAX_DPATH];
+
+	if (dmatrace_active) {
+		dmatrace_stop ();
+		if (dmatrace_debug_dma)
+			debug_dma = 0;
+		dmatrace_debug_dma = false;
+		console_out (_T("DMA trace stopped.\n"));
+		return;
+	}
+	ignore_ws (c);
+	if (!more_params (c) || !next_string (c, name, sizeof name / sizeof (TCHAR), 0)) {
+		console_out (_T("vt needs a file name.\n"));
+		return;
+	}
+	if (!dmatrace_start (name, NR_DMA_REC_HPOS * NR_DMA_REC_VPOS)) {
+		console_out_f (_T("Couldn't open '%s'\n"), name);
+		return;
+	}
+	dmatrace_debug_dma = !debug_dma;
+	if (!debug_dma)
+		debug_dma = 1;
+	console_out_f (_T("DMA trace to '%s' started.\n"), name);
+}
+
 void log_dma_record (void)
 {
 	if (!input_record && !input_play)
@@ -1766,6 +1812,13 @@ struct memwatch_node mwnodes[MEMWATCH_TOTAL];
 static struct memwatch_node mwhit;
 static int addressspaceheatmap;
 
+/* Access types (rwi) of all watchpoints per page of the address space.
+ * Debug banks cover whole 64k banks, accesses to their unwatched pages
+ * skip memwatch_func () and go straight to the original bank. */
+#define MEMWATCH_PAGE_SHIFT 12
+static uae_u8 *memwatch_pages;
+static uae_u32 memwatch_pages_mask;
+
 static uae_u8 *illgdebug, *illghdebug;
 static int illgdebug_break;
 
@@ -2069,6 +2122,38 @@ void restore_debug_memwatch_finish (void)
 	}
 }
 
+static void memwatch_pages_update (void)
+{
+	if (!memwatch_pages)
+		return;
+	memset (memwatch_pages, 0, memwatch_pages_mask + 1);
+	for (int i = 0; i < MEMWATCH_TOTAL; i++) {
+		struct memwatch_node *m = &mwnodes[i];
+		uae_u32 page, last;
+		if (!m->size)
+			continue;
+		page = m->addr >> MEMWATCH_PAGE_SHIFT;
+		last = (m->addr + m->size - 1) >> MEMWATCH_PAGE_SHIFT;
+		for (;;) {
+			memwatch_pages[page & memwatch_pages_mask] |= m->rwi;
+			if (page == last || page == memwatch_pages_mask)
+				break;
+			page++;
+		}
+	}
+}
+
+/* Can this access hit a watchpoint? The debugger features that look at
+ * every access of a debug bank always get to memwatch_func (). */
+STATIC_INLINE int memwatch_check (uaecptr addr, int rwi, int size)
+{
+	if (!memwatch_pages || illgdebug || addressspaceheatmap || (smc_table && rwi >= 2))
+		return 1;
+	addr = munge24 (addr);
+	return (memwatch_pages[(addr >> MEMWATCH_PAGE_SHIFT) & memwatch_pages_mask]
+		| memwatch_pages[((addr + size - 1) >> MEMWATCH_PAGE_SHIFT) & memwatch_pages_mask]) & rwi;
+}
+
 static int memwatch_func (uaecptr addr, int rwi, int size, uae_u32 *valp, uae_u32 accessmask, uae_u32 reg)
 {
 	int i, brk;
@@ -2259,7 +2344,8 @@ static uae_u32 REGPARAM2 debug_lget (uaecptr addr)
 	uae_u32 off = debug_mem_off (&addr);
 	uae_u32 v;
 	v = debug_mem_banks[off]->lget (addr);
-	memwatch_func (addr, 1, 4, &v, MW_MASK_CPU, 0);
+	if (memwatch_check (addr, 1, 4))
+		memwatch_func (addr, 1, 4, &v, MW_MASK_CPU, 0);
 	return v;
 }
 static uae_u32 REGPARAM2 mmu_lgeti (uaecptr addr)
@@ -2284,7 +2370,8 @@ static uae_u32 REGPARAM2 debug_wget (uaecptr addr)
 	int off = debug_mem_off (&addr);
 	uae_u32 v;
 	v = debug_mem_banks[off]->wget (addr);
-	memwatch_func (addr, 1, 2, &v, MW_MASK_CPU, 0);
+	if (memwatch_check (addr, 1, 2))
+		memwatch_func (addr, 1, 2, &v, MW_MASK_CPU, 0);
 	return v;
 }
 static uae_u32 REGPARAM2 debug_bget (uaecptr addr)
@@ -2292,7 +2379,8 @@ static uae_u32 REGPARAM2 debug_bget (uaecptr addr)
 	int off = debug_mem_off (&addr);
 	uae_u32 v;
 	v = debug_mem_banks[off]->bget (addr);
-	memwatch_func (addr, 1, 1, &v, MW_MASK_CPU, 0);
+	if (memwatch_check (addr, 1, 1))
+		memwatch_func (addr, 1, 1, &v, MW_MASK_CPU, 0);
 	return v;
 }
 static uae_u32 REGPARAM2 debug_lgeti (uaecptr addr)
@@ -2300,7 +2388,8 @@ static uae_u32 REGPARAM2 debug_lgeti (uaecptr addr)
 	int off = debug_mem_off (&addr);
 	uae_u32 v;
 	v = debug_mem_banks[off]->lgeti (addr);
-	memwatch_func (addr, 4, 4, &v, MW_MASK_CPU, 0);
+	if (memwatch_check (addr, 4, 4))
+		memwatch_func (addr, 4, 4, &v, MW_MASK_CPU, 0);
 	return v;
 }
 static uae_u32 REGPARAM2 debug_wgeti (uaecptr addr)
@@ -2308,25 +2397,26 @@ static uae_u32 REGPARAM2 debug_wgeti (uaecptr addr)
 	int off = debug_mem_off (&addr);
 	uae_u32 v;
 	v = debug_mem_banks[off]->wgeti (addr);
-	memwatch_func (addr, 4, 2, &v, MW_MASK_CPU, 0);
+	if (memwatch_check (addr, 4, 2))
+		memwatch_func (addr, 4, 2, &v, MW_MASK_CPU, 0);
 	return v;
 }
 static void REGPARAM2 debug_lput (uaecptr addr, uae_u32 v)
 {
 	int off = debug_mem_off (&addr);
-	if (memwatch_func (addr, 2, 4, &v, MW_MASK_CPU, 0))
+	if (!memwatch_check (addr, 2, 4) || memwatch_func (addr, 2, 4, &v, MW_MASK_CPU, 0))
 		debug_mem_banks[off]->lput (addr, v);
 }
 static void REGPARAM2 debug_wput (uaecptr addr, uae_u32 v)
 {
 	int off = debug_mem_off (&addr);
-	if (memwatch_func (addr, 2, 2, &v, MW_MASK_CPU, 0))
+	if (!memwatch_check (addr, 2, 2) || memwatch_func (addr, 2, 2, &v, MW_MASK_CPU, 0))
 		debug_mem_banks[off]->wput (addr, v);
 }
 static void REGPARAM2 debug_bput (uaecptr addr, uae_u32 v)
 {
 	int off = debug_mem_off (&addr);
-	if (memwatch_func (addr, 2, 1, &v, MW_MASK_CPU, 0))
+	if (!memwatch_check (addr, 2, 1) || memwatch_func (addr, 2, 1, &v, MW_MASK_CPU, 0))
 		debug_mem_banks[off]->bput (addr, v);
 }
 static int REGPARAM2 debug_check (uaecptr addr, uae_u32 size)
@@ -2344,7 +2434,8 @@ uae_u16 debug_wputpeekdma_chipset (uaecptr addr, uae_u32 v, uae_u32 mask, int re
 		return v;
 	addr &= 0x1fe;
 	addr += 0xdff000;
-	memwatch_func (addr, 2, 2, &v, mask, reg);
+	if (memwatch_check (addr, 2, 2))
+		memwatch_func (addr, 2, 2, &v, mask, reg);
 	return v;
 }
 uae_u16 debug_wputpeekdma_chipram (uaecptr addr, uae_u32 v, uae_u32 mask, int reg)
@@ -2355,7 +2446,8 @@ uae_u16 debug_wputpeekdma_chipram (uaecptr addr, uae_u32 v, uae_u32 mask, int re
 		return v;
 	if (!currprefs.z3chipmem_size)
 		addr &= chipmem_bank.mask;
-	memwatch_func (addr & chipmem_bank.mask, 2, 2, &v, mask, reg);
+	if (memwatch_check (addr & chipmem_bank.mask, 2, 2))
+		memwatch_func (addr & chipmem_bank.mask, 2, 2, &v, mask, reg);
 	return v;
 }
 uae_u16 debug_wgetpeekdma_chipram (uaecptr addr, uae_u32 v, uae_u32 mask, int reg)
@@ -2367,7 +2459,8 @@ uae_u16 debug_wgetpeekdma_chipram (uaecptr addr, uae_u32 v, uae_u32 mask, int re
 		return v;
 	if (!currprefs.z3chipmem_size)
 		addr &= chipmem_bank.mask;
-	memwatch_func (addr, 1, 2, &vv, mask, reg);
+	if (memwatch_check (addr, 1, 2))
+		memwatch_func (addr, 1, 2, &vv, mask, reg);
 	return vv;
 }
 
@@ -2381,34 +2474,34 @@ void debug_putlpeek (uaecptr addr, uae_u32 v)
 #endif
 void debug_wputpeek (uaecptr addr, uae_u32 v)
 {
-	if (!memwatch_enabled)
+	if (!memwatch_enabled || !memwatch_check (addr, 2, 2))
 		return;
 	memwatch_func (addr, 2, 2, &v, MW_MASK_CPU, 0);
 }
 void debug_bputpeek (uaecptr addr, uae_u32 v)
 {
-	if (!memwatch_enabled)
+	if (!memwatch_enabled || !memwatch_check (addr, 2, 1))
 		return;
 	memwatch_func (addr, 2, 1, &v, MW_MASK_CPU, 0);
 }
 void debug_bgetpeek (uaecptr addr, uae_u32 v)
 {
 	uae_u32 vv = v;
-	if (!memwatch_enabled)
+	if (!memwatch_enabled || !memwatch_check (addr, 1, 1))
 		return;
 	memwatch_func (addr, 1, 1, &vv, MW_MASK_CPU, 0);
 }
 void debug_wgetpeek (uaecptr addr, uae_u32 v)
 {
 	uae_u32 vv = v;
-	if (!memwatch_enabled)
+	if (!memwatch_enabled || !memwatch_check (addr, 1, 2))
 		return;
 	memwatch_func (addr, 1, 2, &vv, MW_MASK_CPU, 0);
 }
 void debug_lgetpeek (uaecptr addr, uae_u32 v)
 {
 	uae_u32 vv = v;
-	if (!memwatch_enabled)
+	if (!memwatch_enabled || !memwatch_check (addr, 1, 4))
 		return;
 	memwatch_func (addr, 1, 4, &vv, MW_MASK_CPU, 0);
 }
@@ -2504,6 +2597,7 @@ static void memwatch_remap (uaecptr addr)
 static void memwatch_setup (void)
 {
 	memwatch_reset ();
+	memwatch_pages_update ();
 	for (int i = 0; i < MEMWATCH_TOTAL; i++) {
 		struct memwatch_node *m = &mwnodes[i];
 		uae_u32 size = 0;
@@ -2530,6 +2624,8 @@ static int deinitialize_memwatch (void)
 	debug_mem_area = NULL;
 	xfree (membank_stores);
 	membank_stores = NULL;
+	xfree (memwatch_pages);
+	memwatch_pages = NULL;
 	memwatch_enabled = 0;
 	mmu_enabled = 0;
 	xfree (illgdebug);
@@ -2544,6 +2640,9 @@ static void initialize_memwatch (int mode)
 	debug_mem_banks = xcalloc (addrbank*, membank_total);
 	debug_mem_area = xcalloc (addrbank, membank_total);
 	membank_stores = xcalloc (struct membank_store, MEMWATCH_STORE_SLOTS);
+	memwatch_pages_mask = (membank_total << (16 - MEMWATCH_PAGE_SHIFT)) - 1;
+	memwatch_pages = xcalloc (uae_u8, memwatch_pages_mask + 1);
+	memwatch_pages_update ();
 #if 0
 	int i, j, as;
 	addrbank *a1, *a2, *oa;
@@ -3594,6 +3693,69 @@ static int staterecorder (TCHAR **cc)
 	return 0;
 }
 
+/* Time in-memory save and restore with each chipset, then put the
+ * machine back the way it was */
+static void statemem_benchmark (TCHAR **cc)
+{
+#ifdef SAVESTATE
+	static const int masks[] = {
+		0,
+		CSMASK_ECS_AGNUS | CSMASK_ECS_DENISE,
+		CSMASK_ECS_AGNUS | CSMASK_ECS_DENISE | CSMASK_AGA
+	};
+	static const TCHAR *names[] = { _T("OCS"), _T("ECS"), _T("AGA") };
+	int rounds = 100, i, j;
+	size_t size, len = 0;
+	frame_time_t ts, tr;
+	uae_u8 *org, *buf;
+
+	if (more_params (cc))
+		rounds = readint (cc);
+	if (rounds <= 0)
+		rounds = 1;
+	size = savestate_mem_size ();
+	org = xmalloc (uae_u8, size);
+	buf = xmalloc (uae_u8, size);
+	if (!org || !buf)
+		goto end;
+	if (!savestate_save_mem (org, size)) {
+		console_out (_T("in-memory save failed\n"));
+		goto end;
+	}
+	for (j = 0; j < 3; j++) {
+		changed_prefs.chipset_mask = currprefs.chipset_mask = masks[j];
+		ts = read_processor_time ();
+		for (i = 0; i < rounds; i++) {
+			len = savestate_save_mem (buf, size);
+			if (!len)
+				break;
+		}
+		ts = read_processor_time () - ts;
+		if (!len) {
+			console_out_f (_T("%s: in-memory save failed\n"), names[j]);
+			break;
+		}
+		tr = read_processor_time ();
+		for (i = 0; i < rounds; i++) {
+			if (!savestate_restore_mem (buf, size))
+				break;
+		}
+		tr = read_processor_time () - tr;
+		if (i < rounds) {
+			console_out_f (_T("%s: in-memory restore failed\n"), names[j]);
+			break;
+		}
+		console_out_f (_T("%s: %d bytes, save %.1f us, restore %.1f us per state over %d rounds\n"),
+			names[j], (int)len, ts * 1000000.0 / syncbase / rounds, tr * 1000000.0 / syncbase / rounds, rounds);
+	}
+	if (!savestate_restore_mem (org, size))
+		console_out (_T("restoring the original state failed\n"));
+end:
+	xfree (buf);
+	xfree (org);
+#endif
+}
+
 static int debugtest_modes[DEBUGTEST_MAX];
 static const TCHAR *debugtest_names[] = {
 	_T("Blitter"), _T("Keyboard"), _T("Floppy")
@@ -4049,6 +4211,10 @@ static bool debug_line (TCHAR *input)
 					console_out_f (_T("Input logging level %d\n"), inputdevice_logging);
 				} else if (*inptr == 'm') {
 					memory_map_dump_2 (0);
+#ifdef JIT
+				} else if (*inptr == 'J') {
+					compemu_stats ();
+#endif
 				} else if (*inptr == 't') {
 					next_char (&inptr);
 					debugtest_set (&inptr);
@@ -4241,6 +4407,11 @@ static bool debug_line (TCHAR *input)
 			break;
 		case 'v':
 		case 'V':
+			if (cmd == 'v' && *inptr == 't') {
+				next_char (&inptr);
+				dma_trace (&inptr);
+				break;
+			}
 			{
 				int v1 = vpos, v2 = 0;
 				if (more_params (&inptr))
@@ -4267,6 +4438,11 @@ static bool debug_line (TCHAR *input)
 		case 'O':
 			break;
 		case 'b':
+			if (*inptr == 'm') {
+				next_char (&inptr);
+				statemem_benchmark (&inptr);
+				break;
+			}
 			if (staterecorder (&inptr))
 				return true;
 			break;
@@ -0,0 +1,217 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Binary DMA slot trace
+  *
+  * At the end of each frame the used slots of the DMA debugger's records
+  * are packed into one of a few fixed size frame buffers, which a writer
+  * thread compresses into a gzip stream, so the emulation never waits for
+  * the disk. When the writer falls behind, whole frames are dropped and
+  * counted in the next frame header. See dmatrace.h for the format and
+  * tools/dmatracestat for a reader.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <zlib.h>
+
+#include "options.h"
+#include "debug.h"
+#include "threaddep/thread.h"
+#include "dmatrace.h"
+
+#ifdef DEBUGGER
+
+#define DMATRACE_BUFFERS 4
+
+struct dmatrace_buffer
+{
+	uae_u8 *data;
+	int len;
+};
+
+bool dmatrace_active;
+
+static struct dmatrace_buffer dmatrace_buf[DMATRACE_BUFFERS];
+static int dmatrace_maxevents;
+static gzFile dmatrace_gz;
+static bool dmatrace_error;
+/* frames queued by the emulation and written by the writer thread */
+static volatile int dmatrace_wr, dmatrace_rd;
+static uae_u32 dmatrace_frames, dmatrace_dropped, dmatrace_dropped_total;
+static uae_u64 dmatrace_bytes;
+#ifdef SUPPORT_THREADS
+static volatile int dmatrace_quit;
+static bool dmatrace_threaded;
+static uae_sem_t dmatrace_sem;
+static uae_thread_id dmatrace_tid;
+#endif
+
+STATIC_INLINE uae_u8 *put16 (uae_u8 *p, uae_u16 v)
+{
+	p[0] = (uae_u8)v;
+	p[1] = (uae_u8)(v >> 8);
+	return p + 2;
+}
+
+STATIC_INLINE uae_u8 *put32 (uae_u8 *p, uae_u32 v)
+{
+	p = put16 (p, (uae_u16)v);
+	return put16 (p, (uae_u16)(v >> 16));
+}
+
+static void dmatrace_write (const uae_u8 *data, int len)
+{
+	if (dmatrace_error)
+		return;
+	if (gzwrite (dmatrace_gz, data, len) != len) {
+		write_log (_T("DMATRACE: write error, trace truncated\n"));
+		dmatrace_error = true;
+		return;
+	}
+	dmatrace_bytes += len;
+}
+
+#ifdef SUPPORT_THREADS
+static void *dmatrace_thread (void *arg)
+{
+	for (;;) {
+		uae_sem_wait (&dmatrace_sem);
+		while (comm_pipe_load (dmatrace_rd) != comm_pipe_load (dmatrace_wr)) {
+			int rd = dmatrace_rd;
+			struct dmatrace_buffer *b = &dmatrace_buf[rd % DMATRACE_BUFFERS];
+			dmatrace_write (b->data, b->len);
+			comm_pipe_store (dmatrace_rd, rd + 1);
+		}
+		if (comm_pipe_load (dmatrace_quit))
+			break;
+	}
+	return NULL;
+}
+#endif
+
+void dmatrace_frame (const struct dma_rec *rec, int stride, int hmax, int vmax)
+{
+	struct dmatrace_buffer *b;
+	uae_u8 *p;
+	int h, v, n;
+
+	if (!dmatrace_active)
+		return;
+	dmatrace_frames++;
+	if (dmatrace_wr - comm_pipe_load (dmatrace_rd) >= DMATRACE_BUFFERS) {
+		dmatrace_dropped++;
+		dmatrace_dropped_total++;
+		return;
+	}
+
+	b = &dmatrace_buf[dmatrace_wr % DMATRACE_BUFFERS];
+	p = b->data + DMATRACE_FRAME_SIZE;
+	n = 0;
+	for (v = 0; rec && v < vmax; v++) {
+		const struct dma_rec *dr = rec + v * stride;
+		for (h = 0; h < hmax && n < dmatrace_maxevents; h++, dr++) {
+			if (dr->reg == 0xffff && !dr->evt)
+				continue;
+			p = put16 (p, v);
+			*p++ = h;
+			*p++ = dr->reg == 0xffff ? 0 : dr->type;
+			p = put16 (p, dr->reg);
+			*p++ = (uae_u8)dr->evt;
+			*p++ = dr->intlev;
+			p = put32 (p, dr->dat);
+			p = put32 (p, dr->addr);
+			n++;
+		}
+	}
+	p = b->data;
+	p = put32 (p, dmatrace_frames - 1);
+	p = put16 (p, hmax);
+	p = put16 (p, vmax);
+	p = put32 (p, n);
+	put32 (p, dmatrace_dropped);
+	b->len = DMATRACE_FRAME_SIZE + n * DMATRACE_EVENT_SIZE;
+	dmatrace_dropped = 0;
+
+#ifdef SUPPORT_THREADS
+	if (dmatrace_threaded) {
+		comm_pipe_store (dmatrace_wr, dmatrace_wr + 1);
+		uae_sem_post (&dmatrace_sem);
+		return;
+	}
+#endif
+	dmatrace_write (b->data, b->len);
+}
+
+bool dmatrace_start (const TCHAR *name, int maxevents)
+{
+	uae_u8 hdr[DMATRACE_HEADER_SIZE], *p;
+	int i;
+
+	dmatrace_stop ();
+	/* level 1, the writer has to keep up with 50 frames a second */
+	dmatrace_gz = gzopen (name, "wb1");
+	if (!dmatrace_gz)
+		return false;
+	dmatrace_maxevents = maxevents;
+	for (i = 0; i < DMATRACE_BUFFERS; i++) {
+		dmatrace_buf[i].data = xmalloc (uae_u8, DMATRACE_FRAME_SIZE + maxevents * DMATRACE_EVENT_SIZE);
+		dmatrace_buf[i].len = 0;
+		if (!dmatrace_buf[i].data) {
+			dmatrace_active = true;
+			dmatrace_stop ();
+			return false;
+		}
+	}
+	dmatrace_wr = dmatrace_rd = 0;
+	dmatrace_frames = dmatrace_dropped = dmatrace_dropped_total = 0;
+	dmatrace_bytes = 0;
+	dmatrace_error = false;
+
+	memcpy (hdr, DMATRACE_MAGIC, 8);
+	p = put32 (hdr + 8, DMATRACE_VERSION);
+	p = put16 (p, DMATRACE_FRAME_SIZE);
+	put16 (p, DMATRACE_EVENT_SIZE);
+	dmatrace_write (hdr, sizeof hdr);
+
+#ifdef SUPPORT_THREADS
+	dmatrace_quit = 0;
+	uae_sem_init (&dmatrace_sem, 0, 0);
+	dmatrace_threaded = uae_start_thread (_T("dmatrace"), dmatrace_thread, NULL, &dmatrace_tid) != 0;
+	if (!dmatrace_threaded)
+		uae_sem_destroy (&dmatrace_sem);
+#endif
+	dmatrace_active = true;
+	write_log (_T("DMATRACE: tracing to '%s'\n"), name);
+	return true;
+}
+
+void dmatrace_stop (void)
+{
+	int i;
+
+	if (!dmatrace_active)
+		return;
+	dmatrace_active = false;
+#ifdef SUPPORT_THREADS
+	if (dmatrace_threaded) {
+		comm_pipe_store (dmatrace_quit, 1);
+		uae_sem_post (&dmatrace_sem);
+		uae_wait_thread (dmatrace_tid);
+		uae_sem_destroy (&dmatrace_sem);
+		dmatrace_threaded = false;
+	}
+#endif
+	if (dmatrace_gz)
+		gzclose (dmatrace_gz);
+	dmatrace_gz = NULL;
+	for (i = 0; i < DMATRACE_BUFFERS; i++) {
+		xfree (dmatrace_buf[i].data);
+		dmatrace_buf[i].data = NULL;
+	}
+	write_log (_T("DMATRACE: %u frames, %u dropped, %llu bytes before compression\n"),
+		dmatrace_frames, dmatrace_dropped_total, (unsigned long long)dmatrace_bytes);
+}
+
+#endif /* DEBUGGER */
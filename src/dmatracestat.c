@@ -0,0 +1,185 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Per frame DMA slot utilization from a trace written by the debugger's
+  * "vt" command (see include/dmatrace.h for the format).
+  *
+  *  dmatracestat [-c] [-s] <trace>
+  *
+  *  -c  comma separated output
+  *  -s  summary only
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define DMATRACE_FORMAT_ONLY
+#include "dmatrace.h"
+
+/* DMARECORD_* of debug.h */
+#define CHANNELS 11
+static const char *channel_names[CHANNELS] = {
+	"other", "refresh", "cpu", "copper", "audio", "blitter",
+	"blitfill", "blitline", "bitplane", "sprite", "disk"
+};
+
+/* DMA_EVENT_BLITNASTY of debug.h */
+#define EVENT_BLITNASTY 2
+
+struct framestat
+{
+	unsigned long slots;
+	unsigned long used;
+	unsigned long channel[CHANNELS];
+	unsigned long nasty;
+};
+
+static int csv;
+
+static unsigned int get16 (const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned long get32 (const unsigned char *p)
+{
+	return get16 (p) | ((unsigned long)get16 (p + 2) << 16);
+}
+
+static int readall (gzFile f, void *buf, int len)
+{
+	return gzread (f, buf, len) == len;
+}
+
+static void print_header (void)
+{
+	int i;
+
+	if (csv) {
+		printf ("frame,dropped,slots,used,percent");
+		for (i = 0; i < CHANNELS; i++)
+			printf (",%s", channel_names[i]);
+		printf (",blitnasty\n");
+	} else {
+		printf ("%8s %5s %6s %6s %6s", "frame", "drop", "slots", "used", "%");
+		for (i = 0; i < CHANNELS; i++)
+			printf (" %8s", channel_names[i]);
+		printf (" %8s\n", "nasty");
+	}
+}
+
+static void print_stat (const char *label, unsigned long dropped, const struct framestat *fs, double div)
+{
+	double pct = fs->slots ? 100.0 * fs->used / fs->slots : 0;
+	int i;
+
+	if (csv) {
+		printf ("%s,%lu,%.1f,%.1f,%.2f", label, dropped, fs->slots / div, fs->used / div, pct);
+		for (i = 0; i < CHANNELS; i++)
+			printf (",%.1f", fs->channel[i] / div);
+		printf (",%.1f\n", fs->nasty / div);
+	} else {
+		printf ("%8s %5lu %6.0f %6.0f %6.2f", label, dropped, fs->slots / div, fs->used / div, pct);
+		for (i = 0; i < CHANNELS; i++)
+			printf (" %8.0f", fs->channel[i] / div);
+		printf (" %8.0f\n", fs->nasty / div);
+	}
+}
+
+int main (int argc, char **argv)
+{
+	unsigned char hdr[DMATRACE_HEADER_SIZE], fh[DMATRACE_FRAME_SIZE], ev[DMATRACE_EVENT_SIZE];
+	struct framestat total, fs;
+	unsigned long frames = 0, dropped_total = 0, peak_used = 0;
+	int summary = 0;
+	const char *name = NULL;
+	int framesize, eventsize;
+	gzFile f;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp (argv[i], "-c"))
+			csv = 1;
+		else if (!strcmp (argv[i], "-s"))
+			summary = 1;
+		else
+			name = argv[i];
+	}
+	if (!name) {
+		fprintf (stderr, "usage: %s [-c] [-s] <trace>\n", argv[0]);
+		return 1;
+	}
+	f = gzopen (name, "rb");
+	if (!f) {
+		fprintf (stderr, "can't open '%s'\n", name);
+		return 1;
+	}
+	if (!readall (f, hdr, sizeof hdr) || memcmp (hdr, DMATRACE_MAGIC, 8)) {
+		fprintf (stderr, "'%s' is not a DMA trace\n", name);
+		return 1;
+	}
+	if (get32 (hdr + 8) != DMATRACE_VERSION) {
+		fprintf (stderr, "unsupported trace version %lu\n", get32 (hdr + 8));
+		return 1;
+	}
+	framesize = get16 (hdr + 12);
+	eventsize = get16 (hdr + 14);
+	if (framesize < DMATRACE_FRAME_SIZE || framesize > sizeof fh || eventsize < DMATRACE_EVENT_SIZE || eventsize > sizeof ev) {
+		fprintf (stderr, "unsupported record sizes %d/%d\n", framesize, eventsize);
+		return 1;
+	}
+
+	memset (&total, 0, sizeof total);
+	if (!summary)
+		print_header ();
+	while (readall (f, fh, framesize)) {
+		unsigned long frame = get32 (fh);
+		unsigned long hmax = get16 (fh + 4), vmax = get16 (fh + 6);
+		unsigned long events = get32 (fh + 8), dropped = get32 (fh + 12);
+		char label[16];
+
+		memset (&fs, 0, sizeof fs);
+		fs.slots = hmax * vmax;
+		while (events-- > 0) {
+			unsigned int ch;
+			if (!readall (f, ev, eventsize)) {
+				fprintf (stderr, "trace truncated in frame %lu\n", frame);
+				goto end;
+			}
+			if (ev[6] & EVENT_BLITNASTY)
+				fs.nasty++;
+			if (get16 (ev + 4) == 0xffff)
+				continue;
+			ch = ev[3] < CHANNELS ? ev[3] : 0;
+			fs.channel[ch]++;
+			fs.used++;
+		}
+		frames++;
+		dropped_total += dropped;
+		if (fs.used > peak_used)
+			peak_used = fs.used;
+		total.slots += fs.slots;
+		total.used += fs.used;
+		total.nasty += fs.nasty;
+		for (i = 0; i < CHANNELS; i++)
+			total.channel[i] += fs.channel[i];
+		if (!summary) {
+			sprintf (label, "%lu", frame);
+			print_stat (label, dropped, &fs, 1.0);
+		}
+	}
+end:
+	gzclose (f);
+	if (!frames) {
+		fprintf (stderr, "no frames\n");
+		return 1;
+	}
+	if (summary)
+		print_header ();
+	print_stat ("average", dropped_total, &total, frames);
+	if (!csv)
+		printf ("%lu frames, %lu dropped, peak %lu used slots per frame\n", frames, dropped_total, peak_used);
+	return 0;
+}
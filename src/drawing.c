@@ -66,16 +66,25 @@ int debug_bpl_mask = 0xff, debug_bpl_mask_one;
 
 static void lores_reset (void)
 {
-	lores_factor = currprefs.gfx_resolution ? 2 : 1;
-	lores_shift = currprefs.gfx_resolution;
+	int factor, shift, sprres;
+
+	factor = currprefs.gfx_resolution ? 2 : 1;
+	shift = currprefs.gfx_resolution;
 	if (doublescan > 0) {
-		if (lores_shift < 2)
-			lores_shift++;
-		lores_factor = 2;
-	}
-	sprite_buffer_res = currprefs.gfx_resolution;
-	if (doublescan > 0 && sprite_buffer_res < RES_SUPERHIRES)
-		sprite_buffer_res++;
+		if (shift < 2)
+			shift++;
+		factor = 2;
+	}
+	sprres = currprefs.gfx_resolution;
+	if (doublescan > 0 && sprres < RES_SUPERHIRES)
+		sprres++;
+	/* The render thread may still be drawing the previous frame with
+	   the old values.  */
+	if (factor != lores_factor || shift != lores_shift || sprres != sprite_buffer_res)
+		drawing_thread_wait (false);
+	lores_factor = factor;
+	lores_shift = shift;
+	sprite_buffer_res = sprres;
 }
 
 bool aga_mode; /* mirror of chipset_mask & CSMASK_AGA */
@@ -245,6 +254,24 @@ int framecnt = 0;
 static int frame_redraw_necessary;
 static int picasso_redraw_necessary;
 
+#ifdef SMART_UPDATE
+/* Signature of everything the output row was last rendered from, h is 0
+ * if unknown. Two independent 64 bit hashes and the number of words fed
+ * to them all have to match before a row is skipped, a collision of one
+ * hash alone would leave stale pixels. A frame that has to be redrawn
+ * completely gets a new seed.  */
+struct row_sig {
+	uae_u64 h, h2;
+	uae_u32 len;
+};
+static struct row_sig row_hash[MAX_UAE_HEIGHT + 1];
+static uae_u64 row_hash_seed;
+/* hash of each color table and the frame it was made in */
+static struct row_sig row_hash_ctab[COLOR_TABLE_SIZE];
+static uae_u32 row_hash_ctab_frame[COLOR_TABLE_SIZE];
+static uae_u32 row_hash_frameno = 1;
+#endif
+
 #ifdef XLINECHECK
 static void xlinecheck (unsigned int start, unsigned int end)
 {
@@ -413,6 +440,7 @@ void set_custom_limits (int w, int h, int dx, int dy)
 	int vts = visible_top_start;
 	int vbs = visible_bottom_stop;
 
+	drawing_thread_wait (false);
 	if (w <= 0 || dx < 0) {
 		visible_left_start = 0;
 		visible_right_stop = MAX_STOP;
@@ -666,6 +694,22 @@ void get_custom_mouse_limits (int *pw, int *ph, int *pdx, int *pdy, int dbl)
 static struct decision *dp_for_drawing;
 static struct draw_info *dip_for_drawing;
 
+/* The frame the line renderer works on. Without the render thread these
+   point to the live chipset tables, with it to the tables of the previous
+   frame, which custom.c no longer writes to.  */
+static struct decision *draw_decisions;
+static uae_u8 (*draw_line_data)[MAX_PLANES * MAX_WORDS_PER_LINE * 2];
+static struct draw_info *draw_drawinfo;
+static struct color_change *draw_color_changes;
+static struct sprite_entry *draw_sprite_entries;
+static struct color_entry *draw_color_tables;
+
+/* Line flushes of a frame drawn by the render thread, passed on to the
+   graphics driver by the emulation thread.  */
+static bool render_deferflush;
+static int render_flushes[LINESTATE_SIZE * 2];
+static int render_flush_count;
+
 /* Record DIW of the current line for use by centering code.  */
 void record_diw_line (int plfstrt, int first, int last)
 {
@@ -804,11 +848,11 @@ static void pfield_init_linetoscr (bool border)
 		int min = visible_right_border, max = visible_left_border, i;
 		for (i = 0; i < dip_for_drawing->nr_sprites; i++) {
 			int x;
-			x = curr_sprite_entries[dip_for_drawing->first_sprite_entry + i].pos;
+			x = draw_sprite_entries[dip_for_drawing->first_sprite_entry + i].pos;
 			if (x < min)
 				min = x;
 			// include max extra pixels, sprite may be 2x or 4x size: 4x - 1.
-			x = curr_sprite_entries[dip_for_drawing->first_sprite_entry + i].max + (4 - 1);
+			x = draw_sprite_entries[dip_for_drawing->first_sprite_entry + i].max + (4 - 1);
 			if (x > max)
 				max = x;
 		}
@@ -1969,7 +2013,7 @@ static void pfield_doline (int lineno)
 	uae_u32 *data = pixdata.apixels_l + MAX_PIXELS_PER_LINE / 4;
 
 #ifdef SMART_UPDATE
-#define DATA_POINTER(n) ((debug_bpl_mask & (1 << n)) ? (line_data[lineno] + (n) * MAX_WORDS_PER_LINE * 2) : (debug_bpl_mask_one ? all_ones : all_zeros))
+#define DATA_POINTER(n) ((debug_bpl_mask & (1 << n)) ? (draw_line_data[lineno] + (n) * MAX_WORDS_PER_LINE * 2) : (debug_bpl_mask_one ? all_ones : all_zeros))
 	real_bplpt[0] = DATA_POINTER (0);
 	real_bplpt[1] = DATA_POINTER (1);
 	real_bplpt[2] = DATA_POINTER (2);
@@ -2004,6 +2048,7 @@ void init_row_map (void)
 	static int oldheight, oldpitch;
 	int i, j;
 
+	drawing_thread_wait (false);
 	if (gfxvidinfo.height_allocated > MAX_UAE_HEIGHT) {
 		write_log (_T("Resolution too high, aborting\n"));
 		abort ();
@@ -2020,6 +2065,9 @@ void init_row_map (void)
 		row_map[i] = row_tmp;
 	for (i = 0, j = 0; i < gfxvidinfo.height_allocated; i++, j += gfxvidinfo.rowbytes)
 		row_map[i] = gfxvidinfo.bufmem + j;
+#ifdef SMART_UPDATE
+	memset (row_hash, 0, sizeof row_hash);
+#endif
 	oldbufmem = gfxvidinfo.bufmem;
 	oldheight = gfxvidinfo.height_allocated;
 	oldpitch = gfxvidinfo.rowbytes;
@@ -2029,6 +2077,7 @@ void init_aspect_maps (void)
 {
 	int i, maxl, h;
 
+	drawing_thread_wait (false);
 	h = gfxvidinfo.height_allocated;
 
 	if (h == 0)
@@ -2117,6 +2166,11 @@ static void do_flush_line_1 (int lineno)
 
 STATIC_INLINE void do_flush_line (int lineno)
 {
+	if (render_deferflush) {
+		if (render_flush_count < sizeof render_flushes / sizeof *render_flushes)
+			render_flushes[render_flush_count++] = lineno;
+		return;
+	}
 	do_flush_line_1 (lineno);
 }
 
@@ -2237,18 +2291,18 @@ static void adjust_drawing_colors (int ctable, int need_full)
 {
 	if (drawing_color_matches != ctable || need_full < 0) {
 		if (need_full) {
-			color_reg_cpy (&colors_for_drawing, curr_color_tables + ctable);
+			color_reg_cpy (&colors_for_drawing, draw_color_tables + ctable);
 			color_match_type = color_match_full;
 		} else {
-			memcpy (colors_for_drawing.acolors, curr_color_tables[ctable].acolors,
+			memcpy (colors_for_drawing.acolors, draw_color_tables[ctable].acolors,
 				sizeof colors_for_drawing.acolors);
-			colors_for_drawing.borderblank = curr_color_tables[ctable].borderblank;
-			colors_for_drawing.bordersprite = curr_color_tables[ctable].bordersprite;
+			colors_for_drawing.borderblank = draw_color_tables[ctable].borderblank;
+			colors_for_drawing.bordersprite = draw_color_tables[ctable].bordersprite;
 			color_match_type = color_match_acolors;
 		}
 		drawing_color_matches = ctable;
 	} else if (need_full && color_match_type != color_match_full) {
-		color_reg_cpy (&colors_for_drawing, &curr_color_tables[ctable]);
+		color_reg_cpy (&colors_for_drawing, &draw_color_tables[ctable]);
 		color_match_type = color_match_full;
 	}
 }
@@ -2278,14 +2332,14 @@ static void do_color_changes (line_draw_func worker_border, line_draw_func worke
 	int endpos = visible_left_border + gfxvidinfo.inwidth;
 
 	for (i = dip_for_drawing->first_color_change; i <= dip_for_drawing->last_color_change; i++) {
-		int regno = curr_color_changes[i].regno;
-		unsigned int value = curr_color_changes[i].value;
+		int regno = draw_color_changes[i].regno;
+		unsigned int value = draw_color_changes[i].value;
 		int nextpos, nextpos_in_range;
 
 		if (i == dip_for_drawing->last_color_change)
 			nextpos = endpos;
 		else
-			nextpos = coord_hw_to_window_x (curr_color_changes[i].linepos);
+			nextpos = coord_hw_to_window_x (draw_color_changes[i].linepos);
 
 		nextpos_in_range = nextpos;
 		if (nextpos > endpos)
@@ -2356,7 +2410,7 @@ static void do_color_changes (line_draw_func worker_border, line_draw_func worke
 
 STATIC_INLINE bool is_color_changes(struct draw_info *di)
 {
-	int regno = curr_color_changes[di->first_color_change].regno;
+	int regno = draw_color_changes[di->first_color_change].regno;
 	int changes = di->nr_color_changes;
 	return changes > 1 || (changes == 1 && regno != 0xffff && regno != -1);
 }
@@ -2367,22 +2421,179 @@ enum double_how {
 	dh_emerg
 };
 
-static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
+/* A line of the display as decided by the emulation thread, the rest of
+   the work is done by render_draw_line ().  */
+struct draw_line {
+	int lineno;
+	/* line_decisions/drawinfo entry, lineno - 1 for doubled lines */
+	int src;
+	int gfx_ypos, follow_ypos;
+	int border;
+	int do_double;
+};
+
+#ifdef SMART_UPDATE
+/*
+ * Second level of smart update. custom.c flags a line as changed when any
+ * of its decisions, color changes or sprites differ from the previous
+ * frame, which also happens when the copper rewrites the same colors with
+ * different timing or a sprite moves back to where it was two frames ago.
+ * render_draw_line () hashes the inputs of the line and skips linetoscr
+ * and the flush if the output row already holds that line.
+ */
+
+STATIC_INLINE void row_hash_mix (struct row_sig *s, uae_u32 v)
 {
-// REMOVEME: static int warned = 0;
-	int border = 0;
-	int do_double = 0;
-	bool have_color_changes;
-	enum double_how dh;
+	uae_u64 h = (s->h ^ v) * 0x9e3779b97f4a7c15ULL;
+	uae_u64 h2 = (s->h2 + v) * 0xff51afd7ed558ccdULL;
+	s->h = h ^ (h >> 29);
+	s->h2 = h2 ^ (h2 >> 32);
+	s->len++;
+}
 
-	dp_for_drawing = line_decisions + lineno;
-	dip_for_drawing = curr_drawinfo + lineno;
+static void row_hash_bytes (struct row_sig *s, const uae_u8 *p, int len)
+{
+	uae_u32 v;
+
+	for (; len >= 4; len -= 4, p += 4) {
+		memcpy (&v, p, 4);
+		row_hash_mix (s, v);
+	}
+	for (; len > 0; len--)
+		row_hash_mix (s, *p++);
+}
 
-	if (dp_for_drawing->plfleft >= 0) {
+/* Color tables are shared by many lines, hash each one once per frame,
+   only the registers of the current chipset */
+static void row_hash_colors (struct row_sig *s, int ctable)
+{
+	struct color_entry *ce = draw_color_tables + ctable;
+	struct row_sig *c = &row_hash_ctab[ctable];
+
+	if (row_hash_ctab_frame[ctable] != row_hash_frameno) {
+		memset (c, 0, sizeof *c);
+#ifdef AGA
+		if (aga_mode) {
+			row_hash_bytes (c, (uae_u8*)ce->acolors, 256 * sizeof (xcolnr));
+			row_hash_bytes (c, (uae_u8*)ce->color_regs_aga, sizeof ce->color_regs_aga);
+		} else
+#endif
+		{
+			row_hash_bytes (c, (uae_u8*)ce->acolors, 32 * sizeof (xcolnr));
+			row_hash_bytes (c, (uae_u8*)ce->color_regs_ecs, sizeof ce->color_regs_ecs);
+		}
+		row_hash_mix (c, ce->borderblank | (ce->bordersprite << 1));
+		row_hash_ctab_frame[ctable] = row_hash_frameno;
+	}
+	row_hash_mix (s, (uae_u32)c->h);
+	row_hash_mix (s, (uae_u32)(c->h >> 32));
+	row_hash_mix (s, (uae_u32)c->h2);
+	row_hash_mix (s, (uae_u32)(c->h2 >> 32));
+}
+
+static void row_hash_line (struct row_sig *s, int lineno, int border, int do_double)
+{
+	struct decision *dp = dp_for_drawing;
+	struct draw_info *dip = dip_for_drawing;
+	int i;
+
+	s->h = row_hash_seed;
+	s->h2 = row_hash_seed ^ 0x6a09e667f3bcc909ULL;
+	s->len = 0;
+	row_hash_mix (s, border | (do_double << 2) | ((lineno - (dp - draw_decisions)) << 3));
+	row_hash_mix (s, visible_left_border);
+	row_hash_mix (s, visible_right_border);
+	row_hash_mix (s, linetoscr_x_adjust_bytes);
+	row_hash_mix (s, lores_shift);
+	row_hash_mix (s, gfxvidinfo.inwidth);
+	row_hash_mix (s, gfxvidinfo.pixbytes);
+	row_hash_mix (s, debug_bpl_mask | (debug_bpl_mask_one << 8));
+
+	row_hash_mix (s, dp->plfleft);
+	row_hash_mix (s, dp->plfright);
+	row_hash_mix (s, dp->plflinelen);
+	row_hash_mix (s, dp->diwfirstword);
+	row_hash_mix (s, dp->diwlastword);
+	row_hash_mix (s, dp->bplcon0 | (dp->bplcon2 << 16));
+#ifdef AGA
+	row_hash_mix (s, dp->bplcon3 | (dp->bplcon4 << 16));
+#endif
+	row_hash_mix (s, dp->nr_planes | (dp->bplres << 8) | (dp->ehb_seen << 16)
+		| (dp->ham_seen << 17) | (dp->ham_at_start << 18) | (dp->bordersprite_seen << 19));
+	if (border >= 0)
+		row_hash_colors (s, dp->ctable);
+
+	if (border == 0 && dp->plflinelen > 0) {
+		int len = dp->plflinelen * 4;
+		if (len > MAX_WORDS_PER_LINE * 2)
+			len = MAX_WORDS_PER_LINE * 2;
+		for (i = 0; i < dp->nr_planes && i < MAX_PLANES; i++) {
+			if (debug_bpl_mask & (1 << i))
+				row_hash_bytes (s, draw_line_data[lineno] + i * MAX_WORDS_PER_LINE * 2, len);
+		}
+	}
+
+	row_hash_mix (s, dip->nr_color_changes);
+	for (i = dip->first_color_change; i <= dip->last_color_change; i++) {
+		struct color_change *cc = draw_color_changes + i;
+		row_hash_mix (s, cc->linepos);
+		row_hash_mix (s, cc->regno);
+		row_hash_mix (s, cc->value);
+	}
+
+	row_hash_mix (s, dip->nr_sprites);
+	for (i = 0; i < dip->nr_sprites; i++) {
+		struct sprite_entry *e = draw_sprite_entries + dip->first_sprite_entry + i;
+		int n = e->max - e->pos;
+		row_hash_mix (s, e->pos | (e->max << 16));
+		row_hash_mix (s, e->has_attached);
+		row_hash_bytes (s, (uae_u8*)(spixels + e->first_pixel), n * sizeof (uae_u16));
+		row_hash_bytes (s, spixstate.bytes + e->first_pixel, n);
+	}
+	if (!s->h)
+		s->h = 1;
+}
+
+STATIC_INLINE bool row_sig_equal (const struct row_sig *a, const struct row_sig *b)
+{
+	return a->h == b->h && a->h2 == b->h2 && a->len == b->len;
+}
+
+/* A frame that is drawn completely, whatever the rows already hold */
+static void row_hash_invalidate (void)
+{
+	row_hash_seed++;
+}
+
+static void row_hash_frame (void)
+{
+	/* 0 marks tables never hashed */
+	if (++row_hash_frameno == 0)
+		row_hash_frameno = 1;
+	if (frame_redraw_necessary)
+		row_hash_invalidate ();
+}
+#endif
+
+/* Advance the line state and decide what needs to be drawn. Returns false
+   if the line is unchanged.  */
+static bool plan_draw_line (struct draw_line *l, int lineno, int gfx_ypos, int follow_ypos)
+{
+// REMOVEME: static int warned = 0;
+	struct decision *dp = line_decisions + lineno;
+
+	if (dp->plfleft >= 0) {
 		lines_count++;
-		resolution_count[dp_for_drawing->bplres]++;
+		resolution_count[dp->bplres]++;
 	}
 
+	l->lineno = lineno;
+	l->src = lineno;
+	l->gfx_ypos = gfx_ypos;
+	l->follow_ypos = follow_ypos;
+	l->border = 0;
+	l->do_double = 0;
+
 	switch (linestate[lineno])
 	{
 	case LINE_REMEMBERED_AS_PREVIOUS:
@@ -2390,42 +2601,69 @@ static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
 		if (!warned) // happens when program messes up with VPOSW
 			write_log (_T("Shouldn't get here... this is a bug.\n")), warned++;
 #endif
-		return;
+		return false;
 
 	case LINE_BLACK:
 		linestate[lineno] = LINE_REMEMBERED_AS_BLACK;
-		border = -1;
+		l->border = -1;
 		break;
 
 	case LINE_REMEMBERED_AS_BLACK:
-		return;
+		return false;
 
 	case LINE_AS_PREVIOUS:
-		dp_for_drawing--;
-		dip_for_drawing--;
+		dp--;
+		l->src--;
 		linestate[lineno] = LINE_DONE_AS_PREVIOUS;
-		if (dp_for_drawing->plfleft < 0)
-			border = 1;
+		if (dp->plfleft < 0)
+			l->border = 1;
 		break;
 
 	case LINE_DONE_AS_PREVIOUS:
 		/* fall through */
 	case LINE_DONE:
-		return;
+		return false;
 
 	case LINE_DECIDED_DOUBLE:
 		if (follow_ypos >= 0) {
-			do_double = 1;
+			l->do_double = 1;
 			linestate[lineno + 1] = LINE_DONE_AS_PREVIOUS;
 		}
 
 		/* fall through */
 	default:
-		if (dp_for_drawing->plfleft < 0)
-			border = 1;
+		if (dp->plfleft < 0)
+			l->border = 1;
 		linestate[lineno] = LINE_DONE;
 		break;
 	}
+	return true;
+}
+
+static void render_draw_line (const struct draw_line *l)
+{
+	int lineno = l->lineno;
+	int gfx_ypos = l->gfx_ypos;
+	int follow_ypos = l->follow_ypos;
+	int border = l->border;
+	int do_double = l->do_double;
+	bool have_color_changes;
+	enum double_how dh;
+
+	dp_for_drawing = draw_decisions + l->src;
+	dip_for_drawing = draw_drawinfo + l->src;
+
+#ifdef SMART_UPDATE
+	{
+		struct row_sig rs;
+		row_hash_line (&rs, lineno, border, do_double);
+		if (row_sig_equal (&row_hash[gfx_ypos], &rs) && (!do_double || row_sig_equal (&row_hash[follow_ypos], &rs)))
+			return;
+		row_hash[gfx_ypos] = rs;
+		if (do_double)
+			row_hash[follow_ypos] = rs;
+	}
+#endif
 
 	have_color_changes = is_color_changes(dip_for_drawing);
 
@@ -2472,10 +2710,10 @@ static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
 			for (i = 0; i < dip_for_drawing->nr_sprites; i++) {
 #ifdef AGA
 				if (currprefs.chipset_mask & CSMASK_AGA)
-					draw_sprites_aga (curr_sprite_entries + dip_for_drawing->first_sprite_entry + i, 1);
+					draw_sprites_aga (draw_sprite_entries + dip_for_drawing->first_sprite_entry + i, 1);
 				else
 #endif
-					draw_sprites_ecs (curr_sprite_entries + dip_for_drawing->first_sprite_entry + i);
+					draw_sprites_ecs (draw_sprite_entries + dip_for_drawing->first_sprite_entry + i);
 			}
 		}
 
@@ -2546,7 +2784,7 @@ static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
 
 			int i;
 			for (i = 0; i < dip_for_drawing->nr_sprites; i++)
-				draw_sprites_aga (curr_sprite_entries + dip_for_drawing->first_sprite_entry + i, 1);
+				draw_sprites_aga (draw_sprite_entries + dip_for_drawing->first_sprite_entry + i, 1);
 			do_color_changes (pfield_do_linetoscr_bordersprite_aga, pfield_do_linetoscr_bordersprite_aga, lineno);
 #else
 		if (0) {
@@ -2584,8 +2822,29 @@ static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
 	}
 }
 
-static void center_image (void)
+static void draw_use_current (void)
+{
+	draw_decisions = line_decisions;
+	draw_line_data = line_data;
+	draw_drawinfo = curr_drawinfo;
+	draw_color_changes = curr_color_changes;
+	draw_sprite_entries = curr_sprite_entries;
+	draw_color_tables = curr_color_tables;
+}
+
+static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
+{
+	struct draw_line l;
+
+	if (!plan_draw_line (&l, lineno, gfx_ypos, follow_ypos))
+		return;
+	draw_use_current ();
+	render_draw_line (&l);
+}
+
+static bool center_image (void)
 {
+	bool changed;
 	int prev_x_adjust = visible_left_border;
 	int prev_y_adjust = thisframe_y_adjust;
 
@@ -2660,7 +2919,8 @@ static void center_image (void)
 	thisframe_y_adjust_real = thisframe_y_adjust << linedbl;
 	max_ypos_thisframe = (maxvpos_display - minfirstline + 1) << linedbl;
 
-	if (prev_x_adjust != visible_left_border || prev_y_adjust != thisframe_y_adjust)
+	changed = prev_x_adjust != visible_left_border || prev_y_adjust != thisframe_y_adjust;
+	if (changed)
 		frame_redraw_necessary |= interlace_seen > 0 && linedbl ? 2 : 1;
 
 	max_diwstop = 0;
@@ -2672,6 +2932,26 @@ static void center_image (void)
 	center_reset = false;
 	horizontal_changed = false;
 	vertical_changed = false;
+	return changed;
+}
+
+/* Set when finish_drawing_frame () already centered for the next frame */
+static bool center_done;
+
+static bool center_frame (void)
+{
+	bool changed;
+
+	if (thisframe_first_drawn_line < 0)
+		thisframe_first_drawn_line = minfirstline;
+	if (thisframe_first_drawn_line > thisframe_last_drawn_line)
+		thisframe_last_drawn_line = thisframe_first_drawn_line;
+
+	changed = center_image ();
+
+	thisframe_first_drawn_line = -1;
+	thisframe_last_drawn_line = -1;
+	return changed;
 }
 
 static int frame_res_cnt;
@@ -2814,11 +3094,6 @@ static void init_drawing_frame (void)
 
 	init_hardware_for_drawing_frame ();
 
-	if (thisframe_first_drawn_line < 0)
-		thisframe_first_drawn_line = minfirstline;
-	if (thisframe_first_drawn_line > thisframe_last_drawn_line)
-		thisframe_last_drawn_line = thisframe_first_drawn_line;
-
 	maxline = ((maxvpos_display + 1) << linedbl) + 2;
 #ifdef SMART_UPDATE
 	for (i = 0; i < maxline; i++) {
@@ -2843,12 +3118,15 @@ static void init_drawing_frame (void)
 	if (frame_redraw_necessary)
 		frame_redraw_necessary--;
 
-	center_image ();
-
-	thisframe_first_drawn_line = -1;
-	thisframe_last_drawn_line = -1;
+	if (!center_done)
+		center_frame ();
+	center_done = false;
 
+#ifndef SMART_UPDATE
+	/* Lines are drawn as they complete. Otherwise drawing_thread_wait ()
+	   resets it, the render thread may still be using it now.  */
 	drawing_color_matches = -1;
+#endif
 }
 
 void putpixel (uae_u8 *buf, int bpp, int x, xcolnr c8, int opaq)
@@ -2903,6 +3181,9 @@ static void draw_status_line (int line, int statusy)
 	xlinebuffer = gfxvidinfo.linemem;
 	if (xlinebuffer == 0)
 		xlinebuffer = row_map[line];
+#ifdef SMART_UPDATE
+	row_hash[line].h = 0;
+#endif
 	buf = xlinebuffer;
 	draw_status_line_single (buf, bpp, statusy, gfxvidinfo.outwidth, xredcolors, xgreencolors, xbluecolors, NULL);
 }
@@ -2912,6 +3193,9 @@ static void draw_debug_status_line (int line)
 	xlinebuffer = gfxvidinfo.linemem;
 	if (xlinebuffer == 0)
 		xlinebuffer = row_map[line];
+#ifdef SMART_UPDATE
+	row_hash[line].h = 0;
+#endif
 #ifdef DEBUGGER
 	debug_draw_cycles (xlinebuffer, gfxvidinfo.pixbytes, line, gfxvidinfo.outwidth, gfxvidinfo.outheight, xredcolors, xgreencolors, xbluecolors);
 #endif
@@ -3017,6 +3301,10 @@ static void lightpen_update (void)
 static void draw_frame2 (void)
 {
 	int i;
+
+#ifdef SMART_UPDATE
+	row_hash_frame ();
+#endif
 	for ( i = 0; i < max_ypos_thisframe; i++) {
 		int i1 = i + min_ypos_for_screen;
 		int line = i + thisframe_y_adjust_real;
@@ -3031,12 +3319,12 @@ static void draw_frame2 (void)
 	}
 }
 
-bool draw_frame (struct vidbuffer *vb)
+/* Make every line of the frame be drawn again */
+static void linestate_redraw (void)
 {
-	uae_u8 oldstate[LINESTATE_SIZE];
-
-	init_row_map ();
-	memcpy (oldstate, linestate, LINESTATE_SIZE);
+#ifdef SMART_UPDATE
+	row_hash_invalidate ();
+#endif
 	for (int i = 0; i < LINESTATE_SIZE; i++) {
 		uae_u8 v = linestate[i];
 		if (v == LINE_REMEMBERED_AS_PREVIOUS) {
@@ -3052,6 +3340,206 @@ bool draw_frame (struct vidbuffer *vb)
 		}
 		linestate[i] = v;
 	}
+}
+
+/*
+ * Optional render thread (gfx_render_thread)
+ *
+ * finish_drawing_frame () only decides which lines need to be drawn and
+ * copies the line_decisions and line_data entries custom.c is going to
+ * overwrite, the other tables are double buffered already. The lines are
+ * then drawn while the next frame is emulated, which means the display
+ * lags one frame behind. Flushes are recorded and passed on to the
+ * graphics driver by the emulation thread when the frame is collected at
+ * the next vsync, status line and debug overlays are drawn at that point.
+ */
+
+enum render_job_state {
+	RENDER_IDLE,
+	RENDER_PLANNED,
+	RENDER_RUNNING
+};
+
+static enum render_job_state render_state;
+static bool render_thread_started, render_thread_failed;
+static uae_thread_id render_tid;
+static uae_sem_t render_start_sem, render_done_sem;
+static struct draw_line render_lines[LINESTATE_SIZE];
+static int render_line_count;
+static struct decision render_decisions[LINESTATE_SIZE];
+static uae_u8 (*render_line_data)[MAX_PLANES * MAX_WORDS_PER_LINE * 2];
+
+static bool render_threaded (void)
+{
+#ifdef SMART_UPDATE
+	/* linemem is one shared line that flush_line () has to copy at once */
+	return currprefs.gfx_render_thread && gfxvidinfo.linemem == 0;
+#else
+	return false;
+#endif
+}
+
+static void render_run (void)
+{
+	int i;
+
+	render_deferflush = true;
+	render_flush_count = 0;
+	drawing_color_matches = -1;
+	for (i = 0; i < render_line_count; i++) {
+		hposblank = 0;
+		render_draw_line (&render_lines[i]);
+	}
+	render_deferflush = false;
+}
+
+static void *render_thread (void *v)
+{
+	for (;;) {
+		uae_sem_wait (&render_start_sem);
+		render_run ();
+		uae_sem_post (&render_done_sem);
+	}
+	return NULL;
+}
+
+static bool render_thread_init (void)
+{
+	if (render_thread_started)
+		return true;
+	if (render_thread_failed)
+		return false;
+	render_thread_failed = true;
+	if (!render_line_data)
+		render_line_data = (uae_u8 (*)[MAX_PLANES * MAX_WORDS_PER_LINE * 2])xmalloc (uae_u8, LINESTATE_SIZE * sizeof *render_line_data);
+	if (!render_line_data)
+		return false;
+	uae_sem_init (&render_start_sem, 0, 0);
+	uae_sem_init (&render_done_sem, 0, 0);
+	if (!uae_start_thread (_T("render"), render_thread, NULL, &render_tid)) {
+		write_log (_T("Render thread failed to start, drawing synchronously\n"));
+		uae_sem_destroy (&render_start_sem);
+		uae_sem_destroy (&render_done_sem);
+		return false;
+	}
+	render_thread_started = true;
+	render_thread_failed = false;
+	return true;
+}
+
+static void finish_drawing_frame_overlay (void);
+
+/* Hand the recorded flushes of a rendered frame to the graphics driver */
+static void render_collect (void)
+{
+	int i;
+
+	last_drawn_line = 0;
+	first_drawn_line = 32767;
+	first_block_line = last_block_line = NO_BLOCK;
+	for (i = 0; i < render_flush_count; i++)
+		do_flush_line_1 (render_flushes[i]);
+	render_flush_count = 0;
+	finish_drawing_frame_overlay ();
+}
+
+/* Decide the lines of the frame that just ended, rendering starts at
+   drawing_thread_kick ().  */
+static bool render_plan_frame (void)
+{
+	int i;
+
+	if (!render_thread_init ())
+		return false;
+
+	/* Center now, not at the start of the next frame, the geometry must
+	   not change under the render thread. Lines that were found unchanged
+	   have to be drawn again if it moved.  */
+	if (center_frame ())
+		linestate_redraw ();
+	center_done = true;
+#ifdef SMART_UPDATE
+	row_hash_frame ();
+#endif
+
+	render_line_count = 0;
+	for (i = 0; i < max_ypos_thisframe; i++) {
+		int i1 = i + min_ypos_for_screen;
+		int line = i + thisframe_y_adjust_real;
+		int where2 = amiga2aspect_line_map[i1];
+		struct draw_line *l = &render_lines[render_line_count];
+
+		if (where2 >= gfxvidinfo.inheight)
+			break;
+		if (where2 < 0)
+			continue;
+		if (!plan_draw_line (l, line, where2, amiga2aspect_line_map[i1 + 1]))
+			continue;
+		render_decisions[l->src] = line_decisions[l->src];
+		if (l->border == 0)
+			memcpy (render_line_data[l->lineno], line_data[l->lineno], sizeof *render_line_data);
+		render_line_count++;
+	}
+
+	draw_decisions = render_decisions;
+	draw_line_data = render_line_data;
+	draw_drawinfo = curr_drawinfo;
+	draw_color_changes = curr_color_changes;
+	draw_sprite_entries = curr_sprite_entries;
+	draw_color_tables = curr_color_tables;
+	render_state = RENDER_PLANNED;
+	return true;
+}
+
+/* Start rendering the planned frame, called once the vsync handling that
+   may still change the display setup is done.  */
+void drawing_thread_kick (void)
+{
+	if (render_state != RENDER_PLANNED)
+		return;
+	if (!lockscr ()) {
+		render_state = RENDER_IDLE;
+		notice_screen_contents_lost ();
+		return;
+	}
+	render_state = RENDER_RUNNING;
+	uae_sem_post (&render_start_sem);
+}
+
+/* Complete an outstanding frame. A frame that has not been started yet
+   is rendered now unless <discard> is set.  */
+void drawing_thread_wait (bool discard)
+{
+	switch (render_state)
+	{
+	case RENDER_IDLE:
+		break;
+	case RENDER_PLANNED:
+		render_state = RENDER_IDLE;
+		if (discard || !lockscr ()) {
+			notice_screen_contents_lost ();
+			break;
+		}
+		render_run ();
+		render_collect ();
+		break;
+	case RENDER_RUNNING:
+		uae_sem_wait (&render_done_sem);
+		render_state = RENDER_IDLE;
+		render_collect ();
+		break;
+	}
+	drawing_color_matches = -1;
+}
+
+bool draw_frame (struct vidbuffer *vb)
+{
+	uae_u8 oldstate[LINESTATE_SIZE];
+
+	drawing_thread_wait (false);
+	init_row_map ();
+	memcpy (oldstate, linestate, LINESTATE_SIZE);
+	linestate_redraw ();
 	last_drawn_line = 0;
 	first_drawn_line = 32767;
 	drawing_color_matches = -1;
@@ -3066,13 +3554,14 @@ bool draw_frame (struct vidbuffer *vb)
 
 void finish_drawing_frame (void)
 {
-	int i;
-	bool didflush = false;
-
 	// Leave if the screen isn't allocated, yet:
 	if (0 == gfxvidinfo.height_allocated)
 		return;
 
+	drawing_thread_wait (false);
+	if (render_threaded () && render_plan_frame ())
+		return;
+
 	if (! lockscr ()) {
 		notice_screen_contents_lost ();
 		return;
@@ -3088,6 +3577,14 @@ void finish_drawing_frame (void)
 #endif
 
 	draw_frame2 ();
+	finish_drawing_frame_overlay ();
+}
+
+/* Status line and debug overlays, then hand the frame to the driver */
+static void finish_drawing_frame_overlay (void)
+{
+	int i;
+	bool didflush = false;
 
 	if (currprefs.leds_on_screen) {
 		int slx, sly;
@@ -3169,6 +3666,7 @@ static void check_picasso (void)
 	if (picasso_requested_on == picasso_on)
 		return;
 
+	drawing_thread_wait (true);
 	picasso_on = picasso_requested_on;
 
 	if (!picasso_on)
@@ -3190,6 +3688,7 @@ void redraw_frame (void)
 	last_drawn_line = 0;
 	first_drawn_line = 32767;
 	finish_drawing_frame ();
+	drawing_thread_wait (false);
 	flush_screen (0, 0);
 }
 
@@ -3246,6 +3745,7 @@ void vsync_handle_redraw (int long_field, int lof_changed, uae_u16 bplcon0p, uae
 				}
 			}
 #endif
+			drawing_thread_wait (true);
 			quit_program = -quit_program;
 			set_inhibit_frame (IHF_QUIT_PROGRAM);
 			set_special (SPCFLAG_BRK | SPCFLAG_MODE_CHANGE);
@@ -3327,8 +3827,7 @@ void hsync_record_line_state (int lineno, enum nln_how how, int changed)
 	}
 }
 
-// REMOVEME:
-#if 0
+/* Null display target, frames are drawn into bufmem and go nowhere */
 static void dummy_flush_line (struct vidbuf_description *gfxinfo, int line_no)
 {
 }
@@ -3354,7 +3853,7 @@ static void dummy_unlock (struct vidbuf_description *gfxinfo)
 {
 }
 
-static void gfxbuffer_reset (void)
+void gfxbuffer_reset (void)
 {
 	gfxvidinfo.flush_line         = dummy_flush_line;
 	gfxvidinfo.flush_block        = dummy_flush_block;
@@ -3363,7 +3862,6 @@ static void gfxbuffer_reset (void)
 	gfxvidinfo.lockscr            = dummy_lock;
 	gfxvidinfo.unlockscr          = dummy_unlock;
 }
-#endif
 
 void notice_resolution_seen (int res, bool lace)
 {
@@ -3397,6 +3895,8 @@ bool notice_interlace_seen (bool lace)
 
 void reset_drawing (void)
 {
+	drawing_thread_wait (true);
+	center_done = false;
 	max_diwstop = 0;
 
 	lores_reset ();
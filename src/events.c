@@ -13,6 +13,7 @@
 
 #include "options.h"
 #include "events.h"
+#include "benchmark.h"
 
 unsigned long int event_cycles, nextevent, currcycle;
 int is_syncline, is_syncline_end;
@@ -81,6 +82,10 @@ void do_cycles_slow (unsigned long cycles_to_add)
 				if (eventtab[i].handler == NULL) {
 					gui_message(_T("eventtab[%d].handler is null!\n"), i);
 					eventtab[i].active = 0;
+				} else if (bench_active) {
+					int bs = bench_enter (i == ev_audio ? BENCH_AUDIO : BENCH_CUSTOM);
+					(*eventtab[i].handler)();
+					bench_leave (bs);
 				} else {
 					(*eventtab[i].handler)();
 				}
@@ -93,6 +98,252 @@ void do_cycles_slow (unsigned long cycles_to_add)
 	currcycle += cycles_to_add;
 }
 
+/* Events scheduled with no < 0 are kept in a growable array, so there
+ * is no upper limit on the number of pending events. While only a few
+ * are pending it is scanned like the old fixed table. Once more than
+ * EV2_HEAP_MIN are pending it is turned into a binary min-heap ordered
+ * by evtime and a hash of (evtime, handler, data) is kept next to it for
+ * the duplicate check, firing and queuing are then O(log n). The fixed
+ * eventtab2 slots (blitter, disk) stay addressable by index as before.
+ */
+#define EV2_HEAP_MIN 16
+
+static struct ev2 *ev2_misc;
+static int ev2_misc_count, ev2_misc_size;
+static bool ev2_heaped;
+
+struct ev2_key {
+	evt evtime;
+	evfunc2 handler;
+	uae_u32 data;
+};
+static struct ev2_key *ev2_keys;
+static int ev2_keys_mask;
+
+STATIC_INLINE bool ev2_before (const struct ev2 *a, const struct ev2 *b)
+{
+	return (signed long)(a->evtime - b->evtime) < 0;
+}
+
+STATIC_INLINE bool ev2_same (evt et, uae_u32 data, evfunc2 func, evt et2, uae_u32 data2, evfunc2 func2)
+{
+	return et == et2 && func == func2 && data == data2;
+}
+
+STATIC_INLINE int ev2_key_hash (evt et, uae_u32 data, evfunc2 func)
+{
+	uae_u64 h = (uae_u64)et * 0x9e3779b97f4a7c15ULL ^ (uae_u64)(uintptr_t)func ^ (uae_u64)data * 0xc2b2ae3d27d4eb4fULL;
+	return (int)(h ^ (h >> 32)) & ev2_keys_mask;
+}
+
+/* Slot of the key, or the empty slot it would go to */
+static int ev2_key_find (evt et, uae_u32 data, evfunc2 func)
+{
+	int i = ev2_key_hash (et, data, func);
+	while (ev2_keys[i].handler && !ev2_same (et, data, func, ev2_keys[i].evtime, ev2_keys[i].data, ev2_keys[i].handler))
+		i = (i + 1) & ev2_keys_mask;
+	return i;
+}
+
+static void ev2_key_add (const struct ev2 *e)
+{
+	struct ev2_key *k = &ev2_keys[ev2_key_find (e->evtime, e->data, e->handler)];
+	k->evtime = e->evtime;
+	k->handler = e->handler;
+	k->data = e->data;
+}
+
+static void ev2_key_remove (const struct ev2 *e)
+{
+	int i = ev2_key_find (e->evtime, e->data, e->handler);
+	int j = i;
+
+	if (!ev2_keys[i].handler)
+		return;
+	/* linear probing, move later keys of the chain back into the hole */
+	for (;;) {
+		int h;
+		ev2_keys[i].handler = NULL;
+		for (;;) {
+			j = (j + 1) & ev2_keys_mask;
+			if (!ev2_keys[j].handler)
+				return;
+			h = ev2_key_hash (ev2_keys[j].evtime, ev2_keys[j].data, ev2_keys[j].handler);
+			if (((j - h) & ev2_keys_mask) >= ((j - i) & ev2_keys_mask))
+				break;
+		}
+		ev2_keys[i] = ev2_keys[j];
+		i = j;
+	}
+}
+
+/* Size the hash for the array and fill it, false if out of memory */
+static bool ev2_keys_build (void)
+{
+	int size = 64, i;
+
+	while (size < ev2_misc_size * 2)
+		size *= 2;
+	if (size != ev2_keys_mask + 1) {
+		struct ev2_key *k = xcalloc (struct ev2_key, size);
+		if (!k)
+			return false;
+		xfree (ev2_keys);
+		ev2_keys = k;
+		ev2_keys_mask = size - 1;
+	} else {
+		memset (ev2_keys, 0, size * sizeof (struct ev2_key));
+	}
+	for (i = 0; i < ev2_misc_count; i++)
+		ev2_key_add (&ev2_misc[i]);
+	return true;
+}
+
+static void ev2_heap_up (int i)
+{
+	struct ev2 e = ev2_misc[i];
+	while (i > 0) {
+		int p = (i - 1) / 2;
+		if (!ev2_before (&e, &ev2_misc[p]))
+			break;
+		ev2_misc[i] = ev2_misc[p];
+		i = p;
+	}
+	ev2_misc[i] = e;
+}
+
+static void ev2_heap_down (int i)
+{
+	struct ev2 e = ev2_misc[i];
+	for (;;) {
+		int c = i * 2 + 1;
+		if (c >= ev2_misc_count)
+			break;
+		if (c + 1 < ev2_misc_count && ev2_before (&ev2_misc[c + 1], &ev2_misc[c]))
+			c++;
+		if (!ev2_before (&ev2_misc[c], &e))
+			break;
+		ev2_misc[i] = ev2_misc[c];
+		i = c;
+	}
+	ev2_misc[i] = e;
+}
+
+/* Switch between scanning and the heap, only called between firings.
+   Any heap is a valid unsorted array, going back is free.  */
+static void ev2_misc_mode (void)
+{
+	int i;
+
+	if (!ev2_heaped && ev2_misc_count > EV2_HEAP_MIN) {
+		if (!ev2_keys_build ())
+			return;
+		for (i = ev2_misc_count / 2 - 1; i >= 0; i--)
+			ev2_heap_down (i);
+		ev2_heaped = true;
+	} else if (ev2_heaped && ev2_misc_count <= EV2_HEAP_MIN / 2) {
+		ev2_heaped = false;
+	}
+}
+
+static bool ev2_misc_pending (evt et, uae_u32 data, evfunc2 func)
+{
+	int i;
+
+	if (ev2_heaped)
+		return ev2_keys[ev2_key_find (et, data, func)].handler != NULL;
+	for (i = 0; i < ev2_misc_count; i++) {
+		if (ev2_same (et, data, func, ev2_misc[i].evtime, ev2_misc[i].data, ev2_misc[i].handler))
+			return true;
+	}
+	return false;
+}
+
+static bool ev2_misc_push (evt et, uae_u32 data, evfunc2 func)
+{
+	struct ev2 *e;
+
+	if (ev2_misc_count == ev2_misc_size) {
+		int newsize = ev2_misc_size ? ev2_misc_size * 2 : 32;
+		struct ev2 *n = xrealloc (struct ev2, ev2_misc, newsize);
+		if (!n) {
+			write_log (_T("out of event2's!\n"));
+			return false;
+		}
+		ev2_misc = n;
+		ev2_misc_size = newsize;
+		if (ev2_heaped && !ev2_keys_build ())
+			ev2_heaped = false;
+	}
+	e = &ev2_misc[ev2_misc_count++];
+	e->active = true;
+	e->evtime = et;
+	e->data = data;
+	e->handler = func;
+	if (ev2_heaped) {
+		ev2_key_add (e);
+		ev2_heap_up (ev2_misc_count - 1);
+	}
+	event2_count++;
+	return true;
+}
+
+static struct ev2 ev2_misc_remove (int i)
+{
+	struct ev2 e = ev2_misc[i];
+	ev2_misc[i] = ev2_misc[--ev2_misc_count];
+	event2_count--;
+	return e;
+}
+
+/* Removes and returns the earliest pending dynamic event. */
+struct ev2 event2_misc_pop (void)
+{
+	struct ev2 e;
+	int i, first = 0;
+
+	if (ev2_heaped) {
+		e = ev2_misc_remove (0);
+		if (ev2_misc_count > 0)
+			ev2_heap_down (0);
+		ev2_key_remove (&e);
+		return e;
+	}
+	for (i = 1; i < ev2_misc_count; i++) {
+		if (ev2_before (&ev2_misc[i], &ev2_misc[first]))
+			first = i;
+	}
+	return ev2_misc_remove (first);
+}
+
+int event2_misc_count (void)
+{
+	return ev2_misc_count;
+}
+
+struct ev2 *event2_misc_get (int idx)
+{
+	return &ev2_misc[idx];
+}
+
+void event2_misc_reset (void)
+{
+	event2_count -= ev2_misc_count;
+	ev2_misc_count = 0;
+	ev2_heaped = false;
+}
+
+STATIC_INLINE void ev2_misc_fire (const struct ev2 *e)
+{
+	if (bench_active) {
+		int bs = bench_enter (BENCH_CUSTOM);
+		e->handler (e->data);
+		bench_leave (bs);
+	} else {
+		e->handler (e->data);
+	}
+}
+
 void MISC_handler (void)
 {
 	static bool dorecheck;
@@ -116,8 +367,13 @@ void MISC_handler (void)
 			if (eventtab2[i].active) {
 				if (eventtab2[i].evtime == ct) {
 					eventtab2[i].active = false;
-					event2_count--;
-					eventtab2[i].handler (eventtab2[i].data);
+					if (bench_active) {
+						int bs = bench_enter (i == ev2_blitter ? BENCH_BLITTER : BENCH_DISK);
+						eventtab2[i].handler (eventtab2[i].data);
+						bench_leave (bs);
+					} else {
+						eventtab2[i].handler (eventtab2[i].data);
+					}
 					if (dorecheck || eventtab2[i].active) {
 						recheck = true;
 						dorecheck = false;
@@ -129,6 +385,39 @@ void MISC_handler (void)
 				}
 			}
 		}
+		ev2_misc_mode ();
+		if (ev2_heaped) {
+			while (ev2_misc_count > 0 && (signed long)(ev2_misc[0].evtime - ct) <= 0) {
+				struct ev2 e = event2_misc_pop ();
+				ev2_misc_fire (&e);
+				if (dorecheck) {
+					recheck = true;
+					dorecheck = false;
+				}
+			}
+			if (ev2_misc_count > 0) {
+				evt eventtime = ev2_misc[0].evtime - ct;
+				if (eventtime < mintime)
+					mintime = eventtime;
+			}
+		} else {
+			/* events queued by the handlers are appended and seen later */
+			for (i = 0; i < ev2_misc_count;) {
+				if ((signed long)(ev2_misc[i].evtime - ct) <= 0) {
+					struct ev2 e = ev2_misc_remove (i);
+					ev2_misc_fire (&e);
+					if (dorecheck) {
+						recheck = true;
+						dorecheck = false;
+					}
+				} else {
+					evt eventtime = ev2_misc[i].evtime - ct;
+					if (eventtime < mintime)
+						mintime = eventtime;
+					i++;
+				}
+			}
+		}
 	}
 	if (mintime != ~0UL) {
 		eventtab[ev_misc].active = true;
@@ -143,32 +432,20 @@ void MISC_handler (void)
 void event2_newevent_xx (int no, evt t, uae_u32 data, evfunc2 func)
 {
 	evt et;
-	static int next = ev2_misc;
 
 	et = t + get_cycles ();
 	if (no < 0) {
-		no = next;
-		for (;;) {
-			if (!eventtab2[no].active) {
-				event2_count++;
-				break;
-			}
-			if (eventtab2[no].evtime == et && eventtab2[no].handler == func && eventtab2[no].data == data)
-				break;
-			no++;
-			if (no == ev2_max)
-				no = ev2_misc;
-			if (no == next) {
-				write_log (_T("out of event2's!\n"));
-				return;
-			}
-		}
-		next = no;
+		/* Same request is still pending */
+		if (ev2_misc_pending (et, data, func))
+			return;
+		if (!ev2_misc_push (et, data, func))
+			return;
+	} else {
+		eventtab2[no].active = true;
+		eventtab2[no].evtime = et;
+		eventtab2[no].handler = func;
+		eventtab2[no].data = data;
 	}
-	eventtab2[no].active = true;
-	eventtab2[no].evtime = et;
-	eventtab2[no].handler = func;
-	eventtab2[no].data = data;
 	MISC_handler ();
 }
 
@@ -31,6 +31,9 @@
 #include "ncr_scsi.h"
 #include "debug.h"
 #include "gayle.h"
+#ifdef PICASSO96
+#include "picasso96.h"
+#endif
 
 #define MAX_EXPANSION_BOARDS 8
 
@@ -1298,6 +1301,7 @@ static void allocate_expamem (void)
 
 #ifdef PICASSO96
 	if (gfxmem_bank.allocated != currprefs.rtgmem_size) {
+		picasso_freewritewatch ();
 		if (gfxmem_bank.baseaddr)
 			mapped_free (gfxmem_bank.baseaddr);
 		mapped_malloc_dynamic (&currprefs.rtgmem_size, &changed_prefs.rtgmem_size, &gfxmem_bank, 1, currprefs.rtgmem_type ? _T("z3_gfx") : _T("z2_gfx"));
@@ -1721,6 +1725,7 @@ void expansion_cleanup (void)
 	z3chipmem_bank.baseaddr = NULL;
 
 #ifdef PICASSO96
+	picasso_freewritewatch ();
 	mapped_free (gfxmem_bank.baseaddr);
 	gfxmem_bank.baseaddr = NULL;
 #endif
@@ -57,6 +57,7 @@
 #include "isofs_api.h"
 #include "scsi.h"
 #include "picasso96.h"
+#include "writewatch.h"
 #ifdef TARGET_AMIGAOS
 #include <dos/dos.h>
 #include <proto/dos.h>
@@ -1110,6 +1111,9 @@ typedef struct notify {
 typedef struct exallkey {
 	uae_u32 id;
 	struct fs_dirhandle *dirhandle;
+	/* or the snapshot of the directory and the next entry */
+	struct fs_dirsnap *snap;
+	int snappos;
 	TCHAR *fn;
 	uaecptr control;
 } ExAllKey;
@@ -1120,7 +1124,6 @@ typedef struct exallkey {
 
 #define EXKEYS 128
 #define EXALLKEYS 100
-#define MAX_AINO_HASH 128
 #define NOTIFY_HASH_SIZE 127
 
 /* handler state info */
@@ -1161,9 +1164,12 @@ typedef struct _unit {
 
 	a_inode rootnode;
 	unsigned long aino_cache_size;
-	a_inode *aino_hash[MAX_AINO_HASH];
+	struct aino_uniqhash aino_hash;
 	unsigned long nr_cache_hits;
 	unsigned long nr_cache_lookups;
+	/* increased by every packet that may change files, directory
+	 * snapshots taken before are stale */
+	uae_u32 dirsnap_gen;
 
 	struct notify *notifyhash[NOTIFY_HASH_SIZE];
 
@@ -1398,6 +1404,42 @@ static void fs_closedir (struct fs_dirhandle *fsd)
 		isofs_closedir (fsd->isod);*/
 	xfree (fsd);
 }
+
+/* Directory snapshots are used as long as no packet changed anything,
+ * and for a short while only, files may change on the host side without
+ * touching the directory.  */
+#define DIRSNAP_TIMEOUT 2
+
+static bool dirsnap_usable (Unit *u, struct fs_dirsnap *ds)
+{
+	return ds && ds->generation == u->dirsnap_gen && time (NULL) - ds->taken <= DIRSNAP_TIMEOUT;
+}
+
+/* Snapshot of directory <aino>, read again if it is not current. NULL
+ * if the volume is not a host directory.  */
+static struct fs_dirsnap *fs_dirsnap (Unit *u, a_inode *aino)
+{
+	if (u->volflags & (MYVOLUMEINFO_ARCHIVE | MYVOLUMEINFO_CDFS))
+		return NULL;
+	if (aino->dirsnap && (!dirsnap_usable (u, aino->dirsnap) || !my_dirsnap_current (aino->dirsnap, aino->nname))) {
+		my_dirsnap_release (aino->dirsnap);
+		aino->dirsnap = NULL;
+	}
+	if (!aino->dirsnap) {
+		aino->dirsnap = my_dirsnap_read (aino->nname);
+		if (aino->dirsnap)
+			aino->dirsnap->generation = u->dirsnap_gen;
+	}
+	return aino->dirsnap;
+}
+
+/* <aino> in a snapshot of its parent that is still usable */
+static struct fs_dirsnap_entry *fs_dirsnap_entry (Unit *u, a_inode *aino)
+{
+	if (!aino->parent || !dirsnap_usable (u, aino->parent->dirsnap))
+		return NULL;
+	return my_dirsnap_find (aino->parent->dirsnap, nname_begin (aino->nname));
+}
 static struct fs_filehandle *fs_openfile (Unit *u, a_inode *aino, int flags)
 {
 	struct fs_filehandle *fsf = xmalloc (struct fs_filehandle, 1);
@@ -1534,6 +1576,8 @@ static void clear_exkeys (Unit *unit)
 	for (i = 0; i < EXALLKEYS; i++) {
 		fs_closedir (unit->exalls[i].dirhandle);
 		unit->exalls[i].dirhandle = NULL;
+		my_dirsnap_release (unit->exalls[i].snap);
+		unit->exalls[i].snap = NULL;
 		xfree (unit->exalls[i].fn);
 		unit->exalls[i].fn = NULL;
 		unit->exalls[i].id = 0;
@@ -2022,9 +2066,11 @@ static void de_recycle_aino (Unit *unit, a_inode *aino)
 
 static void dispose_aino (Unit *unit, a_inode **aip, a_inode *aino)
 {
-	int hash = aino->uniq % MAX_AINO_HASH;
-	if (unit->aino_hash[hash] == aino)
-		unit->aino_hash[hash] = 0;
+	aino_hash_remove (&unit->aino_hash, aino);
+	if (aino->parent)
+		aino_dir_remove (aino->parent, aino);
+	aino_dir_free (aino);
+	my_dirsnap_release (aino->dirsnap);
 
 	if (aino->dirty && aino->parent)
 		fsdb_dir_writeback (aino->parent);
@@ -2053,6 +2099,9 @@ static void free_all_ainos (Unit *u, a_inode *parent)
 		free_all_ainos (u, a);
 		dispose_aino (u, &parent->child, a);
 	}
+	aino_dir_free (parent);
+	my_dirsnap_release (parent->dirsnap);
+	parent->dirsnap = NULL;
 }
 
 static int flush_cache (Unit *unit, int num)
@@ -2182,6 +2231,8 @@ static void move_aino_children (Unit *unit, a_inode *from, a_inode *to)
 {
 	aino_test (from);
 	aino_test (to);
+	aino_dir_free (from);
+	aino_dir_free (to);
 	to->child = from->child;
 	from->child = 0;
 	update_child_names (unit, to->child, to);
@@ -2226,54 +2277,16 @@ static void delete_aino (Unit *unit, a_inode *aino)
 	dispose_aino (unit, aip, aino);
 }
 
-static a_inode *lookup_sub (a_inode *dir, uae_u32 uniq)
-{
-	a_inode **cp = &dir->child;
-	a_inode *c, *retval;
-
-	for (;;) {
-		c = *cp;
-		if (c == 0)
-			return 0;
-
-		if (c->uniq == uniq) {
-			retval = c;
-			break;
-		}
-		if (c->dir) {
-			a_inode *a = lookup_sub (c, uniq);
-			if (a != 0) {
-				retval = a;
-				break;
-			}
-		}
-		cp = &c->sibling;
-	}
-	if (! dir->locked_children) {
-		/* Move to the front to speed up repeated lookups.  Don't do this if
-		an ExNext is going on in this directory, or we'll terminally
-		confuse it.  */
-		*cp = c->sibling;
-		c->sibling = dir->child;
-		dir->child = c;
-	}
-	return retval;
-}
-
 static a_inode *lookup_aino (Unit *unit, uae_u32 uniq)
 {
 	a_inode *a;
-	int hash = uniq % MAX_AINO_HASH;
 
 	if (uniq == 0)
 		return &unit->rootnode;
-	a = unit->aino_hash[hash];
-	if (a == 0 || a->uniq != uniq)
-		a = lookup_sub (&unit->rootnode, uniq);
-	else
+	a = aino_hash_find (&unit->aino_hash, uniq);
+	if (a)
 		unit->nr_cache_hits++;
 	unit->nr_cache_lookups++;
-	unit->aino_hash[hash] = a;
 	aino_test (a);
 	return a;
 }
@@ -2456,6 +2469,8 @@ static void init_child_aino_tree (Unit *unit, a_inode *base, a_inode *aino)
 	base->child = aino;
 	aino->next = aino->prev = 0;
 	aino->volflags = unit->volflags;
+	aino_hash_add (&unit->aino_hash, aino);
+	aino_dir_add (base, aino);
 }
 
 static void init_child_aino (Unit *unit, a_inode *base, a_inode *aino)
@@ -2554,26 +2569,17 @@ static a_inode *create_child_aino (Unit *unit, a_inode *base, TCHAR *rel, int is
 
 static a_inode *lookup_child_aino (Unit *unit, a_inode *base, TCHAR *rel, int *err)
 {
-	a_inode *c = base->child;
-	int l0 = _tcslen (rel);
+	a_inode *c;
 
 	aino_test (base);
-	aino_test (c);
+	aino_test (base->child);
 
 	if (base->dir == 0) {
 		*err = ERROR_OBJECT_WRONG_TYPE;
 		return 0;
 	}
 
-	while (c != 0) {
-		int l1 = _tcslen (c->aname);
-		if ((l0 <= l1)
-			&& same_aname (rel, c->aname + l1 - l0)
-			&& ( (l0 == l1) || (c->aname[l1-l0-1] == '/') )
-			&& c->mountcount == unit->mountcount)
-			break;
-		c = c->sibling;
-	}
+	c = aino_dir_find_aname (base, rel, unit->mountcount);
 	if (c != 0)
 		return c;
 	c = new_child_aino (unit, base, rel);
@@ -2582,28 +2588,23 @@ static a_inode *lookup_child_aino (Unit *unit, a_inode *base, TCHAR *rel, int *e
 	return c;
 }
 
-/* Different version because for this one, REL is an nname.  */
-static a_inode *lookup_child_aino_for_exnext (Unit *unit, a_inode *base, TCHAR *rel, uae_u32 *err, uae_u64 uniq_external)
+/* Different version because for this one, REL is an nname. SE is its
+   entry in the snapshot of BASE, if one was taken.  */
+static a_inode *lookup_child_aino_for_exnext (Unit *unit, a_inode *base, TCHAR *rel, uae_u32 *err, uae_u64 uniq_external, struct fs_dirsnap_entry *se)
 {
-	a_inode *c = base->child;
-	int l0 = _tcslen (rel);
+	a_inode *c;
 	int isvirtual = unit->volflags & (MYVOLUMEINFO_ARCHIVE | MYVOLUMEINFO_CDFS);
 
 	aino_test (base);
-	aino_test (c);
+	aino_test (base->child);
 
 	*err = 0;
-	while (c != 0) {
-		int l1 = _tcslen (c->nname);
-		/* Note: using _tcscmp here.  */
-		if (l0 <= l1 && _tcscmp (rel, c->nname + l1 - l0) == 0
-			&& (l0 == l1 || c->nname[l1-l0-1] == FSDB_DIR_SEPARATOR) && c->mountcount == unit->mountcount)
-			break;
-		c = c->sibling;
-	}
+	/* Note: case sensitive here.  */
+	c = aino_dir_find_nname (base, rel, unit->mountcount);
 	if (c != 0)
 		return c;
-	if (!isvirtual)
+	/* no database, nothing to look up */
+	if (!isvirtual && !(se && !base->dirsnap->hasfsdb))
 		c = fsdb_lookup_aino_nname (base, rel);
 	if (c == 0) {
 		c = xcalloc (a_inode, 1);
@@ -2617,7 +2618,9 @@ static a_inode *lookup_child_aino_for_exnext (Unit *unit, a_inode *base, TCHAR *
 		c->comment = 0;
 		c->uniq_external = uniq_external;
 		c->has_dbentry = 0;
-		if (!fill_file_attrs (unit, base, c)) {
+		if (se && !isvirtual) {
+			fsdb_fill_file_attrs_mode (c, se->hostmode);
+		} else if (!fill_file_attrs (unit, base, c)) {
 			xfree (c);
 			*err = ERROR_NO_FREE_STORE;
 			return 0;
@@ -2806,8 +2809,6 @@ static Unit *startup_create_unit (UnitInfo *uinfo, int num)
 	unit->rootnode.volflags = uinfo->volflags;
 	aino_test_init (&unit->rootnode);
 	unit->aino_cache_size = 0;
-	for (i = 0; i < MAX_AINO_HASH; i++)
-		unit->aino_hash[i] = 0;
 	return unit;
 }
 
@@ -3757,7 +3758,14 @@ static void move_exkeys (Unit *unit, a_inode *from, a_inode *to)
 
 static bool get_statinfo (Unit *unit, a_inode *aino, struct mystat *statbuf)
 {
+	struct fs_dirsnap_entry *se;
 	bool ok = true;
+
+	se = fs_dirsnap_entry (unit, aino);
+	if (se) {
+		*statbuf = se->st;
+		return true;
+	}
 	memset (statbuf, 0, sizeof *statbuf);
 	/* No error checks - this had better work. */
 	if (unit->volflags & MYVOLUMEINFO_ARCHIVE)
@@ -4116,13 +4124,7 @@ static int exalldo (uaecptr exalldata, uae_u32 exalldatasize, uae_u32 type, uaec
 	char *x = NULL, *comment = NULL;
 	int ret = 0;
 
-	memset (&statbuf, 0, sizeof statbuf);
-	if (unit->volflags & MYVOLUMEINFO_ARCHIVE)
-		zfile_stat_archive (aino->nname, &statbuf);
-/*	else if (unit->volflags & MYVOLUMEINFO_CDFS)
-		isofs_stat (unit->ui.cdfs_superblock, aino->uniq_external, &statbuf);*/
-	else
-		my_stat (aino->nname, &statbuf);
+	get_statinfo (unit, aino, &statbuf);
 
 	if (aino->parent == 0) {
 		entrytype = ST_USERDIR;
@@ -4249,6 +4251,23 @@ static int action_examine_all_do (Unit *unit, uaecptr lock, ExAllKey *eak, uaecp
 		base = aino_from_lock (unit, lock);
 	if (base == 0)
 		base = &unit->rootnode;
+	while (eak->snap) {
+		struct fs_dirsnap_entry *se;
+		do {
+			if (eak->snappos >= eak->snap->count)
+				return 0;
+			se = &eak->snap->entries[eak->snappos++];
+		} while (filesys_name_invalid (se->name) || fsdb_name_invalid (se->name));
+		aino = lookup_child_aino_for_exnext (unit, base, se->name, &err, 0, se);
+		if (!aino)
+			return 0;
+		eak->id = unit->exallid++;
+		put_long (control + 4, eak->id);
+		if (!exalldo (exalldata, exalldatasize, type, control, unit, aino)) {
+			eak->snappos--; /* no space in exallstruct, return it next time */
+			return 1;
+		}
+	}
 	for (;;) {
 		uae_u64 uniq = 0;
 		d = eak->dirhandle;
@@ -4270,7 +4289,7 @@ static int action_examine_all_do (Unit *unit, uaecptr lock, ExAllKey *eak, uaecp
 			xfree (eak->fn);
 			eak->fn = NULL;
 		}
-		aino = lookup_child_aino_for_exnext (unit, base, de->d_name, &err, uniq);
+		aino = lookup_child_aino_for_exnext (unit, base, de->d_name, &err, uniq, NULL);
 		if (!aino)
 			return 0;
 		eak->id = unit->exallid++;
@@ -4303,9 +4322,11 @@ static int action_examine_all_end (Unit *unit, dpacket packet)
 	} else {
 		eak->id = 0;
 		fs_closedir (eak->dirhandle);
+		my_dirsnap_release (eak->snap);
 		xfree (eak->fn);
 		eak->fn = NULL;
 		eak->dirhandle = NULL;
+		eak->snap = NULL;
 	}
 	if (doserr) {
 		PUT_PCK_RES1 (packet, DOS_FALSE);
@@ -4384,10 +4405,16 @@ static int action_examine_all (Unit *unit, dpacket packet)
 #if EXALL_DEBUG > 0
 		write_log("exall: ID=%d '%s'\n", eak->id, base->nname);
 #endif
-		d = fs_opendir (unit, base);
-		if (!d)
-			goto fail;
-		eak->dirhandle = d;
+		eak->snap = fs_dirsnap (unit, base);
+		if (eak->snap) {
+			eak->snap->refcnt++;
+			eak->snappos = 0;
+		} else {
+			d = fs_opendir (unit, base);
+			if (!d)
+				goto fail;
+			eak->dirhandle = d;
+		}
 		put_long (control + 4, eak->id);
 		if (!action_examine_all_do (unit, lock, eak, exalldata, exalldatasize, type, control))
 			goto fail;
@@ -4424,6 +4451,8 @@ fail:
 			eak->id = 0;
 			fs_closedir (eak->dirhandle);
 			eak->dirhandle = NULL;
+			my_dirsnap_release (eak->snap);
+			eak->snap = NULL;
 			xfree (eak->fn);
 			eak->fn = NULL;
 		}
@@ -4503,19 +4532,31 @@ static void action_examine_object (Unit *unit, dpacket packet)
 
 static void populate_directory (Unit *unit, a_inode *base)
 {
-	struct fs_dirhandle *d;
+	struct fs_dirhandle *d = NULL;
+	struct fs_dirsnap *ds;
 	a_inode *aino;
+	int i;
 
-	d = fs_opendir (unit, base);
-	if (!d)
-		return;
+	ds = fs_dirsnap (unit, base);
+	if (!ds) {
+		d = fs_opendir (unit, base);
+		if (!d)
+			return;
+	}
 	for (aino = base->child; aino; aino = aino->sibling) {
 		base->locked_children++;
 		unit->total_locked_ainos++;
 	}
 	TRACE3((_T("Populating directory, child %p, locked_children %ld\n"),
 		base->child, base->locked_children));
-	for (;;) {
+	for (i = 0; ds && i < ds->count; i++) {
+		struct fs_dirsnap_entry *se = &ds->entries[i];
+		uae_u32 err;
+		if (filesys_name_invalid (se->name) || fsdb_name_invalid (se->name))
+			continue;
+		lookup_child_aino_for_exnext (unit, base, se->name, &err, 0, se);
+	}
+	while (d) {
 		uae_u64 uniq = 0;
 		TCHAR fn[MAX_DPATH];
 		struct dirent *de = NULL;
@@ -4538,7 +4579,7 @@ static void populate_directory (Unit *unit, a_inode *base)
 			break;
 		/* This calls init_child_aino, which will notice that the parent is
 		being ExNext()ed, and it will increment the locked counts.  */
-		aino = lookup_child_aino_for_exnext (unit, base, de->d_name, &err, uniq);
+		aino = lookup_child_aino_for_exnext (unit, base, de->d_name, &err, uniq, NULL);
 	}
 	fs_closedir (d);
 }
@@ -4547,12 +4588,14 @@ static void do_examine (Unit *unit, dpacket packet, ExamineKey *ek, uaecptr info
 {
 	for (;;) {
 		TCHAR *name;
+		bool exists;
 		if (ek->curr_file == 0)
 			break;
 		name = ek->curr_file->nname;
 		get_fileinfo (unit, packet, info, ek->curr_file, longfilesize);
+		exists = fs_dirsnap_entry (unit, ek->curr_file) != NULL;
 		ek->curr_file = ek->curr_file->sibling;
-		if (!(unit->volflags & (MYVOLUMEINFO_ARCHIVE | MYVOLUMEINFO_CDFS)) && !fsdb_exists(name)) {
+		if (!(unit->volflags & (MYVOLUMEINFO_ARCHIVE | MYVOLUMEINFO_CDFS)) && !exists && !fsdb_exists(name)) {
 			TRACE ((_T("%s orphaned"), name));
 			continue;
 		}
@@ -4958,6 +5001,7 @@ static void
 	if (size) {
 		/* normal fast read */
 		uae_u8 *realpt = get_real_address (addr);
+		uae_u8 *iobuf;
 
 		if (fs_lseek64 (k->fd, k->file_pos, SEEK_SET) < 0) {
 			PUT_PCK_RES1 (packet, 0);
@@ -4965,7 +5009,9 @@ static void
 			return;
 		}
 
-		actual = fs_read (k->fd, realpt, size);
+		iobuf = writewatch_io_begin (realpt, size);
+		actual = fs_read (k->fd, iobuf, size);
+		writewatch_io_end (realpt, iobuf, (uae_s32)actual > 0 ? actual : 0);
 
 		if (actual == 0) {
 			PUT_PCK_RES1 (packet, 0);
@@ -5716,7 +5762,9 @@ static void
 	a2->comment = a1->comment;
 	a1->comment = 0;
 	a2->amigaos_mode = a1->amigaos_mode;
+	aino_hash_remove (&unit->aino_hash, a2);
 	a2->uniq = a1->uniq;
+	aino_hash_add (&unit->aino_hash, a2);
 	a2->elock = a1->elock;
 	a2->shlock = a1->shlock;
 	a2->has_dbentry = a1->has_dbentry;
@@ -6323,6 +6371,44 @@ static uae_u32 REGPARAM2 exter_int_helper (TrapContext *context)
 	return 0;
 }
 
+/* false for packets that only look */
+static bool packet_changes_files (uae_s32 type)
+{
+	switch (type)
+	{
+	case ACTION_LOCATE_OBJECT:
+	case ACTION_FREE_LOCK:
+	case ACTION_COPY_DIR:
+	case ACTION_DISK_INFO:
+	case ACTION_INFO:
+	case ACTION_EXAMINE_OBJECT:
+	case ACTION_EXAMINE_NEXT:
+	case ACTION_FIND_INPUT:
+	case ACTION_READ:
+	case ACTION_SEEK:
+	case ACTION_SAME_LOCK:
+	case ACTION_PARENT:
+	case ACTION_CURRENT_VOLUME:
+	case ACTION_IS_FILESYSTEM:
+	case ACTION_EXAMINE_FH:
+	case ACTION_FH_FROM_LOCK:
+	case ACTION_COPY_DIR_FH:
+	case ACTION_PARENT_FH:
+	case ACTION_EXAMINE_ALL:
+	case ACTION_EXAMINE_ALL_END:
+	case ACTION_READ_LINK:
+	case ACTION_CHANGE_FILE_POSITION64:
+	case ACTION_GET_FILE_POSITION64:
+	case ACTION_GET_FILE_SIZE64:
+	case ACTION_SEEK64:
+	case ACTION_EXAMINE_OBJECT64:
+	case ACTION_EXAMINE_NEXT64:
+	case ACTION_EXAMINE_FH64:
+		return false;
+	}
+	return true;
+}
+
 static int handle_packet (Unit *unit, dpacket pck, uae_u32 msg)
 {
 	uae_s32 type = GET_PCK_TYPE (pck);
@@ -6345,6 +6431,9 @@ static int handle_packet (Unit *unit, dpacket pck, uae_u32 msg)
 			return 1;
 	}
 
+	if (packet_changes_files (type))
+		unit->dirsnap_gen++;
+
 	switch (type) {
 	case ACTION_LOCATE_OBJECT: action_lock (unit, pck); break;
 	case ACTION_FREE_LOCK: action_free_lock (unit, pck); break;
@@ -6574,6 +6663,7 @@ void filesys_free_handles (void)
 		}
 		u->waitingrecords = NULL;
 		free_all_ainos (u, &u->rootnode);
+		aino_hash_free (&u->aino_hash);
 		u->rootnode.next = u->rootnode.prev = &u->rootnode;
 		u->aino_cache_size = 0;
 		xfree (u->newrootdir);
@@ -9,6 +9,9 @@
 #include <sys/timeb.h>
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #include "zfile.h"
 
 typedef int BOOL;
@@ -64,25 +67,28 @@ typedef struct {
 } LARGE_INTEGER;
 
 // fsdb_mywin32
-bool my_stat (const TCHAR *name, struct mystat *statbuf)
+static void my_stat_fill (const struct stat *st, struct mystat *statbuf)
 {
-	struct _stat64 st;
-	uae_s64 foo_size;
-
-	if (stat (name, &st) != -1) {
-		foo_size = st.st_size;
-		statbuf->size = foo_size;
+	statbuf->size = st->st_size;
 
-		if (st.st_mode & (S_IWGRP | S_IWOTH)) {
-			statbuf->mode = FILEFLAG_READ | FILEFLAG_WRITE;
-		} else {
-			statbuf->mode = FILEFLAG_READ;
-		}
+	if (st->st_mode & (S_IWGRP | S_IWOTH)) {
+		statbuf->mode = FILEFLAG_READ | FILEFLAG_WRITE;
+	} else {
+		statbuf->mode = FILEFLAG_READ;
+	}
 
 //S_IFREG: regular file
-		if ((st.st_mode & S_IFMT) == S_IFDIR) {
-			statbuf->mode |= FILEFLAG_DIR;
-		}
+	if ((st->st_mode & S_IFMT) == S_IFDIR) {
+		statbuf->mode |= FILEFLAG_DIR;
+	}
+}
+
+bool my_stat (const TCHAR *name, struct mystat *statbuf)
+{
+	struct stat st;
+
+	if (stat (name, &st) != -1) {
+		my_stat_fill (&st, statbuf);
 
 /*		statbuf->mode = st->st_mode;
 		uae_u64 t = (*(uae_s64 *)&st->st_mtime-((uae_s64)(369*365+89)*(uae_s64)(24*60*60)*(uae_s64)10000000));
@@ -93,6 +99,149 @@ bool my_stat (const TCHAR *name, struct mystat *statbuf)
 	return false;
 }
 
+/* Directory snapshots. The entries come from getdents64 () in big
+ * chunks and are stat'ed relative to the open directory, so a network
+ * file system is asked once per entry instead of once per entry and
+ * DOS packet, and never has to resolve the whole path again.  */
+
+#define DIRSNAP_BUFSIZE 65536
+
+#ifdef SYS_getdents64
+struct linux_dirent64 {
+	uae_u64 d_ino;
+	uae_s64 d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+#endif
+
+static void dirsnap_key (struct fs_dirsnap *ds, const struct stat *st)
+{
+	ds->mtime = (uae_s64)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+	ds->ctime = (uae_s64)st->st_ctim.tv_sec * 1000000000 + st->st_ctim.tv_nsec;
+	ds->ino = st->st_ino;
+}
+
+static void dirsnap_add (struct fs_dirsnap *ds, int *max, int dfd, const char *name)
+{
+	struct fs_dirsnap_entry *e;
+	struct stat st;
+
+	if (!_tcscmp (name, _T(".")) || !_tcscmp (name, _T("..")))
+		return;
+	if (!_tcscmp (name, FSDB_FILE)) {
+		ds->hasfsdb = true;
+		return;
+	}
+	/* gone already, or a dangling link */
+	if (fstatat (dfd, name, &st, 0) == -1)
+		return;
+	if (ds->count == *max) {
+		*max = *max ? *max * 2 : 64;
+		ds->entries = xrealloc (struct fs_dirsnap_entry, ds->entries, *max);
+	}
+	e = &ds->entries[ds->count++];
+	e->name = my_strdup (name);
+	memset (&e->st, 0, sizeof e->st);
+	my_stat_fill (&st, &e->st);
+	e->hostmode = st.st_mode;
+}
+
+static int dirsnap_cmp (const void *a, const void *b)
+{
+	return _tcscmp (((const struct fs_dirsnap_entry*)a)->name, ((const struct fs_dirsnap_entry*)b)->name);
+}
+
+struct fs_dirsnap *my_dirsnap_read (const TCHAR *dirname)
+{
+	struct fs_dirsnap *ds;
+	struct stat st;
+	bool ok = true;
+	int dfd, max = 0;
+
+	dfd = open (dirname, O_RDONLY | O_DIRECTORY);
+	if (dfd < 0)
+		return NULL;
+	if (fstat (dfd, &st) == -1) {
+		close (dfd);
+		return NULL;
+	}
+	ds = xcalloc (struct fs_dirsnap, 1);
+	ds->refcnt = 1;
+	dirsnap_key (ds, &st);
+#ifdef SYS_getdents64
+	{
+		uae_u8 *buf = xmalloc (uae_u8, DIRSNAP_BUFSIZE);
+		for (;;) {
+			long n = syscall (SYS_getdents64, dfd, buf, DIRSNAP_BUFSIZE);
+			long pos;
+			if (n < 0)
+				ok = false;
+			if (n <= 0)
+				break;
+			for (pos = 0; pos < n; pos += ((struct linux_dirent64*)(buf + pos))->d_reclen)
+				dirsnap_add (ds, &max, dfd, ((struct linux_dirent64*)(buf + pos))->d_name);
+		}
+		xfree (buf);
+	}
+#else
+	{
+		DIR *d = fdopendir (dup (dfd));
+		struct dirent *de;
+		if (!d)
+			ok = false;
+		while (d && (de = readdir (d)))
+			dirsnap_add (ds, &max, dfd, de->d_name);
+		if (d)
+			closedir (d);
+	}
+#endif
+	close (dfd);
+	if (!ok) {
+		my_dirsnap_release (ds);
+		return NULL;
+	}
+	if (ds->count > 1)
+		qsort (ds->entries, ds->count, sizeof (struct fs_dirsnap_entry), dirsnap_cmp);
+	ds->taken = time (NULL);
+	return ds;
+}
+
+/* Nothing was added, removed or renamed since */
+bool my_dirsnap_current (struct fs_dirsnap *ds, const TCHAR *dirname)
+{
+	struct fs_dirsnap now;
+	struct stat st;
+
+	if (stat (dirname, &st) == -1)
+		return false;
+	dirsnap_key (&now, &st);
+	return now.mtime == ds->mtime && now.ctime == ds->ctime && now.ino == ds->ino;
+}
+
+struct fs_dirsnap_entry *my_dirsnap_find (struct fs_dirsnap *ds, const TCHAR *name)
+{
+	struct fs_dirsnap_entry key;
+
+	if (!ds->count)
+		return NULL;
+	key.name = (TCHAR*)name;
+	return (struct fs_dirsnap_entry*)bsearch (&key, ds->entries, ds->count, sizeof (struct fs_dirsnap_entry), dirsnap_cmp);
+}
+
+void my_dirsnap_release (struct fs_dirsnap *ds)
+{
+	int i;
+
+	if (!ds || --ds->refcnt > 0)
+		return;
+	for (i = 0; i < ds->count; i++)
+		xfree (ds->entries[i].name);
+	xfree (ds->entries);
+	xfree (ds);
+}
+
 static int setfiletime (const TCHAR *name, int days, int minute, int tick, int tolocal)
 {
 //FIXME
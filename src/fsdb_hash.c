@@ -0,0 +1,264 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * a_inode hashes
+  *
+  * Every a_inode of a unit is in a hash on its uniq, so locks and keys
+  * are resolved without walking the directory tree. A directory whose
+  * children had to be scanned at length gets two hashes of their names,
+  * one on the Amiga name (case insensitive, see same_aname ()) and one
+  * on the last component of the host name (case sensitive). From then
+  * on it is kept up to date until the directory is disposed of, and
+  * grown when it fills up.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <ctype.h>
+
+#include "fsdb.h"
+
+#define AINO_HASH_MIN 1024
+#define NAMEHASH_MIN 64
+/* children passed before a directory gets name hashes */
+#define NAMEHASH_SCAN 32
+
+struct aino_namehash {
+	a_inode **aname;
+	a_inode **nname;
+	unsigned int size, count;
+};
+
+static void uniqhash_resize (struct aino_uniqhash *uh, unsigned int size)
+{
+	a_inode **tab = xcalloc (a_inode*, size);
+	unsigned int i;
+
+	if (!tab)
+		return;
+	for (i = 0; i < uh->size; i++) {
+		a_inode *a = uh->tab[i];
+		while (a) {
+			a_inode *next = a->uniq_next;
+			a->uniq_next = tab[a->uniq & (size - 1)];
+			tab[a->uniq & (size - 1)] = a;
+			a = next;
+		}
+	}
+	xfree (uh->tab);
+	uh->tab = tab;
+	uh->size = size;
+}
+
+void aino_hash_add (struct aino_uniqhash *uh, a_inode *aino)
+{
+	a_inode **ap;
+
+	if (uh->count >= uh->size)
+		uniqhash_resize (uh, uh->size ? uh->size * 2 : AINO_HASH_MIN);
+	if (!uh->tab)
+		return;
+	ap = &uh->tab[aino->uniq & (uh->size - 1)];
+	aino->uniq_next = *ap;
+	*ap = aino;
+	uh->count++;
+}
+
+void aino_hash_remove (struct aino_uniqhash *uh, a_inode *aino)
+{
+	a_inode **ap;
+
+	if (!uh->tab)
+		return;
+	for (ap = &uh->tab[aino->uniq & (uh->size - 1)]; *ap; ap = &(*ap)->uniq_next) {
+		if (*ap == aino) {
+			*ap = aino->uniq_next;
+			aino->uniq_next = 0;
+			uh->count--;
+			return;
+		}
+	}
+}
+
+a_inode *aino_hash_find (struct aino_uniqhash *uh, uae_u32 uniq)
+{
+	a_inode *a;
+
+	if (!uh->tab)
+		return 0;
+	for (a = uh->tab[uniq & (uh->size - 1)]; a; a = a->uniq_next) {
+		if (a->uniq == uniq)
+			return a;
+	}
+	return 0;
+}
+
+void aino_hash_free (struct aino_uniqhash *uh)
+{
+	xfree (uh->tab);
+	uh->tab = 0;
+	uh->size = uh->count = 0;
+}
+
+/* FNV-1a of the last component of a path */
+static unsigned int name_hash (const TCHAR *name, TCHAR sep, int fold)
+{
+	const TCHAR *p = _tcsrchr (name, sep);
+	unsigned int h = 2166136261u;
+
+	for (p = p ? p + 1 : name; *p; p++) {
+		int c = (uae_u8)*p;
+		if (fold)
+			c = _totlower (c);
+		h = (h ^ (unsigned int)c) * 16777619u;
+	}
+	return h;
+}
+
+static void namehash_link (struct aino_namehash *nh, a_inode *a)
+{
+	a_inode **ap;
+
+	ap = &nh->aname[name_hash (a->aname, '/', 1) & (nh->size - 1)];
+	a->aname_next = *ap;
+	*ap = a;
+	ap = &nh->nname[name_hash (a->nname, FSDB_DIR_SEPARATOR, 0) & (nh->size - 1)];
+	a->nname_next = *ap;
+	*ap = a;
+	nh->count++;
+}
+
+static void namehash_build (a_inode *dir)
+{
+	struct aino_namehash *nh;
+	unsigned int size = NAMEHASH_MIN, count = 0;
+	a_inode *c;
+
+	for (c = dir->child; c; c = c->sibling)
+		count++;
+	while (size < count)
+		size *= 2;
+	nh = xcalloc (struct aino_namehash, 1);
+	if (!nh)
+		return;
+	nh->aname = xcalloc (a_inode*, size);
+	nh->nname = xcalloc (a_inode*, size);
+	if (!nh->aname || !nh->nname) {
+		xfree (nh->aname);
+		xfree (nh->nname);
+		xfree (nh);
+		return;
+	}
+	nh->size = size;
+	for (c = dir->child; c; c = c->sibling)
+		namehash_link (nh, c);
+	dir->namehash = nh;
+}
+
+void aino_dir_free (a_inode *dir)
+{
+	struct aino_namehash *nh = dir->namehash;
+
+	if (!nh)
+		return;
+	xfree (nh->aname);
+	xfree (nh->nname);
+	xfree (nh);
+	dir->namehash = 0;
+}
+
+/* <aino> was just linked into dir->child */
+void aino_dir_add (a_inode *dir, a_inode *aino)
+{
+	struct aino_namehash *nh = dir->namehash;
+
+	if (!nh)
+		return;
+	if (nh->count >= nh->size * 2) {
+		aino_dir_free (dir);
+		namehash_build (dir);
+		return;
+	}
+	namehash_link (nh, aino);
+}
+
+void aino_dir_remove (a_inode *dir, a_inode *aino)
+{
+	struct aino_namehash *nh = dir->namehash;
+	a_inode **ap;
+
+	if (!nh)
+		return;
+	ap = &nh->aname[name_hash (aino->aname, '/', 1) & (nh->size - 1)];
+	while (*ap && *ap != aino)
+		ap = &(*ap)->aname_next;
+	if (*ap)
+		*ap = aino->aname_next;
+	ap = &nh->nname[name_hash (aino->nname, FSDB_DIR_SEPARATOR, 0) & (nh->size - 1)];
+	while (*ap && *ap != aino)
+		ap = &(*ap)->nname_next;
+	if (*ap) {
+		*ap = aino->nname_next;
+		nh->count--;
+	}
+	aino->aname_next = aino->nname_next = 0;
+}
+
+/* REL matches the end of NAME, following a separator */
+static int same_tail (const TCHAR *name, const TCHAR *rel, int l0, TCHAR sep, int fold)
+{
+	int l1 = _tcslen (name);
+
+	if (l0 > l1)
+		return 0;
+	if (fold ? !same_aname (rel, name + l1 - l0) : _tcscmp (rel, name + l1 - l0) != 0)
+		return 0;
+	return l0 == l1 || name[l1 - l0 - 1] == sep;
+}
+
+a_inode *aino_dir_find_aname (a_inode *dir, const TCHAR *rel, unsigned int mountcount)
+{
+	int l0 = _tcslen (rel);
+	int n = 0;
+	a_inode *c;
+
+	if (dir->namehash) {
+		struct aino_namehash *nh = dir->namehash;
+		for (c = nh->aname[name_hash (rel, '/', 1) & (nh->size - 1)]; c; c = c->aname_next) {
+			if (c->mountcount == mountcount && same_tail (c->aname, rel, l0, '/', 1))
+				return c;
+		}
+		return 0;
+	}
+	for (c = dir->child; c; c = c->sibling, n++) {
+		if (c->mountcount == mountcount && same_tail (c->aname, rel, l0, '/', 1))
+			break;
+	}
+	if (n >= NAMEHASH_SCAN)
+		namehash_build (dir);
+	return c;
+}
+
+a_inode *aino_dir_find_nname (a_inode *dir, const TCHAR *rel, unsigned int mountcount)
+{
+	int l0 = _tcslen (rel);
+	int n = 0;
+	a_inode *c;
+
+	if (dir->namehash) {
+		struct aino_namehash *nh = dir->namehash;
+		for (c = nh->nname[name_hash (rel, FSDB_DIR_SEPARATOR, 0) & (nh->size - 1)]; c; c = c->nname_next) {
+			if (c->mountcount == mountcount && same_tail (c->nname, rel, l0, FSDB_DIR_SEPARATOR, 0))
+				return c;
+		}
+		return 0;
+	}
+	for (c = dir->child; c; c = c->sibling, n++) {
+		if (c->mountcount == mountcount && same_tail (c->nname, rel, l0, FSDB_DIR_SEPARATOR, 0))
+			break;
+	}
+	if (n >= NAMEHASH_SCAN)
+		namehash_build (dir);
+	return c;
+}
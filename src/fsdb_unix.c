@@ -152,16 +152,22 @@ int fsdb_fill_file_attrs (a_inode *base, a_inode *aino)
     /* This really shouldn't happen...  */
     if (stat (aino->nname, &statbuf) == -1)
 	return 0;
-    aino->dir = S_ISDIR (statbuf.st_mode) ? 1 : 0;
-    aino->amigaos_mode = ((S_IXUSR & statbuf.st_mode ? 0 : A_FIBF_EXECUTE)
-			  | (S_IWUSR & statbuf.st_mode ? 0 : A_FIBF_WRITE)
-			  | (S_IRUSR & statbuf.st_mode ? 0 : A_FIBF_READ));
+    fsdb_fill_file_attrs_mode (aino, statbuf.st_mode);
+    return 1;
+}
+
+/* Same, from an st_mode the caller already has */
+void fsdb_fill_file_attrs_mode (a_inode *aino, int hostmode)
+{
+    aino->dir = S_ISDIR (hostmode) ? 1 : 0;
+    aino->amigaos_mode = ((S_IXUSR & hostmode ? 0 : A_FIBF_EXECUTE)
+			  | (S_IWUSR & hostmode ? 0 : A_FIBF_WRITE)
+			  | (S_IRUSR & hostmode ? 0 : A_FIBF_READ));
 #ifdef ANDROID
     // Always give execute & read permission
     aino->amigaos_mode &= ~A_FIBF_EXECUTE;
     aino->amigaos_mode &= ~A_FIBF_READ;
 #endif
-    return 1;
 }
 
 int fsdb_set_file_attrs (a_inode *aino)
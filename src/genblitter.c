@@ -33,6 +33,117 @@ static void generate_include(void)
 	printf("}\n");
 }
 
+/* One chunk of a wide blit: four words, or the last k words of a line */
+static void generate_wide_chunk(int minterm, int desc, int tail)
+{
+	int active = blitops[minterm].used;
+	int a_is_on = active & 1, b_is_on = active & 2, c_is_on = active & 4;
+	const char *ind = "\t\t";
+	const char *op = desc ? "-" : "+";
+	const char *shl = desc ? "<<" : ">>", *shr = desc ? ">>" : "<<";
+	const char *step = tail ? "2 * k" : "8";
+	/* moves the word processed last of a short chunk to the carry position */
+	const char *align = desc ? " << ks" : " >> ks";
+	char get[3][64], put[64];
+	const char *ptn[3] = { "pta", "ptb", "ptc" };
+	int c;
+
+	for (c = 0; c < 3; c++) {
+		if (!tail)
+			sprintf(get[c], "blit_get64 (%s%s)", ptn[c], desc ? " - 6" : "");
+		else if (desc)
+			sprintf(get[c], "blit_getn (%s - 2 * (k - 1), k)", ptn[c]);
+		else
+			sprintf(get[c], "(blit_getn (%s, k) << ks)", ptn[c]);
+	}
+	if (!tail)
+		sprintf(put, "blit_put64 (ptd%s, dstd)", desc ? " - 6" : "");
+	else if (desc)
+		sprintf(put, "blit_putn (ptd - 2 * (k - 1), dstd, k)");
+	else
+		sprintf(put, "blit_putn (ptd, dstd >> ks, k)");
+
+	if (c_is_on) printf("%sif (ptc) { srcc = %s; ptc %s= %s; }\n", ind, get[2], op, step);
+	if (b_is_on) {
+		printf("%sif (ptb) {\n%s\tbltbdat = %s; ptb %s= %s;\n", ind, ind, get[1], op, step);
+		printf("%s\tsrcb = (bltbdat %s bs) | (prevb %s (63 - bs) %s 1);\n", ind, shl, shr, shr);
+		printf("%s\tprevb = bltbdat%s;\n%s}\n", ind, tail ? align : "", ind);
+	}
+	if (a_is_on) {
+		printf("%sif (pta) { bltadat = lasta = %s; pta %s= %s; } else { bltadat = adat; }\n", ind, get[0], op, step);
+		if (tail) {
+			printf("%sbltadat &= mtail;\n", ind);
+		} else {
+			printf("%sif (i == 0) bltadat &= mfirst;\n", ind);
+			printf("%sif (i == n - 1) bltadat &= mlast;\n", ind);
+		}
+		printf("%ssrca = (bltadat %s as) | (preva %s (63 - as) %s 1);\n", ind, shl, shr, shr);
+		printf("%spreva = bltadat%s;\n", ind, tail ? align : "");
+	}
+	printf("%sdstd = %s;\n", ind, blitops[minterm].s);
+	if (tail) {
+		printf("%sdstd &= mvalid;\n", ind);
+		printf("%sif (fill) dstd = blit_fill64 (dstd, &fc, fill, %d) & mvalid;\n", ind, desc);
+	} else {
+		printf("%sif (fill) dstd = blit_fill64 (dstd, &fc, fill, %d);\n", ind, desc);
+	}
+	printf("%stotald |= dstd;\n", ind);
+	printf("%sif (ptd) { %s; ptd %s= %s; }\n", ind, put, op, step);
+	if (tail) {
+		if (a_is_on) printf("%slasta = lasta%s;\n", ind, align);
+		if (b_is_on) printf("%sif (ptb) srcb = srcb%s;\n", ind, align);
+		if (c_is_on) printf("%sif (ptc) srcc = srcc%s;\n", ind, align);
+		printf("%sdstd = dstd%s;\n", ind, align);
+	}
+}
+
+static void generate_wide(int minterm, int desc)
+{
+	int active = blitops[minterm].used;
+	int a_is_on = active & 1, b_is_on = active & 2, c_is_on = active & 4;
+	const char *op = desc ? "-" : "+";
+	const char *last = desc ? " >> 48" : "";
+
+	printf("void blitdofast_wide_%s%x (uae_u8 *pta, uae_u8 *ptb, uae_u8 *ptc, uae_u8 *ptd, struct bltinfo *b, int fill)\n", desc ? "desc_" : "", minterm);
+	printf("{\n");
+	printf("int i, j, fc;\n");
+	printf("int n = b->hblitsize >> 2, k = b->hblitsize & 3, ks = 16 * (4 - k);\n");
+	printf("uae_u64 totald = 0, dstd = 0;\n");
+	printf("uae_u64 mvalid = k ? ~0ULL %s ks : 0;\n", desc ? ">>" : "<<");
+	if (a_is_on) {
+		printf("uae_u64 bltadat, srca, preva = 0, lasta = 0, adat = blit_rep64 (b->bltadat);\n");
+		printf("uae_u64 mfirst = n ? blit_mask64 (0, 4, %d) : 0;\n", desc);
+		printf("uae_u64 mlast = n ? blit_mask64 ((n - 1) * 4, 4, %d) : 0;\n", desc);
+		printf("uae_u64 mtail = blit_mask64 (n * 4, k, %d);\n", desc);
+		printf("int as = b->blitashift;\n");
+	}
+	if (b_is_on) {
+		printf("uae_u64 bltbdat, prevb = 0, srcb = blit_rep64 (b->bltbhold);\n");
+		printf("int bs = b->blitbshift;\n");
+	}
+	if (c_is_on) printf("uae_u64 srcc = blit_rep64 (b->bltcdat);\n");
+	printf("for (j = b->vblitsize; j--; ) {\n");
+	printf("\tfc = (fill & BLITFILL_CARRYIN) != 0;\n");
+	printf("\tfor (i = 0; i < n; i++) {\n");
+	generate_wide_chunk(minterm, desc, 0);
+	printf("\t}\n");
+	printf("\tif (k) {\n");
+	generate_wide_chunk(minterm, desc, 1);
+	printf("\t}\n");
+	if (a_is_on) printf("\tif (pta) pta %s= b->bltamod;\n", op);
+	if (b_is_on) printf("\tif (ptb) ptb %s= b->bltbmod;\n", op);
+	if (c_is_on) printf("\tif (ptc) ptc %s= b->bltcmod;\n", op);
+	printf("\tif (ptd) ptd %s= b->bltdmod;\n", op);
+	printf("}\n");
+	if (a_is_on) printf("if (pta) b->bltadat = (uae_u16)(lasta%s);\n", last);
+	if (b_is_on) printf("if (ptb) b->bltbdat = (uae_u16)(prevb%s);\n", last);
+	if (b_is_on) printf("b->bltbhold = (uae_u16)(srcb%s);\n", last);
+	if (c_is_on) printf("b->bltcdat = (uae_u16)(srcc%s);\n", last);
+	printf("b->bltddat = (uae_u16)(dstd%s);\n", last);
+	printf("if (totald != 0) b->blitzero = 0;\n");
+	printf("}\n");
+}
+
 static void generate_func(void)
 {
 	unsigned int i;
@@ -42,7 +153,8 @@ static void generate_func(void)
 	printf("#include \"custom.h\"\n");
 	printf("#include \"memory_uae.h\"\n");
 	printf("#include \"blitter.h\"\n");
-	printf("#include \"blitfunc.h\"\n\n");
+	printf("#include \"blitfunc.h\"\n");
+	printf("#include \"blitwide.h\"\n\n");
 
 	for (i = 0; i < sizeof(blttbl); i++) {
 		int active = blitops[blttbl[i]].used;
@@ -208,37 +320,20 @@ static void generate_func(void)
 #endif
 		printf("if (totald != 0) b->blitzero = 0;\n");
 		printf("}\n");
+
+		generate_wide(blttbl[i], 0);
+		generate_wide(blttbl[i], 1);
 	}
 }
 
-static void generate_table(void)
+static void generate_table_entries(const char *type, const char *name, const char *prefix)
 {
 	unsigned int index = 0;
 	unsigned int i;
-	printf("#include \"sysconfig.h\"\n");
-	printf("#include \"sysdeps.h\"\n");
-	printf("#include \"options.h\"\n");
-	printf("#include \"custom.h\"\n");
-	printf("#include \"memory_uae.h\"\n");
-	printf("#include \"blitter.h\"\n");
-	printf("#include \"blitfunc.h\"\n\n");
-	printf("blitter_func * const blitfunc_dofast[256] = {\n");
-	for (i = 0; i < 256; i++) {
-		if (index < sizeof(blttbl) && i == blttbl[index]) {
-			printf("blitdofast_%x",i);
-			index++;
-		}
-		else printf("0");
-		if (i < 255) printf(", ");
-		if ((i & 7) == 7) printf("\n");
-	}
-	printf("};\n\n");
-
-	index = 0;
-	printf("blitter_func * const blitfunc_dofast_desc[256] = {\n");
+	printf("%s * const %s[256] = {\n", type, name);
 	for (i = 0; i < 256; i++) {
 		if (index < sizeof(blttbl) && i == blttbl[index]) {
-			printf("blitdofast_desc_%x",i);
+			printf("%s%x", prefix, i);
 			index++;
 		}
 		else printf("0");
@@ -248,12 +343,32 @@ static void generate_table(void)
 	printf("};\n");
 }
 
+static void generate_table(void)
+{
+	printf("#include \"sysconfig.h\"\n");
+	printf("#include \"sysdeps.h\"\n");
+	printf("#include \"options.h\"\n");
+	printf("#include \"custom.h\"\n");
+	printf("#include \"memory_uae.h\"\n");
+	printf("#include \"blitter.h\"\n");
+	printf("#include \"blitfunc.h\"\n\n");
+	generate_table_entries("blitter_func", "blitfunc_dofast", "blitdofast_");
+	printf("\n");
+	generate_table_entries("blitter_func", "blitfunc_dofast_desc", "blitdofast_desc_");
+	printf("\n");
+	generate_table_entries("blitter_wide_func", "blitfunc_dofast_wide", "blitdofast_wide_");
+	printf("\n");
+	generate_table_entries("blitter_wide_func", "blitfunc_dofast_wide_desc", "blitdofast_wide_desc_");
+}
+
 static void generate_header(void)
 {
 	unsigned int i;
 	for (i = 0; i < sizeof(blttbl); i++) {
 		printf("extern blitter_func blitdofast_%x;\n",blttbl[i]);
 		printf("extern blitter_func blitdofast_desc_%x;\n",blttbl[i]);
+		printf("extern blitter_wide_func blitdofast_wide_%x;\n",blttbl[i]);
+		printf("extern blitter_wide_func blitdofast_wide_desc_%x;\n",blttbl[i]);
 	}
 }
 
@@ -23,6 +23,12 @@ extern char RPATH[512];
 extern void update_input(void);
 extern void texture_init(void);
 
+extern size_t savestate_mem_size(void);
+extern size_t savestate_save_mem(void *buf, size_t size);
+extern bool savestate_queue_mem(const void *buf, size_t size);
+extern void retro_memmap_update(retro_environment_t cb);
+extern void *retro_memmap_data(unsigned id, size_t *size);
+
 static retro_video_refresh_t video_cb;
 static retro_audio_sample_t audio_cb;
 static retro_audio_sample_batch_t audio_batch_cb;
@@ -295,6 +301,8 @@ sortie:
 	video_cb(bmp,retrow,retroh , retrow << 1);
 
 	co_switch(emuThread);
+
+	retro_memmap_update(environ_cb);
 }
 
 bool retro_load_game(const struct retro_game_info *info)
@@ -329,29 +337,32 @@ bool retro_load_game_special(unsigned type, const struct retro_game_info *info,
 
 size_t retro_serialize_size(void)
 {
-   	return 0;
+   	return savestate_mem_size();
 }
 
 bool retro_serialize(void *data_, size_t size)
 {
-   	return false;
+   	return savestate_save_mem(data_, size) != 0;
 }
 
+/* applied at the next frame boundary, until then retro_serialize ()
+   returns the queued state */
 bool retro_unserialize(const void *data_, size_t size)
 {
-	return false;
+   	return savestate_queue_mem(data_, size);
 }
 
 void *retro_get_memory_data(unsigned id)
 {
-   	(void)id;
-   	return NULL;
+   	size_t size;
+   	return retro_memmap_data(id, &size);
 }
 
 size_t retro_get_memory_size(unsigned id)
 {
-   	(void)id;
-   	return 0;
+   	size_t size;
+   	retro_memmap_data(id, &size);
+   	return size;
 }
 
 void retro_cheat_reset(void) {}
@@ -568,6 +568,64 @@ enum retro_mod
                                            // struct retro_perf_callback * --
                                            // Gets an interface for performance counters. This is useful for performance logging in a
                                            // cross-platform way and for detecting architecture-specific features, such as SIMD support.
+#define RETRO_ENVIRONMENT_SET_MEMORY_MAPS (36 | RETRO_ENVIRONMENT_EXPERIMENTAL)
+                                           // const struct retro_memory_map * --
+                                           // This environment call lets a libretro core tell the frontend about the memory maps this
+                                           // core emulates. This can be used to implement, for example, cheats in a core-agnostic way.
+                                           //
+                                           // Should only be used by emulators; it doesn't make much sense for anything else.
+                                           // It is recommended to expose all relevant pointers through retro_get_memory_* as well.
+                                           //
+                                           // Can be called from retro_init and retro_load_game.
+
+#define RETRO_MEMDESC_CONST     (1 << 0)   // The frontend will never change this memory area once retro_load_game has returned.
+#define RETRO_MEMDESC_BIGENDIAN (1 << 1)   // The memory area contains big endian data. Default is little endian.
+#define RETRO_MEMDESC_ALIGN_2   (1 << 16)  // All memory access in this area is aligned to their own size, or 2, whichever is smaller.
+#define RETRO_MEMDESC_ALIGN_4   (2 << 16)
+#define RETRO_MEMDESC_ALIGN_8   (3 << 16)
+#define RETRO_MEMDESC_MINSIZE_2 (1 << 24)  // All memory in this region is accessed at least 2 bytes at the time.
+#define RETRO_MEMDESC_MINSIZE_4 (2 << 24)
+#define RETRO_MEMDESC_MINSIZE_8 (3 << 24)
+
+struct retro_memory_descriptor
+{
+   uint64_t flags;
+
+   // Pointer to the start of the relevant ROM or RAM chip.
+   // It's strongly recommended to use 'offset' if possible, rather than doing math on the pointer.
+   // If the same byte is mapped by multiple descriptors, their descriptors must have the same pointer.
+   // If 'start' does not point to the first byte in the pointer, put the difference in 'offset' instead.
+   // May be NULL if there's nothing usable here (e.g. hardware registers and open bus). No flags should be set if the pointer is NULL.
+   void *ptr;
+   size_t offset;
+
+   // This is the location in the emulated address space where the mapping starts.
+   size_t start;
+
+   // Which bits must be same as in 'start' for this mapping to apply.
+   // If this is zero, it's set to a value based on 'start' and 'len'.
+   size_t select;
+
+   // If this is nonzero, the set bits are assumed not connected to the memory chip's address pins.
+   size_t disconnect;
+
+   // This one tells the size of the current memory area.
+   // If, after start+disconnect are applied, the address is higher than this, the highest bit of the address is cleared.
+   size_t len;
+
+   // To go from emulated address to physical address, the following order applies:
+   // Subtract 'start', pick off 'disconnect', apply 'len', add 'offset'.
+
+   // The address space name must consist of only a-zA-Z0-9_-, should be as short as feasible,
+   // and is case sensitive. NULL or "" means the main address space.
+   const char *addrspace;
+};
+
+struct retro_memory_map
+{
+   const struct retro_memory_descriptor *descriptors;
+   unsigned num_descriptors;
+};
 
 enum retro_log_level
 {
@@ -0,0 +1,177 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * libretro memory access: retro_get_memory_* and memory maps
+  *
+  * RAM and ROM are exposed in place, straight from the bank base
+  * addresses, so frontends (cheats, achievements, external monitors)
+  * never need a copy. The map is rebuilt from mem_banks[] when
+  * mem_banks_generation says map_banks () has been called since, and
+  * passed to the frontend only if it came out different.
+  *
+  * retro_get_memory_data () returns chip RAM as RETRO_MEMORY_SYSTEM_RAM,
+  * the other RAM areas have the RETRO_MEMORY_SYSTEM_RAM based ids below.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "memory_uae.h"
+
+#include "libretro.h"
+
+/* retro_get_memory_data () ids of the RAM areas besides chip RAM */
+#define RETRO_MEMORY_EUAE_SLOW_RAM    ((1 << 8) | RETRO_MEMORY_SYSTEM_RAM)
+#define RETRO_MEMORY_EUAE_FAST_RAM    ((2 << 8) | RETRO_MEMORY_SYSTEM_RAM)
+#define RETRO_MEMORY_EUAE_Z3_FAST_RAM ((3 << 8) | RETRO_MEMORY_SYSTEM_RAM)
+#define RETRO_MEMORY_EUAE_MB_RAM      ((4 << 8) | RETRO_MEMORY_SYSTEM_RAM)
+
+#define MAX_MEMMAP 256
+
+struct memmap_area
+{
+	addrbank *ab;
+	uaecptr start;
+	uae_u32 offset, len;
+};
+
+static struct memmap_area areas[MEMORY_BANKS];
+static struct retro_memory_descriptor memmap[MAX_MEMMAP];
+static struct retro_memory_descriptor memmap_new[MAX_MEMMAP];
+static unsigned memmap_count;
+static uae_u32 memmap_generation;
+static bool memmap_valid;
+
+static int memmap_add (int cnt, addrbank *ab, uaecptr start, uae_u32 offset, uae_u32 len)
+{
+	struct memmap_area *a;
+
+	/* extend the previous area if this one follows it in both spaces */
+	if (cnt > 0) {
+		a = &areas[cnt - 1];
+		if (a->ab->baseaddr == ab->baseaddr && a->start + a->len == start && a->offset + a->len == offset) {
+			a->len += len;
+			return cnt;
+		}
+	}
+	a = &areas[cnt];
+	a->ab = ab;
+	a->start = start;
+	a->offset = offset;
+	a->len = len;
+	return cnt + 1;
+}
+
+/* The frontend decodes addresses with start/select and rejects a
+   descriptor without select whose length is not a power of two, so an
+   area (1.5MB of slow RAM for example) is split into aligned power of
+   two blocks, each with its select mask.  */
+static int memmap_emit (int cnt, const struct memmap_area *a)
+{
+	uaecptr start = a->start;
+	uae_u32 offset = a->offset, len = a->len;
+
+	while (len > 0 && cnt < MAX_MEMMAP) {
+		struct retro_memory_descriptor *d = &memmap_new[cnt++];
+		uae_u32 size = start ? start & -start : 0x80000000;
+		while (size > len)
+			size >>= 1;
+		memset (d, 0, sizeof *d);
+		d->flags = RETRO_MEMDESC_BIGENDIAN;
+		if (!(a->ab->flags & ABFLAG_RAM))
+			d->flags |= RETRO_MEMDESC_CONST;
+		/* mirrors must share the pointer, they differ in start only */
+		d->ptr = a->ab->baseaddr;
+		d->offset = offset;
+		d->start = start;
+		d->select = (uae_u32)~(size - 1);
+		d->disconnect = 0;
+		d->len = size;
+		start += size;
+		offset += size;
+		len -= size;
+	}
+	return cnt;
+}
+
+static int memmap_build (void)
+{
+	int i, n = 0, cnt = 0;
+
+	for (i = 0; i < MEMORY_BANKS; i++) {
+		addrbank *ab = mem_banks[i];
+		uaecptr addr = i << 16;
+		uae_u32 offset, len;
+
+		if (!ab || !ab->baseaddr || !(ab->flags & (ABFLAG_RAM | ABFLAG_ROM)))
+			continue;
+		/* mirrors start over at the beginning of the bank */
+		offset = (addr - ab->start) & ab->mask;
+		len = 65536;
+		if (ab->allocated) {
+			if (offset >= ab->allocated)
+				continue;
+			if (offset + len > ab->allocated)
+				len = ab->allocated - offset;
+		}
+		n = memmap_add (n, ab, addr, offset, len);
+	}
+	for (i = 0; i < n; i++)
+		cnt = memmap_emit (cnt, &areas[i]);
+	return cnt;
+}
+
+/* Publish the memory map if it changed, called after each emulated frame.
+   mem_banks[] is only scanned again after map_banks () has been called.  */
+void retro_memmap_update (retro_environment_t cb)
+{
+	struct retro_memory_map map;
+	int cnt;
+
+	if (memmap_valid && memmap_generation == mem_banks_generation)
+		return;
+	memmap_generation = mem_banks_generation;
+	memmap_valid = true;
+	cnt = memmap_build ();
+	if (cnt == memmap_count && !memcmp (memmap, memmap_new, cnt * sizeof (struct retro_memory_descriptor)))
+		return;
+	memcpy (memmap, memmap_new, cnt * sizeof (struct retro_memory_descriptor));
+	memmap_count = cnt;
+	map.descriptors = memmap;
+	map.num_descriptors = memmap_count;
+	cb (RETRO_ENVIRONMENT_SET_MEMORY_MAPS, &map);
+}
+
+/* Chip RAM is the Amiga's system RAM, the other RAM areas have their own
+   ids. All of them are also in the map.  */
+void *retro_memmap_data (unsigned id, size_t *size)
+{
+	addrbank *ab;
+
+	*size = 0;
+	switch (id)
+	{
+	case RETRO_MEMORY_SYSTEM_RAM:
+		ab = &chipmem_bank;
+		break;
+	case RETRO_MEMORY_EUAE_SLOW_RAM:
+		ab = &bogomem_bank;
+		break;
+	case RETRO_MEMORY_EUAE_FAST_RAM:
+		ab = &fastmem_bank;
+		break;
+	case RETRO_MEMORY_EUAE_Z3_FAST_RAM:
+		ab = &z3fastmem_bank;
+		break;
+	case RETRO_MEMORY_EUAE_MB_RAM:
+		ab = &a3000hmem_bank;
+		break;
+	default:
+		return NULL;
+	}
+	if (!ab->baseaddr)
+		return NULL;
+	*size = ab->allocated;
+	return ab->baseaddr;
+}
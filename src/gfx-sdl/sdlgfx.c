@@ -47,6 +47,37 @@ void gfx_unlock_picasso (bool dorender);
 # ifndef GL_STORAGE_SHARED_APPLE
 #  define GL_STORAGE_SHARED_APPLE 0x85BF
 # endif
+/* Pixel buffer objects, buffer storage and sync objects, fetched at run time. */
+# ifndef GL_PIXEL_UNPACK_BUFFER
+#  define GL_PIXEL_UNPACK_BUFFER 0x88EC
+# endif
+# ifndef GL_STREAM_DRAW
+#  define GL_STREAM_DRAW 0x88E0
+# endif
+# ifndef GL_WRITE_ONLY
+#  define GL_WRITE_ONLY 0x88B9
+# endif
+# ifndef GL_MAP_WRITE_BIT
+#  define GL_MAP_WRITE_BIT 0x0002
+# endif
+# ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#  define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+# endif
+# ifndef GL_MAP_PERSISTENT_BIT
+#  define GL_MAP_PERSISTENT_BIT 0x0040
+# endif
+# ifndef GL_MAP_COHERENT_BIT
+#  define GL_MAP_COHERENT_BIT 0x0080
+# endif
+# ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#  define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+# endif
+# ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#  define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+# endif
+# ifndef GL_TIMEOUT_EXPIRED
+#  define GL_TIMEOUT_EXPIRED 0x911B
+# endif
 
 #ifdef GL_SHADER
 #ifdef __APPLE__
@@ -72,6 +103,7 @@ struct gl_buffer_t
     GLsizei  texture_height;
 
     GLenum   target;
+    GLenum   intformat;
     GLenum   format;
     GLenum   type;
 
@@ -622,6 +654,42 @@ struct gl_buffer_t glbuffer;
 static int have_texture_rectangles;
 static int have_apple_client_storage;
 static int have_apple_texture_range;
+static int have_pixel_buffer_object;
+static int have_buffer_storage;
+static int have_sync;
+
+typedef void   (APIENTRY *gl_genbuffers_t)      (GLsizei n, GLuint *buffers);
+typedef void   (APIENTRY *gl_deletebuffers_t)   (GLsizei n, const GLuint *buffers);
+typedef void   (APIENTRY *gl_bindbuffer_t)      (GLenum target, GLuint buffer);
+typedef void   (APIENTRY *gl_bufferdata_t)      (GLenum target, ptrdiff_t size, const GLvoid *data, GLenum usage);
+typedef void   (APIENTRY *gl_bufferstorage_t)   (GLenum target, ptrdiff_t size, const GLvoid *data, GLbitfield flags);
+typedef void * (APIENTRY *gl_mapbuffer_t)       (GLenum target, GLenum access);
+typedef void * (APIENTRY *gl_mapbufferrange_t)  (GLenum target, ptrdiff_t offset, ptrdiff_t length, GLbitfield access);
+typedef GLboolean (APIENTRY *gl_unmapbuffer_t)  (GLenum target);
+typedef void * (APIENTRY *gl_fencesync_t)       (GLenum condition, GLbitfield flags);
+typedef void   (APIENTRY *gl_deletesync_t)      (void *sync);
+typedef GLenum (APIENTRY *gl_clientwaitsync_t)  (void *sync, GLbitfield flags, uae_u64 timeout);
+
+static gl_genbuffers_t     pglGenBuffers;
+static gl_deletebuffers_t  pglDeleteBuffers;
+static gl_bindbuffer_t     pglBindBuffer;
+static gl_bufferdata_t     pglBufferData;
+static gl_bufferstorage_t  pglBufferStorage;
+static gl_mapbuffer_t      pglMapBuffer;
+static gl_mapbufferrange_t pglMapBufferRange;
+static gl_unmapbuffer_t    pglUnmapBuffer;
+static gl_fencesync_t      pglFenceSync;
+static gl_deletesync_t     pglDeleteSync;
+static gl_clientwaitsync_t pglClientWaitSync;
+
+static void *gl_proc (const char *name, const char *arbname)
+{
+    void *proc = SDL_GL_GetProcAddress (name);
+
+    if (!proc && arbname)
+		proc = SDL_GL_GetProcAddress (arbname);
+    return proc;
+}
 
 static int round_up_to_power_of_2 (int value)
 {
@@ -643,6 +711,33 @@ static void check_gl_extensions (void)
 		have_texture_rectangles   = strstr (extensions, "ARB_texture_rectangle") ? 1 : 0;
 		have_apple_client_storage = strstr (extensions, "APPLE_client_storage")  ? 1 : 0;
 		have_apple_texture_range  = strstr (extensions, "APPLE_texture_range")   ? 1 : 0;
+		have_pixel_buffer_object  = strstr (extensions, "ARB_pixel_buffer_object") ? 1 : 0;
+		have_buffer_storage       = strstr (extensions, "ARB_buffer_storage")    ? 1 : 0;
+		have_sync                 = strstr (extensions, "ARB_sync")              ? 1 : 0;
+
+		if (have_pixel_buffer_object) {
+			pglGenBuffers     = (gl_genbuffers_t)    gl_proc ("glGenBuffers",    "glGenBuffersARB");
+			pglDeleteBuffers  = (gl_deletebuffers_t) gl_proc ("glDeleteBuffers", "glDeleteBuffersARB");
+			pglBindBuffer     = (gl_bindbuffer_t)    gl_proc ("glBindBuffer",    "glBindBufferARB");
+			pglBufferData     = (gl_bufferdata_t)    gl_proc ("glBufferData",    "glBufferDataARB");
+			pglMapBuffer      = (gl_mapbuffer_t)     gl_proc ("glMapBuffer",     "glMapBufferARB");
+			pglUnmapBuffer    = (gl_unmapbuffer_t)   gl_proc ("glUnmapBuffer",   "glUnmapBufferARB");
+			pglMapBufferRange = (gl_mapbufferrange_t) gl_proc ("glMapBufferRange", NULL);
+			if (!pglGenBuffers || !pglDeleteBuffers || !pglBindBuffer || !pglBufferData || !pglMapBuffer || !pglUnmapBuffer)
+				have_pixel_buffer_object = 0;
+		}
+		if (have_buffer_storage)
+			pglBufferStorage  = (gl_bufferstorage_t) gl_proc ("glBufferStorage", NULL);
+		if (have_sync) {
+			pglFenceSync      = (gl_fencesync_t)      gl_proc ("glFenceSync", NULL);
+			pglDeleteSync     = (gl_deletesync_t)     gl_proc ("glDeleteSync", NULL);
+			pglClientWaitSync = (gl_clientwaitsync_t) gl_proc ("glClientWaitSync", NULL);
+			if (!pglFenceSync || !pglDeleteSync || !pglClientWaitSync)
+				have_sync = 0;
+		}
+		/* persistent mappings are only safe to write while we can tell the GPU is done with them */
+		if (!pglBufferStorage || !pglMapBufferRange || !have_sync)
+			have_buffer_storage = 0;
     }
 }
 
@@ -671,8 +766,12 @@ static void init_gl_display (GLsizei width, GLsizei height)
     return;
 }
 
+static void free_gl_stream (struct gl_buffer_t *buffer);
+
 static void free_gl_buffer (struct gl_buffer_t *buffer)
 {
+    free_gl_stream (buffer);
+
     glBindTexture (buffer->target, 0);
     glDeleteTextures (1, &buffer->texture);
 
@@ -682,8 +781,6 @@ static void free_gl_buffer (struct gl_buffer_t *buffer)
 
 static int alloc_gl_buffer (struct gl_buffer_t *buffer, int width, int height, int want_16bit)
 {
-    GLenum tex_intformat;
-
     buffer->width          = width;
     if (have_texture_rectangles) {
 		buffer->texture_width  = width;
@@ -725,21 +822,21 @@ static int alloc_gl_buffer (struct gl_buffer_t *buffer, int width, int height, i
     /* TODO: Better method of deciding on the best texture format to use is needed. */
     if (want_16bit) {
 #if defined (__APPLE__)
-		tex_intformat     = GL_RGB5;
+		buffer->intformat = GL_RGB5;
 		buffer->format    = GL_BGRA;
 		buffer->type      = GL_UNSIGNED_SHORT_1_5_5_5_REV;
 #else
-		tex_intformat     = GL_RGB;
+		buffer->intformat = GL_RGB;
 		buffer->format    = GL_RGB;
 		buffer->type      = GL_UNSIGNED_SHORT_5_6_5;
 #endif
     } else {
-		tex_intformat     = GL_RGBA8;
+		buffer->intformat = GL_RGBA8;
 		buffer->format    = GL_BGRA;
 		buffer->type      = GL_UNSIGNED_INT_8_8_8_8_REV;
     }
 
-    glTexImage2D (buffer->target, 0, tex_intformat, buffer->texture_width, buffer->texture_height, 0, buffer->format, buffer->type, buffer->pixels);
+    glTexImage2D (buffer->target, 0, buffer->intformat, buffer->texture_width, buffer->texture_height, 0, buffer->format, buffer->type, buffer->pixels);
 
     if (glGetError () != GL_NO_ERROR) {
 		write_log ("SDLGFX: Failed to allocate texture.\n");
@@ -812,6 +909,242 @@ void render_gl_buffer (const struct gl_buffer_t *buffer, int first_line, int las
     glEnd ();
 }
 
+/**
+ ** Streaming uploads for the double-buffered output.
+ **
+ ** flush_block only stamps the changed lines with the current frame number.
+ ** At flush_screen, the lines changed since a slot was last used are copied
+ ** into that slot's pixel buffer object and uploaded from there into the
+ ** slot's own texture, so neither the copy nor the upload has to wait for
+ ** the GPU to finish drawing the previous frames. With ARB_buffer_storage
+ ** the buffers stay mapped and a fence tells when a slot is free again,
+ ** otherwise each map orphans the old storage.
+ **/
+
+#define GL_STREAM_SLOTS 3
+
+struct gl_stream_slot_t
+{
+    GLuint   pbo;
+    GLuint   texture;
+    void    *fence;
+    uae_u8  *map;
+    uae_u32  frame;
+};
+
+struct gl_stream_run_t
+{
+    int first;
+    int count;
+};
+
+static struct gl_stream_t
+{
+    int      slots;
+    int      current;
+    uae_u32  frame;
+    uae_u32 *line_frame;
+    int      lines;
+    struct gl_stream_run_t *runs;
+    ptrdiff_t size;
+    int      persistent;
+    uae_u32  stalls;
+    struct gl_stream_slot_t slot[GL_STREAM_SLOTS];
+} glstream;
+
+static void free_gl_stream (struct gl_buffer_t *buffer)
+{
+    int i;
+
+    if (!glstream.slots)
+		return;
+
+    write_log ("SDLGFX: Streamed %u frames, waited for the GPU %u times.\n", glstream.frame - 1, glstream.stalls);
+
+    for (i = 0; i < glstream.slots; i++) {
+		struct gl_stream_slot_t *slot = &glstream.slot[i];
+
+		if (slot->fence)
+			pglDeleteSync (slot->fence);
+		if (slot->map) {
+			pglBindBuffer (GL_PIXEL_UNPACK_BUFFER, slot->pbo);
+			pglUnmapBuffer (GL_PIXEL_UNPACK_BUFFER);
+		}
+		if (slot->pbo)
+			pglDeleteBuffers (1, &slot->pbo);
+		/* slot 0 uses the texture of the buffer itself */
+		if (i > 0 && slot->texture)
+			glDeleteTextures (1, &slot->texture);
+    }
+    pglBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture (buffer->target, buffer->texture);
+
+    xfree (glstream.line_frame);
+    xfree (glstream.runs);
+    memset (&glstream, 0, sizeof glstream);
+}
+
+static int alloc_gl_stream (struct gl_buffer_t *buffer)
+{
+    int i;
+
+    memset (&glstream, 0, sizeof glstream);
+    /* Client storage already avoids the copy and does not mix with PBOs */
+    if (!have_pixel_buffer_object || have_apple_client_storage)
+		return 0;
+
+    glstream.lines      = buffer->texture_height;
+    glstream.size       = (ptrdiff_t)buffer->pitch * buffer->texture_height;
+    glstream.line_frame = xcalloc (uae_u32, glstream.lines);
+    glstream.runs       = xcalloc (struct gl_stream_run_t, glstream.lines / 2 + 1);
+    glstream.persistent = have_buffer_storage;
+    /* slots start at frame 0 and every line at frame 1, so all of them upload once */
+    glstream.frame      = 1;
+    for (i = 0; i < glstream.lines; i++)
+		glstream.line_frame[i] = 1;
+
+    glGetError ();
+    for (i = 0; i < GL_STREAM_SLOTS; i++) {
+		struct gl_stream_slot_t *slot = &glstream.slot[i];
+
+		glstream.slots++;
+		if (i == 0) {
+			slot->texture = buffer->texture;
+		} else {
+			glGenTextures   (1, &slot->texture);
+			glBindTexture   (buffer->target, slot->texture);
+			glTexParameteri (buffer->target, GL_TEXTURE_WRAP_S, GL_CLAMP);
+			glTexParameteri (buffer->target, GL_TEXTURE_WRAP_T, GL_CLAMP);
+			glTexImage2D    (buffer->target, 0, buffer->intformat, buffer->texture_width, buffer->texture_height, 0, buffer->format, buffer->type, NULL);
+		}
+
+		pglGenBuffers (1, &slot->pbo);
+		pglBindBuffer (GL_PIXEL_UNPACK_BUFFER, slot->pbo);
+		if (glstream.persistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+			pglBufferStorage (GL_PIXEL_UNPACK_BUFFER, glstream.size, NULL, flags);
+			slot->map = (uae_u8 *) pglMapBufferRange (GL_PIXEL_UNPACK_BUFFER, 0, glstream.size, flags);
+			if (!slot->map)
+				break;
+		} else {
+			pglBufferData (GL_PIXEL_UNPACK_BUFFER, glstream.size, NULL, GL_STREAM_DRAW);
+		}
+		if (glGetError () != GL_NO_ERROR)
+			break;
+    }
+    pglBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture (buffer->target, buffer->texture);
+
+    if (i < GL_STREAM_SLOTS || glGetError () != GL_NO_ERROR) {
+		write_log ("SDLGFX: Failed to allocate pixel buffer objects.\n");
+		free_gl_stream (buffer);
+		return 0;
+    }
+
+    write_log ("SDLGFX: Streaming through %d %s pixel buffer objects.\n", glstream.slots, glstream.persistent ? "persistently mapped" : "orphaned");
+    return 1;
+}
+
+static void mark_gl_stream (int first_line, int last_line)
+{
+    int i;
+
+    if (first_line < 0)
+		first_line = 0;
+    if (last_line >= glstream.lines)
+		last_line = glstream.lines - 1;
+    for (i = first_line; i <= last_line; i++)
+		glstream.line_frame[i] = glstream.frame;
+}
+
+/* Brings the texture of the current slot up to date and binds it. */
+static void upload_gl_stream (const struct gl_buffer_t *buffer)
+{
+    struct gl_stream_slot_t *slot = &glstream.slot[glstream.current];
+    struct gl_stream_run_t *run;
+    uae_u8 *map;
+    int nruns = 0;
+    int i;
+
+    for (i = 0; i < glstream.lines; i++) {
+		if (glstream.line_frame[i] <= slot->frame)
+			continue;
+		if (nruns > 0 && glstream.runs[nruns - 1].first + glstream.runs[nruns - 1].count == i) {
+			glstream.runs[nruns - 1].count++;
+		} else {
+			glstream.runs[nruns].first = i;
+			glstream.runs[nruns].count = 1;
+			nruns++;
+		}
+    }
+    slot->frame = glstream.frame++;
+
+    glBindTexture (buffer->target, slot->texture);
+    if (!nruns)
+		return;
+
+    pglBindBuffer (GL_PIXEL_UNPACK_BUFFER, slot->pbo);
+    if (glstream.persistent) {
+		if (slot->fence) {
+			if (pglClientWaitSync (slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+				glstream.stalls++;
+				while (pglClientWaitSync (slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+					;
+			}
+			pglDeleteSync (slot->fence);
+			slot->fence = NULL;
+		}
+		map = slot->map;
+    } else if (pglMapBufferRange) {
+		map = (uae_u8 *) pglMapBufferRange (GL_PIXEL_UNPACK_BUFFER, 0, glstream.size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    } else {
+		pglBufferData (GL_PIXEL_UNPACK_BUFFER, glstream.size, NULL, GL_STREAM_DRAW);
+		map = (uae_u8 *) pglMapBuffer (GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    }
+
+    if (!map) {
+		/* upload straight from the display surface then */
+		pglBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+		for (i = 0, run = glstream.runs; i < nruns; i++, run++)
+			flush_gl_buffer (buffer, run->first, run->first + run->count - 1);
+		return;
+    }
+
+    for (i = 0, run = glstream.runs; i < nruns; i++, run++) {
+		size_t offset = (size_t)buffer->pitch * run->first;
+		memcpy (map + offset, buffer->pixels + offset, (size_t)buffer->pitch * run->count);
+    }
+    if (!glstream.persistent)
+		pglUnmapBuffer (GL_PIXEL_UNPACK_BUFFER);
+
+    for (i = 0, run = glstream.runs; i < nruns; i++, run++) {
+		size_t offset = (size_t)buffer->pitch * run->first;
+		glTexSubImage2D (buffer->target, 0, 0, run->first, buffer->texture_width, run->count, buffer->format, buffer->type, (const GLvoid *) offset);
+    }
+    pglBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+/* Called after the frame has been drawn from the current slot. */
+static void finish_gl_stream (void)
+{
+    struct gl_stream_slot_t *slot = &glstream.slot[glstream.current];
+
+    if (glstream.persistent && !slot->fence)
+		slot->fence = pglFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glstream.current = (glstream.current + 1) % glstream.slots;
+}
+
+static void render_gl_frame (const struct gl_buffer_t *buffer, int first_line, int last_line)
+{
+    if (glstream.slots) {
+		upload_gl_stream (buffer);
+		render_gl_buffer (buffer, first_line, last_line);
+		finish_gl_stream ();
+    } else
+		render_gl_buffer (buffer, first_line, last_line);
+}
+
 #endif /* USE_GL */
 
 /**
@@ -939,6 +1272,13 @@ static void sdl_gl_flush_block (struct vidbuf_description *gfxinfo, int first_li
     flush_gl_buffer (&glbuffer, first_line, last_line);
 }
 
+static void sdl_gl_flush_block_stream (struct vidbuf_description *gfxinfo, int first_line, int last_line)
+{
+    DEBUG_LOG ("Function: sdl_gl_flush_block_stream %d %d\n", first_line, last_line);
+
+    mark_gl_stream (first_line, last_line);
+}
+
 /* Single-buffered flush-screen method */
 static void sdl_gl_flush_screen (struct vidbuf_description *gfxinfo, int first_line, int last_line)
 {
@@ -949,7 +1289,7 @@ static void sdl_gl_flush_screen (struct vidbuf_description *gfxinfo, int first_l
 /* Double-buffered flush-screen method */
 static void sdl_gl_flush_screen_dbl (struct vidbuf_description *gfxinfo, int first_line, int last_line)
 {
-    render_gl_buffer (&glbuffer, 0, display->h - 1);
+    render_gl_frame (&glbuffer, 0, display->h - 1);
     SDL_GL_SwapBuffers ();
 }
 
@@ -959,7 +1299,7 @@ static void sdl_gl_flush_screen_vsync (struct vidbuf_description *gfxinfo, int f
     frame_time_t start_time;
     frame_time_t sleep_time;
 
-    render_gl_buffer (&glbuffer, 0, display->h - 1);
+    render_gl_frame (&glbuffer, 0, display->h - 1);
 
     start_time = read_processor_time ();
 
@@ -1116,6 +1456,10 @@ static int graphics_subinit_gl (void)
 	init_gl_display (current_width, current_height);
 	if (!alloc_gl_buffer (&glbuffer, current_width, current_height, want_16bit))
 	    return 0;
+	/* the double-buffered methods redraw whole frames, so they can take
+	 * the changed lines from the stream at flush_screen time */
+	if (dblbuff && !screen_is_picasso && alloc_gl_stream (&glbuffer))
+	    gfxvidinfo.flush_block = sdl_gl_flush_block_stream;
 
 #ifdef PICASSO96
 	if (!screen_is_picasso) {
@@ -1517,6 +1517,7 @@ void gfxboard_reset (void)
 		gfxmem_bank.mask = currprefs.rtgmem_size - 1;
 	}
 	if (vram) {
+		picasso_freewritewatch ();
 		mapped_free (vramrealstart);
 		gfxmem_bank.baseaddr = NULL;
 	}
@@ -31,6 +31,7 @@
 #include "zfile.h"
 #include "sleep.h"
 #include "misc.h"
+#include "writewatch.h"
 
 #if USE_CHD
 #include "archivers/chd/chdtypes.h"
@@ -381,6 +382,8 @@ static void create_virtual_rdb (struct hardfiledata *hfd)
 	rdb_crc (part);
 
 	hfd->virtsize += size;
+	/* everything moved up */
+	hdf_init_cache (hfd);
 
 }
 
@@ -441,26 +444,6 @@ static uae_u32 vhd_checksum (uae_u8 *p, int offset)
 	return ~sum;
 }
 
-static int hdf_write2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
-static int hdf_read2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
-
-static void hdf_init_cache (struct hardfiledata *hfd)
-{
-}
-static void hdf_flush_cache (struct hardfiledata *hdf)
-{
-}
-
-static int hdf_cache_read (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
-{
-	return hdf_read2 (hfd, buffer, offset, len);
-}
-
-static int hdf_cache_write (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
-{
-	return hdf_write2 (hfd, buffer, offset, len);
-}
-
 int hdf_open (struct hardfiledata *hfd, const TCHAR *pname)
 {
 	uae_u8 tmp[512], tmp2[512];
@@ -548,9 +531,8 @@ int hdf_open (struct hardfiledata *hfd, const TCHAR *pname)
 	write_log (_T("HDF is VHD %s image, virtual size=%lluK\n"),
 		hfd->hfd_type == HFD_VHD_FIXED ? _T("fixed") : _T("dynamic"),
 		hfd->virtsize / 1024);
-	hdf_init_cache (hfd);
-	return 1;
 nonvhd:
+	hdf_init_cache (hfd);
 	return 1;
 end:
 	hdf_close_target (hfd);
@@ -559,7 +541,7 @@ end:
 
 void hdf_close (struct hardfiledata *hfd)
 {
-	hdf_flush_cache (hfd);
+	hdf_free_cache (hfd);
 	hdf_close_target (hfd);
 #if USE_CHD
 	if (hfd->chd_handle) {
@@ -866,7 +848,7 @@ end:
 	return ret;
 }
 
-static int hdf_read2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+int hdf_read2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
 {
 	if (hfd->hfd_type == HFD_VHD_DYNAMIC)
 		return vhd_read (hfd, buffer, offset, len);
@@ -884,7 +866,7 @@ static int hdf_read2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, in
 		return hdf_read_target (hfd, buffer, offset, len);
 }
 
-static int hdf_write2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+int hdf_write2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
 {
 	if (hfd->hfd_type == HFD_VHD_DYNAMIC)
 		return vhd_write (hfd, buffer, offset, len);
@@ -1080,8 +1062,14 @@ int hdf_write (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
 
 static uae_u64 cmd_readx (struct hardfiledata *hfd, uae_u8 *dataptr, uae_u64 offset, uae_u64 len)
 {
+	uae_u8 *iobuf;
+	int v;
+
 	gui_flicker_led (LED_HD, hfd->unitnum, 1);
-	return hdf_read (hfd, dataptr, offset, len);
+	iobuf = writewatch_io_begin (dataptr, len);
+	v = hdf_read (hfd, iobuf, offset, len);
+	writewatch_io_end (dataptr, iobuf, v > 0 ? v : 0);
+	return v;
 }
 static uae_u64 cmd_read (struct hardfiledata *hfd, uaecptr dataptr, uae_u64 offset, uae_u64 len)
 {
@@ -1181,6 +1169,8 @@ int scsi_hd_emulate (struct hardfiledata *hfd, struct hd_hardfiledata *hdhfd, ua
 		if (!checkbounds(hfd, offset, len))
 			goto outofbounds;
 		scsi_len = (uae_u32)cmd_writex (hfd, scsi_data, offset, len);
+		if (scsi_len != len)
+			goto writeerr;
 		break;
 	case 0x12: /* INQUIRY */
 		{
@@ -1374,6 +1364,8 @@ int scsi_hd_emulate (struct hardfiledata *hfd, struct hd_hardfiledata *hdhfd, ua
 		if (!checkbounds (hfd, offset, len))
 			goto outofbounds;
 		scsi_len = (uae_u32)cmd_writex (hfd, scsi_data, offset, len);
+		if (scsi_len != len)
+			goto writeerr;
 		break;
 	case 0x2f: /* VERIFY (10) */
 		{
@@ -1406,6 +1398,8 @@ int scsi_hd_emulate (struct hardfiledata *hfd, struct hd_hardfiledata *hdhfd, ua
 	case 0x35: /* SYNCRONIZE CACHE (10) */
 		if (nodisk (hfd))
 			goto nodisk;
+		if (!hdf_flush_cache (hfd))
+			goto writeerr;
 		scsi_len = 0;
 		break;
 	case 0xa8: /* READ (12) */
@@ -1431,6 +1425,8 @@ int scsi_hd_emulate (struct hardfiledata *hfd, struct hd_hardfiledata *hdhfd, ua
 		if (!checkbounds(hfd, offset, len))
 			goto outofbounds;
 		scsi_len = (uae_u32)cmd_writex (hfd, scsi_data, offset, len);
+		if (scsi_len != len)
+			goto writeerr;
 		break;
 	case 0x37: /* READ DEFECT DATA */
 		if (nodisk (hfd))
@@ -1478,6 +1474,14 @@ outofbounds:
 		s[12] = 0x21; /* LOGICAL BLOCK OUT OF RANGE */
 		ls = 0x12;
 		break;
+writeerr:
+		lr = -1;
+		status = 2; /* CHECK CONDITION */
+		s[0] = 0x70;
+		s[2] = 3; /* MEDIUM ERROR */
+		s[12] = 0x0c; /* WRITE ERROR */
+		ls = 0x12;
+		break;
 miscompare:
 		lr = -1;
 		status = 2; /* CHECK CONDITION */
@@ -1841,6 +1845,8 @@ static uae_u32 hardfile_do_io (struct hardfiledata *hfd, struct hardfileprivdata
 				goto bad_len;
 			}
 			actual = (uae_u32)cmd_write (hfd, dataptr, offset, len);
+			if (actual != len)
+				error = 45; /* HFERR_BadStatus */
 		}
 		break;
 
@@ -1868,6 +1874,8 @@ static uae_u32 hardfile_do_io (struct hardfiledata *hfd, struct hardfileprivdata
 				goto bad_len;
 			}
 			actual = (uae_u32)cmd_write (hfd, dataptr, offset64, len);
+			if (actual != len)
+				error = 45; /* HFERR_BadStatus */
 		}
 		break;
 
@@ -1923,8 +1931,12 @@ static uae_u32 hardfile_do_io (struct hardfiledata *hfd, struct hardfileprivdata
 		actual = hfd->drive_empty ? 1 :0;
 		break;
 
-		/* Some commands that just do nothing and return zero */
 	case CMD_UPDATE:
+		if (!hdf_flush_cache (hfd))
+			error = 45; /* HFERR_BadStatus */
+		break;
+
+		/* Some commands that just do nothing and return zero */
 	case CMD_CLEAR:
 	case CMD_MOTOR:
 	case CMD_SEEK:
@@ -2105,6 +2117,12 @@ static void *hardfile_thread (void *devs)
 		} else {
 			hf_log2 (_T("async request %08X\n"), request);
 		}
+		/* read ahead while nothing else is queued */
+		if (!comm_pipe_has_data (&hfpd->requests)) {
+			struct hardfiledata *hfd = get_hardfile_data (hfpd - &hardfpd[0]);
+			if (hfd)
+				hdf_cache_readahead (hfd);
+		}
 		uae_sem_post (&change_sem);
 	}
 }
@@ -0,0 +1,308 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Hardfile block cache
+  *
+  * Sits between hdf_read ()/hdf_write () and the image format code
+  * (hdf_read2 ()/hdf_write2 ()), so it caches the disk as the Amiga sees
+  * it. Blocks of HDF_CACHE_BLOCK_SIZE bytes live in sets of
+  * HDF_CACHE_WAYS, the least recently used block of a set is replaced.
+  * Writes only go to the cache, dirty blocks are written back when they
+  * are replaced, on CMD_UPDATE and SYNCHRONIZE CACHE and when the
+  * hardfile is closed. A block that can't be written back stays dirty
+  * and the failure is reported by the next write or flush, the Amiga was
+  * already told the original write succeeded. Transfers of
+  * HDF_CACHE_BYPASS bytes or more go
+  * straight to the image, streaming a big file would otherwise push the
+  * file system metadata out of the cache.
+  *
+  * Sequential reads leave a hint behind, the hardfile thread loads the
+  * following blocks with hdf_cache_readahead () when it is idle.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "filesys.h"
+
+#define HDF_CACHE_SETS (MAX_HDF_CACHE_BLOCKS / HDF_CACHE_WAYS)
+#define HDF_CACHE_BYPASS (2 * HDF_CACHE_BLOCK_SIZE)
+#define HDF_CACHE_READAHEAD 2
+
+/* Drop all contents, nothing may be dirty. Called whenever the layout of
+   the image changes.  */
+void hdf_init_cache (struct hardfiledata *hfd)
+{
+	int i;
+
+	if (!hfd->bcache_mem)
+		hfd->bcache_mem = xmalloc (uae_u8, MAX_HDF_CACHE_BLOCKS * HDF_CACHE_BLOCK_SIZE);
+	for (i = 0; i < MAX_HDF_CACHE_BLOCKS; i++) {
+		struct hdf_cache *c = &hfd->bcache[i];
+		c->valid = false;
+		c->dirty = false;
+		c->data = hfd->bcache_mem ? hfd->bcache_mem + i * HDF_CACHE_BLOCK_SIZE : NULL;
+	}
+	hfd->bcache_tick = 0;
+	hfd->bcache_next = 0;
+	hfd->bcache_seq = 0;
+	hfd->bcache_error = false;
+}
+
+void hdf_free_cache (struct hardfiledata *hfd)
+{
+	int i;
+
+	hdf_flush_cache (hfd);
+	xfree (hfd->bcache_mem);
+	hfd->bcache_mem = NULL;
+	for (i = 0; i < MAX_HDF_CACHE_BLOCKS; i++) {
+		hfd->bcache[i].valid = false;
+		hfd->bcache[i].data = NULL;
+	}
+}
+
+/* Bytes of the image in <block>, the last one may be short */
+static int blocklen (struct hardfiledata *hfd, uae_u64 block)
+{
+	uae_u64 start = block * HDF_CACHE_BLOCK_SIZE;
+
+	if (start >= hfd->virtsize)
+		return 0;
+	if (hfd->virtsize - start < HDF_CACHE_BLOCK_SIZE)
+		return (int)(hfd->virtsize - start);
+	return HDF_CACHE_BLOCK_SIZE;
+}
+
+static bool writeback (struct hardfiledata *hfd, struct hdf_cache *c)
+{
+	int len;
+
+	if (!c->valid || !c->dirty)
+		return true;
+	len = blocklen (hfd, c->block);
+	if (hdf_write2 (hfd, c->data, c->block * HDF_CACHE_BLOCK_SIZE, len) != len) {
+		write_log (_T("HDF: cache write back at %llx failed\n"), c->block * HDF_CACHE_BLOCK_SIZE);
+		hfd->bcache_error = true;
+		return false;
+	}
+	c->dirty = false;
+	return true;
+}
+
+static struct hdf_cache *lookup (struct hardfiledata *hfd, uae_u64 block, bool touch)
+{
+	struct hdf_cache *c = &hfd->bcache[(block % HDF_CACHE_SETS) * HDF_CACHE_WAYS];
+	int i;
+
+	for (i = 0; i < HDF_CACHE_WAYS; i++, c++) {
+		if (c->valid && c->block == block) {
+			if (touch)
+				c->lastaccess = ++hfd->bcache_tick;
+			return c;
+		}
+	}
+	return NULL;
+}
+
+/* Cache <block>, loaded from the image unless <fill> is false. NULL if
+   it could not be read or the replaced block could not be written back,
+   the caller then goes to the image directly.  */
+static struct hdf_cache *getblock (struct hardfiledata *hfd, uae_u64 block, bool fill)
+{
+	struct hdf_cache *c, *victim = NULL;
+	int i, len;
+
+	c = lookup (hfd, block, true);
+	if (c)
+		return c;
+	c = &hfd->bcache[(block % HDF_CACHE_SETS) * HDF_CACHE_WAYS];
+	for (i = 0; i < HDF_CACHE_WAYS; i++, c++) {
+		if (!c->valid) {
+			victim = c;
+			break;
+		}
+		/* ages, the tick may wrap */
+		if (!victim || hfd->bcache_tick - c->lastaccess > hfd->bcache_tick - victim->lastaccess)
+			victim = c;
+	}
+	if (!writeback (hfd, victim))
+		return NULL;
+	victim->valid = false;
+	len = blocklen (hfd, block);
+	if (fill && hdf_read2 (hfd, victim->data, block * HDF_CACHE_BLOCK_SIZE, len) != len)
+		return NULL;
+	victim->valid = true;
+	victim->dirty = false;
+	victim->block = block;
+	victim->lastaccess = ++hfd->bcache_tick;
+	return victim;
+}
+
+static int cmp_block (const void *a, const void *b)
+{
+	const struct hdf_cache *ca = *(const struct hdf_cache**)a;
+	const struct hdf_cache *cb = *(const struct hdf_cache**)b;
+
+	return ca->block < cb->block ? -1 : ca->block > cb->block;
+}
+
+/* Write back all dirty blocks, in disk order. False if that failed now
+   or a write back failed since the last report.  */
+bool hdf_flush_cache (struct hardfiledata *hfd)
+{
+	struct hdf_cache *dirty[MAX_HDF_CACHE_BLOCKS];
+	bool ok = !hfd->bcache_error;
+	int i, cnt = 0;
+
+	hfd->bcache_error = false;
+	if (!hfd->bcache_mem)
+		return ok;
+	for (i = 0; i < MAX_HDF_CACHE_BLOCKS; i++) {
+		if (hfd->bcache[i].valid && hfd->bcache[i].dirty)
+			dirty[cnt++] = &hfd->bcache[i];
+	}
+	if (cnt > 1)
+		qsort (dirty, cnt, sizeof (struct hdf_cache*), cmp_block);
+	for (i = 0; i < cnt; i++) {
+		if (!writeback (hfd, dirty[i]))
+			ok = false;
+	}
+	hfd->bcache_error = false;
+	return ok;
+}
+
+/* Copy between cached blocks and a transfer that went past the cache.
+   Dirty blocks are newer than the image, cached blocks older than data
+   just written.  */
+static void bypass_sync (struct hardfiledata *hfd, uae_u8 *p, uae_u64 offset, int len, bool write)
+{
+	uae_u64 block;
+
+	for (block = offset / HDF_CACHE_BLOCK_SIZE; block * HDF_CACHE_BLOCK_SIZE < offset + len; block++) {
+		struct hdf_cache *c = lookup (hfd, block, false);
+		uae_u64 start, end, bstart = block * HDF_CACHE_BLOCK_SIZE;
+		if (!c || (!write && !c->dirty))
+			continue;
+		start = offset > bstart ? offset : bstart;
+		end = bstart + blocklen (hfd, block);
+		if (end > offset + len)
+			end = offset + len;
+		if (start >= end)
+			continue;
+		if (write)
+			memcpy (c->data + (start - bstart), p + (start - offset), (size_t)(end - start));
+		else
+			memcpy (p + (start - offset), c->data + (start - bstart), (size_t)(end - start));
+	}
+}
+
+int hdf_cache_read (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	uae_u8 *p = (uae_u8*)buffer;
+	int done = 0;
+
+	if (!hfd->bcache_mem || len <= 0)
+		return hdf_read2 (hfd, buffer, offset, len);
+
+	if (offset == hfd->bcache_next && len < HDF_CACHE_BYPASS)
+		hfd->bcache_seq++;
+	else
+		hfd->bcache_seq = 0;
+	hfd->bcache_next = offset + len;
+
+	if (len >= HDF_CACHE_BYPASS || offset + len > hfd->virtsize) {
+		int got = hdf_read2 (hfd, buffer, offset, len);
+		if (got > 0)
+			bypass_sync (hfd, p, offset, got, false);
+		return got;
+	}
+	while (len > 0) {
+		uae_u64 block = offset / HDF_CACHE_BLOCK_SIZE;
+		int boff = (int)(offset % HDF_CACHE_BLOCK_SIZE);
+		int blen = HDF_CACHE_BLOCK_SIZE - boff;
+		struct hdf_cache *c;
+
+		if (blen > len)
+			blen = len;
+		c = getblock (hfd, block, true);
+		if (c) {
+			memcpy (p, c->data + boff, blen);
+		} else {
+			int got = hdf_read2 (hfd, p, offset, blen);
+			if (got != blen)
+				return done + (got > 0 ? got : 0);
+		}
+		done += blen;
+		offset += blen;
+		p += blen;
+		len -= blen;
+	}
+	return done;
+}
+
+int hdf_cache_write (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	uae_u8 *p = (uae_u8*)buffer;
+	int done = 0;
+
+	if (!hfd->bcache_mem || len <= 0)
+		return hdf_write2 (hfd, buffer, offset, len);
+
+	/* fail this write for an earlier write back that failed */
+	if (hfd->bcache_error) {
+		hfd->bcache_error = false;
+		return 0;
+	}
+	if (len >= HDF_CACHE_BYPASS || offset + len > hfd->virtsize) {
+		int got = hdf_write2 (hfd, buffer, offset, len);
+		if (got > 0)
+			bypass_sync (hfd, p, offset, got, true);
+		return got;
+	}
+	while (len > 0) {
+		uae_u64 block = offset / HDF_CACHE_BLOCK_SIZE;
+		int boff = (int)(offset % HDF_CACHE_BLOCK_SIZE);
+		int blen = HDF_CACHE_BLOCK_SIZE - boff;
+		struct hdf_cache *c;
+
+		if (blen > len)
+			blen = len;
+		/* whole blocks need not be read first */
+		c = getblock (hfd, block, boff != 0 || blen != blocklen (hfd, block));
+		if (c) {
+			memcpy (c->data + boff, p, blen);
+			c->dirty = true;
+		} else {
+			int got = hdf_write2 (hfd, p, offset, blen);
+			if (got != blen)
+				return done + (got > 0 ? got : 0);
+		}
+		done += blen;
+		offset += blen;
+		p += blen;
+		len -= blen;
+	}
+	return done;
+}
+
+/* Load the blocks following a sequential read, returns false if there
+   was nothing to do */
+bool hdf_cache_readahead (struct hardfiledata *hfd)
+{
+	uae_u64 block;
+	int i;
+
+	if (!hfd->bcache_mem || hfd->bcache_seq <= 0)
+		return false;
+	hfd->bcache_seq = 0;
+	block = hfd->bcache_next / HDF_CACHE_BLOCK_SIZE;
+	for (i = 0; i < HDF_CACHE_READAHEAD; i++, block++) {
+		if (!blocklen (hfd, block))
+			break;
+		if (!lookup (hfd, block, false))
+			getblock (hfd, block, true);
+	}
+	return true;
+}
@@ -15,6 +15,8 @@
 #include "filesys.h"
 #include "zfile.h"
 
+#include <unistd.h>
+
 #define hfd_log write_log
 
 //#define HDF_DEBUG
@@ -274,16 +276,11 @@ int hdf_open_target (struct hardfiledata *hfd, const char *pname)
 			i--;
 		}
 		if (h != INVALID_HANDLE_VALUE) {
-			size_t ret;
-			int low;
-			ret = fseek (h, 0, SEEK_END);
-			if (ret)
-				goto end;
-			low = ftell (h);
-			if (low == -1)
+			/* lseek, unlike st_size, also sizes block devices */
+			off_t size = lseek (fileno (h), 0, SEEK_END);
+			if (size == (off_t)-1)
 				goto end;
-//			low &= ~(hfd->blocksize - 1);
-			hfd->physsize = hfd->virtsize = low;
+			hfd->physsize = hfd->virtsize = size;
 			hfd->handle_valid = HDF_HANDLE_LINUX;
 			if (hfd->physsize < 64 * 1024 * 1024 && zmode) {
 				write_log ("HDF '%s' re-opened in zfile-mode\n", name);
@@ -443,6 +440,71 @@ void hfd_flush_cache (struct hardfiledata *hfd, int now)
 }
 #endif
 
+/* Plain files and devices are accessed with positional I/O straight from
+   and into the caller's buffer, which usually is Amiga memory: no stdio
+   buffering, no seek and no copy through hfd->cache. The block cache in
+   hardfile_cache.c sits above this.  */
+static int hdf_pio_len (struct hardfiledata *hfd, uae_u64 offset, int len)
+{
+	uae_u64 size = hfd->physsize - hfd->virtual_size;
+
+	if (len < 0 || offset >= size)
+		return 0;
+	if (offset + len > size)
+		len = (int)(size - offset);
+	return len;
+}
+
+static int hdf_pread (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	uae_u8 *p = (uae_u8*)buffer;
+	int fd = fileno (hfd->handle->h);
+	int got = 0;
+
+	len = hdf_pio_len (hfd, offset, len);
+	offset += hfd->offset;
+	while (got < len) {
+		ssize_t ret = pread (fd, p + got, len - got, offset + got);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			write_log ("hdf_read: pread at 0x%llx failed, error %d\n", offset + got, errno);
+			break;
+		}
+		got += ret;
+	}
+	return got;
+}
+
+static int hdf_pwrite (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	uae_u8 *p = (uae_u8*)buffer;
+	int fd = fileno (hfd->handle->h);
+	int done = 0;
+
+	if (hfd->dangerous)
+		return 0;
+	len = hdf_pio_len (hfd, offset, len);
+	offset += hfd->offset;
+	while (done < len) {
+		ssize_t ret = pwrite (fd, p + done, len - done, offset + done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			gui_message ("Harddrive\n%s\nwrite failed, error %d!", hfd->device_name, errno);
+			return done;
+		}
+		done += ret;
+	}
+	if (offset == 0 && len >= 512) {
+		uae_u8 tmp[512];
+		memset (tmp, 0xa1, sizeof tmp);
+		if (pread (fd, tmp, sizeof tmp, 0) != sizeof tmp || memcmp (p, tmp, sizeof tmp))
+			gui_message ("Harddrive\n%s\nblock zero write failed!", hfd->device_name);
+	}
+	return done;
+}
+
 static int hdf_read_2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
 {
 	long outlen = 0;
@@ -493,6 +555,8 @@ int hdf_read_target (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int
 		return len2;
 	}
 	offset -= hfd->virtual_size;
+	if (hfd->handle_valid == HDF_HANDLE_LINUX)
+		return hdf_pread (hfd, buffer, offset, len);
 	while (len > 0) {
 		unsigned int maxlen;
 		size_t ret = 0;
@@ -566,6 +630,8 @@ int hdf_write_target (struct hardfiledata *hfd, void *buffer, uae_u64 offset, in
 	if (offset < hfd->virtual_size)
 		return len;
 	offset -= hfd->virtual_size;
+	if (hfd->handle_valid == HDF_HANDLE_LINUX)
+		return hdf_pwrite (hfd, buffer, offset, len);
 	while (len > 0) {
 		int maxlen = len > CACHE_SIZE ? CACHE_SIZE : len;
 		int ret = hdf_write_2 (hfd, p, offset, maxlen);
@@ -0,0 +1,57 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Headless benchmark mode
+  */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "machdep/rpt.h"
+
+/* Subsystems host time is charged to. Time not spent in any of the
+ * others belongs to the CPU emulation. */
+enum {
+	BENCH_CPU,
+	BENCH_CUSTOM,
+	BENCH_BLITTER,
+	BENCH_AUDIO,
+	BENCH_DRAWING,
+	BENCH_DISK,
+	BENCH_MAX
+};
+
+extern int benchmark_frames;
+extern bool bench_active;
+extern int bench_subsys;
+extern frame_time_t bench_mark;
+extern uae_u64 bench_time[BENCH_MAX];
+
+/* Charge the time since the last switch to the running subsystem and
+ * make <subsys> the running one. Returns the previous subsystem, which
+ * must be passed to bench_leave (). */
+STATIC_INLINE int bench_enter (int subsys)
+{
+	int old = bench_subsys;
+
+	if (bench_active) {
+		frame_time_t t = read_processor_time ();
+		bench_time[old] += (frame_time_t)(t - bench_mark);
+		bench_mark = t;
+	}
+	bench_subsys = subsys;
+	return old;
+}
+
+STATIC_INLINE void bench_leave (int old)
+{
+	bench_enter (old);
+}
+
+/* -benchmark=<frames> and -benchmark_report=<file>, true if consumed */
+extern bool benchmark_cmdline (const TCHAR *arg);
+extern int benchmark_graphics_init (void);
+extern void benchmark_start (void);
+extern void benchmark_vsync (void);
+
+#endif /* BENCHMARK_H */
@@ -54,6 +54,18 @@ typedef void blitter_func(uaecptr, uaecptr, uaecptr, uaecptr, struct bltinfo *);
 
 extern blitter_func * const blitfunc_dofast[256];
 extern blitter_func * const blitfunc_dofast_desc[256];
+
+/* Same on host pointers into chip RAM, four words at a time, with
+ * optional area fill. Descending functions get the address of the
+ * first (highest) word like the uaecptr ones. */
+typedef void blitter_wide_func(uae_u8 *, uae_u8 *, uae_u8 *, uae_u8 *, struct bltinfo *, int fill);
+
+#define BLITFILL_EXCLUSIVE 1
+#define BLITFILL_INCLUSIVE 2
+#define BLITFILL_CARRYIN 4
+
+extern blitter_wide_func * const blitfunc_dofast_wide[256];
+extern blitter_wide_func * const blitfunc_dofast_wide_desc[256];
 extern uae_u32 blit_masktable[BLITTER_MAX_WORDS];
 
 #define BLIT_MODE_IMMEDIATE -1
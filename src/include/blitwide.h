@@ -0,0 +1,112 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Helpers for the wide blitter functions (blitdofast_wide_*) generated
+  * by genblitter.
+  *
+  * They work on host pointers into chip RAM, four big endian Amiga words
+  * per uae_u64. Ascending blits keep the first word of a chunk in the top
+  * bits, descending blits in the bottom bits, so in both cases a shift
+  * moves bits from one word into the next one to be processed, and the
+  * carry between chunks is the word processed last.
+  */
+
+#ifndef UAE_BLITWIDE_H
+#define UAE_BLITWIDE_H
+
+#define BLITWIDE_WORDS 4
+
+STATIC_INLINE uae_u64 blit_get64 (const uae_u8 *p)
+{
+	return ((uae_u64)p[0] << 56) | ((uae_u64)p[1] << 48) | ((uae_u64)p[2] << 40) | ((uae_u64)p[3] << 32)
+		| ((uae_u64)p[4] << 24) | ((uae_u64)p[5] << 16) | ((uae_u64)p[6] << 8) | p[7];
+}
+
+STATIC_INLINE void blit_put64 (uae_u8 *p, uae_u64 v)
+{
+	p[0] = (uae_u8)(v >> 56);
+	p[1] = (uae_u8)(v >> 48);
+	p[2] = (uae_u8)(v >> 40);
+	p[3] = (uae_u8)(v >> 32);
+	p[4] = (uae_u8)(v >> 24);
+	p[5] = (uae_u8)(v >> 16);
+	p[6] = (uae_u8)(v >> 8);
+	p[7] = (uae_u8)v;
+}
+
+/* n (1-3) words, returned in the low bits */
+STATIC_INLINE uae_u64 blit_getn (const uae_u8 *p, int n)
+{
+	uae_u64 v = 0;
+
+	while (n--) {
+		v = (v << 16) | (p[0] << 8) | p[1];
+		p += 2;
+	}
+	return v;
+}
+
+STATIC_INLINE void blit_putn (uae_u8 *p, uae_u64 v, int n)
+{
+	p += n * 2;
+	while (n--) {
+		p -= 2;
+		p[0] = (uae_u8)(v >> 8);
+		p[1] = (uae_u8)v;
+		v >>= 16;
+	}
+}
+
+STATIC_INLINE uae_u64 blit_rep64 (uae_u16 w)
+{
+	return w * 0x0001000100010001ULL;
+}
+
+STATIC_INLINE uae_u64 blit_wordswap64 (uae_u64 v)
+{
+	v = (v >> 32) | (v << 32);
+	return ((v >> 16) & 0x0000ffff0000ffffULL) | ((v & 0x0000ffff0000ffffULL) << 16);
+}
+
+/* words first..first+n-1 of blit_masktable at their chunk positions */
+STATIC_INLINE uae_u64 blit_mask64 (int first, int n, int desc)
+{
+	uae_u64 m = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		uae_u64 w = blit_masktable[first + i] & 0xffff;
+		m |= w << (desc ? 16 * i : 48 - 16 * i);
+	}
+	return m;
+}
+
+/* Area fill of a whole chunk. The fill runs from bit 0 upwards through
+ * the words in processing order, the state before each bit is the carry
+ * in xor the parity of all lower bits, which is the exclusive prefix xor.
+ */
+STATIC_INLINE uae_u64 blit_fill64 (uae_u64 d, int *fc, int fill, int desc)
+{
+	uae_u64 p;
+	int c = *fc;
+
+	if (!desc)
+		d = blit_wordswap64 (d);
+	p = d;
+	p ^= p << 1;
+	p ^= p << 2;
+	p ^= p << 4;
+	p ^= p << 8;
+	p ^= p << 16;
+	p ^= p << 32;
+	*fc = c ^ (int)(p >> 63);
+	p <<= 1;
+	if (c)
+		p = ~p;
+	d = (fill & BLITFILL_INCLUSIVE) ? d | p : d ^ p;
+	if (!desc)
+		d = blit_wordswap64 (d);
+	return d;
+}
+
+#endif /* UAE_BLITWIDE_H */
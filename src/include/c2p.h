@@ -0,0 +1,234 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Chunky to planar and planar to chunky conversion kernels.
+  *
+  * Both directions are bit matrix transposes, done with the classic
+  * merge-swap butterfly: every stage exchanges the bits whose index
+  * differs in one position, using a shift, a mask and three xors,
+  * instead of moving bits one at a time. The SSE2 and AVX2 variants
+  * run the same stages on several words at once and give exactly the
+  * same results as the scalar code.
+  */
+
+#ifndef C2P_H
+#define C2P_H
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* 8x8 bit matrix transpose, bit 8 * r + c goes to bit 8 * c + r.
+ * With byte k holding the 8 bit slice of plane k, byte c of the result
+ * is the chunky pixel whose bit in each plane slice is c, so pixel x
+ * (counted from the left, bit 7) ends up in byte 7 - x.  */
+STATIC_INLINE uae_u64 c2p_transpose8 (uae_u64 x)
+{
+	uae_u64 t;
+
+	t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+	x ^= t ^ (t << 28);
+	return x;
+}
+
+/* Swap bit index i with bit index j > i inside a word, <mask> has the
+ * positions with bit i set and bit j clear, <d> is 2^j - 2^i */
+#define C2P_DELTA(x, d, mask) \
+	do { uae_u32 t_ = ((x) ^ ((x) >> (d))) & (mask); (x) ^= t_ ^ (t_ << (d)); } while (0)
+
+/* Exchange the upper half of <a> (bit s of the index set) with the
+ * lower half of <b>, which swaps a word index bit with bit s */
+#define C2P_MERGE(a, b, s, mask) \
+	do { uae_u32 t_ = (((a) >> (s)) ^ (b)) & (mask); (b) ^= t_; (a) ^= t_ << (s); } while (0)
+
+/* Akiko C2P: in[] holds 32 chunky pixels, four per longword with the
+ * first pixel of each in the low byte, the last longword has pixels
+ * 0-3. out[p] receives bitplane p, pixel 4 * (7 - k) + m being byte m
+ * of in[k].
+ * Numbering the input bits by longword k' = 7 - k, byte m and bit p
+ * and the output bits by plane p and position k', m, this moves index
+ * (k' | m p) to (p | k' m). Each longword's own index is rotated to
+ * (p m) first, then the three merges trade k' for p.  */
+STATIC_INLINE void c2p_akiko_scalar (const uae_u32 *in, uae_u32 *out)
+{
+	uae_u32 x[8];
+	int j;
+
+	for (j = 0; j < 8; j++) {
+		uae_u32 v = in[7 - j];
+		C2P_DELTA (v, 12, 0x0000f0f0);
+		C2P_DELTA (v, 6, 0x00cc00cc);
+		C2P_DELTA (v, 3, 0x0a0a0a0a);
+		C2P_DELTA (v, 1, 0x22222222);
+		x[j] = v;
+	}
+	for (j = 0; j < 4; j++)
+		C2P_MERGE (x[j], x[j + 4], 16, 0x0000ffff);
+	for (j = 0; j < 8; j += 4) {
+		C2P_MERGE (x[j + 0], x[j + 2], 8, 0x00ff00ff);
+		C2P_MERGE (x[j + 1], x[j + 3], 8, 0x00ff00ff);
+	}
+	for (j = 0; j < 8; j += 2)
+		C2P_MERGE (x[j], x[j + 1], 4, 0x0f0f0f0f);
+	for (j = 0; j < 8; j++)
+		out[j] = x[j];
+}
+
+/* Transpose n blocks with c2p_transpose8 () */
+STATIC_INLINE void c2p_transpose8_scalar (uae_u64 *x, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		x[i] = c2p_transpose8 (x[i]);
+}
+
+#if defined(__AVX2__)
+
+STATIC_INLINE __m256i c2p_delta256 (__m256i x, int d, uae_u32 mask)
+{
+	__m256i t = _mm256_and_si256 (_mm256_xor_si256 (x, _mm256_srli_epi32 (x, d)), _mm256_set1_epi32 (mask));
+	return _mm256_xor_si256 (x, _mm256_xor_si256 (t, _mm256_slli_epi32 (t, d)));
+}
+
+/* C2P_MERGE on all pairs at once, <p> is x with the partners of each
+ * lane, <m> the mask in the upper lane of each pair and 0 elsewhere */
+#define C2P_MERGE256(x, p, s, m, partner) \
+	do { \
+		__m256i t_ = _mm256_and_si256 (_mm256_xor_si256 (_mm256_srli_epi32 (p, s), x), m); \
+		x = _mm256_xor_si256 (x, _mm256_xor_si256 (t_, _mm256_slli_epi32 (partner (t_), s))); \
+	} while (0)
+#define C2P_PARTNER4(v) _mm256_permute2x128_si256 (v, v, 0x01)
+#define C2P_PARTNER2(v) _mm256_shuffle_epi32 (v, _MM_SHUFFLE (1, 0, 3, 2))
+#define C2P_PARTNER1(v) _mm256_shuffle_epi32 (v, _MM_SHUFFLE (2, 3, 0, 1))
+
+STATIC_INLINE void c2p_akiko (const uae_u32 *in, uae_u32 *out)
+{
+	__m256i x = _mm256_permutevar8x32_epi32 (_mm256_loadu_si256 ((const __m256i*)in),
+		_mm256_setr_epi32 (7, 6, 5, 4, 3, 2, 1, 0));
+
+	x = c2p_delta256 (x, 12, 0x0000f0f0);
+	x = c2p_delta256 (x, 6, 0x00cc00cc);
+	x = c2p_delta256 (x, 3, 0x0a0a0a0a);
+	x = c2p_delta256 (x, 1, 0x22222222);
+	C2P_MERGE256 (x, C2P_PARTNER4 (x), 16,
+		_mm256_setr_epi32 (0, 0, 0, 0, 0xffff, 0xffff, 0xffff, 0xffff), C2P_PARTNER4);
+	C2P_MERGE256 (x, C2P_PARTNER2 (x), 8,
+		_mm256_setr_epi32 (0, 0, 0x00ff00ff, 0x00ff00ff, 0, 0, 0x00ff00ff, 0x00ff00ff), C2P_PARTNER2);
+	C2P_MERGE256 (x, C2P_PARTNER1 (x), 4,
+		_mm256_setr_epi32 (0, 0x0f0f0f0f, 0, 0x0f0f0f0f, 0, 0x0f0f0f0f, 0, 0x0f0f0f0f), C2P_PARTNER1);
+	_mm256_storeu_si256 ((__m256i*)out, x);
+}
+
+STATIC_INLINE __m256i c2p_transpose8_256 (__m256i x)
+{
+	__m256i t;
+
+	t = _mm256_and_si256 (_mm256_xor_si256 (x, _mm256_srli_epi64 (x, 7)), _mm256_set1_epi64x (0x00aa00aa00aa00aaLL));
+	x = _mm256_xor_si256 (x, _mm256_xor_si256 (t, _mm256_slli_epi64 (t, 7)));
+	t = _mm256_and_si256 (_mm256_xor_si256 (x, _mm256_srli_epi64 (x, 14)), _mm256_set1_epi64x (0x0000cccc0000ccccLL));
+	x = _mm256_xor_si256 (x, _mm256_xor_si256 (t, _mm256_slli_epi64 (t, 14)));
+	t = _mm256_and_si256 (_mm256_xor_si256 (x, _mm256_srli_epi64 (x, 28)), _mm256_set1_epi64x (0x00000000f0f0f0f0LL));
+	return _mm256_xor_si256 (x, _mm256_xor_si256 (t, _mm256_slli_epi64 (t, 28)));
+}
+
+STATIC_INLINE void c2p_transpose8_n (uae_u64 *x, int n)
+{
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm256_storeu_si256 ((__m256i*)(x + i), c2p_transpose8_256 (_mm256_loadu_si256 ((const __m256i*)(x + i))));
+	c2p_transpose8_scalar (x + i, n - i);
+}
+
+#elif defined(__SSE2__)
+
+STATIC_INLINE __m128i c2p_delta128 (__m128i x, int d, uae_u32 mask)
+{
+	__m128i t = _mm_and_si128 (_mm_xor_si128 (x, _mm_srli_epi32 (x, d)), _mm_set1_epi32 (mask));
+	return _mm_xor_si128 (x, _mm_xor_si128 (t, _mm_slli_epi32 (t, d)));
+}
+
+/* C2P_MERGE lane by lane, a in <a>, b in <b> */
+#define C2P_MERGE128(a, b, s, mask) \
+	do { \
+		__m128i t_ = _mm_and_si128 (_mm_xor_si128 (_mm_srli_epi32 (a, s), b), _mm_set1_epi32 (mask)); \
+		b = _mm_xor_si128 (b, t_); \
+		a = _mm_xor_si128 (a, _mm_slli_epi32 (t_, s)); \
+	} while (0)
+
+STATIC_INLINE __m128i c2p_akiko_rotate (__m128i x)
+{
+	x = c2p_delta128 (x, 12, 0x0000f0f0);
+	x = c2p_delta128 (x, 6, 0x00cc00cc);
+	x = c2p_delta128 (x, 3, 0x0a0a0a0a);
+	return c2p_delta128 (x, 1, 0x22222222);
+}
+
+STATIC_INLINE void c2p_akiko (const uae_u32 *in, uae_u32 *out)
+{
+	/* lo = x0-x3, hi = x4-x7, x[j] = in[7 - j] */
+	__m128i lo = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i*)(in + 4)), _MM_SHUFFLE (0, 1, 2, 3));
+	__m128i hi = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i*)(in + 0)), _MM_SHUFFLE (0, 1, 2, 3));
+	__m128i c, d, e, f;
+
+	lo = c2p_akiko_rotate (lo);
+	hi = c2p_akiko_rotate (hi);
+	C2P_MERGE128 (lo, hi, 16, 0x0000ffff);
+	/* c = x0 x1 x4 x5, d = x2 x3 x6 x7 */
+	c = _mm_unpacklo_epi64 (lo, hi);
+	d = _mm_unpackhi_epi64 (lo, hi);
+	C2P_MERGE128 (c, d, 8, 0x00ff00ff);
+	/* e = x0 x4 x2 x6, f = x1 x5 x3 x7 */
+	e = _mm_castps_si128 (_mm_shuffle_ps (_mm_castsi128_ps (c), _mm_castsi128_ps (d), _MM_SHUFFLE (2, 0, 2, 0)));
+	f = _mm_castps_si128 (_mm_shuffle_ps (_mm_castsi128_ps (c), _mm_castsi128_ps (d), _MM_SHUFFLE (3, 1, 3, 1)));
+	C2P_MERGE128 (e, f, 4, 0x0f0f0f0f);
+	/* x0 x1 x4 x5, x2 x3 x6 x7 */
+	c = _mm_unpacklo_epi32 (e, f);
+	d = _mm_unpackhi_epi32 (e, f);
+	_mm_storeu_si128 ((__m128i*)(out + 0), _mm_unpacklo_epi64 (c, d));
+	_mm_storeu_si128 ((__m128i*)(out + 4), _mm_unpackhi_epi64 (c, d));
+}
+
+STATIC_INLINE __m128i c2p_transpose8_128 (__m128i x)
+{
+	__m128i t;
+
+	t = _mm_and_si128 (_mm_xor_si128 (x, _mm_srli_epi64 (x, 7)), _mm_set1_epi64x (0x00aa00aa00aa00aaLL));
+	x = _mm_xor_si128 (x, _mm_xor_si128 (t, _mm_slli_epi64 (t, 7)));
+	t = _mm_and_si128 (_mm_xor_si128 (x, _mm_srli_epi64 (x, 14)), _mm_set1_epi64x (0x0000cccc0000ccccLL));
+	x = _mm_xor_si128 (x, _mm_xor_si128 (t, _mm_slli_epi64 (t, 14)));
+	t = _mm_and_si128 (_mm_xor_si128 (x, _mm_srli_epi64 (x, 28)), _mm_set1_epi64x (0x00000000f0f0f0f0LL));
+	return _mm_xor_si128 (x, _mm_xor_si128 (t, _mm_slli_epi64 (t, 28)));
+}
+
+STATIC_INLINE void c2p_transpose8_n (uae_u64 *x, int n)
+{
+	int i;
+
+	for (i = 0; i + 2 <= n; i += 2)
+		_mm_storeu_si128 ((__m128i*)(x + i), c2p_transpose8_128 (_mm_loadu_si128 ((const __m128i*)(x + i))));
+	c2p_transpose8_scalar (x + i, n - i);
+}
+
+#else
+
+STATIC_INLINE void c2p_akiko (const uae_u32 *in, uae_u32 *out)
+{
+	c2p_akiko_scalar (in, out);
+}
+
+STATIC_INLINE void c2p_transpose8_n (uae_u64 *x, int n)
+{
+	c2p_transpose8_scalar (x, n);
+}
+
+#endif
+
+#endif /* C2P_H */
@@ -16,17 +16,37 @@ typedef union {
  * time, but it wouldn't be hard to use a "normal" pipe as an extension once the
  * user-level one gets full.
  * We queue up to chunks pieces of data before signalling the other thread to
- * avoid overhead. */
+ * avoid overhead.
+ *
+ * The pipe is a lock-free single reader, single writer ring: the writer only
+ * ever moves wrp and the reader only moves rdp. Pipes with several writers
+ * (see native2amiga.c) must serialize them. The semaphores are only touched
+ * when the pipe runs empty or full and the other side has announced that it
+ * went to sleep, so the common case does not enter the kernel at all. */
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#define comm_pipe_load(x) __atomic_load_n (&(x), __ATOMIC_SEQ_CST)
+#define comm_pipe_store(x, v) __atomic_store_n (&(x), (v), __ATOMIC_SEQ_CST)
+#define comm_pipe_xchg(x, v) __atomic_exchange_n (&(x), (v), __ATOMIC_SEQ_CST)
+#elif defined(__GNUC__)
+#define comm_pipe_load(x) (__sync_synchronize (), (x))
+#define comm_pipe_store(x, v) do { __sync_synchronize (); (x) = (v); __sync_synchronize (); } while (0)
+#define comm_pipe_xchg(x, v) (__sync_synchronize (), __sync_lock_test_and_set (&(x), (v)))
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define comm_pipe_load(x) (_ReadWriteBarrier (), _InterlockedOr ((volatile long*)&(x), 0))
+#define comm_pipe_store(x, v) _InterlockedExchange ((volatile long*)&(x), (v))
+#define comm_pipe_xchg(x, v) _InterlockedExchange ((volatile long*)&(x), (v))
+#endif
 
 typedef struct {
-    uae_sem_t lock;
     uae_sem_t reader_wait;
     uae_sem_t writer_wait;
     uae_pt *data;
     int size, chunks;
-    volatile int rdp, wrp;
-    volatile int writer_waiting;
-    volatile int reader_waiting;
+    volatile long rdp, wrp;
+    volatile long writer_waiting;
+    volatile long reader_waiting;
 } smp_comm_pipe;
 
 STATIC_INLINE void init_comm_pipe (smp_comm_pipe *p, int size, int chunks)
@@ -38,83 +58,73 @@ STATIC_INLINE void init_comm_pipe (smp_comm_pipe *p, int size, int chunks)
     p->rdp = p->wrp = 0;
     p->reader_waiting = 0;
     p->writer_waiting = 0;
-    uae_sem_init (&p->lock, 0, 1);
     uae_sem_init (&p->reader_wait, 0, 0);
     uae_sem_init (&p->writer_wait, 0, 0);
 }
 
 STATIC_INLINE void destroy_comm_pipe (smp_comm_pipe *p)
 {
-    uae_sem_destroy (&p->lock);
     uae_sem_destroy (&p->reader_wait);
     uae_sem_destroy (&p->writer_wait);
 }
 
+/* Drop everything queued, neither side may be using the pipe */
+STATIC_INLINE void reset_comm_pipe (smp_comm_pipe *p)
+{
+    p->rdp = p->wrp = 0;
+    p->reader_waiting = 0;
+    p->writer_waiting = 0;
+}
+
+/* Sleep until cond becomes true. The flag is raised before cond is checked
+ * again; if the other side has already taken the flag, it has posted (or is
+ * about to post) the semaphore and that post must be consumed here. */
+#define comm_pipe_wait(flag, sem, cond) \
+    while (!(cond)) { \
+		comm_pipe_store (flag, 1); \
+		if ((cond) && comm_pipe_xchg (flag, 0)) \
+			break; \
+		uae_sem_wait (&(sem)); \
+    }
+
 STATIC_INLINE void maybe_wake_reader (smp_comm_pipe *p, int no_buffer)
 {
-    if (p->reader_waiting
-	&& (no_buffer || ((p->wrp - p->rdp + p->size) % p->size) >= p->chunks))
-    {
-		p->reader_waiting = 0;
+    if (comm_pipe_load (p->reader_waiting)
+		&& (no_buffer || ((p->wrp - p->rdp + p->size) % p->size) >= p->chunks)
+		&& comm_pipe_xchg (p->reader_waiting, 0))
 		uae_sem_post (&p->reader_wait);
-    }
 }
 
 STATIC_INLINE void write_comm_pipe_pt (smp_comm_pipe *p, uae_pt data, int no_buffer)
 {
-    int nxwrp = (p->wrp + 1) % p->size;
-
-    if (p->reader_waiting) {
-		/* No need to do all the locking */
-		p->data[p->wrp] = data;
-		p->wrp = nxwrp;
-		maybe_wake_reader (p, no_buffer);
-		return;
-    }
+    long wrp = p->wrp;
+    long nxwrp = (wrp + 1) % p->size;
 
-    uae_sem_wait (&p->lock);
-    if (nxwrp == p->rdp) {
-		/* Pipe full! */
-		p->writer_waiting = 1;
-		uae_sem_post (&p->lock);
-		/* Note that the reader could get in between here and do a
-		 * sem_post on writer_wait before we wait on it. That's harmless.
-		 * There's a similar case in read_comm_pipe_int_blocking. */
-		uae_sem_wait (&p->writer_wait);
-		uae_sem_wait (&p->lock);
-    }
-    p->data[p->wrp] = data;
-    p->wrp = nxwrp;
+    /* Pipe full? */
+    comm_pipe_wait (p->writer_waiting, p->writer_wait, nxwrp != comm_pipe_load (p->rdp));
+    p->data[wrp] = data;
+    comm_pipe_store (p->wrp, nxwrp);
     maybe_wake_reader (p, no_buffer);
-    uae_sem_post (&p->lock);
 }
 
 STATIC_INLINE uae_pt read_comm_pipe_pt_blocking (smp_comm_pipe *p)
 {
+    long rdp = p->rdp;
     uae_pt data;
 
-    uae_sem_wait (&p->lock);
-    if (p->rdp == p->wrp) {
-		p->reader_waiting = 1;
-		uae_sem_post (&p->lock);
-		uae_sem_wait (&p->reader_wait);
-		uae_sem_wait (&p->lock);
-    }
-    data = p->data[p->rdp];
-    p->rdp = (p->rdp + 1) % p->size;
+    comm_pipe_wait (p->reader_waiting, p->reader_wait, rdp != comm_pipe_load (p->wrp));
+    data = p->data[rdp];
+    comm_pipe_store (p->rdp, (rdp + 1) % p->size);
 
     /* We ignore chunks here. If this is a problem, make the size bigger in the init call. */
-    if (p->writer_waiting) {
-		p->writer_waiting = 0;
+    if (comm_pipe_load (p->writer_waiting) && comm_pipe_xchg (p->writer_waiting, 0))
 		uae_sem_post (&p->writer_wait);
-    }
-    uae_sem_post (&p->lock);
     return data;
 }
 
 STATIC_INLINE int comm_pipe_has_data (smp_comm_pipe *p)
 {
-    return p->rdp != p->wrp;
+    return comm_pipe_load (p->rdp) != comm_pipe_load (p->wrp);
 }
 
 STATIC_INLINE int read_comm_pipe_int_blocking (smp_comm_pipe *p)
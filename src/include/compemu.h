@@ -47,10 +47,11 @@ extern uae_u32 start_pc;
 
 typedef struct {
   uae_u16* location;
-  uae_u8  cycles;
+  uae_u32 cycles;  /* Of the run up to and including this instruction */
   uae_u8  specmem;
   uae_u8  dummy2;
   uae_u8  dummy3;
+  uae_u8  dummy4;
 } cpu_history;
 
 struct blockinfo_t;
@@ -88,6 +89,10 @@ extern signed long pissoff;
 				 unconditionally even with SOFT_FLUSH */
 #define MAX_HOLD_BI 3  /* One for the current block, and up to two
 			  for jump targets */
+#define HOT_RECOMPILE_COUNT 64 /* Executions at the final level before a
+				 block is recorded again as a superblock */
+#define SUPERBLOCK_EXITS 8 /* Conditional branches a superblock goes
+			      through */
 
 #define INDIVIDUAL_INST 0
 #define FLAG_C    0x0010
@@ -138,6 +143,7 @@ void flush_icache (uaecptr ptr, int n);
 #endif
 void alloc_cache (void);
 void compile_block (cpu_history *pc_hist, int blocklen, int totcyles);
+int trace_through (uae_u16 opcode, uae_u16 *pcp, uae_u8 *next);
 int check_for_cache_miss (void);
 
 
@@ -562,6 +568,7 @@ struct blockinfo_t;
 typedef struct dep_t {
   uae_u32*            jmp_off;
   struct blockinfo_t* target;
+  struct blockinfo_t* source;  /* Only set for flag dependencies */
   struct dep_t**      prev_p;
   struct dep_t*       next;
 } dependency;
@@ -596,7 +603,11 @@ typedef struct blockinfo_t {
     uae_u8 status;
     uae_u8 havestate;
 
+    uae_u8 hot;          /* 1: to be recorded as a superblock, 2: is one */
+
     dependency  dep[2];  /* Holds things we depend on */
+    dependency  fdep[SUPERBLOCK_EXITS+2]; /* Successors whose needed_flags
+					      we rely on */
     dependency* deplist; /* List of things that depend on this */
     smallstate  env;
 } blockinfo;
@@ -193,6 +193,39 @@ extern struct mmu_atc_line mmu_atc_array[ATC_TYPE][ATC_WAYS][ATC_SLOTS];
 /* Last matched ATC index, next lookup starts from this index as an optimization */
 extern int mmu_atc_ways;
 
+/*
+ * Host side TLB in front of the ATC. Pages of plain RAM that hit in the
+ * ATC are entered with the host address of their data, later accesses
+ * skip the TTR check, the ATC search and the memory bank call.
+ * Direct mapped on the 4k page number, one table per ATC type and
+ * privilege level. An entry never outlives its ATC line, it is dropped
+ * when the line is replaced or refilled, on PFLUSH, TC and TTR writes
+ * and when the memory map changes.
+ */
+#define MMU_TLB_SIZE 256
+
+struct mmu_tlb_entry {
+	uaecptr tag; // logical page | 1, 0 if unused
+	bool writable;
+	uae_u8 *host; // host address of the page
+};
+
+extern struct mmu_tlb_entry mmu_tlb[ATC_TYPE][2][MMU_TLB_SIZE];
+
+extern void mmu_tlb_fill(uaecptr addr, bool super, bool data, struct mmu_atc_line *cl);
+extern void mmu_tlb_evict(struct mmu_atc_line *cl, int index);
+extern void mmu_tlb_flush_page(uaecptr addr, bool super);
+extern void mmu_tlb_flush_all(void);
+
+static ALWAYS_INLINE uae_u8 *mmu_tlb_lookup(uaecptr addr, bool super, bool data, bool write)
+{
+	struct mmu_tlb_entry *e = &mmu_tlb[data][super][(addr >> 12) & (MMU_TLB_SIZE - 1)];
+
+	if (e->tag != ((addr & ~mmu_pagemask) | 1) || (write && !e->writable))
+		return NULL;
+	return e->host + (addr & mmu_pagemask);
+}
+
 /*
  * mmu access is a 4 step process:
  * if mmu is not enabled just read physical
@@ -226,6 +259,8 @@ static ALWAYS_INLINE bool mmu_lookup(uaecptr addr, bool data, bool write,
 	}
 	// we select a random way to void
 	*cl=&mmu_atc_array[data][way_miss%ATC_WAYS][index];
+	if ((*cl)->valid)
+		mmu_tlb_evict(*cl, index);
 	(*cl)->tag = tag;
 	way_miss++;
 	return false;
@@ -259,6 +294,8 @@ static ALWAYS_INLINE bool mmu_user_lookup(uaecptr addr, bool super, bool data,
 	}
 	// we select a random way to void
 	*cl=&mmu_atc_array[data][way_miss%ATC_WAYS][index];
+	if ((*cl)->valid)
+		mmu_tlb_evict(*cl, index);
 	(*cl)->tag = tag;
 	way_miss++;
 	return false;
@@ -391,162 +428,276 @@ extern void mmu_put_move16(uaecptr addr, uae_u32 *val, bool data, int size);
 static ALWAYS_INLINE uae_u32 mmu_get_long(uaecptr addr, bool data, int size, bool rmw)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                       addr,super,data
-	if ((!regs.mmu_enabled) || (mmu_match_ttr(addr,regs.s != 0,data,rmw)!=TTR_NO_MATCH))
+	if (!regs.mmu_enabled)
+		return phys_get_long(addr);
+	p = mmu_tlb_lookup(addr, regs.s != 0, data, false);
+	if (likely(p != NULL))
+		return do_get_mem_long((uae_u32 *)p);
+	//                       addr,super,data
+	if (mmu_match_ttr(addr,regs.s != 0,data,rmw)!=TTR_NO_MATCH)
 		return phys_get_long(addr);
-	if (likely(mmu_lookup(addr, data, false, &cl)))
+	if (likely(mmu_lookup(addr, data, false, &cl))) {
+		mmu_tlb_fill(addr, regs.s != 0, data, cl);
 		return phys_get_long(mmu_get_real_address(addr, cl));
+	}
 	return mmu_get_long_slow(addr, regs.s != 0, data, size, rmw, cl);
 }
 
 static ALWAYS_INLINE uae_u16 mmu_get_word(uaecptr addr, bool data, int size, bool rmw)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                       addr,super,data
-	if ((!regs.mmu_enabled) || (mmu_match_ttr(addr,regs.s != 0,data,rmw)!=TTR_NO_MATCH))
+	if (!regs.mmu_enabled)
+		return phys_get_word(addr);
+	p = mmu_tlb_lookup(addr, regs.s != 0, data, false);
+	if (likely(p != NULL))
+		return do_get_mem_word((uae_u16 *)p);
+	//                       addr,super,data
+	if (mmu_match_ttr(addr,regs.s != 0,data,rmw)!=TTR_NO_MATCH)
 		return phys_get_word(addr);
-	if (likely(mmu_lookup(addr, data, false, &cl)))
+	if (likely(mmu_lookup(addr, data, false, &cl))) {
+		mmu_tlb_fill(addr, regs.s != 0, data, cl);
 		return phys_get_word(mmu_get_real_address(addr, cl));
+	}
 	return mmu_get_word_slow(addr, regs.s != 0, data, size, rmw, cl);
 }
 
 static ALWAYS_INLINE uae_u8 mmu_get_byte(uaecptr addr, bool data, int size, bool rmw)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                       addr,super,data
-	if ((!regs.mmu_enabled) || (mmu_match_ttr(addr,regs.s != 0,data,rmw)!=TTR_NO_MATCH))
+	if (!regs.mmu_enabled)
 		return phys_get_byte(addr);
-	if (likely(mmu_lookup(addr, data, false, &cl)))
+	p = mmu_tlb_lookup(addr, regs.s != 0, data, false);
+	if (likely(p != NULL))
+		return do_get_mem_byte(p);
+	//                       addr,super,data
+	if (mmu_match_ttr(addr,regs.s != 0,data,rmw)!=TTR_NO_MATCH)
+		return phys_get_byte(addr);
+	if (likely(mmu_lookup(addr, data, false, &cl))) {
+		mmu_tlb_fill(addr, regs.s != 0, data, cl);
 		return phys_get_byte(mmu_get_real_address(addr, cl));
+	}
 	return mmu_get_byte_slow(addr, regs.s != 0, data, size, rmw, cl);
 }
 
 static ALWAYS_INLINE void mmu_put_long(uaecptr addr, uae_u32 val, bool data, int size, bool rmw)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                        addr,super,data
-	if ((!regs.mmu_enabled) || mmu_match_ttr_write(addr,regs.s != 0,data,val,size,rmw)==TTR_OK_MATCH) {
+	if (!regs.mmu_enabled) {
+		phys_put_long(addr,val);
+		return;
+	}
+	p = mmu_tlb_lookup(addr, regs.s != 0, data, true);
+	if (likely(p != NULL)) {
+		do_put_mem_long((uae_u32 *)p, val);
+		return;
+	}
+	//                             addr,super,data
+	if (mmu_match_ttr_write(addr,regs.s != 0,data,val,size,rmw)==TTR_OK_MATCH) {
 		phys_put_long(addr,val);
 		return;
 	}
-	if (likely(mmu_lookup(addr, data, true, &cl)))
+	if (likely(mmu_lookup(addr, data, true, &cl))) {
+		mmu_tlb_fill(addr, regs.s != 0, data, cl);
 		phys_put_long(mmu_get_real_address(addr, cl), val);
-	else
+	} else
 		mmu_put_long_slow(addr, val, regs.s != 0, data, size, rmw, cl);
 }
 
 static ALWAYS_INLINE void mmu_put_word(uaecptr addr, uae_u16 val, bool data, int size, bool rmw)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                        addr,super,data
-	if ((!regs.mmu_enabled) || (mmu_match_ttr_write(addr,regs.s != 0,data,val,size,rmw)==TTR_OK_MATCH)) {
+	if (!regs.mmu_enabled) {
 		phys_put_word(addr,val);
 		return;
 	}
-	if (likely(mmu_lookup(addr, data, true, &cl)))
+	p = mmu_tlb_lookup(addr, regs.s != 0, data, true);
+	if (likely(p != NULL)) {
+		do_put_mem_word((uae_u16 *)p, val);
+		return;
+	}
+	//                             addr,super,data
+	if (mmu_match_ttr_write(addr,regs.s != 0,data,val,size,rmw)==TTR_OK_MATCH) {
+		phys_put_word(addr,val);
+		return;
+	}
+	if (likely(mmu_lookup(addr, data, true, &cl))) {
+		mmu_tlb_fill(addr, regs.s != 0, data, cl);
 		phys_put_word(mmu_get_real_address(addr, cl), val);
-	else
+	} else
 		mmu_put_word_slow(addr, val, regs.s != 0, data, size, rmw, cl);
 }
 
 static ALWAYS_INLINE void mmu_put_byte(uaecptr addr, uae_u8 val, bool data, int size, bool rmw)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                        addr,super,data
-	if ((!regs.mmu_enabled) || (mmu_match_ttr_write(addr,regs.s != 0,data,val,size,rmw)==TTR_OK_MATCH)) {
+	if (!regs.mmu_enabled) {
 		phys_put_byte(addr,val);
 		return;
 	}
-	if (likely(mmu_lookup(addr, data, true, &cl)))
+	p = mmu_tlb_lookup(addr, regs.s != 0, data, true);
+	if (likely(p != NULL)) {
+		do_put_mem_byte(p, val);
+		return;
+	}
+	//                             addr,super,data
+	if (mmu_match_ttr_write(addr,regs.s != 0,data,val,size,rmw)==TTR_OK_MATCH) {
+		phys_put_byte(addr,val);
+		return;
+	}
+	if (likely(mmu_lookup(addr, data, true, &cl))) {
+		mmu_tlb_fill(addr, regs.s != 0, data, cl);
 		phys_put_byte(mmu_get_real_address(addr, cl), val);
-	else
+	} else
 		mmu_put_byte_slow(addr, val, regs.s != 0, data, size, rmw, cl);
 }
 
 static ALWAYS_INLINE uae_u32 mmu_get_user_long(uaecptr addr, bool super, bool data, bool write, int size)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                       addr,super,data
-	if ((!regs.mmu_enabled) || (mmu_match_ttr(addr,super,data,false)!=TTR_NO_MATCH))
+	if (!regs.mmu_enabled)
+		return phys_get_long(addr);
+	p = mmu_tlb_lookup(addr, super, data, write);
+	if (likely(p != NULL))
+		return do_get_mem_long((uae_u32 *)p);
+	//                       addr,super,data
+	if (mmu_match_ttr(addr,super,data,false)!=TTR_NO_MATCH)
 		return phys_get_long(addr);
-	if (likely(mmu_user_lookup(addr, super, data, write, &cl)))
+	if (likely(mmu_user_lookup(addr, super, data, write, &cl))) {
+		mmu_tlb_fill(addr, super, data, cl);
 		return phys_get_long(mmu_get_real_address(addr, cl));
+	}
 	return mmu_get_long_slow(addr, super, data, size, false, cl);
 }
 
 static ALWAYS_INLINE uae_u16 mmu_get_user_word(uaecptr addr, bool super, bool data, bool write, int size)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                       addr,super,data
-	if ((!regs.mmu_enabled) || (mmu_match_ttr(addr,super,data,false)!=TTR_NO_MATCH))
+	if (!regs.mmu_enabled)
+		return phys_get_word(addr);
+	p = mmu_tlb_lookup(addr, super, data, write);
+	if (likely(p != NULL))
+		return do_get_mem_word((uae_u16 *)p);
+	//                       addr,super,data
+	if (mmu_match_ttr(addr,super,data,false)!=TTR_NO_MATCH)
 		return phys_get_word(addr);
-	if (likely(mmu_user_lookup(addr, super, data, write, &cl)))
+	if (likely(mmu_user_lookup(addr, super, data, write, &cl))) {
+		mmu_tlb_fill(addr, super, data, cl);
 		return phys_get_word(mmu_get_real_address(addr, cl));
+	}
 	return mmu_get_word_slow(addr, super, data, size, false, cl);
 }
 
 static ALWAYS_INLINE uae_u8 mmu_get_user_byte(uaecptr addr, bool super, bool data, bool write, int size)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                       addr,super,data
-	if ((!regs.mmu_enabled) || (mmu_match_ttr(addr,super,data,false)!=TTR_NO_MATCH))
+	if (!regs.mmu_enabled)
+		return phys_get_byte(addr);
+	p = mmu_tlb_lookup(addr, super, data, write);
+	if (likely(p != NULL))
+		return do_get_mem_byte(p);
+	//                       addr,super,data
+	if (mmu_match_ttr(addr,super,data,false)!=TTR_NO_MATCH)
 		return phys_get_byte(addr);
-	if (likely(mmu_user_lookup(addr, super, data, write, &cl)))
+	if (likely(mmu_user_lookup(addr, super, data, write, &cl))) {
+		mmu_tlb_fill(addr, super, data, cl);
 		return phys_get_byte(mmu_get_real_address(addr, cl));
+	}
 	return mmu_get_byte_slow(addr, super, data, size, false, cl);
 }
 
 static ALWAYS_INLINE void mmu_put_user_long(uaecptr addr, uae_u32 val, bool super, bool data, int size)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                        addr,super,data
-	if ((!regs.mmu_enabled) || (mmu_match_ttr(addr,super,data,false)==TTR_OK_MATCH)) {
+	if (!regs.mmu_enabled) {
 		phys_put_long(addr,val);
 		return;
 	}
-	if (likely(mmu_user_lookup(addr, super, data, true, &cl)))
+	p = mmu_tlb_lookup(addr, super, data, true);
+	if (likely(p != NULL)) {
+		do_put_mem_long((uae_u32 *)p, val);
+		return;
+	}
+	//                       addr,super,data
+	if (mmu_match_ttr(addr,super,data,false)==TTR_OK_MATCH) {
+		phys_put_long(addr,val);
+		return;
+	}
+	if (likely(mmu_user_lookup(addr, super, data, true, &cl))) {
+		mmu_tlb_fill(addr, super, data, cl);
 		phys_put_long(mmu_get_real_address(addr, cl), val);
-	else
+	} else
 		mmu_put_long_slow(addr, val, super, data, size, false, cl);
 }
 
 static ALWAYS_INLINE void mmu_put_user_word(uaecptr addr, uae_u16 val, bool super, bool data, int size)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                        addr,super,data
-	if ((!regs.mmu_enabled) || (mmu_match_ttr(addr,super,data,false)==TTR_OK_MATCH)) {
+	if (!regs.mmu_enabled) {
+		phys_put_word(addr,val);
+		return;
+	}
+	p = mmu_tlb_lookup(addr, super, data, true);
+	if (likely(p != NULL)) {
+		do_put_mem_word((uae_u16 *)p, val);
+		return;
+	}
+	//                       addr,super,data
+	if (mmu_match_ttr(addr,super,data,false)==TTR_OK_MATCH) {
 		phys_put_word(addr,val);
 		return;
 	}
-	if (likely(mmu_user_lookup(addr, super, data, true, &cl)))
+	if (likely(mmu_user_lookup(addr, super, data, true, &cl))) {
+		mmu_tlb_fill(addr, super, data, cl);
 		phys_put_word(mmu_get_real_address(addr, cl), val);
-	else
+	} else
 		mmu_put_word_slow(addr, val, super, data, size, false, cl);
 }
 
 static ALWAYS_INLINE void mmu_put_user_byte(uaecptr addr, uae_u8 val, bool super, bool data, int size)
 {
 	struct mmu_atc_line *cl;
+	uae_u8 *p;
 
-	//                                        addr,super,data
-	if ((!regs.mmu_enabled) || (mmu_match_ttr(addr,super,data,false)==TTR_OK_MATCH)) {
+	if (!regs.mmu_enabled) {
 		phys_put_byte(addr,val);
 		return;
 	}
-	if (likely(mmu_user_lookup(addr, super, data, true, &cl)))
+	p = mmu_tlb_lookup(addr, super, data, true);
+	if (likely(p != NULL)) {
+		do_put_mem_byte(p, val);
+		return;
+	}
+	//                       addr,super,data
+	if (mmu_match_ttr(addr,super,data,false)==TTR_OK_MATCH) {
+		phys_put_byte(addr,val);
+		return;
+	}
+	if (likely(mmu_user_lookup(addr, super, data, true, &cl))) {
+		mmu_tlb_fill(addr, super, data, cl);
 		phys_put_byte(mmu_get_real_address(addr, cl), val);
-	else
+	} else
 		mmu_put_byte_slow(addr, val, super, data, size, false, cl);
 }
 
@@ -70,6 +70,7 @@ void mmu030_flush_atc_fc(uae_u32 fc_base, uae_u32 fc_mask);
 void mmu030_flush_atc_page(uaecptr logical_addr);
 void mmu030_flush_atc_page_fc(uaecptr logical_addr, uae_u32 fc_base, uae_u32 fc_mask);
 void mmu030_flush_atc_all(void);
+void mmu030_tlb_flush_all(void);
 void mmu030_reset(int hardreset);
 uaecptr mmu030_translate(uaecptr addr, bool super, bool data, bool write);
 
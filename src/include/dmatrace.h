@@ -0,0 +1,56 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Binary DMA slot trace
+  *
+  * The stream is gzip compressed, all values are little endian:
+  *
+  *  file header (16 bytes):
+  *   0  "UAEDMATR"
+  *   8  u32 version
+  *  12  u16 frame header size, u16 event size
+  *
+  *  frame header (16 bytes), followed by <events> events:
+  *   0  u32 frame number, counting from the start of the trace
+  *   4  u16 maxhpos, u16 maxvpos
+  *   8  u32 events
+  *  12  u32 frames dropped just before this one
+  *
+  *  event (16 bytes), one per used DMA slot:
+  *   0  u16 vpos
+  *   2  u8 hpos
+  *   3  u8 channel (DMARECORD_*, 0 if the slot only has events)
+  *   4  u16 register (0xffff if the slot only has events)
+  *   6  u8 events (DMA_EVENT_*)
+  *   7  u8 CPU interrupt mask
+  *   8  u32 value
+  *  12  u32 address (0xffffffff if none)
+  */
+
+#ifndef UAE_DMATRACE_H
+#define UAE_DMATRACE_H
+
+#define DMATRACE_MAGIC "UAEDMATR"
+#define DMATRACE_VERSION 1
+#define DMATRACE_HEADER_SIZE 16
+#define DMATRACE_FRAME_SIZE 16
+#define DMATRACE_EVENT_SIZE 16
+
+#ifndef DMATRACE_FORMAT_ONLY
+
+struct dma_rec;
+
+extern bool dmatrace_active;
+
+/* Start writing to <name>, frames hold up to <maxevents> events */
+extern bool dmatrace_start (const TCHAR *name, int maxevents);
+extern void dmatrace_stop (void);
+/* Queue the used slots of a finished frame of DMA records, <stride>
+ * records per line. <rec> is NULL if nothing was recorded, the frame is
+ * still written without events to keep the frame numbers counting.
+ * Never blocks, drops the frame if the writer is behind. */
+extern void dmatrace_frame (const struct dma_rec *rec, int stride, int hmax, int vmax);
+
+#endif
+
+#endif /* UAE_DMATRACE_H */
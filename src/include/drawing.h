@@ -207,6 +207,7 @@ extern uae_u16 spixels[MAX_SPR_PIXELS * 2];
 /* Way too much... */
 #define MAX_REG_CHANGE ((MAXVPOS + 1) * 2 * MAXHPOS)
 
+#define COLOR_TABLE_SIZE ((MAXVPOS + 2) * 2)
 extern struct color_entry *curr_color_tables, *prev_color_tables;
 
 extern struct sprite_entry *curr_sprite_entries, *prev_sprite_entries;
@@ -276,11 +277,14 @@ extern void vsync_handle_redraw (int long_field, int lof_changed, uae_u16, uae_u
 extern bool vsync_handle_check (void);
 extern void init_hardware_for_drawing_frame (void);
 extern void reset_drawing (void);
+extern void gfxbuffer_reset (void);
 extern void drawing_init (void);
 extern bool notice_interlace_seen (bool);
 extern void notice_resolution_seen (int, bool);
 extern void frame_drawn (void);
 extern void redraw_frame (void);
+extern void drawing_thread_kick (void);
+extern void drawing_thread_wait (bool discard);
 //extern bool draw_frame (struct vidbuffer*);
 extern int get_custom_limits (int *pw, int *ph, int *pdx, int *pdy, int *prealh);
 extern void set_custom_limits (int w, int h, int dx, int dy);
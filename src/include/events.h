@@ -76,9 +76,12 @@ enum {
     ev_max
 };
 
+/* Fixed event2 slots. Anonymous events (no < 0) are queued separately
+ * and are only limited by available memory.
+ */
 enum {
-    ev2_blitter, ev2_disk, ev2_misc,
-    ev2_max = 12
+    ev2_blitter, ev2_disk,
+    ev2_max
 };
 
 extern int pissoff_value;
@@ -142,6 +145,10 @@ STATIC_INLINE bool cycles_in_range (unsigned long endcycles)
 
 extern void MISC_handler (void);
 extern void event2_newevent_xx (int no, evt t, uae_u32 data, evfunc2 func);
+extern int event2_misc_count (void);
+extern struct ev2 *event2_misc_get (int idx);
+extern struct ev2 event2_misc_pop (void);
+extern void event2_misc_reset (void);
 
 STATIC_INLINE void event2_newevent_x (int no, evt t, uae_u32 data, evfunc2 func)
 {
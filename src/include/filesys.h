@@ -15,7 +15,11 @@ struct mountedinfo;
 struct uaedev_config_info;
 struct uae_prefs;
 
+/* hardfile block cache: MAX_HDF_CACHE_BLOCKS blocks of HDF_CACHE_BLOCK_SIZE
+ * bytes, HDF_CACHE_WAYS way set associative */
 #define MAX_HDF_CACHE_BLOCKS 128
+#define HDF_CACHE_BLOCK_SIZE 32768
+#define HDF_CACHE_WAYS 8
 #define MAX_SCSI_SENSE 36
 struct hdf_cache
 {
@@ -23,9 +27,7 @@ struct hdf_cache
 	uae_u8 *data;
 	uae_u64 block;
 	bool dirty;
-	int readcount;
-	int writecount;
-	time_t lastaccess;
+	uae_u32 lastaccess;
 };
 
 struct hardfiledata {
@@ -70,6 +72,13 @@ struct hardfiledata {
     TCHAR *emptyname;
 
 	struct hdf_cache bcache[MAX_HDF_CACHE_BLOCKS];
+	uae_u8 *bcache_mem;
+	uae_u32 bcache_tick;
+	/* end of the previous read and number of reads in sequence */
+	uae_u64 bcache_next;
+	int bcache_seq;
+	/* a write back failed and was not reported yet */
+	bool bcache_error;
 	uae_u8 scsi_sense[MAX_SCSI_SENSE];
 
 	struct uaedev_config_info delayedci;
@@ -132,6 +141,9 @@ void hdf_close (struct hardfiledata *hfd);
 int hdf_read_rdb (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
 int hdf_read (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
 int hdf_write (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
+/* uncached access below the block cache */
+int hdf_read2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
+int hdf_write2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
 int hdf_getnumharddrives (void);
 TCHAR *hdf_getnameharddrive (int index, int flags, int *sectorsize, int *dangerousdrive);
 int isspecialdrive(const TCHAR *name);
@@ -146,6 +158,14 @@ int hdf_hd_open(struct hd_hardfiledata *hfd);
 
 int vhd_create (const TCHAR *name, uae_u64 size, uae_u32);
 
+/* hardfile_cache.c */
+void hdf_init_cache (struct hardfiledata *hfd);
+void hdf_free_cache (struct hardfiledata *hfd);
+bool hdf_flush_cache (struct hardfiledata *hfd);
+int hdf_cache_read (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
+int hdf_cache_write (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
+bool hdf_cache_readahead (struct hardfiledata *hfd);
+
 int hdf_init_target (void);
 int hdf_open_target (struct hardfiledata *hfd, const TCHAR *name);
 int hdf_dup_target (struct hardfiledata *dhfd, const struct hardfiledata *shfd);
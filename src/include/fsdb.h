@@ -71,6 +71,12 @@ typedef struct a_inode_struct {
     /* This a_inode's relatives in the directory structure.  */
     struct a_inode_struct *parent;
     struct a_inode_struct *child, *sibling;
+    /* Chains of the unit's uniq hash and of the parent's name hashes.  */
+    struct a_inode_struct *uniq_next, *aname_next, *nname_next;
+    /* Name hashes of a directory's children, NULL while it is small.  */
+    struct aino_namehash *namehash;
+    /* Last snapshot of the host directory, see my_dirsnap_read ().  */
+    struct fs_dirsnap *dirsnap;
     /* AmigaOS name, and host OS name.  The host OS name is a full path, the
      * AmigaOS name is relative to the parent.  */
     TCHAR *aname;
@@ -111,6 +117,12 @@ typedef struct a_inode_struct {
 #endif
 } a_inode;
 
+/* uniq -> a_inode, every a_inode of a unit except the root */
+struct aino_uniqhash {
+	a_inode **tab;
+	unsigned int size, count;
+};
+
 struct mytimeval
 {
 	uae_s64 tv_sec;
@@ -152,10 +164,22 @@ STATIC_INLINE int same_aname (const TCHAR *an1, const TCHAR *an2)
 	return strcasecmp (an1, an2) == 0;
 }
 
+/* a_inode hashes, fsdb_hash.c */
+extern void aino_hash_add (struct aino_uniqhash *, a_inode *);
+extern void aino_hash_remove (struct aino_uniqhash *, a_inode *);
+extern a_inode *aino_hash_find (struct aino_uniqhash *, uae_u32 uniq);
+extern void aino_hash_free (struct aino_uniqhash *);
+extern void aino_dir_add (a_inode *dir, a_inode *);
+extern void aino_dir_remove (a_inode *dir, a_inode *);
+extern void aino_dir_free (a_inode *dir);
+extern a_inode *aino_dir_find_aname (a_inode *dir, const TCHAR *rel, unsigned int mountcount);
+extern a_inode *aino_dir_find_nname (a_inode *dir, const TCHAR *rel, unsigned int mountcount);
+
 /* Filesystem-dependent functions.  */
 extern int fsdb_name_invalid (const TCHAR *n);
 extern int fsdb_name_invalid_dir (const TCHAR *n);
 extern int fsdb_fill_file_attrs (a_inode *, a_inode *);
+extern void fsdb_fill_file_attrs_mode (a_inode *, int hostmode);
 extern int fsdb_set_file_attrs (a_inode *);
 extern int fsdb_mode_representable_p (const a_inode *, int);
 extern int fsdb_mode_supported (const a_inode *);
@@ -193,6 +217,32 @@ extern int my_existsdir (const TCHAR *name);
 extern FILE *my_opentext (const TCHAR*);
 
 extern bool my_stat (const TCHAR *name, struct mystat *ms);
+
+/* A host directory read in one go: its entries, sorted by name, with
+ * what my_stat () would return for them. The directory's modification
+ * and change times tell whether it still is current.  */
+struct fs_dirsnap_entry {
+	TCHAR *name;
+	struct mystat st;
+	int hostmode;
+};
+
+struct fs_dirsnap {
+	struct fs_dirsnap_entry *entries;
+	int count;
+	int refcnt;
+	/* the directory has an FSDB_FILE, which is not in entries */
+	bool hasfsdb;
+	uae_s64 mtime, ctime;
+	uae_u64 ino;
+	time_t taken;
+	uae_u32 generation;
+};
+
+extern struct fs_dirsnap *my_dirsnap_read (const TCHAR *dirname);
+extern bool my_dirsnap_current (struct fs_dirsnap *, const TCHAR *dirname);
+extern struct fs_dirsnap_entry *my_dirsnap_find (struct fs_dirsnap *, const TCHAR *name);
+extern void my_dirsnap_release (struct fs_dirsnap *);
 extern bool my_utime (const TCHAR *name, struct mytimeval *tv);
 extern bool my_chmod (const TCHAR *name, uae_u32 mode);
 extern bool my_resolveshortcut(TCHAR *linkfile, int size);
@@ -12,6 +12,8 @@ extern int sound_available;
 extern void (*sample_handler) (void);
 
 extern unsigned int obtainedfreq;
+/* sample period in cycles, the back-end may adjust it around the _orig value */
+extern float scaled_sample_evtime, scaled_sample_evtime_orig;
 
 /* Determine if we can produce any sound at all.  This can be only a guess;
  * if unsure, say yes.  Any call to init_sound may change the value.  */
@@ -24,6 +24,9 @@ extern int special_mem;
 extern uae_u8 *cache_alloc (int);
 extern void cache_free (uae_u8*);
 
+extern int candirect;
+#endif
+
 #ifdef NATMEM_OFFSET
 bool init_shm (void);
 void free_shm (void);
@@ -31,8 +34,6 @@ bool preinit_shm (void);
 #endif
 
 extern bool canbang;
-extern int candirect;
-#endif
 
 #ifdef ADDRESS_SPACE_24BIT
 #define MEMORY_BANKS 256
@@ -344,11 +345,20 @@ extern uae_u32 REGPARAM3 dummy_wgeti (uaecptr addr) REGPARAM;
 #define bankindex(addr) (((uaecptr)(addr)) >> 16)
 
 extern addrbank *mem_banks[MEMORY_BANKS];
+extern uae_u32 mem_banks_generation;
 
 #ifdef JIT
 extern uae_u8 *baseaddr[MEMORY_BANKS];
 #endif
 
+#ifdef NATMEM_OFFSET
+extern uae_u8 *natmem_offset;
+/* nonzero for banks of plain RAM that sit at natmem_offset + addr */
+extern uae_u8 natmem_direct[MEMORY_BANKS];
+extern void natmem_direct_update (void);
+#define natmem_isdirect(addr) (natmem_direct[bankindex(addr)])
+#endif
+
 #define get_mem_bank(addr) (*mem_banks[bankindex(addr)])
 
 #ifdef JIT
@@ -370,6 +380,8 @@ extern void map_banks (addrbank *bank, int first, int count, int realsize);
 extern void map_banks_quick (addrbank *bank, int first, int count, int realsize);
 extern void map_banks_cond (addrbank *bank, int first, int count, int realsize);
 extern void map_overlay (int chip);
+extern uae_u8 *get_ram_address (uaecptr addr, uae_u32 size);
+extern int get_ram_views (addrbank *ab, uae_u8 **views, int max);
 extern void memory_hardreset (int);
 extern void memory_clear (void);
 extern void free_fastmemory (int);
@@ -385,14 +397,26 @@ extern void free_fastmemory (int);
 
 STATIC_INLINE uae_u32 get_long (uaecptr addr)
 {
+#ifdef NATMEM_OFFSET
+	if (natmem_isdirect (addr))
+		return do_get_mem_long ((uae_u32 *)(natmem_offset + addr));
+#endif
 	return longget (addr);
 }
 STATIC_INLINE uae_u32 get_word (uaecptr addr)
 {
+#ifdef NATMEM_OFFSET
+	if (natmem_isdirect (addr))
+		return do_get_mem_word ((uae_u16 *)(natmem_offset + addr));
+#endif
 	return wordget (addr);
 }
 STATIC_INLINE uae_u32 get_byte (uaecptr addr)
 {
+#ifdef NATMEM_OFFSET
+	if (natmem_isdirect (addr))
+		return do_get_mem_byte (natmem_offset + addr);
+#endif
 	return byteget (addr);
 }
 STATIC_INLINE uae_u32 get_longi(uaecptr addr)
@@ -436,14 +460,32 @@ STATIC_INLINE void *get_pointer (uaecptr addr)
 
 STATIC_INLINE void put_long (uaecptr addr, uae_u32 l)
 {
+#ifdef NATMEM_OFFSET
+	if (natmem_isdirect (addr)) {
+		do_put_mem_long ((uae_u32 *)(natmem_offset + addr), l);
+		return;
+	}
+#endif
 	longput(addr, l);
 }
 STATIC_INLINE void put_word (uaecptr addr, uae_u32 w)
 {
+#ifdef NATMEM_OFFSET
+	if (natmem_isdirect (addr)) {
+		do_put_mem_word ((uae_u16 *)(natmem_offset + addr), w);
+		return;
+	}
+#endif
 	wordput(addr, w);
 }
 STATIC_INLINE void put_byte (uaecptr addr, uae_u32 b)
 {
+#ifdef NATMEM_OFFSET
+	if (natmem_isdirect (addr)) {
+		do_put_mem_byte (natmem_offset + addr, b);
+		return;
+	}
+#endif
 	byteput(addr, b);
 }
 
@@ -517,6 +559,7 @@ extern void (REGPARAM3 *chipmem_wput_indirect)(uaecptr, uae_u32) REGPARAM;
 extern void (REGPARAM3 *chipmem_bput_indirect)(uaecptr, uae_u32) REGPARAM;
 extern int (REGPARAM3 *chipmem_check_indirect)(uaecptr, uae_u32) REGPARAM;
 extern uae_u8 *(REGPARAM3 *chipmem_xlate_indirect)(uaecptr) REGPARAM;
+extern uae_u8 *chipmem_xlate_dma (uaecptr addr, uae_u32 size);
 
 #ifdef NATMEM_OFFSET
 
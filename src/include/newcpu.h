@@ -484,6 +484,7 @@ bool m68k_mull (uae_u32, uae_u32, uae_u16);
 void init_m68k (void);
 void init_m68k_full (void);
 void m68k_go (int);
+void m68k_restore_now (void);
 void m68k_dumpstate (uaecptr *);
 void m68k_dumpstate2 (uaecptr, uaecptr *);
 void m68k_dumpcache (void);
@@ -555,6 +556,7 @@ extern cpuop_func *cpufunctbl[65536] ASM_SYM_FOR_FUNC ("cpufunctbl");
 #ifdef JIT
 void flush_icache (uaecptr, int);
 void compemu_reset (void);
+void compemu_stats (void);
 bool check_prefs_changed_comp (void);
 #else
 #define flush_icache(uaecptr, int) do {} while (0)
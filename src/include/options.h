@@ -355,6 +355,7 @@ struct uae_prefs {
 	bool comp_hardflush;
 	bool comp_constjump;
 	bool comp_oldsegv;
+	bool comp_superblocks;
 
 	int optcount[10];
 
@@ -387,6 +388,7 @@ struct uae_prefs {
 	int color_mode;
 	int gfx_extrawidth;
 	bool lightboost_strobo;
+	bool gfx_render_thread;
 
 	struct gfx_filterdata gf[2];
 
@@ -589,6 +591,8 @@ struct uae_prefs {
 
 	bool statecapture;
 	int statecapturerate, statecapturebuffersize;
+	bool statecapturedelta;
+	int statecapturebudget;
 
 	/* input */
 
@@ -741,6 +741,7 @@ void DX_SetPalette (int, int);
 void DX_SetPalette_vsync(void);
 void picasso96_alloc (TrapContext *);
 void picasso_allocatewritewatch (int gfxmemsize);
+void picasso_freewritewatch (void);
 void picasso_getwritewatch (void);
 void picasso_statusline (uae_u8 *dst);
 void picasso_invalidate (int x, int y, int w, int h);
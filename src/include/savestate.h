@@ -250,6 +250,11 @@ extern void savestate_listrewind (void);
 extern void statefile_save_recording (const TCHAR*);
 extern void savestate_capture_request (void);
 
+extern size_t savestate_mem_size (void);
+extern size_t savestate_save_mem (void *buf, size_t size);
+extern bool savestate_restore_mem (const void *buf, size_t size);
+extern bool savestate_queue_mem (const void *buf, size_t size);
+
 #else
 
 #define savestate_state 0
@@ -0,0 +1,89 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * BLEP accumulation for the sinc audio interpolator.
+  *
+  * The per channel queue is kept as two mirrored structure-of-arrays
+  * rings, so the live entries head..head+count-1 are always contiguous
+  * and can be processed without wrapping. All arithmetic is done modulo
+  * 2^32, which makes every variant bit-identical to the scalar loop.
+  */
+
+#ifndef SINCMIX_H
+#define SINCMIX_H
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Returns sum of winsinc[now - evtime[k]] * output[k] for 0 <= k < count */
+STATIC_INLINE uae_u32 sinc_mix_scalar (const int *winsinc, const int *evtime, const int *output, int count, int now)
+{
+	uae_u32 acc = 0;
+	int k;
+
+	for (k = 0; k < count; k++)
+		acc += (uae_u32)winsinc[now - evtime[k]] * (uae_u32)output[k];
+	return acc;
+}
+
+#if defined(__AVX2__)
+
+STATIC_INLINE uae_u32 sinc_mix (const int *winsinc, const int *evtime, const int *output, int count, int now)
+{
+	__m256i vnow = _mm256_set1_epi32 (now);
+	__m256i acc = _mm256_setzero_si256 ();
+	__m128i acc4;
+	int k;
+
+	for (k = 0; k + 8 <= count; k += 8) {
+		__m256i age = _mm256_sub_epi32 (vnow, _mm256_loadu_si256 ((const __m256i*)(evtime + k)));
+		__m256i w = _mm256_i32gather_epi32 (winsinc, age, 4);
+		__m256i o = _mm256_loadu_si256 ((const __m256i*)(output + k));
+		acc = _mm256_add_epi32 (acc, _mm256_mullo_epi32 (w, o));
+	}
+	acc4 = _mm_add_epi32 (_mm256_castsi256_si128 (acc), _mm256_extracti128_si256 (acc, 1));
+	acc4 = _mm_add_epi32 (acc4, _mm_shuffle_epi32 (acc4, _MM_SHUFFLE (1, 0, 3, 2)));
+	acc4 = _mm_add_epi32 (acc4, _mm_shuffle_epi32 (acc4, _MM_SHUFFLE (2, 3, 0, 1)));
+	return (uae_u32)_mm_cvtsi128_si32 (acc4) + sinc_mix_scalar (winsinc, evtime + k, output + k, count - k, now);
+}
+
+#elif defined(__SSE2__)
+
+/* SSE2 has no 32 bit multiply, build the low halves from two pmuludq */
+STATIC_INLINE __m128i sinc_mullo_epi32 (__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32 (a, b);
+	__m128i odd = _mm_mul_epu32 (_mm_srli_epi64 (a, 32), _mm_srli_epi64 (b, 32));
+	return _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, _MM_SHUFFLE (0, 0, 2, 0)),
+		_mm_shuffle_epi32 (odd, _MM_SHUFFLE (0, 0, 2, 0)));
+}
+
+STATIC_INLINE uae_u32 sinc_mix (const int *winsinc, const int *evtime, const int *output, int count, int now)
+{
+	__m128i vnow = _mm_set1_epi32 (now);
+	__m128i acc = _mm_setzero_si128 ();
+	int k;
+
+	for (k = 0; k + 4 <= count; k += 4) {
+		int age[4];
+		__m128i w, o;
+		_mm_storeu_si128 ((__m128i*)age, _mm_sub_epi32 (vnow, _mm_loadu_si128 ((const __m128i*)(evtime + k))));
+		w = _mm_setr_epi32 (winsinc[age[0]], winsinc[age[1]], winsinc[age[2]], winsinc[age[3]]);
+		o = _mm_loadu_si128 ((const __m128i*)(output + k));
+		acc = _mm_add_epi32 (acc, sinc_mullo_epi32 (w, o));
+	}
+	acc = _mm_add_epi32 (acc, _mm_shuffle_epi32 (acc, _MM_SHUFFLE (1, 0, 3, 2)));
+	acc = _mm_add_epi32 (acc, _mm_shuffle_epi32 (acc, _MM_SHUFFLE (2, 3, 0, 1)));
+	return (uae_u32)_mm_cvtsi128_si32 (acc) + sinc_mix_scalar (winsinc, evtime + k, output + k, count - k, now);
+}
+
+#else
+
+#define sinc_mix sinc_mix_scalar
+
+#endif
+
+#endif /* SINCMIX_H */
@@ -39,10 +39,18 @@
 
 #define UAE_RAND_MAX RAND_MAX
 
-#ifdef JIT
+/* 64 bit Linux reserves the whole 32 bit Amiga address space as natmem
+ * (see od-generic/memory.c), which the interpreter uses without the JIT */
+#if defined(__linux__) && SIZEOF_VOID_P == 8
+#define NATMEM_4G 1
+#endif
+
+#if defined(JIT) || defined(NATMEM_4G)
 #define NATMEM_OFFSET natmem_offset
 #else
 #undef NATMEM_OFFSET
+#endif
+#ifndef JIT
 #  undef JIT_DEBUG
 #  undef USE_UDIS86
 #endif
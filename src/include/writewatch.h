@@ -0,0 +1,54 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Host page write tracking (GetWriteWatch() style)
+  */
+
+#ifndef WRITEWATCH_H
+#define WRITEWATCH_H
+
+#define MAX_WRITEWATCH 64
+
+/* Start tracking writes to host memory <base>..<base+size>. All pages
+ * start out clean, except host pages only partly inside the region,
+ * which are never protected and always dirty. Returns a handle >= 0 or
+ * -1 if tracking is not available, in which case every page must be
+ * treated as dirty. */
+extern int writewatch_add (uae_u8 *base, uae_u32 size);
+/* The same, but all pages start out dirty and unprotected, arm them with
+ * writewatch_arm () when their contents are known. */
+extern int writewatch_add_dirty (uae_u8 *base, uae_u32 size);
+extern void writewatch_remove (int handle);
+
+/* Store offsets (relative to base) of up to <max> written pages in
+ * <pages>, returns count. Each page covers writewatch_pagesize () bytes
+ * starting at the offset, except that a page straddling base is reported
+ * as offset 0. If <reset> is set the returned pages are armed again,
+ * except for the partial pages at either end of the region, which are
+ * never protected and always reported. */
+extern int writewatch_get (int handle, uae_u32 *pages, int max, bool reset);
+/* Mark <addr>..<addr+size> written and make it writable. Must be called
+ * before the host kernel writes into watched memory (read () and friends
+ * fail with EFAULT instead of faulting). Only safe on the thread that
+ * arms pages, elsewhere they may be armed again before the I/O is done,
+ * use writewatch_io_begin () there. */
+extern void writewatch_touch (uae_u8 *addr, uae_u32 size);
+/* Buffer for the host kernel to write <size> bytes meant for <addr> into,
+ * a bounce buffer if any of it is watched, else <addr> itself. Pass the
+ * number of bytes received to writewatch_io_end (), which copies them
+ * to <addr> and releases the buffer. Regions must not be added while
+ * the I/O is running. */
+extern uae_u8 *writewatch_io_begin (uae_u8 *addr, uae_u32 size);
+extern void writewatch_io_end (uae_u8 *addr, uae_u8 *buf, uae_u32 len);
+/* Arm every page of the region again without reporting anything */
+extern void writewatch_reset (int handle);
+/* Has the page holding <offset> been written since it was last armed? */
+extern bool writewatch_isdirty (int handle, uae_u32 offset);
+/* Arm the pages covering <offset>..<offset+size> again */
+extern void writewatch_arm (int handle, uae_u32 offset, uae_u32 size);
+/* Handle a write fault at <addr>, for SIGSEGV handlers installed after
+ * the first region. Returns false if <addr> is not watched. */
+extern bool writewatch_fault (void *addr);
+extern uae_u32 writewatch_pagesize (void);
+
+#endif /* WRITEWATCH_H */
@@ -54,6 +54,7 @@
 #include "dongle.h"
 #include "cdtv.h"
 #include "misc.h"
+#include "benchmark.h"
 
 /* external members */
 extern int bootrom_header, bootrom_items;
@@ -2339,6 +2340,9 @@ static int inputdelay;
 
 static void inputdevice_read (void)
 {
+	/* headless benchmark, the host drivers have no window */
+	if (benchmark_frames)
+		return;
 	//do {
 	//	handle_msgpump ();
 		idev[IDTYPE_MOUSE].read ();
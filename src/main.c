@@ -26,6 +26,7 @@
 #include "newcpu.h"
 #include "disk.h"
 #include "debug.h"
+#include "dmatrace.h"
 #include "xwin.h"
 #include "inputdevice.h"
 #include "keybuf.h"
@@ -60,6 +61,7 @@
 #include "misc.h"
 #include "keyboard.h"
 #include "tabletlibrary.h"
+#include "benchmark.h"
 #ifdef RETROPLATFORM
 #include "rp.h"
 #endif
@@ -819,6 +821,8 @@ static void parse_cmdline (int argc, TCHAR **argv)
 			xfree (txt);
 		} else if (_tcsncmp (argv[i], _T("-cfgparam="), 10) == 0) {
 			;
+		} else if (benchmark_cmdline (argv[i])) {
+			;
 		} else if (_tcscmp (argv[i], _T("-cfgparam")) == 0) {
 			if (i + 1 < argc)
 				i++;
@@ -995,11 +999,15 @@ void do_leave_program (void)
 #ifdef SAMPLER
 	sampler_free ();
 #endif
-	graphics_leave ();
+	if (!benchmark_frames)
+		graphics_leave ();
 	inputdevice_close ();
 	DISK_free ();
 	close_sound ();
 	dump_counts ();
+#ifdef DEBUGGER
+	dmatrace_stop ();
+#endif
 #ifdef SERIAL_PORT
 	serial_exit ();
 #endif
@@ -1111,7 +1119,7 @@ static int real_main2 (int argc, TCHAR **argv)
 		fixup_prefs (&currprefs);
 	}
 
-	if (! graphics_setup ()) {
+	if (!benchmark_frames && ! graphics_setup ()) {
 		write_log (_T("Graphics Setup Failed\n"));
 		exit (1);
 	}
@@ -1134,7 +1142,7 @@ static int real_main2 (int argc, TCHAR **argv)
 		fixup_prefs (&currprefs);
 	}
 
-	if (! setup_sound ()) {
+	if (!benchmark_frames && ! setup_sound ()) {
 		write_log (_T("Sound driver unavailable: Sound output disabled\n"));
 		currprefs.produce_sound = 0;
 	}
@@ -1143,7 +1151,7 @@ static int real_main2 (int argc, TCHAR **argv)
 	changed_prefs = currprefs;
 	no_gui = ! currprefs.start_gui;
 
-	if (restart_program == 2)
+	if (restart_program == 2 || benchmark_frames)
 		no_gui = 1;
 	else if (restart_program == 3)
 		no_gui = 0;
@@ -1207,7 +1215,7 @@ static int real_main2 (int argc, TCHAR **argv)
 
 	gui_update ();
 
-	if (graphics_init ()) {
+	if (benchmark_frames ? benchmark_graphics_init () : graphics_init ()) {
 
 #ifdef DEBUGGER
 		setup_brkhandler ();
@@ -1215,7 +1223,9 @@ static int real_main2 (int argc, TCHAR **argv)
 			activate_debugger ();
 #endif
 
-		if (!init_audio ()) {
+		if (benchmark_frames) {
+			benchmark_start ();
+		} else if (!init_audio ()) {
 			if (sound_available && currprefs.produce_sound > 1) {
 				write_log (_T("Sound driver unavailable: Sound output disabled\n"));
 			}
@@ -20,6 +20,8 @@
 #include "custom.h"
 #include "events.h"
 #include "newcpu.h"
+#include "cpummu.h"
+#include "cpummu030.h"
 #include "autoconf.h"
 #include "savestate.h"
 #include "ar.h"
@@ -114,14 +116,81 @@ static bool needmman (void)
 {
 	if (!currprefs.jit_direct_compatible_memory)
 		return false;
+#ifdef NATMEM_4G
+	/* the interpreter accesses RAM through natmem too */
+	if (natmem_offset)
+		return true;
+#endif
 	if (canjit ())
 		return true;
 	return false;
 }
 
+/* RAM without access side effects, plain loads and stores of baseaddr
+ * do the same as the bank functions */
+static bool plain_ram_bank (addrbank *ab)
+{
+	return ab->baseaddr && (ab == &chipmem_bank || ab == &bogomem_bank || ab == &fastmem_bank || ab == &fastmem2_bank
+		|| ab == &z3fastmem_bank || ab == &z3fastmem2_bank || ab == &z3chipmem_bank
+		|| ab == &a3000lmem_bank || ab == &a3000hmem_bank || ab == &gfxmem_bank);
+}
+
+/* Host address of <size> bytes at <addr> if they are all in the same
+ * plain RAM bank, else NULL. The result is only valid until the next
+ * map_banks (). */
+uae_u8 *get_ram_address (uaecptr addr, uae_u32 size)
+{
+	addrbank *ab = mem_banks[bankindex (addr)];
+	uae_u32 offset;
+
+	if (!plain_ram_bank (ab) || bankindex (addr) != bankindex (addr + size - 1))
+		return NULL;
+	offset = (addr - (ab->start & ab->mask)) & ab->mask;
+	if (offset + size - 1 > ab->mask || offset + size > ab->allocated)
+		return NULL;
+	return ab->baseaddr + offset;
+}
+
+#ifdef NATMEM_OFFSET
+
+uae_u8 natmem_direct[MEMORY_BANKS];
+
+/* Banks the CPU core can access with a plain load or store at
+ * natmem_offset + addr: RAM without access side effects, mapped at its
+ * own address in the natmem area. Mirrors and partial banks go through
+ * the bank functions. */
+static bool natmem_direct_bank (int bnr)
+{
+	addrbank *ab = mem_banks[bnr];
+	uaecptr addr = bnr << 16;
+	uae_u32 offset;
+
+	if (!canbang || !natmem_offset || !plain_ram_bank (ab))
+		return false;
+	if (addr < ab->start)
+		return false;
+	offset = addr - ab->start;
+	if ((offset & ab->mask) != offset || offset + 65536 > ab->allocated)
+		return false;
+	return ab->baseaddr + offset == natmem_offset + addr;
+}
+
+void natmem_direct_update (void)
+{
+	int i;
+
+	for (i = 0; i < MEMORY_BANKS; i++)
+		natmem_direct[i] = natmem_direct_bank (i);
+}
+
+#endif
+
 static void nocanbang (void)
 {
 	canbang = 0;
+#ifdef NATMEM_OFFSET
+	memset (natmem_direct, 0, sizeof natmem_direct);
+#endif
 }
 
 uae_u8 ce_banktype[65536];
@@ -139,6 +208,8 @@ static bool bogomem_aliasing;
 static bool last_address_space_24;
 
 addrbank *mem_banks[MEMORY_BANKS];
+/* bumped by every map_banks (), views of RAM may have come and gone */
+uae_u32 mem_banks_generation;
 
 /* This has two functions. It either holds a host address that, when added
    to the 68k address, gives the host address corresponding to that 68k
@@ -736,6 +807,17 @@ static void chipmem_setindirect (void)
 	}
 }
 
+/* Host address of [addr, addr + size) as chip DMA sees it, NULL unless
+ * all of it is plain chip RAM that needs no address wrapping. */
+uae_u8 *chipmem_xlate_dma (uaecptr addr, uae_u32 size)
+{
+	if (currprefs.z3chipmem_size || !chipmem_bank.baseaddr)
+		return NULL;
+	if (addr >= chipmem_full_size || size > chipmem_full_size - addr)
+		return NULL;
+	return chipmem_bank.baseaddr + addr;
+}
+
 /* Slow memory */
 
 MEMORY_FUNCTIONS(bogomem)
@@ -1613,7 +1695,7 @@ static shmpiece *find_shmpiece (uae_u8 *base, bool safe)
 	if (!x) {
 		if (safe || bogomem_aliasing)
 			return 0;
-		write_log (_T("NATMEM: Failure to find mapping at %08X, %p\n"), base - NATMEM_OFFSET, base);
+		write_log (_T("NATMEM: Failure to find mapping at %08X, %p\n"), (uae_u32)(base - NATMEM_OFFSET), base);
 		nocanbang ();
 		return 0;
 	}
@@ -1783,12 +1865,41 @@ uae_u8 *mapped_malloc (size_t s, const TCHAR *file)
 
 #endif
 
+/* Host addresses the memory of <ab> is mapped at, baseaddr first, so
+ * that the writes to all of them can be watched. Returns the count, 0 if
+ * <ab> is not plain RAM and -1 if there are more than <max>. */
+int get_ram_views (addrbank *ab, uae_u8 **views, int max)
+{
+	int cnt = 0;
+
+	if (!plain_ram_bank (ab) || max < 1)
+		return 0;
+	views[cnt++] = ab->baseaddr;
+#ifdef NATMEM_OFFSET
+	if (needmman ()) {
+		shmpiece *x = find_shmpiece (ab->baseaddr, true);
+		shmpiece *y;
+		for (y = shm_start; x && y; y = y->next) {
+			if (y == x || y->id != x->id)
+				continue;
+			if (cnt >= max)
+				return -1;
+			views[cnt++] = y->native_address;
+		}
+	}
+#endif
+	return cnt;
+}
+
 static void init_mem_banks (void)
 {
 	uae_u32 i;
 
 	for (i = 0; i < MEMORY_BANKS; i++)
 		put_mem_bank (i << 16, &dummy_bank, 0);
+#ifdef NATMEM_OFFSET
+	memset (natmem_direct, 0, sizeof natmem_direct);
+#endif
 
 #ifdef NATMEM_OFFSET
 	delete_shmmaps (0, 0xFFFF0000);
@@ -2561,6 +2672,11 @@ static void map_banks2 (addrbank *bank, int start, int size, int realsize, int q
 	if (!quick)
 		old = debug_bankchange (-1);
 #endif
+#ifdef FULLMMU
+	mmu_tlb_flush_all ();
+	mmu030_tlb_flush_all ();
+#endif
+	mem_banks_generation++;
 #ifdef JIT
 	flush_icache (0, 3); /* Sure don't want to keep any old mappings around! */
 #ifdef NATMEM_OFFSET
@@ -2590,6 +2706,9 @@ static void map_banks2 (addrbank *bank, int start, int size, int realsize, int q
 #endif
 			}
 			put_mem_bank (bnr << 16, bank, realstart << 16);
+#ifdef NATMEM_OFFSET
+			natmem_direct[bnr] = natmem_direct_bank (bnr);
+#endif
 			real_left--;
 		}
 #ifdef DEBUGGER
@@ -2616,6 +2735,9 @@ static void map_banks2 (addrbank *bank, int start, int size, int realsize, int q
 #endif
 			}
 			put_mem_bank ((bnr + hioffs) << 16, bank, realstart << 16);
+#ifdef NATMEM_OFFSET
+			natmem_direct[bnr + hioffs] = natmem_direct_bank (bnr + hioffs);
+#endif
 			real_left--;
 		}
 	}
@@ -3621,9 +3621,11 @@ void execute_normal (void)
 		cpu_cycles = adjust_cycles (cpu_cycles);
 		do_cycles (cpu_cycles);
 		total_cycles += cpu_cycles;
+		pc_hist[blocklen].cycles = total_cycles;
 		pc_hist[blocklen].specmem = special_mem;
 		blocklen++;
-		if (end_block (opcode) || blocklen >= MAXRUN || r->spcflags || uae_int_requested || uaenet_int_requested) {
+		if ((end_block (opcode) && !trace_through (opcode, pc_hist[blocklen - 1].location, r->pc_p))
+			|| blocklen >= MAXRUN || r->spcflags || uae_int_requested || uaenet_int_requested) {
 			compile_block (pc_hist, blocklen, total_cycles);
 			return; /* We will deal with the spcflags in the caller */
 		}
@@ -4159,6 +4161,45 @@ static void m68k_run_mmu (void)
 
 int in_m68k_go = 0;
 
+#ifdef SAVESTATE
+/* Chipset and CPU have been reset with a state loaded, finish it */
+static void m68k_restore_finish (void)
+{
+#ifdef DEBUGGER
+	if (debug_dma) {
+		record_dma_reset ();
+		record_dma_reset ();
+	}
+#endif // DEBUGGER
+	savestate_restore_finish ();
+#ifdef DEBUGGER
+	memory_map_dump ();
+#endif // DEBUGGER
+#ifdef MMUEMU
+	if (currprefs.mmu_model == 68030) {
+		mmu030_decode_tc (tc_030);
+	} else if (currprefs.mmu_model >= 68040) {
+		mmu_set_tc (regs.tcr);
+	}
+#endif // MMUEMU
+}
+
+/* Apply a state loaded by restore_state_record () immediately instead of
+ * at the next reset point of m68k_go (). Only for the debugger, states
+ * from a frontend are queued for the next vsync instead. */
+void m68k_restore_now (void)
+{
+	set_cycles (start_cycles);
+	custom_reset (false, false);
+	m68k_reset (false);
+	m68k_restore_finish ();
+	m68k_setpc_normal (regs.pc);
+#ifdef JIT
+	set_special (SPCFLAG_END_COMPILE);
+#endif
+}
+#endif // SAVESTATE
+
 static void exception2_handle (uaecptr addr, uaecptr fault)
 {
 	last_addr_for_exception_3 = addr;
@@ -4229,23 +4270,7 @@ void m68k_go (int may_quit)
 #ifdef SAVESTATE
 			/* We may have been restoring state, but we're done now.  */
 			if (isrestore ()) {
-#ifdef DEBUGGER
-				if (debug_dma) {
-					record_dma_reset ();
-					record_dma_reset ();
-				}
-#endif // DEBUGGER
-				savestate_restore_finish ();
-#ifdef DEBUGGER
-				memory_map_dump ();
-#endif // DEBUGGER
-#ifdef MMUEMU
-				if (currprefs.mmu_model == 68030) {
-					mmu030_decode_tc (tc_030);
-				} else if (currprefs.mmu_model >= 68040) {
-					mmu_set_tc (regs.tcr);
-				}
-#endif // MMUEMU
+				m68k_restore_finish ();
 				startup = 1;
 				restored = 1;
 			}
@@ -142,22 +142,191 @@ static void *mmap_anon(void *addr, size_t len, int prot, int flags, off_t offset
 	close(fd);
 #endif /* MAP_ANONYMOUS */
 	if (result == MAP_FAILED) {
-		write_log("MMAPed failed addr: 0x%08X, %d bytes (%d MB)\n",
+		write_log("MMAPed failed addr: %p, %u bytes (%u MB)\n",
 					addr, (uae_u32)len, (uae_u32)len / 0x100000);
 	} else {
-		write_log("MMAPed OK range: 0x%08X - 0x%08X, %d bytes (%d MB)\n",
-					PTR_TO_UINT32(result), PTR_TO_UINT32(result) + (uae_u32)len,
+		write_log("MMAPed OK range: %p - %p, %u bytes (%u MB)\n",
+					result, (uae_u8*)result + len,
 					(uae_u32)len, (uae_u32)len / 0x100000);
 	}
 	return result;
 }
 
+#ifdef NATMEM_4G
+/*
+ * The whole 32 bit Amiga address space is reserved in one piece and
+ * every RAM and ROM area is committed at its own Amiga address, so that
+ * natmem_offset + addr is valid for all of them. Uncommitted pages (I/O,
+ * holes) stay inaccessible. An access that faults on a page of a bank
+ * that is unmapped (dummy_bank) gets the page backed with zeroes by the
+ * SIGSEGV handler, the way unmapped space reads on the real machine,
+ * instead of crashing. Faults anywhere else, I/O banks and the guard
+ * included, are passed on. The filled pages are taken back, and logged,
+ * at the next memory layout change.
+ */
+
+#include <signal.h>
+
+#define NATMEM_4G_SIZE ((size_t)1 << 32)
+/* catches BARRIER overruns and accesses that wrap past 0xffffffff */
+#define NATMEM_4G_GUARD (16 * 1024 * 1024)
+
+static uae_u8 *natmem_4g;
+/* page bitmaps: committed areas, and hole pages the fault handler filled */
+static uae_u32 *natmem_4g_committed, *natmem_4g_holes;
+/* written by the fault handler, logged outside of it */
+static volatile uae_u32 natmem_4g_holecnt, natmem_4g_holefirst;
+static struct sigaction natmem_4g_oldsegv;
+
+static bool natmem_4g_inside (const void *addr)
+{
+	return natmem_4g && (const uae_u8*)addr >= natmem_4g && (const uae_u8*)addr < natmem_4g + NATMEM_4G_SIZE + NATMEM_4G_GUARD;
+}
+
+STATIC_INLINE bool natmem_4g_bit (const uae_u32 *map, uintptr_t page)
+{
+	return (map[page >> 5] >> (page & 31)) & 1;
+}
+
+static void natmem_4g_bits (uae_u32 *map, uintptr_t first, uintptr_t last, bool set)
+{
+	for (; first < last; first++) {
+		if (set)
+			map[first >> 5] |= 1u << (first & 31);
+		else
+			map[first >> 5] &= ~(1u << (first & 31));
+	}
+}
+
+/* Runs in signal context: no logging, no allocation, only mprotect */
+static void natmem_4g_handler (int sig, siginfo_t *info, void *ctx)
+{
+	uae_u8 *a = (uae_u8*)info->si_addr;
+
+	if (natmem_4g_inside (a) && a < natmem_4g + NATMEM_4G_SIZE) {
+		uintptr_t addr = a - natmem_4g;
+		uintptr_t page = addr / si.dwPageSize;
+		uae_u8 *p = natmem_4g + page * si.dwPageSize;
+		if (mem_banks[addr >> 16] == &dummy_bank
+			&& !natmem_4g_bit (natmem_4g_committed, page) && !natmem_4g_bit (natmem_4g_holes, page)
+			&& !mprotect (p, si.dwPageSize, PROT_READ | PROT_WRITE)) {
+			natmem_4g_bits (natmem_4g_holes, page, page + 1, true);
+			if (!natmem_4g_holecnt++)
+				natmem_4g_holefirst = (uae_u32)addr;
+			return;
+		}
+	}
+	/* not ours: committed memory that is write protected, or elsewhere */
+	if (natmem_4g_oldsegv.sa_flags & SA_SIGINFO) {
+		natmem_4g_oldsegv.sa_sigaction (sig, info, ctx);
+	} else if (natmem_4g_oldsegv.sa_handler == SIG_DFL || natmem_4g_oldsegv.sa_handler == SIG_IGN) {
+		/* restore and return, the faulting access is retried */
+		sigaction (sig, &natmem_4g_oldsegv, NULL);
+	} else {
+		natmem_4g_oldsegv.sa_handler (sig);
+	}
+}
+
+/* address space only, nothing is charged until pages are committed */
+static uae_u8 *natmem_4g_reserve (void)
+{
+	uintptr_t pages = (NATMEM_4G_SIZE + NATMEM_4G_GUARD) / si.dwPageSize;
+	struct sigaction sa;
+	void *p;
+
+	natmem_4g_committed = xcalloc (uae_u32, (pages + 31) / 32);
+	natmem_4g_holes = xcalloc (uae_u32, (pages + 31) / 32);
+	if (!natmem_4g_committed || !natmem_4g_holes)
+		goto fail;
+	p = mmap (NULL, NATMEM_4G_SIZE + NATMEM_4G_GUARD, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED) {
+		write_log (_T("NATMEM: 4G reservation failed, errno %d\n"), errno);
+		goto fail;
+	}
+	memset (&sa, 0, sizeof sa);
+	sa.sa_sigaction = natmem_4g_handler;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset (&sa.sa_mask);
+	sigaction (SIGSEGV, &sa, &natmem_4g_oldsegv);
+	return (uae_u8*)p;
+fail:
+	xfree (natmem_4g_committed);
+	xfree (natmem_4g_holes);
+	natmem_4g_committed = natmem_4g_holes = NULL;
+	return NULL;
+}
+
+/* Give the pages filled by the fault handler back */
+static void natmem_4g_release_holes (void)
+{
+	uintptr_t page, pages = (NATMEM_4G_SIZE + NATMEM_4G_GUARD) / si.dwPageSize;
+
+	if (!natmem_4g || !natmem_4g_holecnt)
+		return;
+	for (page = 0; page < pages; page++) {
+		uae_u8 *p = natmem_4g + page * si.dwPageSize;
+		if (!natmem_4g_bit (natmem_4g_holes, page))
+			continue;
+		madvise (p, si.dwPageSize, MADV_DONTNEED);
+		mprotect (p, si.dwPageSize, PROT_NONE);
+	}
+	memset (natmem_4g_holes, 0, (pages + 31) / 32 * sizeof (uae_u32));
+	write_log (_T("NATMEM: %u unmapped pages had been accessed, first at %08X\n"), natmem_4g_holecnt, natmem_4g_holefirst);
+	natmem_4g_holecnt = 0;
+}
+
+/* Areas are not page aligned at the end (BARRIER), so the partial page
+ * at either end may be shared with a neighbour: commit rounds outwards,
+ * decommit inwards. */
+static void *natmem_4g_commit (void *addr, size_t size)
+{
+	uintptr_t mask = si.dwPageSize - 1;
+	uintptr_t s = (uintptr_t)addr & ~mask;
+	uintptr_t e = ((uintptr_t)addr + size + mask) & ~mask;
+	uintptr_t page;
+
+	/* hole pages the fault handler filled start out zeroed again */
+	for (page = (s - (uintptr_t)natmem_4g) / si.dwPageSize; page < (e - (uintptr_t)natmem_4g) / si.dwPageSize; page++) {
+		if (natmem_4g_bit (natmem_4g_holes, page)) {
+			madvise (natmem_4g + page * si.dwPageSize, si.dwPageSize, MADV_DONTNEED);
+			natmem_4g_bits (natmem_4g_holes, page, page + 1, false);
+		}
+	}
+	if (mprotect ((void*)s, e - s, PROT_READ | PROT_WRITE)) {
+		write_log (_T("NATMEM: commit %08X - %08X failed, errno %d\n"),
+			(uae_u32)(s - (uintptr_t)natmem_4g), (uae_u32)(e - (uintptr_t)natmem_4g), errno);
+		return NULL;
+	}
+	natmem_4g_bits (natmem_4g_committed, (s - (uintptr_t)natmem_4g) / si.dwPageSize, (e - (uintptr_t)natmem_4g) / si.dwPageSize, true);
+	return addr;
+}
+
+static void natmem_4g_decommit (void *addr, size_t size)
+{
+	uintptr_t mask = si.dwPageSize - 1;
+	uintptr_t s = ((uintptr_t)addr + mask) & ~mask;
+	uintptr_t e = ((uintptr_t)addr + size) & ~mask;
+
+	if (e <= s)
+		return;
+	natmem_4g_bits (natmem_4g_committed, (s - (uintptr_t)natmem_4g) / si.dwPageSize, (e - (uintptr_t)natmem_4g) / si.dwPageSize, false);
+	/* pages read back as zero when committed again */
+	madvise ((void*)s, e - s, MADV_DONTNEED);
+	mprotect ((void*)s, e - s, PROT_NONE);
+}
+
+#endif
+
 static void *VirtualAlloc(LPVOID lpAddress, int dwSize, DWORD flAllocationType, DWORD flProtect) {
 #if MEMORY_DEBUG > 0
 	write_log ("VirtualAlloc Addr: 0x%08X, Size: %zu bytes (%d MB), Type: %x, Protect: %d\n", lpAddress, dwSize, dwSize/0x100000, flAllocationType, flProtect);
 #endif
 	void *memory = NULL;
 
+#ifdef NATMEM_4G
+	if ((flAllocationType & MEM_COMMIT) && natmem_4g_inside (lpAddress))
+		return natmem_4g_commit (lpAddress, dwSize);
+#endif
 	if ((flAllocationType == MEM_COMMIT && lpAddress == NULL) || flAllocationType & MEM_RESERVE) {
 		memory = malloc(dwSize);
 		if (memory == NULL)
@@ -173,6 +342,8 @@ static void *VirtualAlloc(LPVOID lpAddress, int dwSize, DWORD flAllocationType,
 		return lpAddress;
 	}
 
+#ifndef NATMEM_4G
+	/* 32 bit address bookkeeping, not used on 64 bit hosts */
 	void* answer;
 	long pgsz;
 
@@ -253,10 +424,16 @@ static void *VirtualAlloc(LPVOID lpAddress, int dwSize, DWORD flAllocationType,
 		write_log ("VirtualAlloc: provides %u bytes starting at 0x%08X\n", dwSize, PTR_TO_UINT32(answer));
 		return answer;
 	}
+#endif
 }
 
 static bool VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType) {
+#ifdef NATMEM_4G
+	if (dwFreeType == MEM_DECOMMIT && natmem_4g_inside (lpAddress))
+		natmem_4g_decommit (lpAddress, dwSize);
+#endif
 	return true;
+#ifndef NATMEM_4G
 	virt_alloc* str = vm;
 	int answer;
 
@@ -280,6 +457,7 @@ static bool VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType) {
 	}
 	write_log ("VirtualFree: ok\n");
 	return -1;
+#endif
 }
 
 static uae_u8 *virtualallocwithlock (LPVOID addr, SIZE_T size, DWORD allocationtype, DWORD protect)
@@ -349,7 +527,7 @@ static uae_u32 lowmem (void)
 void mman_ResetWatch (PVOID lpBaseAddress, SIZE_T dwRegionSize)
 {
 	if (ResetWriteWatch (lpBaseAddress, dwRegionSize))
-		write_log (_T("ResetWriteWatch() failed, %d\n"), GetLastError ());
+		write_log (_T("ResetWriteWatch() failed, %lu\n"), GetLastError ());
 }*/
 
 static uae_u64 size64;
@@ -422,6 +600,27 @@ bool preinit_shm (void)
 	if (max_allowed_mman * 1024 * 1024 > size64)
 		max_allowed_mman = size64 / (1024 * 1024);
 
+#ifdef NATMEM_4G
+	if (!natmem_4g)
+		natmem_4g = natmem_4g_reserve ();
+	if (natmem_4g) {
+		natmem_offset = natmem_4g;
+		natmem_size = MAXZ3MEM64;
+		max_z3fastmem = natmem_size;
+		write_log (_T("Reserved 4G: 0x%p-0x%p, %lluM of it usable\n"),
+			natmem_offset, natmem_offset + NATMEM_4G_SIZE, size64 >> 20);
+		clear_shm ();
+		canbang = 1;
+		return true;
+	}
+#ifndef JIT
+	/* without the JIT natmem is only worth it in one piece */
+	write_log (_T("NATMEM: not used\n"));
+	canbang = 0;
+	return false;
+#endif
+#endif
+
 	natmem_size = (max_allowed_mman + 1) * 1024 * 1024;
 	if (natmem_size < 17 * 1024 * 1024)
 		natmem_size = 17 * 1024 * 1024;
@@ -431,7 +630,7 @@ bool preinit_shm (void)
 	if (natmem_size <= 768 * 1024 * 1024) {
 		uae_u32 p = 0x78000000 - natmem_size;
 		for (;;) {
-			natmem_offset = (uae_u8*)VirtualAlloc ((void*)VALUE_TO_PTR(p), natmem_size, MEM_RESERVE, PAGE_READWRITE);
+			natmem_offset = (uae_u8*)VirtualAlloc ((void*)(uintptr_t)p, natmem_size, MEM_RESERVE, PAGE_READWRITE);
 //			natmem_offset = (uae_u8*)VirtualAlloc ((void*)p, natmem_size, MEM_RESERVE | (VAMODE == 1 ? MEM_WRITE_WATCH : 0), PAGE_READWRITE);
 			if (natmem_offset)
 				break;
@@ -464,7 +663,7 @@ bool preinit_shm (void)
 		max_z3fastmem = 0;
 	else
 		max_z3fastmem = natmem_size;
-		write_log (_T("Reserved: 0x%p-0x%p (%08x %dM)\n"),
+	write_log (_T("Reserved: 0x%p-0x%p (%08x %dM)\n"),
 		natmem_offset, (uae_u8*)natmem_offset + natmem_size,
 		natmem_size, natmem_size >> 20);
 
@@ -480,6 +679,9 @@ static void resetmem (bool decommit)
 {
 	int i;
 
+#ifdef NATMEM_4G
+	natmem_4g_release_holes ();
+#endif
 	if (!shm_start)
 		return;
 	for (i = 0; i < MAX_SHMID; i++) {
@@ -502,7 +704,7 @@ static void resetmem (bool decommit)
 		} else {
 			result = virtualallocwithlock (shmaddr, size, decommit ? MEM_DECOMMIT : MEM_COMMIT, PAGE_READWRITE);
 			if (result != shmaddr)
-				write_log (_T("NATMEM: realloc(%p-%p,%d,%d,%s) failed, err=%d\n"), shmaddr, shmaddr + size, size, s->mode, s->name, GetLastError ());
+				write_log (_T("NATMEM: realloc(%p-%p,%d,%d,%s) failed, err=%lu\n"), shmaddr, shmaddr + size, size, s->mode, s->name, GetLastError ());
 			else
 				write_log (_T("NATMEM: rellocated(%p-%p,%d,%s)\n"), shmaddr, shmaddr + size, size, s->name);
 		}
@@ -528,7 +730,7 @@ static uae_u8 *va (uae_u32 offset, uae_u32 len, DWORD alloc, DWORD protect)
 			natmem_offset + offset, natmem_offset + offset + len, len >> 20, (alloc & MEM_WRITE_WATCH) ? _T("WATCH") : _T("RESERVED"));
 		return addr;
 	}
-	write_log (_T("VA(%p - %p, %4uM, %s) failed %d\n"),
+	write_log (_T("VA(%p - %p, %4uM, %s) failed %lu\n"),
 		natmem_offset + offset, natmem_offset + offset + len, len >> 20, (alloc & MEM_WRITE_WATCH) ? _T("WATCH") : _T("RESERVED"), GetLastError ());
 	return NULL;
 }
@@ -560,7 +762,7 @@ static int doinit_shm (void)
 			int change = lowmem ();
 			if (!change)
 				return 0;
-			write_log (_T("NATMEM: %d, %dM > %dM = %dM\n"), ++lowround, totalsize >> 20, size64 >> 20, (totalsize - change) >> 20);
+			write_log (_T("NATMEM: %d, %dM > %lluM = %dM\n"), ++lowround, totalsize >> 20, size64 >> 20, (totalsize - change) >> 20);
 			totalsize -= change;
 		}
 		if ((rounds > 1 && totalsize < 0x10000000) || rounds > 20) {
@@ -571,8 +773,8 @@ static int doinit_shm (void)
 
 		if (startbarrier + natmemsize + z3rtgmem_size + 16 * si.dwPageSize <= natmem_size)
 			break;
-		write_log (_T("NATMEM: %dM area failed to allocate, err=%d (Z3=%dM,RTG=%dM)\n"),
-			natmemsize >> 20, GetLastError (), (changed_prefs.z3fastmem_size + changed_prefs.z3fastmem2_size + changed_prefs.z3chipmem_size) >> 20, z3rtgmem_size >> 20);
+		write_log (_T("NATMEM: %dM area failed to allocate, err=%lu (Z3=%dM,RTG=%dM)\n"),
+			natmemsize >> 20, GetLastError (), (changed_prefs.z3fastmem_size + changed_prefs.z3fastmem2_size + changed_prefs.z3chipmem_size) >> 20, (int)(z3rtgmem_size >> 20));
 		if (!lowmem ()) {
 			write_log (_T("NATMEM: No special area could be allocated (2)!\n"));
 			return 0;
@@ -610,7 +812,7 @@ static int doinit_shm (void)
 		if (!p96mem_offset) {
 			currprefs.rtgmem_size = changed_prefs.rtgmem_size = 0;
 			z3rtgmem_size = 0;
-			write_log (_T("NATMEM: failed to allocate special Picasso96 GFX RAM, err=%d\n"), GetLastError ());
+			write_log (_T("NATMEM: failed to allocate special Picasso96 GFX RAM, err=%lu\n"), GetLastError ());
 		}
 
 #if 0
@@ -650,13 +852,13 @@ static int doinit_shm (void)
 
 		VirtualFree (natmem_offset, 0, MEM_RELEASE);
 		if (!VirtualAlloc (natmem_offset, natmem_size, MEM_RESERVE, PAGE_READWRITE)) {
-			write_log (_T("NATMEM: No special area could be reallocated! (1) err=%d\n"), GetLastError ());
+			write_log (_T("NATMEM: No special area could be reallocated! (1) err=%lu\n"), GetLastError ());
 			return 0;
 		}
 	}
 #endif
 	if (!natmem_offset) {
-		write_log (_T("NATMEM: No special area could be allocated! err=%d\n"), GetLastError ());
+		write_log (_T("NATMEM: No special area could be allocated! err=%lu\n"), GetLastError ());
 	} else {
 		write_log (_T("NATMEM: Our special area: 0x%p-0x%p (%08x %dM)\n"),
 			natmem_offset, (uae_u8*)natmem_offset + natmemsize,
@@ -775,12 +977,6 @@ STATIC_INLINE key_t find_shmkey (key_t key)
 	return result;
 }
 
-int mprotect (void *addr, size_t len, int prot)
-{
-	int result = 0;
-	return result;
-}
-
 void *my_shmat (int shmid, void *shmaddr, int shmflg)
 {
 	void *result = (void *)-1;
@@ -941,14 +1137,14 @@ void *my_shmat (int shmid, void *shmaddr, int shmflg)
 		result = virtualallocwithlock (shmaddr, size, MEM_COMMIT, PAGE_READWRITE);
 		if (result == NULL) {
 			result = (void*)-1;
-			write_log (_T("Memory %s failed to allocate: VA %08X - %08X %x (%dk). Error %d."),
+			write_log (_T("Memory %s failed to allocate: VA %08X - %08X %x (%dk). Error %lu."),
 				shmids[shmid].name,
-				(uae_u8*)shmaddr - natmem_offset, (uae_u8*)shmaddr - natmem_offset + size,
+				(uae_u32)((uae_u8*)shmaddr - natmem_offset), (uae_u32)((uae_u8*)shmaddr - natmem_offset + size),
 				size, size >> 10, GetLastError ());
 		} else {
 			shmids[shmid].attached = result;
-			write_log (_T("VA %08X - %08X %x (%dk) ok (%08X)%s\n"),
-				(uae_u8*)shmaddr - natmem_offset, (uae_u8*)shmaddr - natmem_offset + size,
+			write_log (_T("VA %08X - %08X %x (%dk) ok (%p)%s\n"),
+				(uae_u32)((uae_u8*)shmaddr - natmem_offset), (uae_u32)((uae_u8*)shmaddr - natmem_offset + size),
 				size, size >> 10, shmaddr, p96special ? _T(" P96") : _T(""));
 		}
 	}
@@ -988,6 +1184,13 @@ void protect_roms (bool protect)
 			continue;
 		if (shm->maprom < 0 && protect)
 			continue;
+#ifdef NATMEM_4G
+		if (natmem_4g_inside (shm->attached) && mprotect (shm->attached, shm->rosize, protect ? PROT_READ : PROT_READ | PROT_WRITE)) {
+			write_log (_T("VP %08X - %08X %x (%dk) failed %d\n"),
+				(uae_u32)((uae_u8*)shm->attached - natmem_offset), (uae_u32)((uae_u8*)shm->attached - natmem_offset + shm->size),
+				(uae_u32)shm->size, (int)(shm->size >> 10), errno);
+		}
+#endif
 	}
 }
 
@@ -1001,7 +1204,7 @@ int my_shmget (key_t key, size_t size, int shmflg, const TCHAR *name)
 	int result = -1;
 
 	if((key == IPC_PRIVATE) || ((shmflg & IPC_CREAT) && (find_shmkey (key) == -1))) {
-		write_log (_T("shmget of size %d (%dk) for %s\n"), size, size >> 10, name);
+		write_log (_T("shmget of size %zu (%zuk) for %s\n"), size, size >> 10, name);
 		if ((result = get_next_shmkey ()) != -1) {
 			shmids[result].size = size;
 			_tcscpy (shmids[result].name, name);
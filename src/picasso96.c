@@ -53,6 +53,8 @@
 #include "misc.h"
 #include "gcc_warnings.h"
 #include "gfxboard.h"
+#include "writewatch.h"
+#include "c2p.h"
 
 int debug_rtg_blitter = 3;
 
@@ -165,7 +167,6 @@ static void checkrtglibrary(void)
 	}
 }
 
-static uae_u32 p2ctab[256][2];
 static int set_gc_called = 0, init_picasso_screen_called = 0;
 //fastscreen
 static uaecptr oldscr = 0;
@@ -321,6 +322,9 @@ static void ShowSupportedResolutions (void)
 
 static void **gwwbuf;
 static int gwwbufsize, gwwpagesize, gwwpagemask;
+/* gfxmem write tracking, -1 if every page has to be treated as dirty */
+static int gwwhandle = -1;
+static uae_u32 *gwwpages;
 extern uae_u8 *natmem_offset;
 
 static uae_u8 GetBytesPerPixel (uae_u32 RGBfmt)
@@ -1795,25 +1799,67 @@ static void CopyLibResolutionStructureU2A (struct LibResolution *libres, uaecptr
 	put_long (amigamemptr + PSSO_LibResolution_BoardInfo, libres->BoardInfo);
 }
 
+/* Must be called before gfxmem is freed */
+void picasso_freewritewatch (void)
+{
+	writewatch_remove (gwwhandle);
+	gwwhandle = -1;
+}
+
 void picasso_allocatewritewatch (int gfxmemsize)
 {
+	picasso_freewritewatch ();
 	xfree (gwwbuf);
-	gwwpagesize = getpagesize();
+	xfree (gwwpages);
+	gwwpagesize = writewatch_pagesize ();
 	gwwbufsize = gfxmemsize / gwwpagesize + 1;
 	gwwpagemask = gwwpagesize - 1;
 	gwwbuf = xmalloc (void*, gwwbufsize);
+	gwwpages = xmalloc (uae_u32, gwwbufsize);
+	if (!gwwbuf || !gwwpages || !gfxmem_bank.baseaddr)
+		return;
+#ifdef JIT
+	/* direct JIT memory access faults end up in the JIT's own handler */
+	if (currprefs.cachesize)
+		return;
+#endif
+	gwwhandle = writewatch_add (gfxmem_bank.baseaddr, gfxmemsize);
+	if (gwwhandle < 0)
+		write_log (_T("P96: VRAM write tracking not available, refreshing full screen\n"));
+}
+
+/* Fill gwwbuf with the pages written since the last reset, as addresses
+   based at <base>, limited to <start>..<end> if given. Without tracking
+   every page counts as written.  */
+static int picasso_getdirtypages (uae_u8 *base, uae_u8 *start, uae_u8 *end, bool reset)
+{
+	int i, cnt, n = 0;
+
+	if (!gwwbuf)
+		return 0;
+	if (gwwhandle < 0 || !gwwpages) {
+		if (!start) {
+			start = base;
+			end = base + (gwwbufsize - 1) * gwwpagesize;
+		}
+		for (; start < end && n < gwwbufsize; start += gwwpagesize)
+			gwwbuf[n++] = start;
+		return n;
+	}
+	cnt = writewatch_get (gwwhandle, gwwpages, gwwbufsize, reset);
+	for (i = 0; i < cnt; i++) {
+		uae_u8 *p = base + gwwpages[i];
+		if (start && (p < start || p >= end))
+			continue;
+		gwwbuf[n++] = p;
+	}
+	return n;
 }
 
 static unsigned long writewatchcount;
 void picasso_getwritewatch (void)
 {
-	ULONG ps;
-	writewatchcount = gwwbufsize;
-/*	if (GetWriteWatch (WRITE_WATCH_FLAG_RESET, p96ram_start + natmem_offset, (gwwbufsize - 1) * gwwpagesize, gwwbuf, &writewatchcount, &ps)) {
-		write_log (_T("picasso_getwritewatch %d\n"), GetLastError ());
-		writewatchcount = 0;
-		return;
-	}*/
+	writewatchcount = picasso_getdirtypages (gfxmem_bank.start + natmem_offset, NULL, NULL, true);
 }
 bool picasso_is_vram_dirty (uaecptr addr, int size)
 {
@@ -3239,6 +3285,40 @@ void init_hz_p96 (void)
 	write_log (_T("RTGFREQ: %d*%.4f = %.4f / %.1f = %d\n"), maxvpos_nom, vblank_hz, maxvpos_nom * vblank_hz, p96vblank, p96syncrate);
 }
 
+/* One row of planar pixels as 8x8 bit blocks, see c2p_transpose8 () */
+static uae_u64 p2c_blocks[(65535 + 7) / 8];
+
+/* Convert <width> pixels from the start of each plane, <bitoffset> bits
+ * into its first byte, to blocks: block i holds pixels 8 * i to 8 * i + 7
+ * in bytes 7 to 0, bit k of each pixel from plane k. Pixels past <width>
+ * are 0.  */
+static void PlanarRowToBlocks (uae_u8 **planes, int depth, unsigned long bitoffset, unsigned long width)
+{
+	int n = (width + 7) >> 3;
+	int i, k;
+
+	memset (p2c_blocks, 0, n * sizeof (uae_u64));
+	for (k = 0; k < depth; k++) {
+		uae_u8 *p = planes[k];
+		int shift = 8 * k;
+		if (p == &all_zeros_bitmap)
+			continue;
+		if (p == &all_ones_bitmap) {
+			for (i = 0; i < n; i++)
+				p2c_blocks[i] |= (uae_u64)0xff << shift;
+		} else if (bitoffset) {
+			for (i = 0; i < n; i++)
+				p2c_blocks[i] |= (uae_u64)(uae_u8)(do_get_mem_word ((uae_u16 *)(p + i)) >> (8 - bitoffset)) << shift;
+		} else {
+			for (i = 0; i < n; i++)
+				p2c_blocks[i] |= (uae_u64)p[i] << shift;
+		}
+	}
+	if (width & 7)
+		p2c_blocks[n - 1] &= ((0xff << (8 - (width & 7))) & 0xff) * 0x0101010101010101ULL;
+	c2p_transpose8_n (p2c_blocks, n);
+}
+
 /* NOTE: Watch for those planeptrs of 0x00000000 and 0xFFFFFFFF for all zero / all one bitmaps !!!! */
 static void PlanarToChunky (struct RenderInfo *ri, struct pBitMap *bm,
 	unsigned long srcx, unsigned long srcy,
@@ -3251,7 +3331,6 @@ static void PlanarToChunky (struct RenderInfo *ri, struct pBitMap *bm,
 	uae_u8 *PLANAR[8], *image = ri->Memory + dstx * GetBytesPerPixel (ri->RGBFormat) + dsty * ri->BytesPerRow;
 	int Depth = bm->Depth;
 	unsigned long rows, bitoffset = srcx & 7;
-	long eol_offset;
 
 	/* Set up our bm->Planes[] pointers to the right horizontal offset */
 	for (j = 0; j < Depth; j++) {
@@ -3262,45 +3341,29 @@ static void PlanarToChunky (struct RenderInfo *ri, struct pBitMap *bm,
 		if ((mask & (1 << j)) == 0)
 			PLANAR[j] = &all_zeros_bitmap;
 	}
-	eol_offset = (long)bm->BytesPerRow - (long)((width + 7) >> 3);
 	for (rows = 0; rows < height; rows++, image += ri->BytesPerRow) {
 		unsigned long cols;
 
+		PlanarRowToBlocks (PLANAR, Depth, bitoffset, width);
 		for (cols = 0; cols < width; cols += 8) {
-			int k;
-			uae_u32 a = 0, b = 0;
-			unsigned int msk = 0xFF;
+			uae_u64 r = p2c_blocks[cols >> 3];
+			uae_u32 a = (uae_u32)(r >> 32), b = (uae_u32)r;
 			long tmp = cols + 8 - width;
+			/* keep the pixels past the right edge */
 			if (tmp > 0) {
-				msk <<= tmp;
-				b = do_get_mem_long ((uae_u32 *)(image + cols + 4));
+				uae_u32 ob = do_get_mem_long ((uae_u32 *)(image + cols + 4));
 				if (tmp < 4)
-					b &= 0xFFFFFFFF >> (32 - tmp * 8);
-				else if (tmp > 4) {
-					a = do_get_mem_long ((uae_u32 *)(image + cols));
-					a &= 0xFFFFFFFF >> (64 - tmp * 8);
-				}
-			}
-			for (k = 0; k < Depth; k++) {
-				unsigned int data;
-				if (PLANAR[k] == &all_zeros_bitmap)
-					data = 0;
-				else if (PLANAR[k] == &all_ones_bitmap)
-					data = 0xFF;
-				else {
-					data = (uae_u8)(do_get_mem_word ((uae_u16 *)PLANAR[k]) >> (8 - bitoffset));
-					PLANAR[k]++;
-				}
-				data &= msk;
-				a |= p2ctab[data][0] << k;
-				b |= p2ctab[data][1] << k;
+					ob &= 0xFFFFFFFF >> (32 - tmp * 8);
+				else if (tmp > 4)
+					a |= do_get_mem_long ((uae_u32 *)(image + cols)) & (0xFFFFFFFF >> (64 - tmp * 8));
+				b |= ob;
 			}
 			do_put_mem_long ((uae_u32 *)(image + cols), a);
 			do_put_mem_long ((uae_u32 *)(image + cols + 4), b);
 		}
 		for (j = 0; j < Depth; j++) {
 			if (PLANAR[j] != &all_zeros_bitmap && PLANAR[j] != &all_ones_bitmap) {
-				PLANAR[j] += eol_offset;
+				PLANAR[j] += bm->BytesPerRow;
 			}
 		}
 	}
@@ -3366,8 +3429,7 @@ static void PlanarToDirect (struct RenderInfo *ri, struct pBitMap *bm,
 	uae_u8 *PLANAR[8];
 	uae_u8 *image = ri->Memory + dstx * bpp + dsty * ri->BytesPerRow;
 	int Depth = bm->Depth;
-	unsigned long rows;
-	long eol_offset;
+	unsigned long rows, bitoffset = srcx & 7;
 
 	if(!bpp)
 		return;
@@ -3382,22 +3444,13 @@ static void PlanarToDirect (struct RenderInfo *ri, struct pBitMap *bm,
 			PLANAR[j] = &all_zeros_bitmap;
 	}
 
-	eol_offset = (long)bm->BytesPerRow - (long)((width + (srcx & 7)) >> 3);
 	for (rows = 0; rows < height; rows++, image += ri->BytesPerRow) {
 		unsigned long cols;
 		uae_u8 *image2 = image;
-		unsigned int bitoffs = 7 - (srcx & 7);
-		int i;
 
+		PlanarRowToBlocks (PLANAR, Depth, bitoffset, width);
 		for (cols = 0; cols < width; cols ++) {
-			int v = 0, k;
-			for (k = 0; k < Depth; k++) {
-				if (PLANAR[k] == &all_ones_bitmap)
-					v |= 1 << k;
-				else if (PLANAR[k] != &all_zeros_bitmap) {
-					v |= ((*PLANAR[k] >> bitoffs) & 1) << k;
-				}
-			}
+			int v = (uae_u8)(p2c_blocks[cols >> 3] >> (8 * (7 - (cols & 7))));
 			switch (bpp)
 			{
 			case 2:
@@ -3415,21 +3468,11 @@ static void PlanarToDirect (struct RenderInfo *ri, struct pBitMap *bm,
 				image2 += 4;
 				break;
 			}
-			bitoffs--;
-			bitoffs &= 7;
-			if (bitoffs == 7) {
-				int k;
-				for (k = 0; k < Depth; k++) {
-					if (PLANAR[k] != &all_zeros_bitmap && PLANAR[k] != &all_ones_bitmap) {
-						PLANAR[k]++;
-					}
-				}
-			}
 		}
 
-		for (i = 0; i < Depth; i++) {
-			if (PLANAR[i] != &all_zeros_bitmap && PLANAR[i] != &all_ones_bitmap) {
-				PLANAR[i] += eol_offset;
+		for (j = 0; j < Depth; j++) {
+			if (PLANAR[j] != &all_zeros_bitmap && PLANAR[j] != &all_ones_bitmap) {
+				PLANAR[j] += bm->BytesPerRow;
 			}
 		}
 	}
@@ -3895,10 +3938,7 @@ bool picasso_flushpixels (uae_u8 *src, int off)
 			for (i = 0; (ULONG)i < gwwcnt; i++)
 				gwwbuf[i] = src_start + i * gwwpagesize;
 		} else {
-			/*ULONG ps;*/
-			gwwcnt = gwwbufsize;
-			/*if (mman_GetWriteWatch (src_start, src_end - src_start, gwwbuf, &gwwcnt, &ps))
-				break;*/
+			gwwcnt = picasso_getdirtypages (src, src_start, src_end, false);
 		}
 
 		if (gwwcnt == 0)
@@ -4006,7 +4046,7 @@ bool picasso_flushpixels (uae_u8 *src, int off)
 		if (doskip () && p96skipmode == 3) {
 			;
 		} else {
-			;//mman_ResetWatch (src_start, src_end - src_start);
+			writewatch_reset (gwwhandle);
 		}
 		full_refresh = 0;
 	}
@@ -4027,23 +4067,10 @@ addrbank gfxmem_bank = {
 * Also put it in reset_drawing() for safe-keeping.  */
 void InitPicasso96 (void)
 {
-	int i;
-
 	//fastscreen
 	oldscr = 0;
 	//fastscreen
 	memset (&picasso96_state, 0, sizeof (struct picasso96_state_struct));
-
-	for (i = 0; i < 256; i++) {
-		p2ctab[i][0] = (((i & 128) ? 0x01000000 : 0)
-			| ((i & 64) ? 0x010000 : 0)
-			| ((i & 32) ? 0x0100 : 0)
-			| ((i & 16) ? 0x01 : 0));
-		p2ctab[i][1] = (((i & 8) ? 0x01000000 : 0)
-			| ((i & 4) ? 0x010000 : 0)
-			| ((i & 2) ? 0x0100 : 0)
-			| ((i & 1) ? 0x01 : 0));
-	}
 }
 
 #endif
@@ -67,6 +67,8 @@
 #include "threaddep/thread.h"
 #include "a2091.h"
 #include "misc.h"
+#include "writewatch.h"
+#include "events.h"
 
 int savestate_state = 0;
 static int savestate_first_capture;
@@ -81,6 +83,7 @@ static int savestate_docompress, savestate_specialdump, savestate_nodialogs;
 TCHAR savestate_fname[MAX_DPATH];
 
 #define STATEFILE_ALLOC_SIZE 600000
+#define STATEFILE_DELTA_ALLOC_SIZE 100000
 static int statefile_alloc;
 static int staterecords_max = 1000;
 static int staterecords_first = 0;
@@ -93,6 +96,8 @@ struct staterecord
 	uae_u8 *data;
 	uae_u8 *end;
 	int inprecoffset;
+	uae_u8 *delta;
+	int deltalen;
 };
 
 static struct staterecord **staterecords;
@@ -459,8 +464,10 @@ void restore_ram (size_t filepos, uae_u8 *memory)
 		src = tmp;
 		fullsize = restore_u32 ();
 		size -= 4;
+		writewatch_touch (memory, fullsize);
 		zfile_zuncompress (memory, fullsize, savestate_file, size);
 	} else {
+		writewatch_touch (memory, size);
 		zfile_fread (memory, 1, size, savestate_file);
 	}
 }
@@ -1229,134 +1236,335 @@ void savestate_listrewind (void)
 }
 #endif
 
-void savestate_rewind (void)
+/* Delta rewind (state_replay_delta)
+ *
+ * RAM is not copied into every staterecord. Instead a shadow copy of RAM
+ * as it was at the latest capture is kept and host page write tracking
+ * tells which pages were written since. Each capture stores, for those
+ * pages only, the XOR of RAM and shadow (zero runs skipped), which is
+ * exactly what is needed to step RAM back by one capture. Rewinding
+ * first copies the shadow back over pages written since the latest
+ * capture and then applies the stored XORs newest to oldest. Both sides
+ * cost O(pages written), not O(RAM size). The oldest captures are
+ * dropped when the stored XORs exceed state_replay_budget megabytes.
+ */
+
+#define REWIND_RAMS 4
+
+struct rewindram
 {
-	int len, i, dummy;
-	uae_u8 *p, *p2;
-	struct staterecord *st;
-	int pos;
-	bool rewind = false;
+	uae_u8 *mem;
+	uae_u8 *shadow;
+	int size;
+	int watch;
+};
 
-	if (hsync_counter % currprefs.statecapturerate <= 25 && rewindmode <= -2) {
-		pos = replaycounter - 2;
-		rewind = true;
-	} else {
-		pos = replaycounter - 1;
-	}
-	st = canrewind (pos);
-	if (!st) {
-		rewind = false;
-		pos = replaycounter - 1;
-		st = canrewind (pos);
-		if (!st)
-			return;
+static struct rewindram rewindrams[REWIND_RAMS];
+static bool rewind_delta;
+static uae_u32 *rewind_pages;
+static int rewind_pages_max;
+static uae_u8 *rewind_buf;
+static int rewind_buf_size;
+static size_t rewind_delta_total;
+
+static uae_u8 *rewind_ram (int idx, int *len)
+{
+	*len = 0;
+	switch (idx)
+	{
+	case 0:
+		return save_cram (len);
+	case 1:
+		return save_bram (len);
+#ifdef AUTOCONFIG
+	case 2:
+		return save_fram (len, 0);
+	case 3:
+		return save_zram (len, 0);
+#endif
 	}
-	p = st->data;
-	p2 = st->end;
-	write_log (_T("rewinding %d -> %d\n"), replaycounter - 1, pos);
-	hsync_counter = restore_u32_func (&p);
-	vsync_counter = restore_u32_func (&p);
-	p = restore_cpu (p);
-	p = restore_cycles (p);
-	p = restore_cpu_extra (p);
-	if (restore_u32_func (&p))
-		p = restore_cpu_trace (p);
-#ifdef FPUEMU
-	if (restore_u32_func (&p))
-		p = restore_fpu (p);
+	return NULL;
+}
+
+static void rewind_delta_free_record (struct staterecord *st)
+{
+	if (!st || !st->delta)
+		return;
+	rewind_delta_total -= st->deltalen;
+	xfree (st->delta);
+	st->delta = NULL;
+	st->deltalen = 0;
+}
+
+static void rewind_delta_close (void)
+{
+	int i;
+
+	for (i = 0; i < REWIND_RAMS; i++) {
+		struct rewindram *rr = &rewindrams[i];
+		writewatch_remove (rr->watch);
+		xfree (rr->shadow);
+		rr->shadow = NULL;
+		rr->mem = NULL;
+		rr->size = 0;
+		rr->watch = -1;
+	}
+	if (staterecords) {
+		for (i = 0; i < staterecords_max; i++)
+			rewind_delta_free_record (staterecords[i]);
+	}
+	xfree (rewind_pages);
+	rewind_pages = NULL;
+	rewind_pages_max = 0;
+	xfree (rewind_buf);
+	rewind_buf = NULL;
+	rewind_buf_size = 0;
+	rewind_delta_total = 0;
+	rewind_delta = false;
+}
+
+static bool rewind_delta_open (void)
+{
+	uae_u32 ps = writewatch_pagesize ();
+	int i;
+
+	rewind_delta_close ();
+#ifdef JIT
+	/* direct JIT memory access writes through a second mapping */
+	if (currprefs.cachesize)
+		return false;
 #endif
-	for (i = 0; i < 4; i++) {
-		p = restore_disk (i, p);
-		if (restore_u32_func (&p))
-			p = restore_disk2 (i, p);
+	for (i = 0; i < REWIND_RAMS; i++) {
+		struct rewindram *rr = &rewindrams[i];
+		int len;
+		uae_u8 *mem = rewind_ram (i, &len);
+		rr->watch = -1;
+		if (!mem || len <= 0)
+			continue;
+		rr->shadow = xmalloc (uae_u8, len);
+		if (!rr->shadow)
+			goto fail;
+		memcpy (rr->shadow, mem, len);
+		rr->mem = mem;
+		rr->size = len;
+		rr->watch = writewatch_add (mem, len);
+		if (rr->watch < 0)
+			goto fail;
+		if (rewind_pages_max < len / ps + 2)
+			rewind_pages_max = len / ps + 2;
+	}
+	rewind_pages = xmalloc (uae_u32, rewind_pages_max);
+	if (!rewind_pages)
+		goto fail;
+	/* older full captures can't be mixed with the new chain */
+	for (i = 0; i < staterecords_max; i++) {
+		if (staterecords[i])
+			staterecords[i]->inuse = 0;
+	}
+	staterecords_first = replaycounter;
+	rewind_delta = true;
+	write_log (_T("delta rewind enabled\n"));
+	return true;
+fail:
+	write_log (_T("delta rewind not available, using full captures\n"));
+	rewind_delta_close ();
+	return false;
+}
+
+/* RAM allocations may change on reset */
+static bool rewind_delta_valid (void)
+{
+	int i;
+
+	for (i = 0; i < REWIND_RAMS; i++) {
+		int len;
+		uae_u8 *mem = rewind_ram (i, &len);
+		if (len < 0)
+			len = 0;
+		if (rewindrams[i].size != (mem ? len : 0) || (rewindrams[i].size && rewindrams[i].mem != mem))
+			return false;
 	}
-	p = restore_floppy (p);
-	p = restore_custom (p);
-	p = restore_custom_extra (p);
-	if (restore_u32_func (&p))
-		p = restore_custom_event_delay (p);
-	p = restore_blitter_new (p);
-	p = restore_custom_agacolors (p);
-	for (i = 0; i < 8; i++) {
-		p = restore_custom_sprite (i, p);
+	return true;
+}
+
+/* Append XOR of mem and shadow as (skip, count, bytes) runs, update shadow. */
+static uae_u8 *rewind_xor_rle (uae_u8 *dst, uae_u8 *mem, uae_u8 *shadow, int len)
+{
+	int pos = 0;
+
+	while (pos < len) {
+		int start = pos, last, skip;
+		while (pos < len && mem[pos] == shadow[pos] && pos - start < 65535)
+			pos++;
+		if (pos >= len)
+			break;
+		skip = pos - start;
+		/* literal runs absorb short gaps, a token costs 4 bytes */
+		start = last = pos;
+		while (pos < len && pos - start < 65535) {
+			if (mem[pos] != shadow[pos])
+				last = pos + 1;
+			else if (pos - last >= 4)
+				break;
+			pos++;
+		}
+		pos = last;
+		save_u16_func (&dst, skip);
+		save_u16_func (&dst, last - start);
+		for (; start < last; start++) {
+			*dst++ = mem[start] ^ shadow[start];
+			shadow[start] = mem[start];
+		}
 	}
-	for (i = 0; i < 4; i++) {
-		p = restore_audio (i, p);
+	return dst;
+}
+
+/* Walk runs produced above, XOR them into both mem and shadow */
+static void rewind_xor_apply (uae_u8 *src, uae_u8 *end, uae_u8 *mem, uae_u8 *shadow)
+{
+	int pos = 0;
+
+	while (src < end) {
+		int skip = restore_u16_func (&src);
+		int cnt = restore_u16_func (&src);
+		pos += skip;
+		while (cnt-- > 0) {
+			mem[pos] ^= *src;
+			shadow[pos] ^= *src;
+			src++;
+			pos++;
+		}
 	}
-	p = restore_cia (0, p);
-	p = restore_cia (1, p);
-	p = restore_keyboard (p);
-	p = restore_inputstate (p);
-#ifdef AUTOCONFIG
-	p = restore_expansion (p);
-#endif
-#ifdef PICASSO96
-	if (restore_u32_func (&p))
-		p = restore_p96 (p);
-#endif
-	len = restore_u32_func (&p);
-	memcpy (chipmem_bank.baseaddr, p, currprefs.chipmem_size > len ? len : currprefs.chipmem_size);
-	p += len;
-	len = restore_u32_func (&p);
-	memcpy (save_bram (&dummy), p, currprefs.bogomem_size > len ? len : currprefs.bogomem_size);
-	p += len;
-#ifdef AUTOCONFIG
-	len = restore_u32_func (&p);
-	memcpy (save_fram (&dummy, 0), p, currprefs.fastmem_size > len ? len : currprefs.fastmem_size);
-	p += len;
-	len = restore_u32_func (&p);
-	memcpy (save_zram (&dummy, 0), p, currprefs.z3fastmem_size > len ? len : currprefs.z3fastmem_size);
-	p += len;
-#endif
-#ifdef ACTION_REPLAY
-	if (restore_u32_func (&p))
-		p = restore_action_replay (p);
-	if (restore_u32_func (&p))
-		p = restore_hrtmon (p);
-#endif
-#ifdef CD32
-	if (restore_u32_func (&p))
-		p = restore_akiko (p);
-#endif
-#ifdef CDTV
-	if (restore_u32_func (&p))
-		p = restore_cdtv (p);
-	if (restore_u32_func (&p))
-		p = restore_cdtv_dmac (p);
-#endif
-	if (restore_u32_func (&p))
-		p = restore_scsi_dmac (WDTYPE_A2091, p);
-	if (restore_u32_func (&p))
-		p = restore_scsi_dmac (WDTYPE_A3000, p);
-	if (restore_u32_func (&p))
-		p = restore_gayle (p);
-	for (i = 0; i < 4; i++) {
-		if (restore_u32_func (&p))
-			p = restore_ide (p);
+}
+
+static bool rewind_delta_capture (struct staterecord *st)
+{
+	uae_u32 ps = writewatch_pagesize ();
+	uae_u8 *p;
+	int i, j;
+
+	rewind_delta_free_record (st);
+	p = rewind_buf;
+	for (i = 0; i < REWIND_RAMS; i++) {
+		struct rewindram *rr = &rewindrams[i];
+		int cnt;
+		if (rr->watch < 0)
+			continue;
+		cnt = writewatch_get (rr->watch, rewind_pages, rewind_pages_max, true);
+		/* worst case every other byte differs: 4 + 5/4 * page per page */
+		if ((p - rewind_buf) + cnt * (ps * 2 + 16) > rewind_buf_size) {
+			int used = p - rewind_buf;
+			int newsize = used + cnt * (ps * 2 + 16);
+			uae_u8 *n = xrealloc (uae_u8, rewind_buf, newsize);
+			if (!n)
+				return false;
+			rewind_buf = n;
+			rewind_buf_size = newsize;
+			p = rewind_buf + used;
+		}
+		for (j = 0; j < cnt; j++) {
+			uae_u32 off = rewind_pages[j];
+			int len = rr->size - off < ps ? rr->size - off : ps;
+			uae_u8 *hdr = p;
+			if (memcmp (rr->mem + off, rr->shadow + off, len) == 0)
+				continue;
+			p = rewind_xor_rle (p + 9, rr->mem + off, rr->shadow + off, len);
+			len = p - (hdr + 9);
+			save_u8_func (&hdr, i);
+			save_u32_func (&hdr, off);
+			save_u32_func (&hdr, len);
+		}
 	}
-	p += 4;
-	if (p != p2) {
-		gui_message (_T("reload failure, address mismatch %p != %p"), p, p2);
-		uae_reset (0, 0);
-		return;
+	st->deltalen = p - rewind_buf;
+	if (st->deltalen) {
+		st->delta = xmalloc (uae_u8, st->deltalen);
+		if (!st->delta) {
+			st->deltalen = 0;
+			return false;
+		}
+		memcpy (st->delta, rewind_buf, st->deltalen);
 	}
-	inprec_setposition (st->inprecoffset, pos);
-	write_log (_T("state %d restored.  (%010ld/%03ld)\n"), pos, hsync_counter, vsync_counter);
-	if (rewind) {
-		replaycounter--;
-		if (replaycounter < 0)
-			replaycounter += staterecords_max;
-		st = canrewind (replaycounter);
-		st->inuse = 0;
+	rewind_delta_total += st->deltalen;
+	return true;
+}
+
+static void rewind_delta_undo (struct staterecord *st)
+{
+	uae_u8 *p = st->delta;
+	uae_u8 *end = st->delta + st->deltalen;
+
+	while (p && p < end) {
+		struct rewindram *rr = &rewindrams[restore_u8_func (&p)];
+		uae_u32 off = restore_u32_func (&p);
+		uae_u32 len = restore_u32_func (&p);
+		rewind_xor_apply (p, p + len, rr->mem + off, rr->shadow + off);
+		p += len;
+	}
+}
+
+static void rewind_delta_restore (int pos)
+{
+	uae_u32 ps = writewatch_pagesize ();
+	int i, j, k;
+
+	/* back to the state of the latest capture */
+	for (i = 0; i < REWIND_RAMS; i++) {
+		struct rewindram *rr = &rewindrams[i];
+		int cnt;
+		if (rr->watch < 0)
+			continue;
+		cnt = writewatch_get (rr->watch, rewind_pages, rewind_pages_max, false);
+		for (j = 0; j < cnt; j++) {
+			uae_u32 off = rewind_pages[j];
+			int len = rr->size - off < ps ? rr->size - off : ps;
+			memcpy (rr->mem + off, rr->shadow + off, len);
+		}
 	}
+	/* then step back capture by capture */
+	if (pos < 0)
+		pos += staterecords_max;
+	k = replaycounter - 1;
+	if (k < 0)
+		k += staterecords_max;
+	while (k != pos && staterecords[k]) {
+		rewind_delta_undo (staterecords[k]);
+		rewind_delta_free_record (staterecords[k]);
+		k--;
+		if (k < 0)
+			k += staterecords_max;
+	}
+	for (i = 0; i < REWIND_RAMS; i++)
+		writewatch_reset (rewindrams[i].watch);
+}
 
+/* Drop oldest captures until the stored deltas fit the budget */
+static void rewind_delta_trim (void)
+{
+	size_t budget = (size_t)currprefs.statecapturebudget * 1024 * 1024;
+
+	while (rewind_delta_total > budget) {
+		int last = replaycounter - 1;
+		struct staterecord *st = staterecords[staterecords_first];
+		if (last < 0)
+			last += staterecords_max;
+		if (staterecords_first == last)
+			break;
+		if (st) {
+			rewind_delta_free_record (st);
+			st->inuse = 0;
+		}
+		staterecords_first++;
+		if (staterecords_first >= staterecords_max)
+			staterecords_first -= staterecords_max;
+	}
 }
 
+/* Every fixed size chunk of a state record is smaller than this */
 #define BS 10000
 
-STATIC_INLINE int bufcheck (struct staterecord *sr, uae_u8 *p, int len)
+STATIC_INLINE int statebufcheck (uae_u8 *p, uae_u8 *pend, int len)
 {
-	if (p - sr->data + BS + len >= sr->len)
+	if (p + BS + len >= pend)
 		return 1;
 	return 0;
 }
@@ -1371,81 +1579,40 @@ void savestate_memorysave (void)
 		save_state_internal (staterecord_statefile, _T("rerecording"), 1, false);
 }
 
-void savestate_capture (int force)
+/* Serialize the machine into p..pend, RAM only if <ram> is set.
+ * Returns the end of the data or NULL if the buffer was too small. */
+static uae_u8 *save_state_record (uae_u8 *p, uae_u8 *pend, bool ram, uae_u8 **cpup)
 {
-	uae_u8 *p, *p2, *p3, *dst;
-	int i, len, tlen, retrycnt;
-	struct staterecord *st;
-	bool firstcapture = false;
-
-#ifdef FILESYS
-	if (nr_units ())
-		return;
-#endif
-	if (!staterecords)
-		return;
-	if (!input_record)
-		return;
-	if (currprefs.statecapturerate && hsync_counter == 0 && input_record == INPREC_RECORD_START && savestate_first_capture > 0) {
-		// first capture
-		force = true;
-		firstcapture = true;
-	} else if (savestate_first_capture < 0) {
-		force = true;
-		firstcapture = false;
-	}
-	if (!force) {
-		if (currprefs.statecapturerate <= 0)
-			return;
-		if (hsync_counter % currprefs.statecapturerate)
-			return;
-	}
-	savestate_first_capture = false;
+	uae_u8 *p3, *dst;
+	int i, len, tlen;
 
-	retrycnt = 0;
-retry2:
-	st = staterecords[replaycounter];
-	if (st == NULL) {
-		st = (struct staterecord*)xmalloc (uae_u8, statefile_alloc);
-		st->len = statefile_alloc;
-	} else if (retrycnt > 0) {
-		write_log (_T("realloc %d -> %d\n"), st->len, st->len + STATEFILE_ALLOC_SIZE);
-		st->len += STATEFILE_ALLOC_SIZE;
-		st = (struct staterecord*)xrealloc (uae_u8, st, st->len);
-	}
-	if (st->len > statefile_alloc)
-		statefile_alloc = st->len;
-	st->inuse = 0;
-	st->data = (uae_u8*)(st + 1);
-	staterecords[replaycounter] = st;
-	retrycnt++;
-	p = p2 = st->data;
 	tlen = 0;
 	save_u32_func (&p, hsync_counter);
 	save_u32_func (&p, vsync_counter);
 	tlen += 8;
 
-	if (bufcheck (st, p, 0))
-		goto retry;
-	st->cpu = p;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
+	if (cpup)
+		*cpup = p;
 	save_cpu (&len, p);
 	tlen += len;
 	p += len;
 
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	save_cycles (&len, p);
 	tlen += len;
 	p += len;
 
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	save_cpu_extra (&len, p);
 	tlen += len;
 	p += len;
 
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1456,8 +1623,8 @@ retry2:
 	}
 
 #ifdef FPUEMU
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1468,8 +1635,8 @@ retry2:
 	}
 #endif
 	for (i = 0; i < 4; i++) {
-		if (bufcheck (st, p, 0))
-			goto retry;
+		if (statebufcheck (p, pend, 0))
+			return NULL;
 		save_disk (i, &len, p, true);
 		tlen += len;
 		p += len;
@@ -1483,97 +1650,104 @@ retry2:
 		}
 	}
 
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	save_floppy (&len, p);
 	tlen += len;
 	p += len;
 
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	save_custom (&len, p, 0);
 	tlen += len;
 	p += len;
 
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	save_custom_extra (&len, p);
 	tlen += len;
 	p += len;
 
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
-	if (save_custom_event_delay (&len, p)) {
+	dst = save_custom_event_delay (&len, 0);
+	if (dst) {
+		if (statebufcheck (p, pend, len)) {
+			xfree (dst);
+			return NULL;
+		}
+		memcpy (p, dst, len);
+		xfree (dst);
 		save_u32_func (&p3, 1);
 		tlen += len;
 		p += len;
 	}
 
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	save_blitter_new (&len, p);
 	tlen += len;
 	p += len;
 
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	save_custom_agacolors (&len, p);
 	tlen += len;
 	p += len;
 	for (i = 0; i < 8; i++) {
-		if (bufcheck (st, p, 0))
-			goto retry;
+		if (statebufcheck (p, pend, 0))
+			return NULL;
 		save_custom_sprite (i, &len, p);
 		tlen += len;
 		p += len;
 	}
 
 	for (i = 0; i < 4; i++) {
-		if (bufcheck (st, p, 0))
-			goto retry;
+		if (statebufcheck (p, pend, 0))
+			return NULL;
 		save_audio (i, &len, p);
 		tlen += len;
 		p += len;
 	}
 
-	if (bufcheck (st, p, len))
-		goto retry;
+	if (statebufcheck (p, pend, len))
+		return NULL;
 	save_cia (0, &len, p);
 	tlen += len;
 	p += len;
 
-	if (bufcheck (st, p, len))
-		goto retry;
+	if (statebufcheck (p, pend, len))
+		return NULL;
 	save_cia (1, &len, p);
 	tlen += len;
 	p += len;
 
-	if (bufcheck (st, p, len))
-		goto retry;
+	if (statebufcheck (p, pend, len))
+		return NULL;
 	save_keyboard (&len, p);
 	tlen += len;
 	p += len;
 
-	if (bufcheck (st, p, len))
-		goto retry;
+	if (statebufcheck (p, pend, len))
+		return NULL;
 	save_inputstate (&len, p);
 	tlen += len;
 	p += len;
 
 #ifdef AUTOCONFIG
-	if (bufcheck (st, p, len))
-		goto retry;
+	if (statebufcheck (p, pend, len))
+		return NULL;
 	save_expansion (&len, p);
 	tlen += len;
 	p += len;
 #endif
 
 #ifdef PICASSO96
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1584,39 +1758,53 @@ retry2:
 	}
 #endif
 
-	dst = save_cram (&len);
-	if (bufcheck (st, p, len))
-		goto retry;
-	save_u32_func (&p, len);
-	memcpy (p, dst, len);
-	tlen += len + 4;
-	p += len;
-	dst = save_bram (&len);
-	if (bufcheck (st, p, len))
-		goto retry;
-	save_u32_func (&p, len);
-	memcpy (p, dst, len);
-	tlen += len + 4;
-	p += len;
+	if (!ram) {
+		/* RAM is handled by rewind_delta_capture () */
+		if (statebufcheck (p, pend, 0))
+			return NULL;
+		save_u32_func (&p, 0);
+		save_u32_func (&p, 0);
+		tlen += 8;
 #ifdef AUTOCONFIG
-	dst = save_fram (&len, 0);
-	if (bufcheck (st, p, len))
-		goto retry;
-	save_u32_func (&p, len);
-	memcpy (p, dst, len);
-	tlen += len + 4;
-	p += len;
-	dst = save_zram (&len, 0);
-	if (bufcheck (st, p, len))
-		goto retry;
-	save_u32_func (&p, len);
-	memcpy (p, dst, len);
-	tlen += len + 4;
-	p += len;
+		save_u32_func (&p, 0);
+		save_u32_func (&p, 0);
+		tlen += 8;
 #endif
+	} else {
+		dst = save_cram (&len);
+		if (statebufcheck (p, pend, len))
+			return NULL;
+		save_u32_func (&p, len);
+		memcpy (p, dst, len);
+		tlen += len + 4;
+		p += len;
+		dst = save_bram (&len);
+		if (statebufcheck (p, pend, len))
+			return NULL;
+		save_u32_func (&p, len);
+		memcpy (p, dst, len);
+		tlen += len + 4;
+		p += len;
+#ifdef AUTOCONFIG
+		dst = save_fram (&len, 0);
+		if (statebufcheck (p, pend, len))
+			return NULL;
+		save_u32_func (&p, len);
+		memcpy (p, dst, len);
+		tlen += len + 4;
+		p += len;
+		dst = save_zram (&len, 0);
+		if (statebufcheck (p, pend, len))
+			return NULL;
+		save_u32_func (&p, len);
+		memcpy (p, dst, len);
+		tlen += len + 4;
+		p += len;
+#endif
+	}
 #ifdef ACTION_REPLAY
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1625,8 +1813,8 @@ retry2:
 		tlen += len;
 		p += len;
 	}
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1637,8 +1825,8 @@ retry2:
 	}
 #endif
 #ifdef CD32
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1649,8 +1837,8 @@ retry2:
 	}
 #endif
 #ifdef CDTV
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1659,8 +1847,8 @@ retry2:
 		tlen += len;
 		p += len;
 	}
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1670,8 +1858,8 @@ retry2:
 		p += len;
 	}
 #endif
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1680,8 +1868,8 @@ retry2:
 		tlen += len;
 		p += len;
 	}
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1690,8 +1878,8 @@ retry2:
 		tlen += len;
 		p += len;
 	}
-	if (bufcheck (st, p, 0))
-		goto retry;
+	if (statebufcheck (p, pend, 0))
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1701,8 +1889,8 @@ retry2:
 		p += len;
 	}
 	for (i = 0; i < 4; i++) {
-		if (bufcheck (st, p, 0))
-			goto retry;
+		if (statebufcheck (p, pend, 0))
+			return NULL;
 		p3 = p;
 		save_u32_func (&p, 0);
 		tlen += 4;
@@ -1713,7 +1901,400 @@ retry2:
 		}
 	}
 	save_u32_func (&p, tlen);
+	return p;
+}
+
+/* Length of a custom_event_delay chunk, which is the only one with a
+ * variable number of entries (see save_custom_event_delay ()) */
+static uae_u64 event_delay_len (uae_u8 *p)
+{
+	uae_u32 v = restore_u32_func (&p);
+	if (v == 1)
+		return 4 + 1 + restore_u8_func (&p) * (1 + 8 + 4);
+	if (v == 2)
+		return 4 + 4 + (uae_u64)restore_u32_func (&p) * (1 + 8 + 4);
+	return 4;
+}
+
+/* Counterpart of save_state_record (), p2 is the end of the record.
+ * A chunk is only parsed if it starts inside the record, so at most BS
+ * bytes past p2 are read from a damaged record. */
+static bool restore_state_record (uae_u8 *p, uae_u8 *p2)
+{
+	int i, dummy;
+	uae_u32 len;
+
+#define RCHECK(n) if (p > p2 || (uae_u64)(p2 - p) < (uae_u64)(n)) goto bad;
+	RCHECK (8);
+	hsync_counter = restore_u32_func (&p);
+	vsync_counter = restore_u32_func (&p);
+	p = restore_cpu (p);
+	RCHECK (0);
+	p = restore_cycles (p);
+	RCHECK (0);
+	p = restore_cpu_extra (p);
+	RCHECK (4);
+	if (restore_u32_func (&p))
+		p = restore_cpu_trace (p);
+#ifdef FPUEMU
+	RCHECK (4);
+	if (restore_u32_func (&p))
+		p = restore_fpu (p);
+#endif
+	for (i = 0; i < 4; i++) {
+		RCHECK (0);
+		p = restore_disk (i, p);
+		RCHECK (4);
+		if (restore_u32_func (&p))
+			p = restore_disk2 (i, p);
+	}
+	RCHECK (0);
+	p = restore_floppy (p);
+	RCHECK (0);
+	p = restore_custom (p);
+	RCHECK (0);
+	p = restore_custom_extra (p);
+	RCHECK (4);
+	if (restore_u32_func (&p)) {
+		RCHECK (event_delay_len (p));
+		p = restore_custom_event_delay (p);
+	}
+	RCHECK (0);
+	p = restore_blitter_new (p);
+	RCHECK (0);
+	p = restore_custom_agacolors (p);
+	for (i = 0; i < 8; i++) {
+		RCHECK (0);
+		p = restore_custom_sprite (i, p);
+	}
+	for (i = 0; i < 4; i++) {
+		RCHECK (0);
+		p = restore_audio (i, p);
+	}
+	RCHECK (0);
+	p = restore_cia (0, p);
+	RCHECK (0);
+	p = restore_cia (1, p);
+	RCHECK (0);
+	p = restore_keyboard (p);
+	RCHECK (0);
+	p = restore_inputstate (p);
+#ifdef AUTOCONFIG
+	RCHECK (0);
+	p = restore_expansion (p);
+#endif
+#ifdef PICASSO96
+	RCHECK (4);
+	if (restore_u32_func (&p))
+		p = restore_p96 (p);
+#endif
+	RCHECK (4);
+	len = restore_u32_func (&p);
+	RCHECK (len);
+	memcpy (chipmem_bank.baseaddr, p, currprefs.chipmem_size > len ? len : currprefs.chipmem_size);
+	p += len;
+	RCHECK (4);
+	len = restore_u32_func (&p);
+	RCHECK (len);
+	memcpy (save_bram (&dummy), p, currprefs.bogomem_size > len ? len : currprefs.bogomem_size);
+	p += len;
+#ifdef AUTOCONFIG
+	RCHECK (4);
+	len = restore_u32_func (&p);
+	RCHECK (len);
+	memcpy (save_fram (&dummy, 0), p, currprefs.fastmem_size > len ? len : currprefs.fastmem_size);
+	p += len;
+	RCHECK (4);
+	len = restore_u32_func (&p);
+	RCHECK (len);
+	memcpy (save_zram (&dummy, 0), p, currprefs.z3fastmem_size > len ? len : currprefs.z3fastmem_size);
+	p += len;
+#endif
+#ifdef ACTION_REPLAY
+	RCHECK (4);
+	if (restore_u32_func (&p))
+		p = restore_action_replay (p);
+	RCHECK (4);
+	if (restore_u32_func (&p))
+		p = restore_hrtmon (p);
+#endif
+#ifdef CD32
+	RCHECK (4);
+	if (restore_u32_func (&p))
+		p = restore_akiko (p);
+#endif
+#ifdef CDTV
+	RCHECK (4);
+	if (restore_u32_func (&p))
+		p = restore_cdtv (p);
+	RCHECK (4);
+	if (restore_u32_func (&p))
+		p = restore_cdtv_dmac (p);
+#endif
+	RCHECK (4);
+	if (restore_u32_func (&p))
+		p = restore_scsi_dmac (WDTYPE_A2091, p);
+	RCHECK (4);
+	if (restore_u32_func (&p))
+		p = restore_scsi_dmac (WDTYPE_A3000, p);
+	RCHECK (4);
+	if (restore_u32_func (&p))
+		p = restore_gayle (p);
+	for (i = 0; i < 4; i++) {
+		RCHECK (4);
+		if (restore_u32_func (&p))
+			p = restore_ide (p);
+	}
+	p += 4;
+#undef RCHECK
+	if (p != p2)
+		goto bad;
+	return true;
+bad:
+	gui_message (_T("reload failure, address mismatch %p != %p"), p, p2);
+	uae_reset (0, 0);
+	return false;
+}
+
+/*
+ * In-memory savestates for frontends that keep states themselves
+ * (libretro retro_serialize ()). The layout is the uncompressed rewind
+ * capture record with full RAM contents, prefixed by a small header.
+ * The frontend may call them while the emulation is suspended in the
+ * middle of a frame, a state it passes in is therefore only queued and
+ * applied at the next frame boundary through the rewind path of
+ * m68k_go (). Until then saving returns the queued state.
+ */
+
+#define MEMSTATE_ID 0x55414d53 /* 'UAMS' */
+#define MEMSTATE_VERSION 1
+#define MEMSTATE_HEADER 12
+
+static uae_u8 *memstate_pending;
+static size_t memstate_pending_size;
+
+size_t savestate_mem_size (void)
+{
+	size_t size = MEMSTATE_HEADER + STATEFILE_ALLOC_SIZE;
+	int i;
+
+	for (i = 0; i < REWIND_RAMS; i++) {
+		int len;
+		if (rewind_ram (i, &len))
+			size += len + 4;
+	}
+	if (memstate_pending && size < memstate_pending_size)
+		size = memstate_pending_size;
+	return size;
+}
+
+size_t savestate_save_mem (void *buf, size_t size)
+{
+	uae_u8 *p = (uae_u8*)buf, *end;
+
+	if (memstate_pending) {
+		if (size < memstate_pending_size)
+			return 0;
+		memcpy (buf, memstate_pending, memstate_pending_size);
+		return memstate_pending_size;
+	}
+	if (size <= MEMSTATE_HEADER + BS)
+		return 0;
+	save_u32_func (&p, MEMSTATE_ID);
+	save_u32_func (&p, MEMSTATE_VERSION);
+	save_u32_func (&p, 0);
+	/* keep BS bytes after the record, restore_state_record () may read
+	 * that far into them before it notices a damaged record */
+	end = save_state_record (p, (uae_u8*)buf + size - BS, true, NULL);
+	if (!end) {
+		write_log (_T("in-memory savestate: %d byte buffer too small\n"), (int)size);
+		return 0;
+	}
+	p = (uae_u8*)buf + 8;
+	save_u32_func (&p, end - (uae_u8*)buf - MEMSTATE_HEADER);
+	return end - (uae_u8*)buf;
+}
+
+/* Length of the record in a state, 0 if it is not one of ours */
+static uae_u32 memstate_check (const void *buf, size_t size)
+{
+	uae_u8 *p = (uae_u8*)buf;
+	uae_u32 len;
+
+	if (size <= MEMSTATE_HEADER + BS)
+		return 0;
+	if (restore_u32_func (&p) != MEMSTATE_ID || restore_u32_func (&p) != MEMSTATE_VERSION)
+		return 0;
+	len = restore_u32_func (&p);
+	if (len > size - MEMSTATE_HEADER - BS)
+		return 0;
+	return len;
+}
+
+/* savestate_state has to be STATE_REWIND */
+static bool memstate_load (const uae_u8 *buf, uae_u32 len)
+{
+	uae_u8 *p = (uae_u8*)buf + MEMSTATE_HEADER;
+
+	if (!restore_state_record (p, p + len))
+		return false;
+	/* RAM changed behind the back of the delta shadows */
+	if (rewind_delta)
+		rewind_delta_open ();
+	return true;
+}
+
+/* Queue a state, m68k_go () picks it up at the next vsync */
+bool savestate_queue_mem (const void *buf, size_t size)
+{
+	uae_u8 *copy;
+
+	if ((savestate_state && !memstate_pending) || !memstate_check (buf, size))
+		return false;
+	copy = xmalloc (uae_u8, size);
+	if (!copy)
+		return false;
+	memcpy (copy, buf, size);
+	xfree (memstate_pending);
+	memstate_pending = copy;
+	memstate_pending_size = size;
+	savestate_state = STATE_DOREWIND;
+	return true;
+}
+
+/* Restore right now, only while the CPU is stopped between instructions
+   with no frame in progress that could notice (debugger).  */
+bool savestate_restore_mem (const void *buf, size_t size)
+{
+	uae_u32 len;
+
+	if (savestate_state)
+		return false;
+	len = memstate_check (buf, size);
+	if (!len)
+		return false;
+	savestate_state = STATE_REWIND;
+	if (!memstate_load ((const uae_u8*)buf, len)) {
+		savestate_state = 0;
+		return false;
+	}
+	m68k_restore_now ();
+	return true;
+}
+
+void savestate_rewind (void)
+{
+	uae_u8 *p, *p2;
+	struct staterecord *st;
+	int pos;
+	bool rewind = false;
+
+	if (memstate_pending) {
+		if (!memstate_load (memstate_pending, memstate_check (memstate_pending, memstate_pending_size)))
+			write_log (_T("in-memory savestate: damaged state not restored\n"));
+		xfree (memstate_pending);
+		memstate_pending = NULL;
+		return;
+	}
+	if (hsync_counter % currprefs.statecapturerate <= 25 && rewindmode <= -2) {
+		pos = replaycounter - 2;
+		rewind = true;
+	} else {
+		pos = replaycounter - 1;
+	}
+	st = canrewind (pos);
+	if (!st) {
+		rewind = false;
+		pos = replaycounter - 1;
+		st = canrewind (pos);
+		if (!st)
+			return;
+	}
+	p = st->data;
+	p2 = st->end;
+	write_log (_T("rewinding %d -> %d\n"), replaycounter - 1, pos);
+	if (rewind_delta)
+		rewind_delta_restore (pos);
+	if (!restore_state_record (p, p2))
+		return;
+	inprec_setposition (st->inprecoffset, pos);
+	write_log (_T("state %d restored.  (%010ld/%03ld)\n"), pos, hsync_counter, vsync_counter);
+	if (rewind) {
+		replaycounter--;
+		if (replaycounter < 0)
+			replaycounter += staterecords_max;
+		st = canrewind (replaycounter);
+		st->inuse = 0;
+	}
+
+}
+
+void savestate_capture (int force)
+{
+	uae_u8 *p;
+	int i, retrycnt;
+	struct staterecord *st;
+	bool firstcapture = false;
+
+#ifdef FILESYS
+	if (nr_units ())
+		return;
+#endif
+	if (!staterecords)
+		return;
+	if (!input_record)
+		return;
+	if (currprefs.statecapturerate && hsync_counter == 0 && input_record == INPREC_RECORD_START && savestate_first_capture > 0) {
+		// first capture
+		force = true;
+		firstcapture = true;
+	} else if (savestate_first_capture < 0) {
+		force = true;
+		firstcapture = false;
+	}
+	if (!force) {
+		if (currprefs.statecapturerate <= 0)
+			return;
+		if (hsync_counter % currprefs.statecapturerate)
+			return;
+	}
+	savestate_first_capture = false;
+
+	if (currprefs.statecapturedelta) {
+		if (!rewind_delta || !rewind_delta_valid ())
+			rewind_delta_open ();
+	} else if (rewind_delta) {
+		rewind_delta_close ();
+	}
+
+	retrycnt = 0;
+retry2:
+	st = staterecords[replaycounter];
+	if (st == NULL) {
+		st = (struct staterecord*)xmalloc (uae_u8, statefile_alloc);
+		st->len = statefile_alloc;
+		st->delta = NULL;
+		st->deltalen = 0;
+	} else if (retrycnt > 0) {
+		write_log (_T("realloc %d -> %d\n"), st->len, st->len + STATEFILE_ALLOC_SIZE);
+		st->len += STATEFILE_ALLOC_SIZE;
+		st = (struct staterecord*)xrealloc (uae_u8, st, st->len);
+	}
+	if (st->len > statefile_alloc)
+		statefile_alloc = st->len;
+	st->inuse = 0;
+	st->data = (uae_u8*)(st + 1);
+	staterecords[replaycounter] = st;
+	retrycnt++;
+	p = save_state_record (st->data, (uae_u8*)st + st->len, !rewind_delta, &st->cpu);
+	if (!p)
+		goto retry;
 	st->end = p;
+	if (rewind_delta && !rewind_delta_capture (st)) {
+		write_log (_T("delta capture failed, restarting rewind chain\n"));
+		rewind_delta_open ();
+		return;
+	}
 	st->inuse = 1;
 	st->inprecoffset = inprec_getposition ();
 
@@ -1726,10 +2307,13 @@ retry2:
 			staterecords_first -= staterecords_max;
 	}
 
-	write_log (_T("state capture %d (%010ld/%03ld,%ld/%d) (%ld bytes, alloc %d)\n"),
+	if (rewind_delta)
+		rewind_delta_trim ();
+
+	write_log (_T("state capture %d (%010ld/%03ld,%ld/%d) (%ld bytes, alloc %d, delta %d/%ld)\n"),
 		replaycounter, hsync_counter, vsync_counter,
 		hsync_counter % current_maxvpos (), current_maxvpos (),
-		st->end - st->data, statefile_alloc);
+		st->end - st->data, statefile_alloc, st->deltalen, (long)rewind_delta_total);
 
 	if (firstcapture) {
 		savestate_memorysave ();
@@ -1753,6 +2337,7 @@ retry:
 
 void savestate_free (void)
 {
+	rewind_delta_close ();
 	xfree (staterecords);
 	staterecords = NULL;
 }
@@ -1768,7 +2353,7 @@ void savestate_init (void)
 	replaycounter = 0;
 	staterecords_max = currprefs.statecapturebuffersize;
 	staterecords = xcalloc (struct staterecord*, staterecords_max);
-	statefile_alloc = STATEFILE_ALLOC_SIZE;
+	statefile_alloc = currprefs.statecapturedelta ? STATEFILE_DELTA_ALLOC_SIZE : STATEFILE_ALLOC_SIZE;
 	if (input_record && savestate_state != STATE_DORESTORE) {
 		zfile_fclose (staterecord_statefile);
 		staterecord_statefile = NULL;
@@ -32,13 +32,29 @@ uae_u16 *paula_sndbufpt;
 int paula_sndbufsize;
 static SDL_AudioSpec spec;
 
-static smp_comm_pipe to_sound_pipe;
-static uae_sem_t data_available_sem, callback_done_sem, sound_init_sem;
-
 static struct sound_data sdpaula;
 static struct sound_data *sdp = &sdpaula;
 
-static int in_callback, closing_sound;
+/* Paula output goes to the SDL callback through a lock-free single
+ * reader, single writer byte ring, so finish_sound_buffer () never waits
+ * for the callback. A block that does not fit is dropped (overrun), an
+ * empty ring makes the callback play silence until the ring is back at
+ * its target fill (underrun). The target is sound_max_buff bytes, kept
+ * by resampling Paula output a little faster or slower. */
+static uae_u8 *sndring;
+static uae_u32 sndring_mask;
+static volatile uae_u32 sndring_rd, sndring_wr;
+static volatile int sndring_playing, sndring_underruns;
+static int sndring_target, sndring_overruns, sndring_underruns_seen;
+static double sndring_avgfill, sndring_drift;
+
+/* statusline: frames to show an under/overrun count instead of the fill */
+#define SND_STATUSCNT 100
+/* resampling adjust in 1/1000 at twice the target fill, and how fast
+ * the integral of the fill error tracks a steady clock drift */
+#define ADJUST_GAIN 10.0
+#define ADJUST_DRIFT 0.02
+#define ADJUST_LIMIT 6
 
 static void clearbuffer (void)
 {
@@ -53,24 +69,88 @@ static void dummy_callback (void *userdata, Uint8 *stream, int len)
 
 static void sound_callback (void *userdata, Uint8 *stream, int len)
 {
-	if (closing_sound)
-		return;
-	in_callback = 1;
+	uae_u32 rd = sndring_rd;
+	uae_u32 fill = comm_pipe_load (sndring_wr) - rd;
+	uae_u32 n, pos, first;
+
+	if (!sndring_playing) {
+		if (fill < (uae_u32)sndring_target) {
+			memset (stream, 0, len);
+			return;
+		}
+		sndring_playing = 1;
+	}
+	n = fill < (uae_u32)len ? fill : (uae_u32)len;
+	pos = rd & sndring_mask;
+	first = sndring_mask + 1 - pos;
+	if (first > n)
+		first = n;
+	memcpy (stream, sndring + pos, first);
+	memcpy (stream + first, sndring, n - first);
+	if (n < (uae_u32)len) {
+		memset (stream + n, 0, len - n);
+		sndring_playing = 0;
+		comm_pipe_store (sndring_underruns, sndring_underruns + 1);
+	}
+	comm_pipe_store (sndring_rd, rd + n);
+}
 
-	/* Wait for data to finish.  */
-	uae_sem_wait (&data_available_sem);
+/* only while the callback does not run */
+static void sndring_reset (void)
+{
+	SDL_LockAudio ();
+	sndring_rd = sndring_wr = 0;
+	sndring_playing = 0;
+	sndring_avgfill = sndring_target;
+	sndring_drift = 0;
+	SDL_UnlockAudio ();
+}
 
-	if (!closing_sound) {
-		memcpy (stream, paula_sndbuffer, paula_sndbufsize);
+static void sndring_status (int status, int count)
+{
+	gui_data.sndbuf_status = status;
+	count %= 100;
+	gui_data.sndbuf = status < 0 ? -count * 10 - 5 : count * 10;
+	statuscnt = SND_STATUSCNT;
+}
 
-		/* Notify writer that we're done.  */
-		uae_sem_post (&callback_done_sem);
+void sound_setadjust (double v)
+{
+	if (v < -ADJUST_LIMIT)
+		v = -ADJUST_LIMIT;
+	if (v > ADJUST_LIMIT)
+		v = ADJUST_LIMIT;
+	scaled_sample_evtime = scaled_sample_evtime_orig * (1000.0 + v) / 1000.0;
+}
+
+/* fill level feedback: more Paula samples per second when the ring runs
+ * low, fewer when it fills up. The integral part takes over the constant
+ * host/emulation clock difference so the fill settles at the target. */
+static void sndring_adjust (uae_u32 fill)
+{
+	double dev;
+
+	if (!comm_pipe_load (sndring_playing))
+		return;
+	sndring_avgfill += (fill - sndring_avgfill) / 16;
+	dev = (sndring_avgfill - sndring_target) / sndring_target;
+	sndring_drift += dev * ADJUST_DRIFT;
+	if (sndring_drift < -ADJUST_LIMIT)
+		sndring_drift = -ADJUST_LIMIT;
+	if (sndring_drift > ADJUST_LIMIT)
+		sndring_drift = ADJUST_LIMIT;
+	sound_setadjust (dev * ADJUST_GAIN + sndring_drift);
+	if (statuscnt == 0) {
+		int sndbuf = (int)(dev * 1000);
+		gui_data.sndbuf = sndbuf < -990 ? -990 : (sndbuf > 990 ? 990 : sndbuf);
 	}
-	in_callback = 0;
 }
 
 void finish_sound_buffer (void)
 {
+	uae_u32 rd, wr, fill, n, pos, first;
+	int under;
+
 	if (currprefs.turbo_emulation)
 		return;
 #ifdef DRIVESOUND
@@ -85,8 +165,30 @@ void finish_sound_buffer (void)
 	}
 	if (gui_data.sndbuf_status == 3)
 		gui_data.sndbuf_status = 0;
-	uae_sem_post (&data_available_sem);
-	uae_sem_wait (&callback_done_sem);
+
+	n = paula_sndbufsize;
+	wr = sndring_wr;
+	rd = comm_pipe_load (sndring_rd);
+	fill = wr - rd;
+	if (fill + n > sndring_mask + 1) {
+		sndring_overruns++;
+		sndring_status (2, sndring_overruns);
+	} else {
+		pos = wr & sndring_mask;
+		first = sndring_mask + 1 - pos;
+		if (first > n)
+			first = n;
+		memcpy (sndring + pos, paula_sndbuffer, first);
+		memcpy (sndring, (uae_u8*)paula_sndbuffer + first, n - first);
+		comm_pipe_store (sndring_wr, wr + n);
+		fill += n;
+	}
+	under = comm_pipe_load (sndring_underruns);
+	if (under != sndring_underruns_seen) {
+		sndring_underruns_seen = under;
+		sndring_status (-1, under);
+	}
+	sndring_adjust (fill);
 }
 
 /* Try to determine whether sound is available. */
@@ -118,6 +220,8 @@ int setup_sound (void)
 
 static int open_sound (void)
 {
+	int frame, size;
+
 	if (!currprefs.produce_sound)
 		return 0;
 	config_changed = 1;
@@ -138,13 +242,33 @@ static int open_sound (void)
 	sample_handler = currprefs.sound_stereo ? sample16s_handler : sample16_handler;
 
 	obtainedfreq = currprefs.sound_freq;
-	write_log ("SDL: sound driver found and configured at %d Hz, buffer is %d ms (%d bytes).\n", spec.freq, spec.samples * 1000 / spec.freq, paula_sndbufsize);
+	frame = 2 * spec.channels;
+	paula_sndbufsize = spec.samples * frame;
+	if (paula_sndbufsize > (int)sizeof (paula_sndbuffer))
+		paula_sndbufsize = sizeof (paula_sndbuffer) / frame * frame;
+	paula_sndbufpt = paula_sndbuffer;
+
+	sndring_target = currprefs.sound_maxbsiz / frame * frame;
+	if (sndring_target < 2 * paula_sndbufsize)
+		sndring_target = 2 * paula_sndbufsize;
+	if (sndring_target < 2 * (int)spec.size)
+		sndring_target = 2 * spec.size;
+	for (size = 4096; size < 2 * (sndring_target + (int)spec.size + paula_sndbufsize); size <<= 1);
+	sndring = xcalloc (uae_u8, size);
+	sndring_mask = size - 1;
+	sndring_rd = sndring_wr = 0;
+	sndring_playing = 0;
+	sndring_avgfill = sndring_target;
+	sndring_drift = 0;
+	sndring_underruns = sndring_underruns_seen = sndring_overruns = 0;
+
+	write_log ("SDL: sound driver found and configured at %d Hz, buffer is %d ms (%d bytes), latency %d ms (%d bytes).\n",
+		spec.freq, spec.samples * 1000 / spec.freq, paula_sndbufsize,
+		sndring_target * 1000 / (frame * spec.freq), sndring_target);
 
 	have_sound = 1;
 	sound_available = 1;
 	//update_sound (fake_vblank_hz);
-	paula_sndbufsize = spec.samples * 2 * spec.channels;
-	paula_sndbufpt = paula_sndbuffer;
 #ifdef DRIVESOUND
 	driveclick_init();
 #endif
@@ -152,38 +276,6 @@ static int open_sound (void)
 	return 1;
 }
 
-static void *sound_thread (void *dummy)
-{
-	for (;;) {
-		int cmd = read_comm_pipe_int_blocking (&to_sound_pipe);
-
-		switch (cmd) {
-			case 0:
-				open_sound ();
-				uae_sem_post (&sound_init_sem);
-				break;
-			case 1:
-				uae_sem_post (&sound_init_sem);
-				return 0;
-			}
-	}
-}
-
-/* We need a thread for this, since communication between finish_sound_buffer
- * and the callback works through semaphores.  In theory, this is unnecessary,
- * since SDL uses a sound thread internally, and the callback runs in its
- * context.  But we don't want to depend on SDL's internals too much.  */
-static void init_sound_thread (void)
-{
-	uae_thread_id tid;
-
-	init_comm_pipe (&to_sound_pipe, 20, 1);
-	uae_sem_init (&data_available_sem, 0, 0);
-	uae_sem_init (&callback_done_sem, 0, 0);
-	uae_sem_init (&sound_init_sem, 0, 0);
-	uae_start_thread ("Sound", sound_thread, NULL, &tid);
-}
-
 void close_sound (void)
 {
 	config_changed = 1;
@@ -193,18 +285,12 @@ void close_sound (void)
 		return;
 
 	SDL_PauseAudio (1);
-	clearbuffer();
-	if (in_callback) {
-		closing_sound = 1;
-		uae_sem_post (&data_available_sem);
-	}
-
-	write_comm_pipe_int (&to_sound_pipe, 1, 1);
-	uae_sem_wait (&sound_init_sem);
 	SDL_CloseAudio ();
-	uae_sem_destroy (&data_available_sem);
-	uae_sem_destroy (&sound_init_sem);
-	uae_sem_destroy (&callback_done_sem);
+	clearbuffer();
+	write_log ("SDL: sound closed, %d underruns, %d overruns.\n", sndring_underruns, sndring_overruns);
+	xfree (sndring);
+	sndring = NULL;
+	scaled_sample_evtime = scaled_sample_evtime_orig;
 	have_sound = 0;
 }
 
@@ -219,13 +305,10 @@ int init_sound (void)
 	if (have_sound)
 		return 1;
 
-	in_callback = 0;
-	closing_sound = 0;
-
-	init_sound_thread ();
-	write_comm_pipe_int (&to_sound_pipe, 0, 1);
-	uae_sem_wait (&sound_init_sem);
-	SDL_PauseAudio (0);
+	statuscnt = 0;
+	open_sound ();
+	if (have_sound)
+		SDL_PauseAudio (0);
 #ifdef DRIVESOUND
 	driveclick_reset ();
 #endif
@@ -244,12 +327,15 @@ void resume_sound (void)
 	if (!have_sound)
 		return;
 	clearbuffer();
+	sndring_reset ();
 	SDL_PauseAudio (0);
 }
 
 void reset_sound (void)
 {
 	clearbuffer();
+	if (have_sound)
+		sndring_reset ();
 	return;
 }
 
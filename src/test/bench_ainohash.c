@@ -0,0 +1,324 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Runs a lock/examine/open workload against the a_inode hashes
+  * (fsdb_hash.c) and against the old list walks, on a synthetic host
+  * tree of 100000 files: one flat directory of 20000 files and 80
+  * directories of 1000 files each.
+  *
+  * The tree is created under <dir> on the first run and mounted by
+  * scanning it like ExNext () does, every entry looked up by its host
+  * name and an a_inode created for it if missing. Then
+  *   lock     resolve "dir/file", Amiga names in random case
+  *   examine  lock key (uniq) to a_inode, stat () the host file
+  *   open     lock, resolve the key, open () and close () the host file
+  *
+  *  gcc -O2 -D_GNU_SOURCE -Isrc/include -Isrc src/test/bench_ainohash.c \
+  *      src/fsdb_hash.c -o bench_ainohash
+  *  ./bench_ainohash /tmp/ainotree [ops]
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "fsdb.h"
+
+#define FLAT_FILES 20000
+#define DIRS 80
+#define DIR_FILES 1000
+
+static a_inode root;
+static struct aino_uniqhash uniqhash;
+static uae_u32 a_uniq;
+static int hashed;
+static a_inode **all;
+static int nall;
+
+/* the lookups filesys.c did before */
+#define OLD_AINO_HASH 128
+static a_inode *old_hash[OLD_AINO_HASH];
+
+static a_inode *old_lookup_sub (a_inode *dir, uae_u32 uniq)
+{
+	a_inode **cp = &dir->child;
+	a_inode *c, *retval;
+
+	for (;;) {
+		c = *cp;
+		if (c == 0)
+			return 0;
+		if (c->uniq == uniq) {
+			retval = c;
+			break;
+		}
+		if (c->dir) {
+			a_inode *a = old_lookup_sub (c, uniq);
+			if (a != 0) {
+				retval = a;
+				break;
+			}
+		}
+		cp = &c->sibling;
+	}
+	*cp = c->sibling;
+	c->sibling = dir->child;
+	dir->child = c;
+	return retval;
+}
+
+static a_inode *lookup_aino (uae_u32 uniq)
+{
+	a_inode *a;
+
+	if (uniq == 0)
+		return &root;
+	if (hashed)
+		return aino_hash_find (&uniqhash, uniq);
+	a = old_hash[uniq % OLD_AINO_HASH];
+	if (a == 0 || a->uniq != uniq)
+		a = old_lookup_sub (&root, uniq);
+	old_hash[uniq % OLD_AINO_HASH] = a;
+	return a;
+}
+
+static a_inode *find_child (a_inode *base, const TCHAR *rel, int native)
+{
+	a_inode *c;
+	int l0 = _tcslen (rel);
+
+	if (hashed)
+		return native ? aino_dir_find_nname (base, rel, 0) : aino_dir_find_aname (base, rel, 0);
+	for (c = base->child; c; c = c->sibling) {
+		const TCHAR *name = native ? c->nname : c->aname;
+		int l1 = _tcslen (name);
+		if (l0 <= l1 && (native ? !_tcscmp (rel, name + l1 - l0) : same_aname (rel, name + l1 - l0))
+			&& (l0 == l1 || name[l1 - l0 - 1] == '/'))
+			break;
+	}
+	return c;
+}
+
+static a_inode *new_aino (a_inode *base, const TCHAR *name, int dir)
+{
+	a_inode *a = xcalloc (a_inode, 1);
+
+	a->aname = my_strdup (name);
+	a->nname = xmalloc (TCHAR, _tcslen (base->nname) + _tcslen (name) + 2);
+	_stprintf (a->nname, _T("%s/%s"), base->nname, name);
+	a->dir = dir;
+	a->uniq = ++a_uniq;
+	a->parent = base;
+	a->sibling = base->child;
+	base->child = a;
+	if (hashed) {
+		aino_hash_add (&uniqhash, a);
+		aino_dir_add (base, a);
+	}
+	all[nall++] = a;
+	return a;
+}
+
+static void scan (a_inode *dir)
+{
+	DIR *d = opendir (dir->nname);
+	struct dirent *de;
+
+	if (!d) {
+		perror (dir->nname);
+		exit (1);
+	}
+	while ((de = readdir (d))) {
+		a_inode *a;
+		if (de->d_name[0] == '.')
+			continue;
+		a = find_child (dir, de->d_name, 1);
+		if (!a)
+			a = new_aino (dir, de->d_name, de->d_type == DT_DIR);
+		if (a->dir)
+			scan (a);
+	}
+	closedir (d);
+}
+
+static void freetree (a_inode *dir)
+{
+	a_inode *c, *next;
+
+	for (c = dir->child; c; c = next) {
+		next = c->sibling;
+		freetree (c);
+		xfree (c->aname);
+		xfree (c->nname);
+		xfree (c);
+	}
+	dir->child = 0;
+	aino_dir_free (dir);
+}
+
+static void mkfiles (const char *dir, int n)
+{
+	char name[1024];
+	int i;
+
+	mkdir (dir, 0755);
+	for (i = 0; i < n; i++) {
+		int fd;
+		if (snprintf (name, sizeof name, "%s/Asset_%05d.dat", dir, i) >= (int)sizeof name) {
+			fprintf (stderr, "%s: path too long\n", dir);
+			exit (1);
+		}
+		fd = open (name, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0) {
+			perror (name);
+			exit (1);
+		}
+		close (fd);
+	}
+}
+
+static void mktree (const char *top)
+{
+	char name[1024], stamp[1024];
+	int i;
+
+	snprintf (stamp, sizeof stamp, "%s/flat/Asset_%05d.dat", top, FLAT_FILES - 1);
+	if (access (stamp, F_OK) == 0)
+		return;
+	printf ("creating tree in %s\n", top);
+	mkdir (top, 0755);
+	for (i = 0; i < DIRS; i++) {
+		snprintf (name, sizeof name, "%s/Dir%02d", top, i);
+		mkfiles (name, DIR_FILES);
+	}
+	snprintf (name, sizeof name, "%s/flat", top);
+	mkfiles (name, FLAT_FILES);
+}
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* lock "dir/file" by Amiga name, returns the key */
+static uae_u32 lock (const TCHAR *path)
+{
+	TCHAR part[256];
+	a_inode *a = &root;
+
+	while (*path && a) {
+		int n = 0;
+		while (*path && *path != '/')
+			part[n++] = *path++;
+		part[n] = 0;
+		if (*path)
+			path++;
+		a = find_child (a, part, 0);
+	}
+	return a ? a->uniq : 0xffffffff;
+}
+
+static void randcase (TCHAR *s)
+{
+	for (; *s; s++) {
+		if (rand () & 1)
+			*s = (TCHAR)(isupper ((uae_u8)*s) ? tolower ((uae_u8)*s) : toupper ((uae_u8)*s));
+	}
+}
+
+static void run (const char *top, int ops, int usehash)
+{
+	double t0, t1, t2;
+	int i, nlock = 0, nexam = 0, nopen = 0;
+
+	hashed = usehash;
+	a_uniq = 0;
+	nall = 0;
+	memset (old_hash, 0, sizeof old_hash);
+	memset (&root, 0, sizeof root);
+	root.nname = my_strdup (top);
+	root.aname = my_strdup (_T("Work"));
+	root.dir = 1;
+
+	t0 = now ();
+	scan (&root);
+	/* a second scan, everything is known now */
+	scan (&root);
+	t1 = now ();
+
+	srand (1);
+	for (i = 0; i < ops; i++) {
+		TCHAR path[256];
+		int r = rand () % 100;
+		int d = rand () % (DIRS + 1);
+		uae_u32 key;
+		a_inode *a;
+		struct stat st;
+
+		if (d == DIRS)
+			_stprintf (path, _T("flat/Asset_%05d.dat"), rand () % FLAT_FILES);
+		else
+			_stprintf (path, _T("Dir%02d/Asset_%05d.dat"), d, rand () % DIR_FILES);
+		randcase (path);
+		if (r < 40) {
+			key = lock (path);
+			if (key == 0xffffffff) {
+				printf ("lock '%s' failed\n", path);
+				exit (1);
+			}
+			nlock++;
+		} else if (r < 80) {
+			a = lookup_aino (all[rand () % nall]->uniq);
+			if (!a || stat (a->nname, &st)) {
+				printf ("examine failed\n");
+				exit (1);
+			}
+			nexam++;
+		} else {
+			int fd;
+			a = lookup_aino (lock (path));
+			fd = a ? open (a->nname, O_RDONLY) : -1;
+			if (fd < 0) {
+				printf ("open '%s' failed\n", path);
+				exit (1);
+			}
+			close (fd);
+			nopen++;
+		}
+	}
+	t2 = now ();
+	printf ("%-6s: %d a_inodes, mount %8.3fs, %d locks %d examines %d opens %8.3fs (%.0f ops/s)\n",
+		usehash ? "hashed" : "lists", nall, t1 - t0, nlock, nexam, nopen, t2 - t1, ops / (t2 - t1));
+
+	freetree (&root);
+	aino_hash_free (&uniqhash);
+	xfree (root.nname);
+	xfree (root.aname);
+}
+
+int main (int argc, char **argv)
+{
+	int ops = 20000;
+
+	if (argc < 2) {
+		printf ("usage: %s <dir> [ops]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		ops = atoi (argv[2]);
+	mktree (argv[1]);
+	all = (a_inode**)malloc ((FLAT_FILES + DIRS * (DIR_FILES + 1)) * sizeof (a_inode*));
+	run (argv[1], ops, 0);
+	run (argv[1], ops, 1);
+	return 0;
+}
@@ -0,0 +1,224 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Throughput benchmark for smp_comm_pipe (commpipe.h), compared with the
+  * previous lock and semaphore based pipe.
+  *
+  * Mimics filesys.c with UAE_FILESYS_THREADS: the emulation side sends
+  * packet, message and lock list through unit_pipe (100 entries, chunks 3),
+  * the filesys thread hands locks back through back_pipe and replies
+  * through a native2amiga_pending style pipe (chunks 2). Up to <window>
+  * packets are in flight, 1 measures the round trip latency.
+  *
+  *  gcc -O2 -D_GNU_SOURCE -Isrc/include -Isrc src/test/bench_commpipe.c \
+  *      src/td-posix/thread.c -o bench_commpipe -lpthread
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "threaddep/thread.h"
+
+void write_log (const TCHAR *format, ...) { }
+
+/* Previous implementation, copied from the old commpipe.h */
+
+typedef struct {
+	uae_sem_t lock;
+	uae_sem_t reader_wait;
+	uae_sem_t writer_wait;
+	uae_pt *data;
+	int size, chunks;
+	volatile int rdp, wrp;
+	volatile int writer_waiting;
+	volatile int reader_waiting;
+} old_comm_pipe;
+
+static void old_init (old_comm_pipe *p, int size, int chunks)
+{
+	memset (p, 0, sizeof (*p));
+	p->data = (uae_pt *)malloc (size * sizeof (uae_pt));
+	p->size = size;
+	p->chunks = chunks;
+	uae_sem_init (&p->lock, 0, 1);
+	uae_sem_init (&p->reader_wait, 0, 0);
+	uae_sem_init (&p->writer_wait, 0, 0);
+}
+
+static void old_maybe_wake_reader (old_comm_pipe *p, int no_buffer)
+{
+	if (p->reader_waiting
+		&& (no_buffer || ((p->wrp - p->rdp + p->size) % p->size) >= p->chunks))
+	{
+		p->reader_waiting = 0;
+		uae_sem_post (&p->reader_wait);
+	}
+}
+
+static void old_write (old_comm_pipe *p, uae_u32 v, int no_buffer)
+{
+	int nxwrp = (p->wrp + 1) % p->size;
+	uae_pt data;
+
+	data.u32 = v;
+	if (p->reader_waiting) {
+		p->data[p->wrp] = data;
+		p->wrp = nxwrp;
+		old_maybe_wake_reader (p, no_buffer);
+		return;
+	}
+	uae_sem_wait (&p->lock);
+	if (nxwrp == p->rdp) {
+		p->writer_waiting = 1;
+		uae_sem_post (&p->lock);
+		uae_sem_wait (&p->writer_wait);
+		uae_sem_wait (&p->lock);
+	}
+	p->data[p->wrp] = data;
+	p->wrp = nxwrp;
+	old_maybe_wake_reader (p, no_buffer);
+	uae_sem_post (&p->lock);
+}
+
+static uae_u32 old_read (old_comm_pipe *p)
+{
+	uae_pt data;
+
+	uae_sem_wait (&p->lock);
+	if (p->rdp == p->wrp) {
+		p->reader_waiting = 1;
+		uae_sem_post (&p->lock);
+		uae_sem_wait (&p->reader_wait);
+		uae_sem_wait (&p->lock);
+	}
+	data = p->data[p->rdp];
+	p->rdp = (p->rdp + 1) % p->size;
+	if (p->writer_waiting) {
+		p->writer_waiting = 0;
+		uae_sem_post (&p->writer_wait);
+	}
+	uae_sem_post (&p->lock);
+	return data.u32;
+}
+
+/* Both variants behind one interface */
+
+struct bpipe {
+	int useold;
+	old_comm_pipe o;
+	smp_comm_pipe n;
+};
+
+static void bp_init (struct bpipe *p, int useold, int size, int chunks)
+{
+	p->useold = useold;
+	if (useold)
+		old_init (&p->o, size, chunks);
+	else
+		init_comm_pipe (&p->n, size, chunks);
+}
+
+static void bp_write (struct bpipe *p, uae_u32 v, int no_buffer)
+{
+	if (p->useold)
+		old_write (&p->o, v, no_buffer);
+	else
+		write_comm_pipe_u32 (&p->n, v, no_buffer);
+}
+
+static uae_u32 bp_read (struct bpipe *p)
+{
+	if (p->useold)
+		return old_read (&p->o);
+	return read_comm_pipe_u32_blocking (&p->n);
+}
+
+static int bp_has_data (struct bpipe *p)
+{
+	if (p->useold)
+		return p->o.rdp != p->o.wrp;
+	return comm_pipe_has_data (&p->n);
+}
+
+static struct bpipe unit_pipe, back_pipe, pending;
+static int packets;
+
+static void *filesys_thread (void *v)
+{
+	int i;
+
+	for (i = 0; i < packets; i++) {
+		uae_u32 pck = bp_read (&unit_pipe);
+		uae_u32 msg = bp_read (&unit_pipe);
+		uae_u32 locks = bp_read (&unit_pipe);
+		if (locks)
+			bp_write (&back_pipe, locks, 0);
+		/* uae_ReplyMsg () */
+		bp_write (&pending, 2, 0);
+		bp_write (&pending, msg ^ pck, 1);
+	}
+	return NULL;
+}
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run (int useold, int window, int count)
+{
+	pthread_t tid;
+	uae_u32 check = 0, expect = 0;
+	double t0;
+	int sent = 0, done = 0;
+
+	packets = count;
+	bp_init (&unit_pipe, useold, 100, 3);
+	bp_init (&back_pipe, useold, 100, 1);
+	bp_init (&pending, useold, 100, 2);
+	t0 = now ();
+	pthread_create (&tid, NULL, filesys_thread, NULL);
+	while (done < count) {
+		while (sent < count && sent - done < window) {
+			bp_write (&unit_pipe, sent, 0);
+			bp_write (&unit_pipe, sent * 3, 0);
+			bp_write (&unit_pipe, (sent & 7) == 0 ? sent : 0, 1);
+			expect ^= sent ^ (sent * 3);
+			sent++;
+		}
+		if (bp_read (&pending) != 2)
+			abort ();
+		check ^= bp_read (&pending);
+		done++;
+		while (bp_has_data (&back_pipe))
+			bp_read (&back_pipe);
+	}
+	pthread_join (tid, NULL);
+	t0 = now () - t0;
+	if (check != expect) {
+		printf ("data mismatch\n");
+		exit (1);
+	}
+	return t0;
+}
+
+int main (int argc, char **argv)
+{
+	static const int windows[] = { 1, 4, 16, 30 };
+	int count = argc > 1 ? atoi (argv[1]) : 200000;
+	int i;
+
+	for (i = 0; i < sizeof windows / sizeof windows[0]; i++) {
+		double told = run (1, windows[i], count);
+		double tnew = run (0, windows[i], count);
+		printf ("window %2d: old %8.0f packets/s  new %8.0f packets/s  (%.2fx)\n",
+			windows[i], count / told, count / tnew, told / tnew);
+	}
+	return 0;
+}
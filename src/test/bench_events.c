@@ -0,0 +1,206 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Microbenchmark for the event2 scheduler: compares the old fixed
+  * 12 slot linear-scan table against the queue in events.c, which is
+  * scanned the same way while few events are pending and is a heap
+  * above EV2_HEAP_MIN.
+  *
+  * Build from the top level source directory after configure, e.g.
+  *  gcc -O2 -D_GNU_SOURCE -Isrc/include -Isrc src/test/bench_events.c -o bench_events
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "options.h"
+#include "events.h"
+
+#include "../events.c"
+
+/* benchmark.c, events.c's hooks stay inactive */
+bool bench_active;
+int bench_subsys;
+frame_time_t bench_mark;
+uae_u64 bench_time[BENCH_MAX];
+
+struct ev eventtab[ev_max];
+struct ev2 eventtab2[ev2_max];
+int pissoff_value;
+signed long pissoff;
+
+void write_log (const TCHAR *format, ...) { }
+void gui_message (const TCHAR *format, ...) { }
+
+/* Old scheme, copied from the previous events.c */
+
+#define OLD_MAX 12
+#define OLD_MISC 2
+
+static struct ev2 oldtab[OLD_MAX];
+
+static void old_misc (void)
+{
+	static bool dorecheck;
+	bool recheck;
+	int i;
+	evt mintime;
+	evt ct = get_cycles ();
+	static int recursive;
+
+	if (recursive) {
+		dorecheck = true;
+		return;
+	}
+	recursive++;
+	eventtab[ev_misc].active = 0;
+	recheck = true;
+	while (recheck) {
+		recheck = false;
+		mintime = ~0L;
+		for (i = 0; i < OLD_MAX; i++) {
+			if (oldtab[i].active) {
+				if (oldtab[i].evtime == ct) {
+					oldtab[i].active = false;
+					oldtab[i].handler (oldtab[i].data);
+					if (dorecheck || oldtab[i].active) {
+						recheck = true;
+						dorecheck = false;
+					}
+				} else {
+					evt eventtime = oldtab[i].evtime - ct;
+					if (eventtime < mintime)
+						mintime = eventtime;
+				}
+			}
+		}
+	}
+	if (mintime != ~0UL) {
+		eventtab[ev_misc].active = true;
+		eventtab[ev_misc].oldcycles = ct;
+		eventtab[ev_misc].evtime = ct + mintime;
+		events_schedule ();
+	}
+	recursive--;
+}
+
+static void old_newevent (evt t, uae_u32 data, evfunc2 func)
+{
+	static int next = OLD_MISC;
+	evt et = t + get_cycles ();
+	int no = next;
+
+	for (;;) {
+		if (!oldtab[no].active)
+			break;
+		if (oldtab[no].evtime == et && oldtab[no].handler == func && oldtab[no].data == data)
+			break;
+		no++;
+		if (no == OLD_MAX)
+			no = OLD_MISC;
+		if (no == next)
+			return;
+	}
+	next = no;
+	oldtab[no].active = true;
+	oldtab[no].evtime = et;
+	oldtab[no].handler = func;
+	oldtab[no].data = data;
+	old_misc ();
+}
+
+static unsigned long fired;
+
+static void count_func (uae_u32 v)
+{
+	fired += v;
+}
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define ROUNDS 2000000
+
+static uae_u32 seed;
+
+static evt next_delay (void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (1 + (seed >> 16) % 200) * CYCLE_UNIT;
+}
+
+/* Keep 'depth' events pending, advance time to the next one, refill. */
+static double run (int depth, int useold)
+{
+	double t0;
+	int i;
+
+	currcycle = 0;
+	fired = 0;
+	memset (oldtab, 0, sizeof oldtab);
+	event2_misc_reset ();
+	seed = 1;
+	for (i = 0; i < depth; i++) {
+		evt t = next_delay ();
+		if (useold)
+			old_newevent (t, 1, count_func);
+		else
+			event2_newevent_xx (-1, t, 1, count_func);
+	}
+	t0 = now ();
+	for (i = 0; i < ROUNDS; i++) {
+		evt t = next_delay ();
+		currcycle = eventtab[ev_misc].evtime;
+		if (useold) {
+			old_misc ();
+			old_newevent (t, 1, count_func);
+		} else {
+			MISC_handler ();
+			event2_newevent_xx (-1, t, 1, count_func);
+		}
+	}
+	return now () - t0;
+}
+
+/* Best of a few runs, the machine is rarely idle */
+static double best (int depth, int useold)
+{
+	double t = run (depth, useold);
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		double t2 = run (depth, useold);
+		if (t2 < t)
+			t = t2;
+	}
+	return t;
+}
+
+int main (int argc, char **argv)
+{
+	static const int depths[] = { 2, 4, 8, 10, 16, 32, 64, 256 };
+	int i;
+
+	for (i = 0; i < sizeof depths / sizeof depths[0]; i++) {
+		int d = depths[i];
+		double tnew = best (d, 0);
+		unsigned long fnew = fired;
+		if (d <= OLD_MAX - OLD_MISC) {
+			double told = best (d, 1);
+			printf ("%4d pending: table %7.1f ns/event  new %7.1f ns/event  (fired %lu/%lu)\n",
+				d, told * 1e9 / ROUNDS, tnew * 1e9 / ROUNDS, fired, fnew);
+		} else {
+			printf ("%4d pending: table    n/a           new %7.1f ns/event  (fired %lu)\n",
+				d, tnew * 1e9 / ROUNDS, fnew);
+		}
+	}
+	return 0;
+}
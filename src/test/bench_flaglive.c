@@ -0,0 +1,430 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Static measurement of the JIT's flag liveness: how many flag
+  * computations the blocks of real 68k code need when all flags are live
+  * at the end of every block, and how many when the end only keeps what
+  * the successor blocks read (compute_liveflags () in compemu_support.c).
+  *
+  * Reads the code hunks of AmigaOS executables, such as the ones in
+  * amiga/programs.
+  * Counts are static, every block is counted once.
+  *
+  * Build from the top level source directory after configure and make,
+  * which leave the table68k reader in src/tools, e.g.
+  *  gcc -O2 -D_GNU_SOURCE -Isrc/include -Isrc -Isrc/tools src/test/bench_flaglive.c \
+  *   src/tools/readcpu.o src/tools/cpudefs.o src/tools/missing.o src/tools/writelog.o -o bench_flaglive
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "readcpu.h"
+
+#define FLAG_Z 0x0004
+#define MAXRUN 1024
+
+#define HUNK_CODE 0x3e9
+#define HUNK_DATA 0x3ea
+#define HUNK_BSS 0x3eb
+#define HUNK_RELOC32 0x3ec
+#define HUNK_SYMBOL 0x3f0
+#define HUNK_DEBUG 0x3f1
+#define HUNK_END 0x3f2
+#define HUNK_HEADER 0x3f3
+
+static uae_u8 *code;
+static uae_u32 codesize;
+
+struct insn {
+	uae_u16 opcode;
+	uae_u8 len;
+	uae_u8 flags;		/* INSN_* */
+	uae_u32 target;		/* branch target, if INSN_BRANCH */
+};
+#define INSN_END 1		/* ends a block */
+#define INSN_BRANCH 2		/* Bcc or DBcc, goes on at target or next */
+#define INSN_GOTO 4		/* BRA or BSR, the block goes on at target */
+
+static struct insn *insns;	/* by offset / 2 */
+static uae_u8 *needs;		/* flags the block starting there reads, 0xff: not known */
+
+struct totals {
+	uae_u64 insns, flagbits, noflags;
+};
+
+static uae_u16 word (uae_u32 o)
+{
+	return o + 1 < codesize ? (code[o] << 8) | code[o + 1] : 0;
+}
+
+static int ea_len (int mode, int size, uae_u32 o)
+{
+	switch (mode) {
+	case Ad16: case PC16: case absw: case imm0: case imm1:
+		return 2;
+	case absl: case imm2:
+		return 4;
+	case imm:
+		return size == sz_long ? 4 : 2;
+	case Ad8r: case PC8r:
+	{
+		uae_u16 ext = word (o);
+		int len = 2;
+		if (!(ext & 0x100))
+			return 2;
+		/* full format: base and outer displacement */
+		if ((ext & 0x30) == 0x20) len += 2;
+		if ((ext & 0x30) == 0x30) len += 4;
+		if ((ext & 3) == 2) len += 2;
+		if ((ext & 3) == 3) len += 4;
+		return len;
+	}
+	default:
+		return 0;
+	}
+}
+
+/* Length of the instruction at <o>, 0 if it can't be decoded */
+static int insn_len (uae_u32 o)
+{
+	uae_u16 op = word (o);
+	struct instr *dp = table68k + op;
+	int len = 2;
+
+	if (dp->mnemo == i_ILLG || (op & 0xf000) == 0xf000)
+		return 0;
+	len += ea_len (dp->smode, dp->size, o + len);
+	len += ea_len (dp->dmode, dp->size, o + len);
+	return o + len <= codesize ? len : 0;
+}
+
+static void decode_one (uae_u32 o)
+{
+	struct insn *in = &insns[o / 2];
+	uae_u16 op = word (o);
+	struct instr *dp = table68k + op;
+	uae_s32 disp;
+
+	in->opcode = op;
+	in->len = insn_len (o);
+	in->flags = INSN_END;
+	if (!in->len)
+		return;
+	in->flags = 0;
+	if (dp->mnemo == i_Bcc || dp->mnemo == i_BSR) {
+		disp = (uae_s8)op;
+		if (disp == 0)
+			disp = (uae_s16)word (o + 2);
+		else if (disp == -1)
+			disp = (uae_s32)((word (o + 2) << 16) | word (o + 4));
+		in->target = o + 2 + disp;
+		if (dp->mnemo == i_BSR || dp->cc == 0)
+			in->flags = INSN_GOTO;
+		else
+			in->flags = INSN_BRANCH | INSN_END;
+	} else if (dp->mnemo == i_DBcc) {
+		in->target = o + 2 + (uae_s16)word (o + 2);
+		in->flags = INSN_BRANCH | INSN_END;
+	} else if (dp->isjmp) {
+		in->flags = INSN_END;
+	}
+	if ((in->flags & (INSN_BRANCH | INSN_GOTO)) && (in->target >= codesize || (in->target & 1)))
+		in->flags = INSN_END;
+}
+
+/* Linear sweep, then from the branch targets it did not reach until they
+   run into decoded code */
+static void decode (void)
+{
+	uae_u8 *done = xcalloc (uae_u8, codesize / 2 + 1);
+	uae_u32 o, p;
+	int more;
+
+	for (o = 0; o + 1 < codesize; o += insns[o / 2].len ? insns[o / 2].len : 2) {
+		decode_one (o);
+		done[o / 2] = 1;
+	}
+	do {
+		more = 0;
+		for (o = 0; o + 1 < codesize; o += 2) {
+			if (!done[o / 2] || !(insns[o / 2].flags & (INSN_BRANCH | INSN_GOTO)))
+				continue;
+			for (p = insns[o / 2].target; p + 1 < codesize && !done[p / 2]; p += insns[p / 2].len ? insns[p / 2].len : 2) {
+				decode_one (p);
+				done[p / 2] = 1;
+				more = 1;
+			}
+		}
+	} while (more);
+	xfree (done);
+}
+
+STATIC_INLINE int set_flags (uae_u16 op)
+{
+	return table68k[op].flagdead & 0x1f;
+}
+
+STATIC_INLINE int use_flags (uae_u16 op)
+{
+	struct instr *dp = table68k + op;
+	/* Unconditional jumps don't evaluate condition codes */
+	if (dp->mnemo == i_BSR || (dp->mnemo == i_Bcc && dp->cc == 0))
+		return 0;
+	return dp->flaglive & 0x1f;
+}
+
+STATIC_INLINE int is_addx (uae_u16 op)
+{
+	int m = table68k[op].mnemo;
+	return m == i_ADDX || m == i_SUBX || m == i_NEGX;
+}
+
+/* Records the block starting at <o> the way execute_normal () would run
+   through it, following BRA and BSR. Returns its length. */
+static int record (uae_u32 o, uae_u32 *hist)
+{
+	int n = 0;
+
+	while (n < MAXRUN && o < codesize) {
+		struct insn *in = &insns[o / 2];
+		if (!in->len)
+			break;
+		hist[n++] = o;
+		if (in->flags & INSN_END)
+			break;
+		o = (in->flags & INSN_GOTO) ? in->target : o + in->len;
+	}
+	return n;
+}
+
+/* The flags the successors of the last instruction read, like
+   successor_flags (): all of them unless every one is known */
+static int end_flags (uae_u32 start, uae_u32 last, int succ, int *self)
+{
+	struct insn *in = &insns[last / 2];
+	uae_u32 t[2];
+	int i, flags = 0;
+
+	if (!succ || !(in->flags & INSN_BRANCH))
+		return 0x1f;
+	t[0] = last + in->len;
+	t[1] = in->target;
+	for (i = 0; i < 2; i++) {
+		if (t[i] == start) {
+			*self = 1;
+			continue;
+		}
+		if (t[i] >= codesize || needs[t[i] / 2] == 0xff)
+			return 0x1f;
+		flags |= needs[t[i] / 2];
+	}
+	return flags;
+}
+
+/* Liveness over one block as compute_liveflags () does it, adds up the
+   flags its instructions have to compute. Returns what the block reads. */
+static int block_flags (uae_u32 start, int succ, struct totals *tot)
+{
+	uae_u32 hist[MAXRUN];
+	uae_u8 live[MAXRUN + 1];
+	int n = record (start, hist);
+	int self = 0, first = 0;
+	int endflags = end_flags (start, hist[n - 1], succ, &self);
+	int i;
+
+	for (;;) {
+		live[n] = endflags | (self ? first : 0);
+		for (i = n - 1; i >= 0; i--) {
+			uae_u16 op = insns[hist[i] / 2].opcode;
+			live[i] = (live[i + 1] & ~set_flags (op)) | use_flags (op);
+			if (is_addx (op) && !(live[i + 1] & FLAG_Z))
+				live[i] &= ~FLAG_Z;
+		}
+		if (live[0] == first)
+			break;
+		first = live[0];
+	}
+	if (tot) {
+		for (i = 0; i < n; i++) {
+			uae_u16 op = insns[hist[i] / 2].opcode;
+			int needed = live[i + 1] & set_flags (op);
+			tot->insns++;
+			tot->flagbits += __builtin_popcount (needed);
+			if (!needed && set_flags (op))
+				tot->noflags++;
+		}
+	}
+	return live[0];
+}
+
+static void measure (struct totals *all, struct totals *succ)
+{
+	uae_u8 *leader = xcalloc (uae_u8, codesize / 2 + 1);
+	uae_u32 o;
+	int changed, rounds = 0;
+
+	/* Blocks start at branch targets and after block ends */
+	leader[0] = 1;
+	for (o = 0; o + 1 < codesize; o += 2) {
+		struct insn *in = &insns[o / 2];
+		if (!in->len)
+			continue;
+		if (in->flags & (INSN_BRANCH | INSN_GOTO))
+			leader[in->target / 2] = 1;
+		if ((in->flags & INSN_END) && o + in->len < codesize)
+			leader[(o + in->len) / 2] = 1;
+	}
+	for (o = 0; o + 1 < codesize; o += 2) {
+		if (leader[o / 2] && insns[o / 2].len)
+			block_flags (o, 0, all);
+	}
+
+	/* Successors first have to be compiled. Start from "reads nothing"
+	   and go on until nothing changes, the blocks only ever read more. */
+	memset (needs, 0, codesize / 2 + 1);
+	for (o = 0; o + 1 < codesize; o += 2) {
+		if (!leader[o / 2] || !insns[o / 2].len)
+			needs[o / 2] = 0xff;
+	}
+	do {
+		changed = 0;
+		for (o = 0; o + 1 < codesize; o += 2) {
+			int f;
+			if (needs[o / 2] == 0xff)
+				continue;
+			f = block_flags (o, 1, NULL);
+			if (f != needs[o / 2]) {
+				needs[o / 2] = f;
+				changed = 1;
+			}
+		}
+	} while (changed && ++rounds < 100);
+	for (o = 0; o + 1 < codesize; o += 2) {
+		if (needs[o / 2] != 0xff)
+			block_flags (o, 1, succ);
+	}
+	xfree (leader);
+}
+
+static uae_u32 get_long (FILE *f, int *err)
+{
+	uae_u8 b[4];
+	if (fread (b, 1, 4, f) != 4) {
+		*err = 1;
+		return 0;
+	}
+	return (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+/* Measures every code hunk of <name> */
+static int do_file (const char *name, struct totals *all, struct totals *succ)
+{
+	FILE *f = fopen (name, "rb");
+	int err = 0, hunks = 0;
+	uae_u32 type, n, first, last, i;
+
+	if (!f) {
+		perror (name);
+		return 0;
+	}
+	if (get_long (f, &err) != HUNK_HEADER) {
+		fprintf (stderr, "%s: not an executable\n", name);
+		fclose (f);
+		return 0;
+	}
+	while ((n = get_long (f, &err)) && !err)
+		fseek (f, n * 4, SEEK_CUR);
+	get_long (f, &err);
+	first = get_long (f, &err);
+	last = get_long (f, &err);
+	for (i = first; i <= last && !err; i++)
+		get_long (f, &err);
+
+	while (!err) {
+		type = get_long (f, &err) & 0x3fffffff;
+		if (err)
+			break;
+		switch (type) {
+		case HUNK_CODE:
+			codesize = get_long (f, &err) * 4;
+			code = xmalloc (uae_u8, codesize + 8);
+			memset (code, 0, codesize + 8);
+			if (fread (code, 1, codesize, f) != codesize)
+				err = 1;
+			insns = xcalloc (struct insn, codesize / 2 + 1);
+			needs = xcalloc (uae_u8, codesize / 2 + 1);
+			decode ();
+			measure (all, succ);
+			xfree (insns);
+			xfree (needs);
+			xfree (code);
+			hunks++;
+			break;
+		case HUNK_DATA:
+		case HUNK_DEBUG:
+			n = get_long (f, &err);
+			fseek (f, n * 4, SEEK_CUR);
+			break;
+		case HUNK_BSS:
+			get_long (f, &err);
+			break;
+		case HUNK_RELOC32:
+			while ((n = get_long (f, &err)) && !err)
+				fseek (f, (n + 1) * 4, SEEK_CUR);
+			break;
+		case HUNK_SYMBOL:
+			while ((n = get_long (f, &err)) && !err)
+				fseek (f, (n + 1) * 4, SEEK_CUR);
+			break;
+		case HUNK_END:
+			break;
+		default:
+			fprintf (stderr, "%s: hunk type %x not known, stopping\n", name, type);
+			err = 1;
+			break;
+		}
+	}
+	fclose (f);
+	return hunks;
+}
+
+static void print (const char *what, struct totals *t, struct totals *base)
+{
+	printf ("%-28s %8llu instructions, %8llu flag bits computed (%5.1f%%), %7llu without flags\n",
+		what, (unsigned long long)t->insns, (unsigned long long)t->flagbits,
+		base->flagbits ? 100.0 * t->flagbits / base->flagbits : 0.0,
+		(unsigned long long)t->noflags);
+}
+
+int main (int argc, char **argv)
+{
+	struct totals all = { 0 }, succ = { 0 };
+	int i, hunks = 0;
+
+	if (argc < 2) {
+		fprintf (stderr, "usage: %s <amiga executable>...\n", argv[0]);
+		return 1;
+	}
+	read_table68k ();
+	do_merges ();
+	for (i = 1; i < argc; i++) {
+		struct totals a = { 0 }, s = { 0 };
+		hunks += do_file (argv[i], &a, &s);
+		if (!a.insns)
+			continue;
+		printf ("%s:\n", argv[i]);
+		print ("  all flags live at the end", &a, &a);
+		print ("  successor flags", &s, &a);
+		all.insns += a.insns; all.flagbits += a.flagbits; all.noflags += a.noflags;
+		succ.insns += s.insns; succ.flagbits += s.flagbits; succ.noflags += s.noflags;
+	}
+	printf ("total, %d code hunks:\n", hunks);
+	print ("  all flags live at the end", &all, &all);
+	print ("  successor flags", &succ, &all);
+	return 0;
+}
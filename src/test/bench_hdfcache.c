@@ -0,0 +1,243 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Replays hardfile request traces through the block cache
+  * (hardfile_cache.c) against a real image file, with and without the
+  * cache, and checks every read against a shadow copy of the image.
+  *
+  * A trace has one request per line, offsets and lengths in bytes:
+  *   R <offset> <length>     CMD_READ
+  *   W <offset> <length>     CMD_WRITE
+  *   U                       CMD_UPDATE
+  *   I                       idle, the hardfile thread may read ahead
+  * Without a trace a build-like workload is generated: a hot set of
+  * directory and bitmap blocks, small files (headers, sources, objects)
+  * read and written in sequence, the popular ones far more often, now
+  * and then a large file streamed in 64k transfers.
+  *
+  * A last cached run fails every 7th host write: the written data must
+  * survive until a later write back succeeds and every failure must be
+  * reported by a write or a flush.
+  *
+  *  gcc -O2 -D_GNU_SOURCE -Isrc/include -Isrc src/test/bench_hdfcache.c \
+  *      src/hardfile_cache.c -o bench_hdfcache
+  *  ./bench_hdfcache /tmp/test.hdf 512 [trace]
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "options.h"
+#include "filesys.h"
+
+void write_log (const TCHAR *format, ...) { }
+
+static int fd;
+static uae_u8 *shadow;
+static long host_reads, host_writes;
+static bool fail_writes;
+
+int hdf_read2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	host_reads++;
+	return pread (fd, buffer, len, offset);
+}
+
+int hdf_write2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	host_writes++;
+	if (fail_writes && host_writes % 7 == 0)
+		return -1;
+	return pwrite (fd, buffer, len, offset);
+}
+
+struct req {
+	char type;
+	uae_u64 offset;
+	int len;
+};
+
+static struct req *reqs;
+static int nreqs, maxreqs;
+
+static void addreq (char type, uae_u64 offset, int len)
+{
+	if (nreqs == maxreqs) {
+		maxreqs = maxreqs ? maxreqs * 2 : 65536;
+		reqs = (struct req*)realloc (reqs, maxreqs * sizeof (struct req));
+	}
+	reqs[nreqs].type = type;
+	reqs[nreqs].offset = offset;
+	reqs[nreqs].len = len;
+	nreqs++;
+}
+
+static void loadtrace (const char *name)
+{
+	FILE *f = fopen (name, "r");
+	char line[256];
+
+	if (!f) {
+		perror (name);
+		exit (1);
+	}
+	while (fgets (line, sizeof line, f)) {
+		unsigned long long o;
+		int l;
+		if ((line[0] == 'R' || line[0] == 'W') && sscanf (line + 1, "%llu %d", &o, &l) == 2)
+			addreq (line[0], o, l);
+		else if (line[0] == 'U' || line[0] == 'I')
+			addreq (line[0], 0, 0);
+	}
+	fclose (f);
+}
+
+static void gentrace (uae_u64 size, int count)
+{
+	uae_u64 meta[64], files[2048];
+	int i, j;
+
+	srand (1);
+	for (i = 0; i < 64; i++)
+		meta[i] = ((uae_u64)rand () * 512) % size & ~511ULL;
+	for (i = 0; i < 2048; i++)
+		files[i] = ((uae_u64)rand () * 4096) % (size - 65536) & ~511ULL;
+	while (nreqs < count) {
+		int r = rand () % 100;
+		if (r < 45) {
+			/* directory, header and bitmap blocks */
+			addreq (rand () % 4 ? 'R' : 'W', meta[rand () % 64], 512);
+		} else if (r < 90) {
+			/* a small file in sequence */
+			int k = rand () % 2048;
+			uae_u64 o = files[k * k / 2048];
+			int n = 1 + rand () % 12;
+			char t = rand () % 3 ? 'R' : 'W';
+			for (j = 0; j < n; j++)
+				addreq (t, o + j * 1024, 1024);
+			addreq ('I', 0, 0);
+		} else if (r < 98) {
+			uae_u64 o = ((uae_u64)rand () * 65536) % (size - 1024 * 1024) & ~511ULL;
+			for (j = 0; j < 16; j++)
+				addreq ('R', o + j * 65536, 65536);
+		} else {
+			addreq ('U', 0, 0);
+		}
+	}
+	addreq ('U', 0, 0);
+}
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run (uae_u64 size, bool cache, long *errors)
+{
+	static struct hardfiledata hfd;
+	uae_u8 *buf = (uae_u8*)malloc (1024 * 1024);
+	double t;
+	int i, j;
+
+	memset (&hfd, 0, sizeof hfd);
+	hfd.virtsize = size;
+	if (cache)
+		hdf_init_cache (&hfd);
+	host_reads = host_writes = 0;
+	t = now ();
+	for (i = 0; i < nreqs; i++) {
+		struct req *r = &reqs[i];
+		switch (r->type)
+		{
+		case 'R':
+			if (hdf_cache_read (&hfd, buf, r->offset, r->len) != r->len || memcmp (buf, shadow + r->offset, r->len)) {
+				printf ("request %d: read mismatch at %llx\n", i, (unsigned long long)r->offset);
+				exit (1);
+			}
+			break;
+		case 'W':
+			for (j = 0; j < r->len; j++)
+				buf[j] = (uae_u8)(i + j);
+			if (hdf_cache_write (&hfd, buf, r->offset, r->len) == r->len)
+				memcpy (shadow + r->offset, buf, r->len);
+			else if (!fail_writes)
+				exit (1);
+			else
+				(*errors)++;
+			break;
+		case 'U':
+			if (!hdf_flush_cache (&hfd))
+				(*errors)++;
+			break;
+		case 'I':
+			hdf_cache_readahead (&hfd);
+			break;
+		}
+	}
+	fail_writes = false;
+	if (!hdf_flush_cache (&hfd))
+		(*errors)++;
+	hdf_free_cache (&hfd);
+	t = now () - t;
+	free (buf);
+	return t;
+}
+
+int main (int argc, char **argv)
+{
+	uae_u64 size;
+	long errors = 0;
+	double t;
+
+	if (argc < 3) {
+		printf ("usage: %s <image> <size in MB> [trace]\n", argv[0]);
+		return 1;
+	}
+	size = (uae_u64)atoi (argv[2]) * 1024 * 1024;
+	fd = open (argv[1], O_RDWR | O_CREAT, 0644);
+	if (fd < 0 || ftruncate (fd, size)) {
+		perror (argv[1]);
+		return 1;
+	}
+	shadow = (uae_u8*)calloc (1, size);
+	if (pread (fd, shadow, size, 0) != (ssize_t)size) {
+		perror ("read");
+		return 1;
+	}
+	if (argc > 3)
+		loadtrace (argv[3]);
+	else
+		gentrace (size, 200000);
+
+	t = run (size, false, &errors);
+	printf ("uncached: %8.3fs %8ld host reads %8ld host writes\n", t, host_reads, host_writes);
+	t = run (size, true, &errors);
+	printf ("cached:   %8.3fs %8ld host reads %8ld host writes\n", t, host_reads, host_writes);
+	fail_writes = true;
+	t = run (size, true, &errors);
+	printf ("failing:  %8.3fs %8ld host reads %8ld host writes %8ld errors\n", t, host_reads, host_writes, errors);
+	if (!errors) {
+		printf ("write back failures were not reported\n");
+		return 1;
+	}
+
+	/* everything must have been written back */
+	{
+		uae_u8 *img = (uae_u8*)malloc (size);
+		if (pread (fd, img, size, 0) != (ssize_t)size || memcmp (img, shadow, size)) {
+			printf ("image differs after flush\n");
+			return 1;
+		}
+		free (img);
+	}
+	close (fd);
+	return 0;
+}
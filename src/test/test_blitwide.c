@@ -0,0 +1,312 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Compares the wide blitter functions generated by genblitter with the
+  * word functions (blitdofast_*) and, for area fill, with the word loop
+  * of blitter_dofast ()/blitter_dofast_desc (), on random blits: all
+  * minterms of blttbl, both directions, random sizes, shifts, masks,
+  * modulos, disabled channels and C = D in place. Then times both.
+  *
+  * Needs the generated sources, run make first or genblitter f/t/i/h:
+  *  gcc -O2 -D_GNU_SOURCE -Isrc/include -Isrc src/test/test_blitwide.c \
+  *      src/blitfunc.c src/blittable.c -o test_blitwide
+  *  ./test_blitwide [bench]
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "options.h"
+#include "custom.h"
+#include "memory_uae.h"
+#include "blitter.h"
+#include "blit.h"
+
+#define CHIPSIZE 0x100000
+#define REGION 0x40000
+
+struct bltinfo blt_info;
+uae_u32 blit_masktable[BLITTER_MAX_WORDS];
+
+static uae_u8 chip_ref[CHIPSIZE], chip_wide[CHIPSIZE];
+static int errors;
+
+static uae_u32 REGPARAM2 test_wget (uaecptr addr)
+{
+	return (chip_ref[addr] << 8) | chip_ref[addr + 1];
+}
+
+static void REGPARAM2 test_wput (uaecptr addr, uae_u32 w)
+{
+	chip_ref[addr] = (uae_u8)(w >> 8);
+	chip_ref[addr + 1] = (uae_u8)w;
+}
+
+uae_u32 (REGPARAM2 *chipmem_wget_indirect)(uaecptr) = test_wget;
+void (REGPARAM2 *chipmem_wput_indirect)(uaecptr, uae_u32) = test_wput;
+
+static uae_u8 filltable[256][4][2];
+
+static void build_filltable (void)
+{
+	unsigned int d, fillmask;
+	int i;
+
+	for (d = 0; d < 256; d++) {
+		for (i = 0; i < 4; i++) {
+			int fc = i & 1;
+			uae_u8 data = d;
+			for (fillmask = 1; fillmask != 0x100; fillmask <<= 1) {
+				uae_u16 tmp = data;
+				if (fc) {
+					if (i & 2)
+						data |= fillmask;
+					else
+						data ^= fillmask;
+				}
+				if (tmp & fillmask) fc = !fc;
+			}
+			filltable[d][i][0] = data;
+			filltable[d][i][1] = fc;
+		}
+	}
+}
+
+/* the word loop of blitter_dofast () and blitter_dofast_desc () */
+static void ref_slow (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, uae_u8 mt, int desc, int fill)
+{
+	uae_u32 blitbhold = blt_info.bltbhold;
+	uae_u32 preva = 0, prevb = 0;
+	uaecptr dstp = 0;
+	int dodst = 0, blitfc, i, j;
+	int ifemode = (fill & BLITFILL_INCLUSIVE) ? 2 : 0;
+	int step = desc ? -2 : 2, sign = desc ? -1 : 1;
+
+	for (j = 0; j < blt_info.vblitsize; j++) {
+		blitfc = (fill & BLITFILL_CARRYIN) != 0;
+		for (i = 0; i < blt_info.hblitsize; i++) {
+			uae_u32 bltadat, blitahold;
+			uae_u16 bltbdat;
+			if (pta) {
+				blt_info.bltadat = bltadat = chipmem_wget_indirect (pta);
+				pta += step;
+			} else
+				bltadat = blt_info.bltadat;
+			bltadat &= blit_masktable[i];
+			if (desc)
+				blitahold = (((uae_u32)bltadat << 16) | preva) >> blt_info.blitdownashift;
+			else
+				blitahold = (((uae_u32)preva << 16) | bltadat) >> blt_info.blitashift;
+			preva = bltadat;
+			if (ptb) {
+				blt_info.bltbdat = bltbdat = chipmem_wget_indirect (ptb);
+				ptb += step;
+				if (desc)
+					blitbhold = (((uae_u32)bltbdat << 16) | prevb) >> blt_info.blitdownbshift;
+				else
+					blitbhold = (((uae_u32)prevb << 16) | bltbdat) >> blt_info.blitbshift;
+				prevb = bltbdat;
+			}
+			if (ptc) {
+				blt_info.bltcdat = chipmem_wget_indirect (ptc);
+				ptc += step;
+			}
+			if (dodst)
+				chipmem_wput_indirect (dstp, blt_info.bltddat);
+			blt_info.bltddat = blit_func (blitahold, blitbhold, blt_info.bltcdat, mt) & 0xFFFF;
+			if (fill) {
+				uae_u16 d = blt_info.bltddat;
+				int fc1 = filltable[d & 255][ifemode + blitfc][1];
+				blt_info.bltddat = (filltable[d & 255][ifemode + blitfc][0]
+					+ (filltable[d >> 8][ifemode + fc1][0] << 8));
+				blitfc = filltable[d >> 8][ifemode + fc1][1];
+			}
+			if (blt_info.bltddat)
+				blt_info.blitzero = 0;
+			if (ptd) {
+				dodst = 1;
+				dstp = ptd;
+				ptd += step;
+			}
+		}
+		if (pta)
+			pta += sign * blt_info.bltamod;
+		if (ptb)
+			ptb += sign * blt_info.bltbmod;
+		if (ptc)
+			ptc += sign * blt_info.bltcmod;
+		if (ptd)
+			ptd += sign * blt_info.bltdmod;
+	}
+	if (dodst)
+		chipmem_wput_indirect (dstp, blt_info.bltddat);
+	blt_info.bltbhold = blitbhold;
+}
+
+static uae_u32 rnd (void)
+{
+	static uae_u32 s = 0x12345678;
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+	return s;
+}
+
+/* start address of a channel whose blit lies inside region r */
+static uaecptr place (int r, int mod, int desc)
+{
+	int w = blt_info.hblitsize * 2;
+	int span = (blt_info.vblitsize - 1) * (w + mod);
+	uaecptr lo = 0x1000 + r * REGION + (rnd () & 0xffe);
+
+	if (desc)
+		return lo + (span > 0 ? span : 0) + w - 2;
+	return lo + (span < 0 ? -span : 0);
+}
+
+static void masks_set (void)
+{
+	int i;
+
+	for (i = 0; i < BLITTER_MAX_WORDS; i++)
+		blit_masktable[i] = 0xFFFF;
+	blit_masktable[0] = blt_info.bltafwm;
+	blit_masktable[blt_info.hblitsize - 1] &= blt_info.bltalwm;
+}
+
+static void check (uae_u8 mt, int desc, int fill, int n)
+{
+	struct bltinfo start, ref;
+	uaecptr pt[4];
+	int ch = rnd () & 15, inplace = (rnd () & 3) == 0;
+	int mods[4], i;
+
+	memset (&start, 0, sizeof start);
+	start.hblitsize = 1 + (n & 7 ? rnd () % 12 : rnd () % 80);
+	start.vblitsize = 1 + rnd () % 12;
+	start.blitashift = rnd () & 15;
+	start.blitbshift = rnd () & 15;
+	start.blitdownashift = 16 - start.blitashift;
+	start.blitdownbshift = 16 - start.blitbshift;
+	start.bltafwm = (rnd () & 1) ? 0xffff : (uae_u16)rnd ();
+	start.bltalwm = (rnd () & 1) ? 0xffff : (uae_u16)rnd ();
+	start.bltadat = (uae_u16)rnd ();
+	start.bltbdat = (uae_u16)rnd ();
+	start.bltcdat = (uae_u16)rnd ();
+	start.bltbhold = (uae_u16)rnd ();
+	start.blitzero = 1;
+	for (i = 0; i < 4; i++)
+		mods[i] = ((int)(rnd () % 160) - 60) & ~1;
+	if (inplace)
+		mods[2] = mods[3];
+	start.bltamod = mods[0];
+	start.bltbmod = mods[1];
+	start.bltcmod = mods[2];
+	start.bltdmod = mods[3];
+	blt_info = start;
+	for (i = 0; i < 4; i++)
+		pt[i] = (ch & (1 << i)) ? place (i, mods[i], desc) : 0;
+	if (inplace && pt[3])
+		pt[2] = pt[3];
+
+	for (i = 0; i < CHIPSIZE / 4; i++)
+		((uae_u32*)chip_ref)[i] = rnd ();
+	memcpy (chip_wide, chip_ref, CHIPSIZE);
+	masks_set ();
+
+	if (fill)
+		ref_slow (pt[0], pt[1], pt[2], pt[3], mt, desc, fill);
+	else
+		(desc ? blitfunc_dofast_desc : blitfunc_dofast)[mt] (pt[0], pt[1], pt[2], pt[3], &blt_info);
+	ref = blt_info;
+
+	blt_info = start;
+	(desc ? blitfunc_dofast_wide_desc : blitfunc_dofast_wide)[mt] (
+		pt[0] ? chip_wide + pt[0] : NULL, pt[1] ? chip_wide + pt[1] : NULL,
+		pt[2] ? chip_wide + pt[2] : NULL, pt[3] ? chip_wide + pt[3] : NULL, &blt_info, fill);
+
+	/* the word loop also reads channels the minterm ignores, compare the
+	 * channel registers with the word functions only */
+	if (!memcmp (chip_ref, chip_wide, CHIPSIZE) && ref.blitzero == blt_info.blitzero
+		&& (fill ? ref.bltddat == blt_info.bltddat : ref.bltbhold == blt_info.bltbhold
+			&& ref.bltcdat == blt_info.bltcdat && ref.bltadat == blt_info.bltadat
+			&& ref.bltbdat == blt_info.bltbdat))
+		return;
+	if (errors++ < 10) {
+		printf ("mt %02x %s fill %d: %dx%d shift %d/%d ch %x mods %d %d %d %d inplace %d\n",
+			mt, desc ? "desc" : "asc", fill, start.hblitsize, start.vblitsize,
+			start.blitashift, start.blitbshift, ch, mods[0], mods[1], mods[2], mods[3], inplace);
+		for (i = 0; i < CHIPSIZE; i++) {
+			if (chip_ref[i] != chip_wide[i]) {
+				printf ("  first difference at %06x: %02x %02x\n", i, chip_ref[i], chip_wide[i]);
+				break;
+			}
+		}
+		printf ("  zero %d %d bhold %04x %04x cdat %04x %04x adat %04x %04x bdat %04x %04x ddat %04x %04x\n",
+			ref.blitzero, blt_info.blitzero, ref.bltbhold, blt_info.bltbhold, ref.bltcdat, blt_info.bltcdat,
+			ref.bltadat, blt_info.bltadat, ref.bltbdat, blt_info.bltbdat, ref.bltddat, blt_info.bltddat);
+	}
+}
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* a 640x512 8 plane AGA screen blitted as one 40 word wide plane stack */
+static void bench (void)
+{
+	static const uae_u8 mts[] = { 0xf0, 0xca, 0xcc };
+	uaecptr pta = 0x1000, ptb = 0x1000 + REGION, ptc = 0x1000 + 2 * REGION, ptd = ptc;
+	double t;
+	int i, m, loops = 200;
+
+	memset (&blt_info, 0, sizeof blt_info);
+	blt_info.hblitsize = 40;
+	blt_info.vblitsize = 512 * 8 / 2;
+	blt_info.bltafwm = blt_info.bltalwm = 0xffff;
+	masks_set ();
+	for (m = 0; m < 3; m++) {
+		double tw, tn;
+		blt_info.blitashift = blt_info.blitbshift = m ? 5 : 0;
+		t = now ();
+		for (i = 0; i < loops; i++)
+			blitfunc_dofast[mts[m]] (pta, ptb, ptc, ptd, &blt_info);
+		tw = now () - t;
+		t = now ();
+		for (i = 0; i < loops; i++)
+			blitfunc_dofast_wide[mts[m]] (chip_wide + pta, chip_wide + ptb, chip_wide + ptc, chip_wide + ptd, &blt_info, 0);
+		tn = now () - t;
+		printf ("minterm %02x shift %d: words %7.3f ms, wide %7.3f ms per blit (%.1fx)\n",
+			mts[m], blt_info.blitashift, tw * 1000 / loops, tn * 1000 / loops, tw / tn);
+	}
+}
+
+int main (int argc, char **argv)
+{
+	int mt, n;
+
+	build_filltable ();
+	for (mt = 0; mt < 256; mt++) {
+		if (!blitfunc_dofast_wide[mt])
+			continue;
+		for (n = 0; n < 40; n++) {
+			check (mt, n & 1, 0, n);
+			check (mt, n & 1, ((n & 2) ? BLITFILL_INCLUSIVE : BLITFILL_EXCLUSIVE) | ((n & 4) ? BLITFILL_CARRYIN : 0), n);
+		}
+	}
+	if (errors) {
+		printf ("%d errors\n", errors);
+		return 1;
+	}
+	printf ("all blits match\n");
+	if (argc > 1)
+		bench ();
+	return 0;
+}
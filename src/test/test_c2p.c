@@ -0,0 +1,276 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Checks the C2P kernels (c2p.h) against the code they replaced and
+  * times them.
+  *
+  * Both conversions only move bits around, every output bit is one
+  * input bit, so feeding each single set input bit through them and
+  * comparing with the reference covers all inputs. Random inputs are
+  * checked as well. The Akiko kernel is compared with the original bit
+  * loop and with Mequa's table version that was used until now, the
+  * 8x8 transpose with the p2ctab lookup of PlanarToChunky () and the
+  * per pixel bit extraction of PlanarToDirect ().
+  *
+  *  gcc -O2 -D_GNU_SOURCE -Isrc/include -Isrc src/test/test_c2p.c -o test_c2p
+  *  ./test_c2p [bench]
+  *  (x86-64 builds use SSE2, add -mavx2 for the AVX2 variants)
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "c2p.h"
+
+static int errors;
+
+/* Akiko: the original bit loop */
+static void ref_akiko_loop (const uae_u32 *buffer, uae_u32 *result)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		result[i] = 0;
+	for (i = 0; i < 8 * 32; i++) {
+		if (buffer[7 - (i >> 5)] & (1 << (i & 31)))
+			result[i & 7] |= 1 << (i >> 3);
+	}
+}
+
+/* Akiko: Mequa's version */
+static uae_u32 precalc_shift[32];
+static uae_u32 precalc_bytenum[32][8];
+
+static void ref_akiko_precalculate (void)
+{
+	uae_u32 i, j;
+
+	for (i = 0; i < 32; i++) {
+		precalc_shift[i] = 1 << i;
+		for (j = 0; j < 8; j++)
+			precalc_bytenum[i][j] = (i >> 3) + ((7 - j) << 2);
+	}
+}
+
+static void ref_akiko_mequa (const uae_u32 *buffer, uae_u32 *result)
+{
+	int i, j, k;
+
+	for (i = 0; i < 8; i++) {
+		uae_u32 v = 0;
+		for (k = 0; k < 32; k += 8) {
+			for (j = 0; j < 8; j++)
+				v |= ((buffer[j] & precalc_shift[i + k]) != 0) << precalc_bytenum[i + k][j];
+		}
+		result[i] = v;
+	}
+}
+
+static void check_akiko (const uae_u32 *in, const char *what)
+{
+	uae_u32 r1[8], r2[8], r3[8], r4[8];
+	int i;
+
+	ref_akiko_loop (in, r1);
+	ref_akiko_mequa (in, r2);
+	c2p_akiko_scalar (in, r3);
+	c2p_akiko (in, r4);
+	if (!memcmp (r1, r2, sizeof r1) && !memcmp (r1, r3, sizeof r1) && !memcmp (r1, r4, sizeof r1))
+		return;
+	if (errors++ < 10) {
+		printf ("akiko %s mismatch\n", what);
+		for (i = 0; i < 8; i++)
+			printf ("  %08x: %08x %08x %08x %08x\n", in[i], r1[i], r2[i], r3[i], r4[i]);
+	}
+}
+
+/* Planar to chunky: p2ctab as in PlanarToChunky () */
+static uae_u32 p2ctab[256][2];
+
+static void ref_p2c_init (void)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		p2ctab[i][0] = (((i & 128) ? 0x01000000 : 0)
+			| ((i & 64) ? 0x010000 : 0)
+			| ((i & 32) ? 0x0100 : 0)
+			| ((i & 16) ? 0x01 : 0));
+		p2ctab[i][1] = (((i & 8) ? 0x01000000 : 0)
+			| ((i & 4) ? 0x010000 : 0)
+			| ((i & 2) ? 0x0100 : 0)
+			| ((i & 1) ? 0x01 : 0));
+	}
+}
+
+/* planes[k] holds 8 pixels of plane k, returns pixels 0-7 in bytes 7-0 */
+static uae_u64 ref_p2c_tab (const uae_u8 *planes)
+{
+	uae_u32 a = 0, b = 0;
+	int k;
+
+	for (k = 0; k < 8; k++) {
+		a |= p2ctab[planes[k]][0] << k;
+		b |= p2ctab[planes[k]][1] << k;
+	}
+	return ((uae_u64)a << 32) | b;
+}
+
+/* the same, one pixel at a time as in PlanarToDirect () */
+static uae_u64 ref_p2c_bits (const uae_u8 *planes)
+{
+	uae_u64 r = 0;
+	int x, k;
+
+	for (x = 0; x < 8; x++) {
+		int v = 0;
+		for (k = 0; k < 8; k++)
+			v |= ((planes[k] >> (7 - x)) & 1) << k;
+		r |= (uae_u64)v << (8 * (7 - x));
+	}
+	return r;
+}
+
+static uae_u64 blocks[4096];
+
+static void check_p2c (const uae_u8 *planes, int n, const char *what)
+{
+	int i, k;
+
+	for (i = 0; i < n; i++) {
+		blocks[i] = 0;
+		for (k = 0; k < 8; k++)
+			blocks[i] |= (uae_u64)planes[i * 8 + k] << (8 * k);
+	}
+	c2p_transpose8_n (blocks, n);
+	for (i = 0; i < n; i++) {
+		uae_u64 r1 = ref_p2c_tab (planes + i * 8);
+		uae_u64 r2 = ref_p2c_bits (planes + i * 8);
+		if (r1 == r2 && r1 == blocks[i])
+			continue;
+		if (errors++ < 10)
+			printf ("p2c %s block %d mismatch: %016llx %016llx %016llx\n", what, i,
+				(unsigned long long)r1, (unsigned long long)r2, (unsigned long long)blocks[i]);
+	}
+}
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uae_u32 rnd (void)
+{
+	static uae_u32 s = 0x12345678;
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+	return s;
+}
+
+#define BENCH_AKIKO 2000000
+#define BENCH_P2C 20000
+
+static void bench (void)
+{
+	static uae_u32 in[256][8];
+	static uae_u8 planes[sizeof blocks];
+	uae_u32 out[8], sum = 0;
+	uae_u64 sum64 = 0;
+	double t;
+	int i, j, k;
+
+	for (i = 0; i < 256; i++)
+		for (j = 0; j < 8; j++)
+			in[i][j] = rnd ();
+	for (i = 0; i < (int)sizeof planes; i++)
+		planes[i] = (uae_u8)rnd ();
+
+	t = now ();
+	for (i = 0; i < BENCH_AKIKO; i++) {
+		ref_akiko_loop (in[i & 255], out);
+		sum += out[i & 7];
+	}
+	printf ("akiko bit loop:  %6.1f ns per conversion\n", (now () - t) * 1e9 / BENCH_AKIKO);
+	t = now ();
+	for (i = 0; i < BENCH_AKIKO; i++) {
+		ref_akiko_mequa (in[i & 255], out);
+		sum += out[i & 7];
+	}
+	printf ("akiko tables:    %6.1f ns per conversion\n", (now () - t) * 1e9 / BENCH_AKIKO);
+	t = now ();
+	for (i = 0; i < BENCH_AKIKO; i++) {
+		c2p_akiko (in[i & 255], out);
+		sum += out[i & 7];
+	}
+	printf ("akiko c2p_akiko: %6.1f ns per conversion\n", (now () - t) * 1e9 / BENCH_AKIKO);
+
+	t = now ();
+	for (j = 0; j < BENCH_P2C; j++) {
+		for (i = 0; i < 4096; i++)
+			sum64 += ref_p2c_tab (planes + i * 8);
+	}
+	printf ("p2c p2ctab:      %6.2f ns per 8 pixels\n", (now () - t) * 1e9 / BENCH_P2C / 4096);
+	t = now ();
+	for (j = 0; j < BENCH_P2C; j++) {
+		for (i = 0; i < 4096; i++) {
+			uae_u64 x = 0;
+			for (k = 0; k < 8; k++)
+				x |= (uae_u64)planes[i * 8 + k] << (8 * k);
+			blocks[i] = x;
+		}
+		c2p_transpose8_n (blocks, 4096);
+		sum64 += blocks[j & 4095];
+	}
+	printf ("p2c transpose:   %6.2f ns per 8 pixels\n", (now () - t) * 1e9 / BENCH_P2C / 4096);
+	printf ("(%08x %016llx)\n", sum, (unsigned long long)sum64);
+}
+
+int main (int argc, char **argv)
+{
+	uae_u32 in[8];
+	uae_u8 planes[4096 * 8];
+	int i, j;
+
+	ref_akiko_precalculate ();
+	ref_p2c_init ();
+
+	for (i = 0; i < 256; i++) {
+		memset (in, 0, sizeof in);
+		in[i >> 5] = 1u << (i & 31);
+		check_akiko (in, "unit");
+	}
+	memset (in, 0, sizeof in);
+	check_akiko (in, "zero");
+	for (i = 0; i < 1000000; i++) {
+		for (j = 0; j < 8; j++)
+			in[j] = rnd ();
+		check_akiko (in, "random");
+	}
+
+	/* 64 unit blocks, odd count to cover the scalar tail */
+	memset (planes, 0, sizeof planes);
+	for (i = 0; i < 64; i++)
+		planes[i * 8 + (i >> 3)] = 1 << (i & 7);
+	check_p2c (planes, 65, "unit");
+	for (i = 0; i < 100; i++) {
+		for (j = 0; j < (int)sizeof planes; j++)
+			planes[j] = (uae_u8)rnd ();
+		check_p2c (planes, 4096 - (i & 3), "random");
+	}
+
+	if (errors) {
+		printf ("%d errors\n", errors);
+		return 1;
+	}
+	printf ("all conversions match\n");
+	if (argc > 1)
+		bench ();
+	return 0;
+}
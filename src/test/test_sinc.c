@@ -0,0 +1,204 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Checks that the sinc BLEP mixer (sincmix.h) produces exactly the
+  * same output as the original array-of-structs queue walk.
+  *
+  * Without arguments a pseudo random AUDx register stream is generated.
+  * A recorded stream can be replayed instead, one write per line:
+  *   <colour clock> <register offset, hex> <value, hex>
+  * Only AUDxVOL (0xa8 + n * 0x10) and AUDxDAT (0xaa + n * 0x10) are
+  * used, the high byte of AUDxDAT becomes the channel's current sample.
+  *
+  *  gcc -O2 -D_GNU_SOURCE -Isrc/include -Isrc src/test/test_sinc.c -o test_sinc
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SINC_QUEUE_MAX_AGE 2048
+#define SINC_QUEUE_LENGTH 256
+
+#include "../sinctable.c"
+#include "sincmix.h"
+
+/* Mix every 80 colour clocks, roughly 44.1kHz on PAL */
+#define MIX_PERIOD 80
+
+struct chan {
+	int sample, vol;
+	int output_state;
+	/* reference: old layout */
+	struct { int time, output; } ref_queue[SINC_QUEUE_LENGTH];
+	int ref_head;
+	/* new layout */
+	int evtime[SINC_QUEUE_LENGTH * 2];
+	int output[SINC_QUEUE_LENGTH * 2];
+	int head, count;
+	int time;
+};
+
+static struct chan chans[4];
+static long samples, mismatches;
+
+static void prehandler (int evtime)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		struct chan *c = &chans[i];
+		int output = c->sample * c->vol;
+		if (c->output_state != output) {
+			int d = output - c->output_state;
+			c->ref_head = (c->ref_head - 1) & (SINC_QUEUE_LENGTH - 1);
+			c->ref_queue[c->ref_head].time = c->time;
+			c->ref_queue[c->ref_head].output = d;
+			c->head = (c->head - 1) & (SINC_QUEUE_LENGTH - 1);
+			c->evtime[c->head] = c->evtime[c->head + SINC_QUEUE_LENGTH] = c->time;
+			c->output[c->head] = c->output[c->head + SINC_QUEUE_LENGTH] = d;
+			if (c->count < SINC_QUEUE_LENGTH)
+				c->count++;
+			c->output_state = output;
+		}
+		c->time += evtime;
+	}
+}
+
+static int clampv (int sum)
+{
+	int v = sum >> 15;
+	if (v > 32767)
+		v = 32767;
+	else if (v < -32768)
+		v = -32768;
+	return v;
+}
+
+static void mix (int table)
+{
+	const int *winsinc = winsinc_integral[table];
+	int i, j;
+
+	for (i = 0; i < 4; i++) {
+		struct chan *c = &chans[i];
+		int sum = c->output_state << 17;
+		int pos = c->ref_head;
+		int sum2, v1, v2;
+
+		for (j = 0; j < SINC_QUEUE_LENGTH; j++) {
+			int age = c->time - c->ref_queue[pos].time;
+			if (age >= SINC_QUEUE_MAX_AGE || age < 0)
+				break;
+			sum -= winsinc[age] * c->ref_queue[pos].output;
+			pos = (pos + 1) & (SINC_QUEUE_LENGTH - 1);
+		}
+		v1 = clampv (sum);
+
+		while (c->count > 0) {
+			int age = c->time - c->evtime[c->head + c->count - 1];
+			if (age < SINC_QUEUE_MAX_AGE && age >= 0)
+				break;
+			c->count--;
+		}
+		sum2 = c->output_state << 17;
+		sum2 = (int)((uae_u32)sum2 - sinc_mix (winsinc, c->evtime + c->head, c->output + c->head, c->count, c->time));
+		v2 = clampv (sum2);
+
+		samples++;
+		if (v1 != v2) {
+			if (mismatches < 10)
+				printf ("mismatch: sample %ld channel %d: %d != %d\n", samples, i, v1, v2);
+			mismatches++;
+		}
+	}
+}
+
+static int now, nextmix;
+
+static void advance (int to, int table)
+{
+	while (now < to) {
+		int step = to - now;
+		if (nextmix - now < step)
+			step = nextmix - now;
+		if (step > 0)
+			prehandler (step);
+		now += step;
+		if (now == nextmix) {
+			mix (table);
+			nextmix += MIX_PERIOD;
+		}
+	}
+}
+
+static void write_reg (int reg, int value)
+{
+	int ch = (reg - 0xa0) >> 4;
+
+	if (reg < 0xa0 || reg >= 0xe0)
+		return;
+	switch (reg & 15) {
+	case 8:
+		chans[ch].vol = value & 64 ? 64 : value & 63;
+		break;
+	case 10:
+		chans[ch].sample = (uae_s8)(value >> 8);
+		break;
+	}
+}
+
+static void run_file (FILE *f, int table)
+{
+	unsigned int t, reg, value;
+
+	while (fscanf (f, "%u %x %x", &t, &reg, &value) == 3) {
+		advance (t, table);
+		write_reg (reg, value);
+	}
+}
+
+static void run_random (int table)
+{
+	uae_u32 seed = 12345 + table;
+	int t = now, n;
+
+	for (n = 0; n < 200000; n++) {
+		int ch;
+		seed = seed * 1103515245 + 12345;
+		ch = (seed >> 8) & 3;
+		/* mix of very short (period 1) and long periods */
+		t += (seed >> 16) & 8 ? 1 + ((seed >> 20) & 3) : 1 + ((seed >> 20) % 600);
+		advance (t, table);
+		if (((seed >> 12) & 31) == 0)
+			write_reg (0xa8 + ch * 16, (seed >> 24) & 127);
+		else
+			write_reg (0xaa + ch * 16, seed >> 13);
+	}
+}
+
+int main (int argc, char **argv)
+{
+	int table;
+
+	for (table = 0; table < 5; table++) {
+		memset (chans, 0, sizeof chans);
+		now = 0;
+		nextmix = MIX_PERIOD;
+		if (argc > 1) {
+			FILE *f = fopen (argv[1], "r");
+			if (!f) {
+				perror (argv[1]);
+				return 1;
+			}
+			run_file (f, table);
+			fclose (f);
+		} else {
+			run_random (table);
+		}
+	}
+	printf ("%ld samples compared, %ld mismatches\n", samples, mismatches);
+	return mismatches ? 1 : 0;
+}
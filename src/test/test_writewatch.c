@@ -0,0 +1,136 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Checks the page states of writewatch.c the JIT relies on to leave
+  * blocks active over a cache flush: regions added dirty, arming single
+  * pages, overlapping regions and removing one of them. Then a region
+  * that does not start or end on a page boundary, which must leave its
+  * neighbours writable for the kernel, and I/O through a bounce buffer.
+  *
+  *  gcc -O2 -D_GNU_SOURCE -Isrc/include -Isrc src/test/test_writewatch.c \
+  *      src/writewatch.c -o test_writewatch
+  *  ./test_writewatch
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "writewatch.h"
+
+static int errors;
+
+void write_log (const TCHAR *format, ...)
+{
+	va_list ap;
+
+	va_start (ap, format);
+	vprintf (format, ap);
+	va_end (ap);
+}
+
+static void check (bool ok, const char *what)
+{
+	if (ok)
+		return;
+	errors++;
+	printf ("FAILED: %s\n", what);
+}
+
+int main (int argc, char **argv)
+{
+	uae_u32 ps = writewatch_pagesize ();
+	int npages = 8;
+	uae_u8 *mem = (uae_u8*)mmap (NULL, npages * ps, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	uae_u32 pages[8];
+	int a, b, i, fd[2];
+	uae_u8 *buf;
+
+	if (mem == MAP_FAILED) {
+		printf ("mmap failed\n");
+		return 1;
+	}
+
+	a = writewatch_add_dirty (mem, npages * ps);
+	check (a >= 0, "add_dirty");
+	for (i = 0; i < npages; i++)
+		check (writewatch_isdirty (a, i * ps), "pages start out dirty");
+	mem[0] = 1;
+	check (writewatch_isdirty (a, 0), "unarmed page write");
+
+	writewatch_arm (a, ps + 10, 2 * ps);
+	check (writewatch_isdirty (a, 0), "page before the armed range");
+	check (!writewatch_isdirty (a, ps), "first armed page");
+	check (!writewatch_isdirty (a, 2 * ps + ps - 1), "last byte of the armed range");
+	check (!writewatch_isdirty (a, 3 * ps), "page holding the end of the range");
+	check (writewatch_isdirty (a, 4 * ps), "page after the armed range");
+
+	mem[2 * ps + 5] = 2;
+	check (mem[2 * ps + 5] == 2, "write to an armed page goes through");
+	check (writewatch_isdirty (a, 2 * ps), "written armed page");
+	check (!writewatch_isdirty (a, ps), "neighbour of the written page");
+
+	/* a second region over pages 1-3, both see the write */
+	b = writewatch_add (mem + ps, 3 * ps);
+	check (b >= 0, "add overlapping");
+	check (writewatch_get (b, pages, 8, false) == 0, "overlapping region starts clean");
+	mem[ps] = 3;
+	check (writewatch_isdirty (a, ps), "write seen by the first region");
+	check (writewatch_get (b, pages, 8, false) == 1 && pages[0] == 0, "write seen by the second region");
+
+	/* removing it unprotects page 3, the first region must not miss writes there */
+	check (!writewatch_isdirty (a, 3 * ps), "page 3 clean before remove");
+	writewatch_remove (b);
+	check (writewatch_isdirty (a, 3 * ps), "page 3 dirty after removing the overlap");
+
+	writewatch_arm (a, 0, npages * ps);
+	for (i = 0; i < npages; i++)
+		check (!writewatch_isdirty (a, i * ps), "everything armed");
+	check (writewatch_fault (mem + 5 * ps + 1), "fault inside a region");
+	check (writewatch_isdirty (a, 5 * ps), "page marked by writewatch_fault");
+	mem[5 * ps + 1] = 4;
+	check (!writewatch_fault (mem + npages * ps), "fault outside of all regions");
+
+	writewatch_touch (mem + 6 * ps, 1);
+	check (writewatch_isdirty (a, 6 * ps), "touched page");
+	writewatch_remove (a);
+	mem[7 * ps] = 5;
+
+	/* pages 0 and 3 are only partly inside */
+	a = writewatch_add (mem + 100, 3 * ps);
+	check (a >= 0, "add unaligned");
+	check (writewatch_get (a, pages, 8, true) == 2 && pages[0] == 0 && pages[1] == 3 * ps - 100,
+		"partial pages reported");
+	check (writewatch_get (a, pages, 8, false) == 2, "partial pages stay dirty after reset");
+	check (!writewatch_isdirty (a, 2 * ps - 100), "inner page armed");
+	check (pipe (fd) == 0 && write (fd[1], "abcd", 4) == 4, "pipe");
+	check (read (fd[0], mem + 10, 2) == 2 && mem[10] == 'a', "kernel write in front of the region");
+	check (read (fd[0], mem + 3 * ps + 200, 2) == 2 && mem[3 * ps + 201] == 'd', "kernel write behind the region");
+
+	buf = writewatch_io_begin (mem + ps, 16);
+	check (buf != mem + ps, "bounce buffer for watched memory");
+	check (write (fd[1], "efgh", 4) == 4 && read (fd[0], buf, 4) == 4, "read into the bounce buffer");
+	writewatch_io_end (mem + ps, buf, 4);
+	check (mem[ps] == 'e' && mem[ps + 3] == 'h', "bounce buffer copied");
+	check (writewatch_isdirty (a, ps - 100), "bounced page dirty");
+	check (!writewatch_isdirty (a, 2 * ps - 100), "other inner page still clean");
+	buf = writewatch_io_begin (mem + 4 * ps, 16);
+	check (buf == mem + 4 * ps, "no bounce buffer outside of regions");
+	writewatch_io_end (mem + 4 * ps, buf, 0);
+	writewatch_reset (a);
+	check (writewatch_get (a, pages, 8, false) == 2, "reset keeps partial pages dirty");
+	writewatch_remove (a);
+	close (fd[0]);
+	close (fd[1]);
+
+	if (errors) {
+		printf ("%d errors\n", errors);
+		return 1;
+	}
+	printf ("all checks passed\n");
+	return 0;
+}
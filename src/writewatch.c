@@ -0,0 +1,394 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Host page write tracking
+  *
+  * Watched memory is made read-only. The first write to a page faults,
+  * the SIGSEGV handler marks the page dirty and makes it writable again,
+  * so a region only pays one fault per page per reset. Faults outside of
+  * watched regions are passed on to the previously installed handler.
+  * Regions may overlap, a fault marks the page in all of them.
+  *
+  * Only host pages that lie completely inside a region are protected, the
+  * partial pages at either end are shared with other allocations and stay
+  * writable and dirty for good.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "writewatch.h"
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_SIGACTION)
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* page states, WW_ARMING counts as dirty until the page is protected */
+#define WW_CLEAN 0
+#define WW_DIRTY 1
+#define WW_ARMING 2
+
+struct wwregion {
+	volatile bool active;
+	uae_u8 *base;
+	uae_u32 size;
+	/* page aligned span covering base..base+size */
+	uae_u8 *start, *end;
+	/* pages completely inside base..base+size, the only ones protected */
+	uae_u8 *istart, *iend;
+	int pages;
+	uae_u8 *dirty;
+};
+
+static struct wwregion wwregions[MAX_WRITEWATCH];
+static uintptr_t wwpagesize;
+static struct sigaction ww_oldsegv, ww_oldbus;
+static bool ww_installed;
+
+static void ww_chain (int sig, siginfo_t *si, void *ctx)
+{
+	struct sigaction *old = sig == SIGBUS ? &ww_oldbus : &ww_oldsegv;
+
+	if (old->sa_flags & SA_SIGINFO) {
+		old->sa_sigaction (sig, si, ctx);
+	} else if (old->sa_handler == SIG_DFL || old->sa_handler == SIG_IGN) {
+		/* restore and return, the faulting access is retried */
+		sigaction (sig, old, NULL);
+	} else {
+		old->sa_handler (sig);
+	}
+}
+
+bool writewatch_fault (void *addr)
+{
+	uae_u8 *a = (uae_u8*)addr;
+	bool hit = false;
+	int i;
+
+	for (i = 0; i < MAX_WRITEWATCH; i++) {
+		struct wwregion *r = &wwregions[i];
+		if (r->active && a >= r->istart && a < r->iend) {
+			r->dirty[(a - r->start) / wwpagesize] = WW_DIRTY;
+			hit = true;
+		}
+	}
+	if (hit)
+		mprotect ((uae_u8*)((uintptr_t)a & ~(wwpagesize - 1)), wwpagesize, PROT_READ | PROT_WRITE);
+	return hit;
+}
+
+static void ww_handler (int sig, siginfo_t *si, void *ctx)
+{
+	if (!writewatch_fault (si->si_addr))
+		ww_chain (sig, si, ctx);
+}
+
+static bool ww_install (void)
+{
+	struct sigaction sa;
+
+	if (ww_installed)
+		return true;
+	wwpagesize = sysconf (_SC_PAGESIZE);
+	if ((long)wwpagesize <= 0)
+		return false;
+	memset (&sa, 0, sizeof sa);
+	sa.sa_sigaction = ww_handler;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset (&sa.sa_mask);
+	if (sigaction (SIGSEGV, &sa, &ww_oldsegv))
+		return false;
+	sigaction (SIGBUS, &sa, &ww_oldbus);
+	ww_installed = true;
+	return true;
+}
+
+uae_u32 writewatch_pagesize (void)
+{
+	if (!wwpagesize)
+		wwpagesize = sysconf (_SC_PAGESIZE);
+	return wwpagesize;
+}
+
+STATIC_INLINE bool ww_partial (struct wwregion *r, int page)
+{
+	uae_u8 *p = r->start + page * wwpagesize;
+	return p < r->istart || p >= r->iend;
+}
+
+/* Protect the page first and only then clear its dirty mark. A write
+ * from another thread that faults in between turns WW_ARMING into
+ * WW_DIRTY and the page stays dirty. */
+static void ww_arm_page (struct wwregion *r, int page)
+{
+	if (ww_partial (r, page))
+		return;
+	r->dirty[page] = WW_ARMING;
+	if (mprotect (r->start + page * wwpagesize, wwpagesize, PROT_READ))
+		r->dirty[page] = WW_DIRTY;
+	else
+		__sync_bool_compare_and_swap (&r->dirty[page], WW_ARMING, WW_CLEAN);
+}
+
+static int ww_add (uae_u8 *base, uae_u32 size, bool armed)
+{
+	struct wwregion *r = NULL;
+	int i, page;
+
+	if (!base || !size || !ww_install ())
+		return -1;
+	for (i = 0; i < MAX_WRITEWATCH; i++) {
+		if (!wwregions[i].active && !wwregions[i].base) {
+			r = &wwregions[i];
+			break;
+		}
+	}
+	if (!r) {
+		write_log (_T("writewatch: out of regions\n"));
+		return -1;
+	}
+	r->base = base;
+	r->size = size;
+	r->start = (uae_u8*)((uintptr_t)base & ~(wwpagesize - 1));
+	r->end = (uae_u8*)(((uintptr_t)base + size + wwpagesize - 1) & ~(wwpagesize - 1));
+	r->istart = (uae_u8*)(((uintptr_t)base + wwpagesize - 1) & ~(wwpagesize - 1));
+	r->iend = (uae_u8*)(((uintptr_t)base + size) & ~(wwpagesize - 1));
+	if (r->iend < r->istart)
+		r->iend = r->istart;
+	r->pages = (r->end - r->start) / wwpagesize;
+	r->dirty = xcalloc (uae_u8, r->pages);
+	if (!r->dirty || (armed && r->iend > r->istart && mprotect (r->istart, r->iend - r->istart, PROT_READ))) {
+		write_log (_T("writewatch: can't protect %p-%p\n"), r->istart, r->iend);
+		xfree (r->dirty);
+		r->dirty = NULL;
+		r->base = NULL;
+		return -1;
+	}
+	for (page = 0; page < r->pages; page++) {
+		if (!armed || ww_partial (r, page))
+			r->dirty[page] = WW_DIRTY;
+	}
+	r->active = true;
+	return i;
+}
+
+int writewatch_add (uae_u8 *base, uae_u32 size)
+{
+	return ww_add (base, size, true);
+}
+
+int writewatch_add_dirty (uae_u8 *base, uae_u32 size)
+{
+	return ww_add (base, size, false);
+}
+
+void writewatch_remove (int handle)
+{
+	struct wwregion *r;
+
+	if (handle < 0 || handle >= MAX_WRITEWATCH)
+		return;
+	r = &wwregions[handle];
+	if (!r->base)
+		return;
+	r->active = false;
+	/* overlapping regions lose their protection too */
+	if (r->iend > r->istart) {
+		writewatch_touch (r->istart, r->iend - r->istart);
+		mprotect (r->istart, r->iend - r->istart, PROT_READ | PROT_WRITE);
+	}
+	xfree (r->dirty);
+	r->dirty = NULL;
+	r->base = NULL;
+}
+
+int writewatch_get (int handle, uae_u32 *pages, int max, bool reset)
+{
+	struct wwregion *r;
+	uae_u32 skew;
+	int i, cnt = 0;
+
+	if (handle < 0 || handle >= MAX_WRITEWATCH)
+		return 0;
+	r = &wwregions[handle];
+	if (!r->active)
+		return 0;
+	skew = r->base - r->start;
+	for (i = 0; i < r->pages && cnt < max; i++) {
+		uae_u32 off;
+		if (!r->dirty[i])
+			continue;
+		off = i * wwpagesize;
+		pages[cnt++] = off < skew ? 0 : off - skew;
+		if (reset)
+			ww_arm_page (r, i);
+	}
+	return cnt;
+}
+
+void writewatch_touch (uae_u8 *addr, uae_u32 size)
+{
+	int i;
+
+	for (i = 0; i < MAX_WRITEWATCH; i++) {
+		struct wwregion *r = &wwregions[i];
+		uae_u8 *s, *e;
+		int page;
+		if (!r->active || addr >= r->iend || addr + size <= r->istart)
+			continue;
+		s = addr < r->istart ? r->istart : addr;
+		e = addr + size > r->iend ? r->iend : addr + size;
+		for (page = (s - r->start) / wwpagesize; r->start + page * wwpagesize < e; page++) {
+			if (r->dirty[page] == WW_DIRTY)
+				continue;
+			r->dirty[page] = WW_DIRTY;
+			mprotect (r->start + page * wwpagesize, wwpagesize, PROT_READ | PROT_WRITE);
+		}
+	}
+}
+
+static bool ww_watched (uae_u8 *addr, uae_u32 size)
+{
+	int i;
+
+	for (i = 0; i < MAX_WRITEWATCH; i++) {
+		struct wwregion *r = &wwregions[i];
+		if (r->active && addr < r->iend && addr + size > r->istart)
+			return true;
+	}
+	return false;
+}
+
+uae_u8 *writewatch_io_begin (uae_u8 *addr, uae_u32 size)
+{
+	uae_u8 *buf;
+
+	if (!size || !ww_watched (addr, size))
+		return addr;
+	buf = xmalloc (uae_u8, size);
+	if (!buf) {
+		/* can still fail if the pages get armed before the I/O is done */
+		writewatch_touch (addr, size);
+		return addr;
+	}
+	return buf;
+}
+
+void writewatch_io_end (uae_u8 *addr, uae_u8 *buf, uae_u32 len)
+{
+	int err = errno;
+
+	if (buf == addr)
+		return;
+	/* a plain copy faults and is tracked like any other write */
+	memcpy (addr, buf, len);
+	xfree (buf);
+	/* callers look at errno of the I/O afterwards */
+	errno = err;
+}
+
+void writewatch_reset (int handle)
+{
+	struct wwregion *r;
+	int page, first, last;
+
+	if (handle < 0 || handle >= MAX_WRITEWATCH)
+		return;
+	r = &wwregions[handle];
+	if (!r->active || r->iend == r->istart)
+		return;
+	first = (r->istart - r->start) / wwpagesize;
+	last = (r->iend - r->start) / wwpagesize;
+	for (page = first; page < last; page++)
+		r->dirty[page] = WW_ARMING;
+	if (mprotect (r->istart, r->iend - r->istart, PROT_READ)) {
+		for (page = first; page < last; page++)
+			r->dirty[page] = WW_DIRTY;
+		return;
+	}
+	for (page = first; page < last; page++)
+		__sync_bool_compare_and_swap (&r->dirty[page], WW_ARMING, WW_CLEAN);
+}
+
+bool writewatch_isdirty (int handle, uae_u32 offset)
+{
+	struct wwregion *r;
+
+	if (handle < 0 || handle >= MAX_WRITEWATCH)
+		return true;
+	r = &wwregions[handle];
+	if (!r->active || offset >= r->size)
+		return true;
+	return r->dirty[(r->base + offset - r->start) / wwpagesize] != 0;
+}
+
+void writewatch_arm (int handle, uae_u32 offset, uae_u32 size)
+{
+	struct wwregion *r;
+	int page, last;
+
+	if (handle < 0 || handle >= MAX_WRITEWATCH || !size)
+		return;
+	r = &wwregions[handle];
+	if (!r->active || offset >= r->size)
+		return;
+	if (size > r->size - offset)
+		size = r->size - offset;
+	page = (r->base + offset - r->start) / wwpagesize;
+	last = (r->base + offset + size - 1 - r->start) / wwpagesize;
+	for (; page <= last; page++) {
+		if (r->dirty[page])
+			ww_arm_page (r, page);
+	}
+}
+
+#else
+
+uae_u32 writewatch_pagesize (void)
+{
+	return 4096;
+}
+int writewatch_add (uae_u8 *base, uae_u32 size)
+{
+	return -1;
+}
+int writewatch_add_dirty (uae_u8 *base, uae_u32 size)
+{
+	return -1;
+}
+void writewatch_remove (int handle)
+{
+}
+int writewatch_get (int handle, uae_u32 *pages, int max, bool reset)
+{
+	return 0;
+}
+void writewatch_touch (uae_u8 *addr, uae_u32 size)
+{
+}
+uae_u8 *writewatch_io_begin (uae_u8 *addr, uae_u32 size)
+{
+	return addr;
+}
+void writewatch_io_end (uae_u8 *addr, uae_u8 *buf, uae_u32 len)
+{
+}
+void writewatch_reset (int handle)
+{
+}
+bool writewatch_isdirty (int handle, uae_u32 offset)
+{
+	return true;
+}
+void writewatch_arm (int handle, uae_u32 offset, uae_u32 size)
+{
+}
+bool writewatch_fault (void *addr)
+{
+	return false;
+}
+
+#endif